@@ -0,0 +1,71 @@
+#include "bbzbcode.h"
+#include "bbzvm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Maps a bytecode file in memory with the given protection.
+ * @details The mapping is private: writes to it are not carried to the file.
+ * @param[out] f The mapped file.
+ * @param[in] fname The name of the bytecode file.
+ * @param[in] prot The protection of the mapping (see mmap()).
+ * @return 1 on success, 0 on failure.
+ */
+static uint8_t bbzbcode_map_prot(bbzbcode_file_t* f, const char* fname, int prot) {
+    f->data = NULL;
+    f->size = 0;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > UINT16_MAX) {
+        close(fd);
+        return 0;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, prot, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid once the file is closed.
+    close(fd);
+    if (data == MAP_FAILED) return 0;
+    f->data = (const uint8_t*)data;
+    f->size = (uint16_t)st.st_size;
+    return 1;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzbcode_map(bbzbcode_file_t* f, const char* fname) {
+    return bbzbcode_map_prot(f, fname, PROT_READ);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzbcode_unmap(bbzbcode_file_t* f) {
+    if (f->data) munmap((void*)f->data, f->size);
+    f->data = NULL;
+    f->size = 0;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzbcode_load(bbzbcode_file_t* f, const char* fname) {
+    if (!bbzbcode_map(f, fname)) return 0;
+    bbzvm_set_bcode_ptr(f->data, f->size);
+    return 1;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzbcode_load_rw(bbzbcode_file_t* f, const char* fname) {
+    if (!bbzbcode_map_prot(f, fname, PROT_READ | PROT_WRITE)) return 0;
+    bbzvm_set_bcode_rw((uint8_t*)f->data, f->size);
+    return 1;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file bbzbcode.h
+ * @brief Loading of bytecode files on hosts, by mapping them in memory.
+ * @details Only available on POSIX systems (i.e., not when
+ * crosscompiling for a robot).
+ */
+
+#ifndef BBZBCODE_H
+#define BBZBCODE_H
+
+#include "bbzinclude.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * @brief A bytecode file mapped in memory.
+ */
+typedef struct bbzbcode_file_t {
+    const uint8_t* data; /**< @brief The bytecode (NULL if not mapped) */
+    uint16_t size;       /**< @brief Size of the bytecode */
+} bbzbcode_file_t;
+
+/**
+ * @brief Maps a bytecode file in memory.
+ * @param[out] f The mapped file.
+ * @param[in] fname The name of the bytecode file.
+ * @return 1 on success, 0 if the file could not be opened or mapped or
+ * if it is too large.
+ */
+uint8_t bbzbcode_map(bbzbcode_file_t* f, const char* fname);
+
+/**
+ * @brief Unmaps a bytecode file.
+ * @param[in,out] f The mapped file.
+ */
+void bbzbcode_unmap(bbzbcode_file_t* f);
+
+/**
+ * @brief Maps a bytecode file in memory and sets it as the VM's bytecode.
+ * @details The file should be unmapped with bbzbcode_unmap() once the VM
+ * is done with it.
+ * @param[out] f The mapped file.
+ * @param[in] fname The name of the bytecode file.
+ * @return 1 on success, 0 if the file could not be mapped.
+ * @see bbzvm_set_bcode_ptr
+ */
+uint8_t bbzbcode_load(bbzbcode_file_t* f, const char* fname);
+
+/**
+ * @brief Maps a bytecode file in memory as a private, writable copy, and
+ * sets it as the VM's bytecode so that it gets quickened.
+ * @details Pages of the file are only copied once the VM writes to them.
+ * The file itself is never modified. The file should be unmapped with
+ * bbzbcode_unmap() once the VM is done with it.
+ * @param[out] f The mapped file.
+ * @param[in] fname The name of the bytecode file.
+ * @return 1 on success, 0 if the file could not be mapped.
+ * @see bbzvm_set_bcode_rw
+ */
+uint8_t bbzbcode_load_rw(bbzbcode_file_t* f, const char* fname);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // !BBZBCODE_H
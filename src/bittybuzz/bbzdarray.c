@@ -353,7 +353,13 @@ uint16_t bbzdarray_find(bbzheap_idx_t d,
 /****************************************/
 /****************************************/
 
-uint8_t bbzdarray_lambda_alloc(bbzheap_idx_t d, uint8_t* l) {
+/**
+ * @brief Allocates an empty activation record in the part of the heap
+ * reserved for them.
+ * @param[out] l A buffer for the index of the activation record.
+ * @return 1 for success, 0 for failure (out of memory)
+ */
+static uint8_t bbzdarray_lambda_new(uint8_t* l) {
     /* Look for empty slot */
     for(uint8_t i = 0;
         i < BBZHEAP_RSV_ACTREC_MAX;
@@ -370,16 +376,35 @@ uint8_t bbzdarray_lambda_alloc(bbzheap_idx_t d, uint8_t* l) {
             /* Set result */
             *l = i;
             /* Allocate an array segment */
-            if(!bbzheap_aseg_alloc(&(x->t.value))) return 0;
-            uint16_t idx = bbzdarray_size(d);
-            uint16_t v;
-            for (uint16_t j = 0; j < idx; ++j) {
-                bbzdarray_get(d, j, &v);
-                if (!bbzdarray_push(*l, v)) return 0;
-            }
-            /* Success */
-            return 1;
+            return bbzheap_aseg_alloc(&(x->t.value));
         }
     /* No empty slot found, we're out of reserved memory! */
     return 0;
-}
\ No newline at end of file
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzdarray_lambda_alloc(bbzheap_idx_t d, uint8_t* l) {
+    if (!bbzdarray_lambda_new(l)) return 0;
+    uint16_t idx = bbzdarray_size(d);
+    uint16_t v;
+    for (uint16_t j = 0; j < idx; ++j) {
+        bbzdarray_get(d, j, &v);
+        if (!bbzdarray_push(*l, v)) return 0;
+    }
+    /* Success */
+    return 1;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzdarray_lambda_alloc_from(const bbzheap_idx_t* v, uint16_t n, uint8_t* l) {
+    if (!bbzdarray_lambda_new(l)) return 0;
+    for (uint16_t j = 0; j < n; ++j) {
+        if (!bbzdarray_push(*l, v[j])) return 0;
+    }
+    /* Success */
+    return 1;
+}
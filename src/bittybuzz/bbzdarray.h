@@ -162,6 +162,17 @@ extern "C" {
      */
     uint8_t bbzdarray_lambda_alloc(bbzheap_idx_t d, uint8_t* l);
 
+    /**
+     * @brief Allocates space for a lambda closure on the heap, copying
+     * its data from a buffer.
+     * @param[in] v Data to copy.
+     * @param[in] n Number of elements in v.
+     * @param[out] l A buffer for the index of the allocated closure.
+     * @return 1 for success, 0 for failure (out of memory)
+     * @see bbzdarray_lambda_alloc
+     */
+    uint8_t bbzdarray_lambda_alloc_from(const bbzheap_idx_t* v, uint16_t n, uint8_t* l);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,6 +15,7 @@ typedef enum bbzvm_state {
     BBZVM_STATE_STOPPED,    /**< @brief Stopped (Paused) @details May be used for debugging purpose. */
     BBZVM_STATE_DONE,       /**< @brief Program finished */
     BBZVM_STATE_ERROR,      /**< @brief Error occurred */
+    BBZVM_STATE_YIELDED,    /**< @brief Out of instruction budget, execution may be resumed @see bbzvm_run_budget */
     BBZVM_STATE_COUNT,      /**< @brief The number of states in the enum. */
 } bbzvm_state;
 
@@ -100,7 +101,73 @@ typedef enum bbzvm_instr {
     BBZVM_INSTR_JUMP,    /**< @brief Set PC to argument */ // =44
     BBZVM_INSTR_JUMPZ,   /**< @brief Set PC to argument if stack top is zero, pop operand */ // =45
     BBZVM_INSTR_JUMPNZ,  /**< @brief Set PC to argument if stack top is not zero, pop operand */ // =46
-    BBZVM_INSTR_COUNT    /**< @brief Used to count how many instructions have been defined */ // =47
+    /*
+     * Superinstructions, produced by bo2bbo from common instruction sequences
+     */
+    BBZVM_INSTR_GLOADS,  /**< @brief Push global variable whose name is the string argument (PUSHS; GLOAD) */ // =47
+    BBZVM_INSTR_TGETS,   /**< @brief Replace table at stack top by its value for the string argument (PUSHS; TGET) */ // =48
+    BBZVM_INSTR_LLOAD2,  /**< @brief Push local variables at positions (argument & 0xFF) and (argument >> 8) (LLOAD; LLOAD) */ // =49
+    BBZVM_INSTR_INCL,    /**< @brief Increment local variable at given position (LLOAD; PUSHI 1; ADD; LSTORE) */ // =50
+    BBZVM_INSTR_CMPJEQ,  /**< @brief Set PC to argument unless stack(#1) == stack(#0), pop operands (EQ; JUMPZ) */ // =51
+    BBZVM_INSTR_CMPJNEQ, /**< @brief Set PC to argument unless stack(#1) != stack(#0), pop operands (NEQ; JUMPZ) */ // =52
+    BBZVM_INSTR_CMPJGT,  /**< @brief Set PC to argument unless stack(#1) > stack(#0), pop operands (GT; JUMPZ) */ // =53
+    BBZVM_INSTR_CMPJGTE, /**< @brief Set PC to argument unless stack(#1) >= stack(#0), pop operands (GTE; JUMPZ) */ // =54
+    BBZVM_INSTR_CMPJLT,  /**< @brief Set PC to argument unless stack(#1) < stack(#0), pop operands (LT; JUMPZ) */ // =55
+    BBZVM_INSTR_CMPJLTE, /**< @brief Set PC to argument unless stack(#1) <= stack(#0), pop operands (LTE; JUMPZ) */ // =56
+    /*
+     * Quickened instructions, rewritten at runtime by the VM in writable
+     * bytecode (see bbzvm_set_bcode_rw()). Each one checks the type of its
+     * operands, and is rewritten back to its generic instruction if they are
+     * not the expected ones.
+     */
+    BBZVM_INSTR_ADDII,   /**< @brief ADD on two integers */ // =57
+    BBZVM_INSTR_SUBII,   /**< @brief SUB on two integers */ // =58
+    BBZVM_INSTR_MULII,   /**< @brief MUL on two integers */ // =59
+    BBZVM_INSTR_ADDFF,   /**< @brief ADD on two floats */ // =60
+    BBZVM_INSTR_SUBFF,   /**< @brief SUB on two floats */ // =61
+    BBZVM_INSTR_MULFF,   /**< @brief MUL on two floats */ // =62
+    BBZVM_INSTR_DIVFF,   /**< @brief DIV on two floats */ // =63
+    BBZVM_INSTR_EQII,    /**< @brief EQ on two integers */ // =64
+    BBZVM_INSTR_NEQII,   /**< @brief NEQ on two integers */ // =65
+    BBZVM_INSTR_GTII,    /**< @brief GT on two integers */ // =66
+    BBZVM_INSTR_GTEII,   /**< @brief GTE on two integers */ // =67
+    BBZVM_INSTR_LTII,    /**< @brief LT on two integers */ // =68
+    BBZVM_INSTR_LTEII,   /**< @brief LTE on two integers */ // =69
+    BBZVM_INSTR_CMPJEQII, /**< @brief CMPJEQ on two integers */ // =70
+    BBZVM_INSTR_CMPJNEQII,/**< @brief CMPJNEQ on two integers */ // =71
+    BBZVM_INSTR_CMPJGTII, /**< @brief CMPJGT on two integers */ // =72
+    BBZVM_INSTR_CMPJGTEII,/**< @brief CMPJGTE on two integers */ // =73
+    BBZVM_INSTR_CMPJLTII, /**< @brief CMPJLT on two integers */ // =74
+    BBZVM_INSTR_CMPJLTEII,/**< @brief CMPJLTE on two integers */ // =75
+    /*
+     * Tail call, produced by bo2bbo from CALLC followed by RET1. The RET1 is
+     * kept, and only executed when the call cannot reuse the caller's frame.
+     */
+    BBZVM_INSTR_TCALLC,  /**< @brief Calls the closure on top of the stack in place of the current closure */ // =76
+    /*
+     * Short forms, chosen by bo2bbo when the argument fits in a single
+     * byte. Jump offsets are relative to the next instruction.
+     */
+    BBZVM_INSTR_PUSHI8,  /**< @brief PUSHI with a signed 8-bit argument */ // =77
+    BBZVM_INSTR_PUSHS8,  /**< @brief PUSHS with an 8-bit argument */ // =78
+    BBZVM_INSTR_LLOAD8,  /**< @brief LLOAD with an 8-bit argument */ // =79
+    BBZVM_INSTR_LSTORE8, /**< @brief LSTORE with an 8-bit argument */ // =80
+    BBZVM_INSTR_JUMP8,   /**< @brief Add signed 8-bit argument to PC */ // =81
+    BBZVM_INSTR_JUMPZ8,  /**< @brief Add signed 8-bit argument to PC if stack top is zero, pop operand */ // =82
+    BBZVM_INSTR_JUMPNZ8, /**< @brief Add signed 8-bit argument to PC if stack top is not zero, pop operand */ // =83
+    /*
+     * Register instructions, produced by bo2bbo with BBZ_REGISTER_BCODE.
+     * Their operands are single bytes; registers are the local symbols of
+     * the current frame, and r0 is self.
+     */
+    BBZVM_INSTR_RMOV,    /**< @brief rd = ra; operands rd, ra */ // =84
+    BBZVM_INSTR_RSETI,   /**< @brief rd = k; operands rd, signed k */ // =85
+    BBZVM_INSTR_RADD,    /**< @brief rd = ra + rb; operands rd, ra, rb */ // =86
+    BBZVM_INSTR_RSUB,    /**< @brief rd = ra - rb; operands rd, ra, rb */ // =87
+    BBZVM_INSTR_RMUL,    /**< @brief rd = ra * rb; operands rd, ra, rb */ // =88
+    BBZVM_INSTR_RADDI,   /**< @brief rd = ra + k; operands rd, ra, signed k */ // =89
+    BBZVM_INSTR_RGETF,   /**< @brief rd = ra.k; operands rd, ra, string ID k */ // =90
+    BBZVM_INSTR_COUNT    /**< @brief Used to count how many instructions have been defined */ // =91
 } bbzvm_instr;
 
 /**
@@ -16,28 +16,128 @@ void bbzheap_clear() {
     for(int16_t i = (BBZHEAP_RSV_ACTREC_MAX-1)* sizeof(bbzobj_t); i >= 0; --i) {
         vm->heap.data[i] = 0;
     }
+    vm->heap.immpos = 0;
+    vm->heap.gcdepth = 1; // The value of 1 is necessary
+#if BBZHEAP_GC_ALLOC_THRESHOLD > 0
+    vm->heap.nalloc = 0;
+#endif // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+#ifdef BBZ_HEAP_GC_RETRY
+    vm->heap.pinpos = 0;
+    for(uint8_t i = 0; i < BBZHEAP_GC_PINS; ++i) {
+        vm->heap.pins[i] = 0;
+    }
+    vm->heap.nupins = 0;
+#endif // BBZ_HEAP_GC_RETRY
+#if BBZHEAP_STR_INTERN_SIZE > 0
+    for(uint16_t i = 0; i < BBZHEAP_STR_INTERN_SIZE; ++i) {
+        vm->heap.strs[i] = 0;
+    }
+#endif // BBZHEAP_STR_INTERN_SIZE > 0
 }
 
 /****************************************/
 /****************************************/
 
-static uint8_t bbzheap_obj_alloc_prepare_obj(uint8_t t, bbzobj_t* x) {
+#ifdef BBZ_HEAP_GC_RETRY
+/**
+ * @brief Collects garbage in the middle of an instruction, when an
+ * allocation could not be satisfied.
+ * @details Operands already popped by the current instruction are still
+ * in the stack slots above the stack pointer, so the whole stack buffer
+ * is used as the root set. Recently allocated objects are pinned as well.
+ */
+static void bbzheap_gc_retry() {
+    bbzheap_gc(vm->stack, BBZSTACK_SIZE);
+}
+
+/**
+ * @brief Pins an object returned by an allocation, in place of the least
+ * recently pinned one.
+ * @param[in] o The object.
+ */
+#define bbzheap_pin_recent(o) vm->heap.pins[vm->heap.pinpos++ & (BBZHEAP_GC_PINS - 1)] = (o)
+#else // BBZ_HEAP_GC_RETRY
+#define bbzheap_pin_recent(o)
+#endif // BBZ_HEAP_GC_RETRY
+
+#if BBZHEAP_GC_ALLOC_THRESHOLD > 0
+/**
+ * @brief Counts a segment allocation.
+ */
+#define bbzheap_count_alloc() ++vm->heap.nalloc
+#else // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+#define bbzheap_count_alloc()
+#endif // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+
+/**
+ * @brief Counts an object allocation and pins the allocated object.
+ * @param[in] o The allocated object.
+ */
+static void bbzheap_count_obj_alloc(bbzheap_idx_t o) {
+    RM_UNUSED_WARN(o);
+    bbzheap_pin_recent(o);
+    bbzheap_count_alloc();
+}
+
+/****************************************/
+/****************************************/
+
+static void bbzheap_obj_alloc_prepare_obj(uint8_t t, bbzobj_t* x, bbzheap_idx_t seg) {
     /* Set valid bit and type */
     x->mdata = ((t << BBZTYPE_TYPEIDX) & BBZTYPE_MASK) | BBZHEAP_OBJ_MASK_VALID;
     /* Take care of special initialisations */
     if (t == BBZTYPE_TABLE) {
-        if (!bbzheap_tseg_alloc(&x->t.value)) return 0;
+        x->t.value = seg;
     }
     else if (t == BBZTYPE_CLOSURE) {
         bbzclosure_unmake_lambda(*x);
         (x)->l.value.actrec = BBZHEAP_CLOSURE_DFLT_ACTREC; // Default activation record
     }
-    /* Success */
-    return 1;
 }
 
-uint8_t bbzheap_obj_alloc(uint8_t t,
-                          bbzheap_idx_t* o) {
+#if BBZHEAP_STR_INTERN_SIZE > 0
+#if BBZHEAP_STR_INTERN_SIZE & (BBZHEAP_STR_INTERN_SIZE - 1)
+#error "BBZHEAP_STR_INTERN_SIZE must be a power of two."
+#endif
+
+/**
+ * @brief Returns the entry of the string intern table of a string ID.
+ * @details Builtin string IDs are consecutive and small, so they get an
+ * entry each; other IDs may share one.
+ * @param[in] strid The string ID.
+ */
+#define bbzheap_str_intern_at(strid) (vm->heap.strs + ((strid) & (BBZHEAP_STR_INTERN_SIZE - 1)))
+
+/**
+ * @brief Looks a string up in the string intern table.
+ * @details Entries are weak references: the garbage collector ignores
+ * them, so an entry whose string was collected, or whose slot now holds
+ * another object, is a miss.
+ * @param[in,out] o The string ID, then the index of the string if found.
+ * @return 1 if the string was found, 0 otherwise.
+ */
+static uint8_t bbzheap_str_intern_find(bbzheap_idx_t* o) {
+    bbzheap_idx_t s = *bbzheap_str_intern_at(*o);
+    if (s < (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t) &&
+        bbzheap_obj_isvalid(*bbzheap_obj_at(s)) &&
+        bbztype_isstring(*bbzheap_obj_at(s)) &&
+        bbzheap_obj_at(s)->s.value == *o) {
+        *o = s;
+        return 1;
+    }
+    return 0;
+}
+#endif // BBZHEAP_STR_INTERN_SIZE > 0
+
+/**
+ * @brief Looks for a slot for a new object.
+ * @param[in] t The type of the object.
+ * @param[in,out] o The string ID (for strings), then the index of the slot.
+ * @return 0 if the heap is full, 1 if a free slot was found, 2 if an
+ * existing string with the same ID was found.
+ */
+static uint8_t bbzheap_obj_alloc_find(uint8_t t,
+                                      bbzheap_idx_t* o) {
     /* Look for empty slot */
     for(uint16_t i = BBZHEAP_RSV_ACTREC_MAX;
         i < (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
@@ -46,14 +146,14 @@ uint8_t bbzheap_obj_alloc(uint8_t t,
             /* Empty slot found */
             /* Set result */
             *o = i;
-            return bbzheap_obj_alloc_prepare_obj(t, bbzheap_obj_at(i));
+            return 1;
         }
         else {
             if (t == BBZTYPE_STRING &&
                 bbztype_isstring(*bbzheap_obj_at(i)) &&
                 *o == bbzheap_obj_at(i)->s.value) {
                 *o = i;
-                return 1;
+                return 2;
             }
         }
     }
@@ -63,19 +163,114 @@ uint8_t bbzheap_obj_alloc(uint8_t t,
     /* Set result */
     *o = (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
     vm->heap.rtobj += sizeof(bbzobj_t);
-    return bbzheap_obj_alloc_prepare_obj(t, (bbzobj_t*)(vm->heap.rtobj - sizeof(bbzobj_t)));
+    return 1;
+}
+
+uint8_t bbzheap_obj_alloc(uint8_t t,
+                          bbzheap_idx_t* o) {
+#if BBZHEAP_STR_INTERN_SIZE > 0
+    /* An interned string allocates nothing, but is pinned all the same:
+     * the caller may hold the only reference to it */
+    if (t == BBZTYPE_STRING && bbzheap_str_intern_find(o)) {
+        bbzheap_pin_recent(*o);
+        return 1;
+    }
+#endif // BBZHEAP_STR_INTERN_SIZE > 0
+    /* A table needs its first segment; allocate it before the object so
+     * that a garbage collection never sees a table without one. */
+    bbzheap_idx_t seg = 0;
+    if (t == BBZTYPE_TABLE && !bbzheap_tseg_alloc(&seg)) return 0;
+    bbzheap_idx_t strid = *o;
+    uint8_t found = bbzheap_obj_alloc_find(t, o);
+#ifdef BBZ_HEAP_GC_RETRY
+    if (!found) {
+        bbzheap_gc_retry();
+        *o = strid;
+        found = bbzheap_obj_alloc_find(t, o);
+    }
+#else // BBZ_HEAP_GC_RETRY
+    RM_UNUSED_WARN(strid);
+#endif // BBZ_HEAP_GC_RETRY
+    if (!found) {
+        if (t == BBZTYPE_TABLE) bbzheap_tseg_makeinvalid(*bbzheap_tseg_at(seg));
+        return 0;
+    }
+#if BBZHEAP_STR_INTERN_SIZE > 0
+    if (t == BBZTYPE_STRING) {
+        *bbzheap_str_intern_at(strid) = *o;
+    }
+#endif // BBZHEAP_STR_INTERN_SIZE > 0
+    if (found == 1) {
+        bbzheap_obj_alloc_prepare_obj(t, bbzheap_obj_at(*o), seg);
+        bbzheap_count_obj_alloc(*o);
+    }
+    else {
+        /* An existing string */
+        bbzheap_pin_recent(*o);
+    }
+    return 1;
 }
 
 /****************************************/
 /****************************************/
 
+#ifdef BBZ_HEAP_GC_RETRY
+uint8_t bbzheap_pin(bbzheap_idx_t o) {
+    if (vm->heap.nupins >= BBZHEAP_GC_USER_PINS) return 0;
+    vm->heap.upins[vm->heap.nupins++] = o;
+    return 1;
+}
+
+/****************************************/
+/****************************************/
+
+void bbzheap_unpin() {
+    if (vm->heap.nupins > 0) --vm->heap.nupins;
+}
+#endif // BBZ_HEAP_GC_RETRY
+
+/****************************************/
+/****************************************/
+
 bbzobj_t* bbzheap_obj_at(bbzheap_idx_t i) {
+    if (bbzheap_idx_isimm(i)) {
+        /* Decode the immediate value in a scratch object */
+        bbzobj_t* x = vm->heap.imm + (vm->heap.immpos++ & (BBZHEAP_IMM_SCRATCH - 1));
+        x->biggest.value = 0;
+        if (i == BBZHEAP_IDX_NIL) {
+            x->mdata = ((BBZTYPE_NIL << BBZTYPE_TYPEIDX) & BBZTYPE_MASK) | BBZHEAP_OBJ_MASK_VALID;
+        }
+        else {
+            x->mdata = ((BBZTYPE_INT << BBZTYPE_TYPEIDX) & BBZTYPE_MASK) | BBZHEAP_OBJ_MASK_VALID;
+            x->i.value = bbzheap_idx_toint(i);
+        }
+        return x;
+    }
     return (bbzobj_t*)vm->heap.data + i;
 }
 
 /****************************************/
 /****************************************/
 
+int8_t bbzheap_idx_cmp(bbzheap_idx_t a,
+                       bbzheap_idx_t b) {
+    if (bbzheap_idx_isimm(a) && bbzheap_idx_isimm(b)) {
+        /* nil is smaller than anything, and equal to itself */
+        if (a == BBZHEAP_IDX_NIL || b == BBZHEAP_IDX_NIL) {
+            return (int8_t)((a != BBZHEAP_IDX_NIL) - (b != BBZHEAP_IDX_NIL));
+        }
+        int16_t x = bbzheap_idx_toint(a);
+        int16_t y = bbzheap_idx_toint(b);
+        if(x < y) return -1;
+        if(x > y) return  1;
+        return 0;
+    }
+    return bbztype_cmp(bbzheap_obj_at(a), bbzheap_obj_at(b));
+}
+
+/****************************************/
+/****************************************/
+
 static uint8_t bbzheap_tseg_alloc_prepare_seg(bbzheap_tseg_t* x) {
     /* Set valid bit of segment and -1 index for next */
     bbzheap_tseg_makevalid(*x);
@@ -88,7 +283,7 @@ static uint8_t bbzheap_tseg_alloc_prepare_seg(bbzheap_tseg_t* x) {
     return 1;
 }
 
-uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s) {
+static uint8_t bbzheap_tseg_alloc_find(bbzheap_idx_t* s) {
     /* Look for empty slot */
     int16_t qot = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
     for(int16_t i = 0;
@@ -114,11 +309,25 @@ uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s) {
     return bbzheap_tseg_alloc_prepare_seg((bbzheap_tseg_t*)vm->heap.ltseg);
 }
 
+uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s) {
+    if (!bbzheap_tseg_alloc_find(s)) {
+#ifdef BBZ_HEAP_GC_RETRY
+        bbzheap_gc_retry();
+        if (!bbzheap_tseg_alloc_find(s)) return 0;
+#else // BBZ_HEAP_GC_RETRY
+        return 0;
+#endif // BBZ_HEAP_GC_RETRY
+    }
+    bbzheap_count_alloc();
+    return 1;
+}
+
 /****************************************/
 /****************************************/
 static void bbzheap_gc_mark(bbzheap_idx_t obj) {
-    static uint8_t callstack = 1; // The value of 1 is necessary
-    if (++callstack <= BBZHEAP_GCMARK_DEPTH && !gc_hasmark(*bbzheap_obj_at(obj))) {
+    /* Immediate values do not live in the heap */
+    if (bbzheap_idx_isimm(obj)) return;
+    if (++vm->heap.gcdepth <= BBZHEAP_GCMARK_DEPTH && !gc_hasmark(*bbzheap_obj_at(obj))) {
         /* Mark gc bit */
         gc_mark(*bbzheap_obj_at(obj));
         /* If it's a table, go through it and mark all associated objects */
@@ -145,7 +354,7 @@ static void bbzheap_gc_mark(bbzheap_idx_t obj) {
             bbzheap_gc_mark(bbzheap_obj_at(obj)->l.value.actrec);
         }
     }
-    --callstack;
+    --vm->heap.gcdepth;
 }
 
 void bbzheap_gc(bbzheap_idx_t* st,
@@ -168,8 +377,38 @@ void bbzheap_gc(bbzheap_idx_t* st,
     /* Go through the stack and set the gc bit of valid variables */
     for(i = sz; i-- != 0;) {
         /* Mark gc bit */
-        bbzheap_gc_mark(st[i]);
+        if (st[i] < qot && bbzheap_obj_isvalid(*bbzheap_obj_at(st[i]))) {
+            bbzheap_gc_mark(st[i]);
+        }
+    }
+#if BBZVM_GSYM_SLOTS > 0
+    /* Go through the global symbols */
+    for(i = BBZVM_GSYM_SLOTS; i-- != 0;) {
+        bbzheap_idx_t g = vm->gslots[i];
+        if (g < qot && bbzheap_obj_isvalid(*bbzheap_obj_at(g))) {
+            bbzheap_gc_mark(g);
+        }
+    }
+#endif // BBZVM_GSYM_SLOTS > 0
+#ifdef BBZ_HEAP_GC_RETRY
+    /* Recently allocated objects may not be on the stack yet */
+    for(i = BBZHEAP_GC_PINS; i-- != 0;) {
+        bbzheap_idx_t p = vm->heap.pins[i];
+        if (p < qot && bbzheap_obj_isvalid(*bbzheap_obj_at(p))) {
+            bbzheap_gc_mark(p);
+        }
+    }
+    /* Objects pinned by C code */
+    for(i = vm->heap.nupins; i-- != 0;) {
+        bbzheap_idx_t p = vm->heap.upins[i];
+        if (p < qot && bbzheap_obj_isvalid(*bbzheap_obj_at(p))) {
+            bbzheap_gc_mark(p);
+        }
     }
+#endif // BBZ_HEAP_GC_RETRY
+#if BBZHEAP_GC_ALLOC_THRESHOLD > 0
+    vm->heap.nalloc = 0;
+#endif // BBZHEAP_GC_ALLOC_THRESHOLD > 0
     /* Go through the objects; invalidate those with 0 gc bit */
     for(i = qot; i-- != 0;) {
         if(!gc_hasmark(*bbzheap_obj_at(i)) && bbzheap_obj_isvalid(*bbzheap_obj_at(i))) {
@@ -24,6 +24,88 @@ extern "C" {
  */
 #define BBZHEAP_ELEMS_PER_ASEG (2*(BBZHEAP_ELEMS_PER_TSEG))
 
+/**
+ * @brief Heap index flag which marks an immediate integer.
+ * @details An immediate integer is not stored in the heap: its value is
+ * held by the 14 lower bits of the index itself. The 16th bit of indices
+ * stored in segments is their valid flag, so the 15th bit is used.
+ */
+#define BBZHEAP_IDX_IMMINT_MASK ((bbzheap_idx_t)0x4000)
+
+/**
+ * @brief Heap index of the immediate nil value.
+ * @details No heap object can have this index.
+ */
+#define BBZHEAP_IDX_NIL ((bbzheap_idx_t)0x3FFF)
+
+/**
+ * @brief Smallest integer that can be stored as an immediate.
+ */
+#define BBZHEAP_IMMINT_MIN (-8192)
+
+/**
+ * @brief Largest integer that can be stored as an immediate.
+ */
+#define BBZHEAP_IMMINT_MAX 8191
+
+/**
+ * @brief Number of scratch objects in which immediate values are decoded
+ * by #bbzheap_obj_at. Must be a power of two.
+ */
+#define BBZHEAP_IMM_SCRATCH 4
+
+#if BBZHEAP_SIZE / 3 >= 0x3FFF
+#error "BBZHEAP_SIZE is too large: object indices must be smaller than BBZHEAP_IDX_NIL."
+#endif
+
+/**
+ * @brief Returns non-zero if the given heap index is an immediate value
+ * (an integer or nil) rather than the index of a heap object.
+ * @param[in] i The heap index.
+ */
+#define bbzheap_idx_isimm(i) ((bbzheap_idx_t)(i) >= BBZHEAP_IDX_NIL)
+
+/**
+ * @brief Returns non-zero if the given heap index is an immediate integer.
+ * @param[in] i The heap index.
+ */
+#define bbzheap_idx_isimmint(i) (((i) & BBZHEAP_IDX_IMMINT_MASK) != 0)
+
+/**
+ * @brief Returns non-zero if an integer fits in an immediate.
+ * @param[in] v The integer.
+ */
+#define bbzheap_imm_fits(v) ((v) >= BBZHEAP_IMMINT_MIN && (v) <= BBZHEAP_IMMINT_MAX)
+
+/**
+ * @brief Encodes an integer as an immediate heap index.
+ * @warning The integer must fit ; see #bbzheap_imm_fits.
+ * @param[in] v The integer.
+ */
+#define bbzheap_idx_fromint(v) ((bbzheap_idx_t)(((uint16_t)(v) & 0x3FFF) | BBZHEAP_IDX_IMMINT_MASK))
+
+/**
+ * @brief Decodes the value of an immediate integer.
+ * @param[in] i The heap index of the immediate integer.
+ */
+#define bbzheap_idx_toint(i) ((int16_t)((int16_t)((uint16_t)(i) << 2) >> 2))
+
+#ifdef BBZ_HEAP_GC_RETRY
+/**
+ * @brief Number of most recent object allocations that are treated as
+ * roots by a garbage collection.
+ * @details A freshly allocated object may only be referenced by a C
+ * variable until the current instruction pushes it on the stack. Must be
+ * a power of two.
+ */
+#define BBZHEAP_GC_PINS 4
+
+/**
+ * @brief Number of objects C code may pin with bbzheap_pin().
+ */
+#define BBZHEAP_GC_USER_PINS 4
+#endif // BBZ_HEAP_GC_RETRY
+
 /**
  * @brief A table segment.
  */
@@ -90,6 +172,21 @@ typedef struct PACKED bbzheap_aseg_t {
 typedef struct PACKED bbzheap_t {
     uint8_t* rtobj;             /**< @brief Pointer to after the rightmost object in heap, not necessarly valid */
     uint8_t* ltseg;             /**< @brief Pointer to the leftmost table segment in heap, not necessarly valid */
+    bbzobj_t imm[BBZHEAP_IMM_SCRATCH]; /**< @brief Scratch objects for decoded immediate values */
+    uint8_t immpos;             /**< @brief Next scratch object to use */
+    uint8_t gcdepth;            /**< @brief Recursion depth of the garbage collector's marking, plus one */
+#if BBZHEAP_GC_ALLOC_THRESHOLD > 0
+    uint16_t nalloc;            /**< @brief Number of allocations since the last garbage collection */
+#endif // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+#ifdef BBZ_HEAP_GC_RETRY
+    bbzheap_idx_t pins[BBZHEAP_GC_PINS]; /**< @brief Most recently allocated objects */
+    uint8_t pinpos;             /**< @brief Next slot of #pins to use */
+    bbzheap_idx_t upins[BBZHEAP_GC_USER_PINS]; /**< @brief Objects pinned by bbzheap_pin() */
+    uint8_t nupins;             /**< @brief Number of objects in #upins */
+#endif // BBZ_HEAP_GC_RETRY
+#if BBZHEAP_STR_INTERN_SIZE > 0
+    bbzheap_idx_t strs[BBZHEAP_STR_INTERN_SIZE]; /**< @brief String intern table, indexed by string ID (weak references) */
+#endif // BBZHEAP_STR_INTERN_SIZE > 0
     uint8_t data[BBZHEAP_SIZE]; /**< @brief Data buffer */
 } bbzheap_t;
 
@@ -109,6 +206,14 @@ void bbzheap_clear();
  * The value of <code>o</code> is not checked for <code>NULL</code>, so make sure it's a valid pointer.
  * @details In the case of a string allocation, the parameter <code>o</code> must be set to the string ID beforehand.
  * @param[in] t The type of the object.
+ * If the heap is full, the allocation fails, unless #BBZ_HEAP_GC_RETRY is
+ * defined: garbage is then collected and the allocation is retried once.
+ * @warning With #BBZ_HEAP_GC_RETRY, this garbage collection may happen in
+ * the middle of a C function. Its roots are the VM's stack, the global
+ * symbols, the objects returned by the last #BBZHEAP_GC_PINS allocations
+ * and the objects pinned with bbzheap_pin(): an object only referred to by
+ * a C variable is lost after #BBZHEAP_GC_PINS more allocations, unless it
+ * is pushed on the stack or pinned.
  * @param[in,out] o A buffer for the index of the allocated object. In the case of a string allocation,
  * this must be set to the string ID beforehand.
  * @return 1 for success, 0 for failure (out of memory)
@@ -116,13 +221,53 @@ void bbzheap_clear();
 uint8_t bbzheap_obj_alloc(uint8_t t,
                           bbzheap_idx_t* o);
 
+#ifdef BBZ_HEAP_GC_RETRY
+/**
+ * @brief Protects an object from garbage collection until it is unpinned.
+ * @details Use it for objects which C code holds across allocations
+ * without pushing them on the VM's stack. Pins are released in the reverse
+ * order they are made.
+ * @param[in] o The object.
+ * @return 1 for success, 0 if #BBZHEAP_GC_USER_PINS objects are already
+ * pinned.
+ * @see bbzheap_unpin
+ */
+uint8_t bbzheap_pin(bbzheap_idx_t o);
+
+/**
+ * @brief Releases the most recent pin made by bbzheap_pin().
+ */
+void bbzheap_unpin();
+#else // BBZ_HEAP_GC_RETRY
+/*
+ * Garbage is only collected between instructions: C code needs no pins.
+ */
+#define bbzheap_pin(o) 1
+#define bbzheap_unpin()
+#endif // BBZ_HEAP_GC_RETRY
+
 /**
  * @brief Returns a pointer located at position i within the heap.
+ * @details Immediate values (see #bbzheap_idx_isimm) are decoded in a
+ * scratch object, which is reused after #BBZHEAP_IMM_SCRATCH other
+ * immediates are decoded. Writing to a decoded immediate has no effect on
+ * the value.
  * @param[in] i The position (a bbzheap_idx_t).
  * @return A pointer to the object.
  */
 bbzobj_t* bbzheap_obj_at(bbzheap_idx_t i);
 
+/**
+ * @brief Compares two objects given by their heap index.
+ * @details Immediate values are compared without being decoded.
+ * @param[in] a The first object to compare.
+ * @param[in] b The second object to compare.
+ * @return <0 if a<b, 0 if a==b, >0 if a>b
+ * @see bbztype_cmp
+ */
+int8_t bbzheap_idx_cmp(bbzheap_idx_t a,
+                       bbzheap_idx_t b);
+
 /**
  * @brief Returns non-zero if the given object is valid (i.e., in use).
  * @param[in] x The object.
@@ -158,6 +303,7 @@ bbzobj_t* bbzheap_obj_at(bbzheap_idx_t i);
 /**
  * @brief Allocates space for a table segment on the heap.
  * Sets as output the value of s, the index of the allocated segment.
+ * If the heap is full, garbage is collected and the allocation is retried once.
  * @param[out] s A buffer for the pointer to the allocated segment.
  * @return 1 for success, 0 for failure (out of memory)
  */
@@ -312,12 +458,34 @@ uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s);
 
 /**
  * Performs garbage collection on the heap.
+ * @details Stack entries which do not refer to a valid object are ignored,
+ * so stale stack slots may safely be passed.
  * @param[in,out] st The stack.
  * @param[in] sz The stack size (number of elements in the stack).
  */
 void bbzheap_gc(bbzheap_idx_t* st,
                 uint16_t sz);
 
+/**
+ * @brief Room (in bytes) between the objects and the table segments of
+ * the heap below which garbage is collected before every instruction.
+ * @details Allocations only collect garbage with #BBZ_HEAP_GC_RETRY, so
+ * the VM collects early when the heap is nearly full, rather than let an
+ * instruction fail for lack of memory with garbage on the heap.
+ */
+#define BBZHEAP_GC_RESERVE (4 * sizeof(bbzobj_t) + 2 * sizeof(bbzheap_tseg_t))
+
+#if BBZHEAP_GC_ALLOC_THRESHOLD > 0
+/**
+ * @brief Returns non-zero if enough allocations were made since the last
+ * garbage collection to justify a new one, or if the heap is nearly full.
+ */
+#define bbzheap_gc_isdue() (vm->heap.nalloc >= BBZHEAP_GC_ALLOC_THRESHOLD || \
+                            vm->heap.ltseg < vm->heap.rtobj + BBZHEAP_GC_RESERVE)
+#else // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+#define bbzheap_gc_isdue() 1
+#endif // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+
 /**
  * @brief <b>For the VM's internal use only</b>.
  *
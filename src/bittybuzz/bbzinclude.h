@@ -79,6 +79,20 @@ typedef uint16_t bbzpc_t;
  */
 #define PACKED __attribute__((packed))
 
+/**
+ * @brief Specifies that a variable has one instance per thread, if
+ * #BBZ_USE_THREAD_LOCAL_VM is defined.
+ */
+#if !defined(BBZ_USE_THREAD_LOCAL_VM)
+#define THREAD_LOCAL
+#elif defined(__cplusplus)
+#define THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 /**
  * @brief Specifies that a function should not perform extra
  * computation before and after the call.
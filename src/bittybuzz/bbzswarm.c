@@ -229,7 +229,7 @@ uint8_t bbzswarm_isrobotin(bbzrobot_id_t robot,
 void bbzswarm_create() {
     bbzvm_assert_lnum(1);
 
-    uint16_t swarm = bbzheap_obj_at(bbzvm_locals_at(1))->i.value;
+    uint16_t swarm = bbzheap_obj_at(bbzvm_argv()[0])->i.value;
 
     if (swarm < 8) {
         make_table(swarm);
@@ -256,7 +256,7 @@ void bbzswarm_id() {
             stack_depth = 0;
         }
         else {
-            stack_depth = bbzheap_obj_at(bbzvm_locals_at(1))->i.value;
+            stack_depth = bbzheap_obj_at(bbzvm_argv()[0])->i.value;
         }
 
         // Make sure we have enough elements
@@ -340,7 +340,7 @@ void bbzswarm_in() {
  * @param[in] select Nonzero if selecting, 0 if unselecting.
  */
 static void swarm_select_unselect(uint8_t select) {
-    uint8_t should_join = bbztype_tobool(bbzheap_obj_at(bbzvm_locals_at(1)));
+    uint8_t should_join = bbztype_tobool(bbzheap_obj_at(bbzvm_argv()[0]));
     if (should_join) {
         bbzvm_lload(0); // Push table we are calling '(un)select' on.
         bbzswarm_id_t swarm = get_id();
@@ -378,7 +378,7 @@ void bbzswarm_unselect() {
 
 void bbzswarm_exec() {
     bbzvm_assert_lnum(1);
-    bbzvm_assert_type(bbzvm_locals_at(1), BBZTYPE_CLOSURE);
+    bbzvm_assert_type(bbzvm_argv()[0], BBZTYPE_CLOSURE);
 
     // Get swarm ID and push it on the swarmstack
     bbzvm_lload(0); // Push table we are calling 'exec' on.
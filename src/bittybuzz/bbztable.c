@@ -17,8 +17,7 @@ uint8_t bbztable_get(bbzheap_idx_t t,
         /* Go through valid keys in the segment */
         for (uint8_t i = 0; i < BBZHEAP_ELEMS_PER_TSEG; ++i) {
             if (bbzheap_tseg_elem_isvalid(sd->keys[i]) &&
-                bbztype_cmp(bbzheap_obj_at(bbzheap_tseg_elem_get(sd->keys[i])),
-                            bbzheap_obj_at(k)) == 0) {
+                bbzheap_idx_cmp(bbzheap_tseg_elem_get(sd->keys[i]), k) == 0) {
                 /* Key found */
                 *v = bbzheap_tseg_elem_get(sd->values[i]);
                 return 1;
@@ -35,6 +34,61 @@ uint8_t bbztable_get(bbzheap_idx_t t,
 /****************************************/
 /****************************************/
 
+/**
+ * @brief Checks whether a table key is the string with the given ID.
+ */
+#define bbztable_key_isstr(K, STRID) (bbzheap_tseg_elem_isvalid(K) &&       \
+    bbztype_isstring(*bbzheap_obj_at(bbzheap_tseg_elem_get(K))) &&           \
+    bbzheap_obj_at(bbzheap_tseg_elem_get(K))->s.value == (STRID))
+
+uint8_t bbztable_find_str(bbzheap_idx_t t,
+                          uint16_t strid,
+                          uint8_t* hops,
+                          uint8_t* slot) {
+    /* Get first segment data */
+    bbzheap_tseg_t* sd = bbzheap_tseg_at(bbzheap_obj_at(t)->t.value);
+    /* Go through segments */
+    *hops = 0;
+    while (1) {
+        for (uint8_t i = 0; i < BBZHEAP_ELEMS_PER_TSEG; ++i) {
+            if (bbztable_key_isstr(sd->keys[i], strid)) {
+                /* Key found */
+                *slot = i;
+                return 1;
+            }
+        }
+        /* Are we done? */
+        if (!bbzheap_tseg_hasnext(sd)) return 0;
+        /* Get next segment */
+        sd = bbzheap_tseg_at(bbzheap_tseg_next_get(sd));
+        ++*hops;
+    }
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbztable_get_at(bbzheap_idx_t t,
+                        uint16_t strid,
+                        uint8_t hops,
+                        uint8_t slot,
+                        bbzheap_idx_t* v) {
+    /* Follow the segment chain; this is valid even if the table changed,
+     * because segments are only ever unlinked from it. */
+    bbzheap_tseg_t* sd = bbzheap_tseg_at(bbzheap_obj_at(t)->t.value);
+    for (; hops > 0; --hops) {
+        if (!bbzheap_tseg_hasnext(sd)) return 0;
+        sd = bbzheap_tseg_at(bbzheap_tseg_next_get(sd));
+    }
+    /* Does the slot still hold the key? */
+    if (slot >= BBZHEAP_ELEMS_PER_TSEG || !bbztable_key_isstr(sd->keys[slot], strid)) return 0;
+    *v = bbzheap_tseg_elem_get(sd->values[slot]);
+    return 1;
+}
+
+/****************************************/
+/****************************************/
+
 uint8_t bbztable_set(bbzheap_idx_t t,
                      bbzheap_idx_t k,
                      bbzheap_idx_t v) {
@@ -60,8 +114,7 @@ uint8_t bbztable_set(bbzheap_idx_t t,
                     fslot = i;
                 }
             }
-            else if (bbztype_cmp(bbzheap_obj_at(bbzheap_tseg_elem_get(sd->keys[i])),
-                                bbzheap_obj_at(k)) == 0) {
+            else if (bbzheap_idx_cmp(bbzheap_tseg_elem_get(sd->keys[i]), k) == 0) {
                 /* Key found */
                 seg = si;
                 slot = i;
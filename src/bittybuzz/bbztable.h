@@ -38,6 +38,38 @@ uint8_t bbztable_get(bbzheap_idx_t t,
                      bbzheap_idx_t k,
                      bbzheap_idx_t* v);
 
+/**
+ * @brief Finds the position of a string key in a table.
+ * @details The position stays meaningful until the table is modified ; use
+ * bbztable_get_at() to read it back, which checks that it still holds the key.
+ * @param[in] t The position of the table's object in the heap.
+ * @param[in] strid The string ID of the key.
+ * @param[out] hops Number of segments to skip after the table's first one.
+ * @param[out] slot Slot of the key in its segment.
+ * @return 1 for success, 0 for failure (key not in table)
+ */
+uint8_t bbztable_find_str(bbzheap_idx_t t,
+                          uint16_t strid,
+                          uint8_t* hops,
+                          uint8_t* slot);
+
+/**
+ * @brief Gets the value at a position returned by bbztable_find_str().
+ * @details Fails if the table changed so that the position no longer exists
+ * or no longer holds the given key.
+ * @param[in] t The position of the table's object in the heap.
+ * @param[in] strid The string ID of the key.
+ * @param[in] hops Number of segments to skip after the table's first one.
+ * @param[in] slot Slot of the key in its segment.
+ * @param[out] v A buffer for the pointer to the value.
+ * @return 1 for success, 0 for failure (key not at this position)
+ */
+uint8_t bbztable_get_at(bbzheap_idx_t t,
+                        uint16_t strid,
+                        uint8_t hops,
+                        uint8_t slot,
+                        bbzheap_idx_t* v);
+
 /**
  * @brief Add/Edit the value corresponding to the key k in the table t from the heap h.
  * If the key isn't in the table, it will be added.
@@ -41,6 +41,10 @@ extern "C" {
  * <ul>
  * <li>If you are using this function many times in a row, it is advised to
  * periodically call the garbage-collector to free some space on the heap.</li>
+ * <li>When #BBZ_HEAP_GC_RETRY is defined, allocations may collect garbage
+ * in the middle of a C closure: objects it holds in variables across
+ * allocations must be on the stack, as the table is here, or pinned with
+ * bbzheap_pin() (see #bbzvm_funp).</li>
  * <li>A table can technically contain any object as key, but in the
  * typical case the key is a string. If you need the key to be another
  * type of object (integer, float, another closure, ...), you can do it
@@ -80,6 +84,10 @@ void bbztable_add_function(uint16_t strid, bbzvm_funp fun);
  * <ul>
  * <li>If you are using this function many times in a row, it is advised to
  * periodically call the garbage-collector to free some space on the heap.</li>
+ * <li>When #BBZ_HEAP_GC_RETRY is defined, allocations may collect garbage
+ * in the middle of a C closure: objects it holds in variables across
+ * allocations must be on the stack, as the table is here, or pinned with
+ * bbzheap_pin() (see #bbzvm_funp).</li>
  * <li>A table can technically contain any object as key, but in the
  * typical case the key is a string. If you need the key to be another
  * type of object (integer, float, another closure, ...), you can do it
@@ -118,6 +126,10 @@ void bbztable_add_data(uint16_t strid, bbzheap_idx_t data);
  * <ul>
  * <li>If you are using this function many times in a row, it is advised to
  * periodically call the garbage-collector to free some space on the heap.</li>
+ * <li>When #BBZ_HEAP_GC_RETRY is defined, allocations may collect garbage
+ * in the middle of a C closure: objects it holds in variables across
+ * allocations must be on the stack, as the table is here, or pinned with
+ * bbzheap_pin() (see #bbzvm_funp).</li>
  * <li>A table can technically contain any object as key, but in the
  * typical case the key is a string. If you need the key to be another
  * type of object (integer, float, another closure, ...), you can do it
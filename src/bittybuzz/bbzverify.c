@@ -0,0 +1,316 @@
+#include "bbzverify.h"
+
+/*
+ * The buffer holds one byte of state per byte of bytecode: the number of
+ * operands on the stack before the instruction which starts there, flagged
+ * while the instruction still has to be walked, or whether the byte was not
+ * reached yet or is an operand.
+ */
+#define STATE_UNSEEN  0xFF
+#define STATE_OPERAND 0xFE
+#define STATE_PENDING 0x80
+#define STATE_DEPTH   0x7F
+#define MAX_DEPTH     0x7D
+
+/**
+ * @brief State of a verification.
+ */
+typedef struct {
+    bbzverify_fetch_fun fetch; /**< @brief Bytecode fetcher */
+    uint16_t size;             /**< @brief Size of the bytecode */
+    uint8_t* state;            /**< @brief State of each byte of the bytecode */
+    bbzpc_t pc;                /**< @brief Offset of the instruction being walked */
+    uint8_t again;             /**< @brief Whether an instruction before #pc became pending */
+} verifier_t;
+
+/**
+ * @brief Reads a 16-bit little-endian operand.
+ */
+static uint16_t read_arg(const verifier_t* v, bbzpc_t offset) {
+    const uint8_t* p = v->fetch(offset, sizeof(uint16_t));
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief Records that some instruction is reached with a number of operands
+ * on the stack.
+ * @return The error found, if any.
+ */
+static bbzvm_error reach(verifier_t* v, bbzpc_t offset, uint8_t depth) {
+    if (offset < sizeof(uint16_t) || offset >= v->size) return BBZVM_ERROR_PC;
+    uint8_t s = v->state[offset];
+    if (s == STATE_UNSEEN) {
+        v->state[offset] = (uint8_t)(depth | STATE_PENDING);
+        if (offset <= v->pc) v->again = 1;
+        return BBZVM_ERROR_NONE;
+    }
+    if (s == STATE_OPERAND) return BBZVM_ERROR_PC;
+    if ((s & STATE_DEPTH) != depth) return BBZVM_ERROR_STACK;
+    return BBZVM_ERROR_NONE;
+}
+
+/**
+ * @brief Walks the instruction at v->pc.
+ * @param[in,out] max_stack The maximum stack depth so far.
+ * @return The error found, if any.
+ */
+static bbzvm_error walk(verifier_t* v, uint8_t* max_stack) {
+    bbzpc_t pc = v->pc;
+    uint8_t depth = v->state[pc] & STATE_DEPTH;
+    uint8_t instr = *v->fetch(pc, 1);
+    uint8_t len = 1;
+    if ((instr >= BBZVM_INSTR_PUSHF && instr <= BBZVM_INSTR_CMPJLTE) ||
+        (instr >= BBZVM_INSTR_CMPJEQII && instr <= BBZVM_INSTR_CMPJLTEII)) {
+        len += sizeof(uint16_t);
+    }
+    else if (instr >= BBZVM_INSTR_PUSHI8 && instr <= BBZVM_INSTR_JUMPNZ8) {
+        len += sizeof(uint8_t);
+    }
+    else if (instr >= BBZVM_INSTR_RMOV && instr <= BBZVM_INSTR_RSETI) {
+        len += 2 * sizeof(uint8_t);
+    }
+    else if (instr >= BBZVM_INSTR_RADD && instr <= BBZVM_INSTR_RGETF) {
+        len += 3 * sizeof(uint8_t);
+    }
+    if (pc + len > v->size) return BBZVM_ERROR_PC;
+    for (uint8_t i = 1; i < len; ++i) {
+        uint8_t* s = v->state + pc + i;
+        if (*s != STATE_UNSEEN && *s != STATE_OPERAND) return BBZVM_ERROR_PC;
+        *s = STATE_OPERAND;
+    }
+    /* Short arguments are widened, and short jumps made absolute */
+    uint16_t arg = 0;
+    if (instr >= BBZVM_INSTR_RMOV) {
+        /* Register operands are not needed here */
+    }
+    else if (len > 2) {
+        arg = read_arg(v, pc + 1);
+    }
+    else if (len > 1) {
+        uint8_t b = *v->fetch(pc + 1, 1);
+        if (instr >= BBZVM_INSTR_JUMP8) {
+            int32_t target = (int32_t)pc + len + (int8_t)b;
+            arg = (target < 0) ? UINT16_MAX : (uint16_t)target;
+        }
+        else if (instr == BBZVM_INSTR_PUSHI8) {
+            arg = (uint16_t)(int16_t)(int8_t)b;
+        }
+        else {
+            arg = b;
+        }
+    }
+
+    /* Operands needed and pushed, and what comes next */
+    uint8_t pops = 0, pushes = 0;
+    uint8_t falls = 1;  // Whether the next instruction is reached
+    uint8_t jumps = 0;  // Whether the operand is a jump target
+    switch (instr) {
+        case BBZVM_INSTR_DONE: // fallthrough
+        case BBZVM_INSTR_RET0:
+            falls = 0;
+            break;
+        case BBZVM_INSTR_RET1:
+            pops = 1;
+            falls = 0;
+            break;
+        case BBZVM_INSTR_NOP:     // fallthrough
+        case BBZVM_INSTR_CALLS:   // fallthrough
+        case BBZVM_INSTR_LREMOVE: // fallthrough
+        case BBZVM_INSTR_INCL:
+            break;
+        case BBZVM_INSTR_PUSHNIL: // fallthrough
+        case BBZVM_INSTR_PUSHT:   // fallthrough
+        case BBZVM_INSTR_PUSHF:   // fallthrough
+        case BBZVM_INSTR_PUSHS:   // fallthrough
+        case BBZVM_INSTR_PUSHS8:  // fallthrough
+        case BBZVM_INSTR_PUSHCC:  // fallthrough
+        case BBZVM_INSTR_LLOAD:   // fallthrough
+        case BBZVM_INSTR_LLOAD8:  // fallthrough
+        case BBZVM_INSTR_GLOADS:
+            pushes = 1;
+            break;
+        case BBZVM_INSTR_PUSHCN: // fallthrough
+        case BBZVM_INSTR_PUSHL: {
+            /* The function starts with an empty stack */
+            bbzvm_error err = reach(v, arg, 0);
+            if (err != BBZVM_ERROR_NONE) return err;
+            pushes = 1;
+            break;
+        }
+        case BBZVM_INSTR_PUSHI: // fallthrough
+        case BBZVM_INSTR_PUSHI8: {
+            pushes = 1;
+            if (pc + len >= v->size) break;
+            uint8_t next = *v->fetch(pc + len, 1);
+            if (next != BBZVM_INSTR_CALLC && next != BBZVM_INSTR_TCALLC) break;
+            /* A call, which pops self, the closure and the arguments and
+             * pushes the return value. The call is part of this step, so
+             * its own state is not pending. */
+            if ((int16_t)arg < 0 || arg > MAX_DEPTH) return BBZVM_ERROR_STACK;
+            if (depth < arg + 2) return BBZVM_ERROR_STACK;
+            bbzvm_error err = reach(v, pc + len, (uint8_t)(depth + 1));
+            if (err != BBZVM_ERROR_NONE) return err;
+            v->state[pc + len] &= (uint8_t)~STATE_PENDING;
+            if (depth + 1 > *max_stack) *max_stack = (uint8_t)(depth + 1);
+            ++len;
+            pops = (uint8_t)(arg + 2);
+            pushes = 1;
+            break;
+        }
+        case BBZVM_INSTR_CALLC: // fallthrough
+        case BBZVM_INSTR_TCALLC:
+            /* Not preceded by its argument count */
+            return BBZVM_ERROR_STACK;
+        case BBZVM_INSTR_DUP:
+            pops = 1;
+            pushes = 2;
+            break;
+        case BBZVM_INSTR_LLOAD2:
+            pushes = 2;
+            break;
+        case BBZVM_INSTR_POP:    // fallthrough
+        case BBZVM_INSTR_LSTORE: // fallthrough
+        case BBZVM_INSTR_LSTORE8:
+            pops = 1;
+            break;
+        case BBZVM_INSTR_UNM:   // fallthrough
+        case BBZVM_INSTR_LNOT:  // fallthrough
+        case BBZVM_INSTR_BNOT:  // fallthrough
+        case BBZVM_INSTR_GLOAD: // fallthrough
+        case BBZVM_INSTR_TGETS:
+            pops = 1;
+            pushes = 1;
+            break;
+        case BBZVM_INSTR_ADD:  // fallthrough
+        case BBZVM_INSTR_SUB:  // fallthrough
+        case BBZVM_INSTR_MUL:  // fallthrough
+        case BBZVM_INSTR_DIV:  // fallthrough
+        case BBZVM_INSTR_MOD:  // fallthrough
+        case BBZVM_INSTR_POW:  // fallthrough
+        case BBZVM_INSTR_LAND: // fallthrough
+        case BBZVM_INSTR_LOR:  // fallthrough
+        case BBZVM_INSTR_BAND: // fallthrough
+        case BBZVM_INSTR_BOR:  // fallthrough
+        case BBZVM_INSTR_EQ:   // fallthrough
+        case BBZVM_INSTR_NEQ:  // fallthrough
+        case BBZVM_INSTR_GT:   // fallthrough
+        case BBZVM_INSTR_GTE:  // fallthrough
+        case BBZVM_INSTR_LT:   // fallthrough
+        case BBZVM_INSTR_LTE:  // fallthrough
+        case BBZVM_INSTR_TGET:
+            pops = 2;
+            pushes = 1;
+            break;
+        case BBZVM_INSTR_GSTORE:
+            pops = 2;
+            break;
+        case BBZVM_INSTR_TPUT:
+            pops = 3;
+            break;
+        case BBZVM_INSTR_JUMP: // fallthrough
+        case BBZVM_INSTR_JUMP8:
+            falls = 0;
+            jumps = 1;
+            break;
+        case BBZVM_INSTR_JUMPZ:   // fallthrough
+        case BBZVM_INSTR_JUMPNZ:  // fallthrough
+        case BBZVM_INSTR_JUMPZ8:  // fallthrough
+        case BBZVM_INSTR_JUMPNZ8:
+            pops = 1;
+            jumps = 1;
+            break;
+        case BBZVM_INSTR_CMPJEQ:  // fallthrough
+        case BBZVM_INSTR_CMPJNEQ: // fallthrough
+        case BBZVM_INSTR_CMPJGT:  // fallthrough
+        case BBZVM_INSTR_CMPJGTE: // fallthrough
+        case BBZVM_INSTR_CMPJLT:  // fallthrough
+        case BBZVM_INSTR_CMPJLTE:
+            pops = 2;
+            jumps = 1;
+            break;
+#ifndef BBZ_DISABLE_QUICKENING
+        /* Quickened instructions only appear in writable bytecode which
+         * already ran */
+        case BBZVM_INSTR_ADDII: // fallthrough
+        case BBZVM_INSTR_SUBII: // fallthrough
+        case BBZVM_INSTR_MULII: // fallthrough
+        case BBZVM_INSTR_ADDFF: // fallthrough
+        case BBZVM_INSTR_SUBFF: // fallthrough
+        case BBZVM_INSTR_MULFF: // fallthrough
+        case BBZVM_INSTR_DIVFF: // fallthrough
+        case BBZVM_INSTR_EQII:  // fallthrough
+        case BBZVM_INSTR_NEQII: // fallthrough
+        case BBZVM_INSTR_GTII:  // fallthrough
+        case BBZVM_INSTR_GTEII: // fallthrough
+        case BBZVM_INSTR_LTII:  // fallthrough
+        case BBZVM_INSTR_LTEII:
+            pops = 2;
+            pushes = 1;
+            break;
+        case BBZVM_INSTR_CMPJEQII:  // fallthrough
+        case BBZVM_INSTR_CMPJNEQII: // fallthrough
+        case BBZVM_INSTR_CMPJGTII:  // fallthrough
+        case BBZVM_INSTR_CMPJGTEII: // fallthrough
+        case BBZVM_INSTR_CMPJLTII:  // fallthrough
+        case BBZVM_INSTR_CMPJLTEII:
+            pops = 2;
+            jumps = 1;
+            break;
+#endif // !BBZ_DISABLE_QUICKENING
+#ifdef BBZ_REGISTER_BCODE
+        /* Register instructions leave the stack as it is */
+        case BBZVM_INSTR_RMOV:  // fallthrough
+        case BBZVM_INSTR_RSETI: // fallthrough
+        case BBZVM_INSTR_RADD:  // fallthrough
+        case BBZVM_INSTR_RSUB:  // fallthrough
+        case BBZVM_INSTR_RMUL:  // fallthrough
+        case BBZVM_INSTR_RADDI: // fallthrough
+        case BBZVM_INSTR_RGETF:
+            break;
+#endif // BBZ_REGISTER_BCODE
+        default:
+            return BBZVM_ERROR_INSTR;
+    }
+
+    if (depth < pops) return BBZVM_ERROR_STACK;
+    depth = (uint8_t)(depth - pops);
+    if (depth + pushes > MAX_DEPTH) return BBZVM_ERROR_STACK;
+    depth = (uint8_t)(depth + pushes);
+    if (depth > *max_stack) *max_stack = depth;
+    if (jumps) {
+        bbzvm_error err = reach(v, arg, depth);
+        if (err != BBZVM_ERROR_NONE) return err;
+    }
+    if (falls) return reach(v, pc + len, depth);
+    return BBZVM_ERROR_NONE;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzverify_bcode(bbzverify_fetch_fun fetch, uint16_t size,
+                        uint8_t* buf, bbzverify_result_t* res) {
+    verifier_t v = {fetch, size, buf, 0, 0};
+    for (uint16_t i = 0; i < size; ++i) buf[i] = STATE_UNSEEN;
+    res->max_stack = 0;
+    res->pc = sizeof(uint16_t);
+    /* The prelude follows the number of strings */
+    res->error = reach(&v, sizeof(uint16_t), 0);
+    /* Walk the pending instructions until none is left. Jumps backwards
+     * make instructions pending behind the walk, which needs another pass. */
+    while (res->error == BBZVM_ERROR_NONE) {
+        v.again = 0;
+        for (v.pc = sizeof(uint16_t); v.pc < size; ++v.pc) {
+            uint8_t s = buf[v.pc];
+            if (s >= STATE_OPERAND || !(s & STATE_PENDING)) continue;
+            buf[v.pc] = (uint8_t)(s & STATE_DEPTH);
+            res->error = walk(&v, &res->max_stack);
+            if (res->error != BBZVM_ERROR_NONE) {
+                res->pc = v.pc;
+                break;
+            }
+        }
+        if (!v.again) break;
+    }
+    return res->error == BBZVM_ERROR_NONE;
+}
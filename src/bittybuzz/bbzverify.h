@@ -0,0 +1,73 @@
+/**
+ * @file bbzverify.h
+ * @brief Definition of the bytecode verifier, which checks statically what
+ * the interpreter would otherwise check on every instruction.
+ */
+
+#ifndef BBZVERIFY_H
+#define BBZVERIFY_H
+
+#include "bbzinclude.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * @brief Pointer to a function which fetches bytecode data.
+ * @details Same as bbzvm_bcode_fetch_fun, for users of the verifier which
+ * do not run a VM, such as bo2bbo.
+ * @param[in] offset Bytecode offset for the data to fetch.
+ * @param[in] size Size of the data to fetch (1 or 2 bytes).
+ * @return A pointer to the data.
+ */
+typedef const uint8_t* (*bbzverify_fetch_fun)(bbzpc_t offset, uint8_t size);
+
+/**
+ * @brief Outcome of the verification of some bytecode.
+ */
+typedef struct PACKED bbzverify_result_t {
+    bbzvm_error error; /**< @brief BBZVM_ERROR_NONE if the bytecode is valid */
+    bbzpc_t pc;        /**< @brief Offset of the faulty instruction, if any */
+    uint8_t max_stack; /**< @brief Maximum number of operands on the stack of a frame */
+} bbzverify_result_t;
+
+/**
+ * @brief Verifies some bytecode.
+ * @details The code which runs from the prelude, and the code of every
+ * function whose address is pushed by PUSHL or PUSHCN, is walked along all
+ * its paths. The verifier checks that:
+ * <ul>
+ * <li>every opcode is known to the VM (BBZVM_ERROR_INSTR);</li>
+ * <li>operands and jump targets lie within the bytecode, and jumps land on
+ * the first byte of an instruction (BBZVM_ERROR_PC);</li>
+ * <li>no path falls off the end of the bytecode (BBZVM_ERROR_PC);</li>
+ * <li>every instruction finds the operands it pops on the stack of its
+ * frame, and the number of operands at an instruction is the same on all
+ * the paths which reach it (BBZVM_ERROR_STACK);</li>
+ * <li>every CALLC or TCALLC comes right after the PUSHI or PUSHI8 of its
+ * argument count, so that its effect on the stack is known
+ * (BBZVM_ERROR_STACK).</li>
+ * </ul>
+ * Verified bytecode never trips the PC and stack checks of the interpreter,
+ * which BBZ_UNCHECKED removes ; it then refuses to run bytecode which was
+ * not verified.
+ * @note The maximum stack depth is that of a single frame, i.e., of the
+ * operands above the local symbols. The stack must also hold, for each
+ * nested call, a three-slot header, the activation record and the
+ * arguments.
+ * @param[in] fetch The function to call to read the bytecode.
+ * @param[in] size The size (in bytes) of the bytecode.
+ * @param[in,out] buf A buffer of @c size bytes, used as the verifier's
+ * state.
+ * @param[out] res The outcome of the verification.
+ * @return 1 if the bytecode is valid, 0 otherwise.
+ */
+uint8_t bbzverify_bcode(bbzverify_fetch_fun fetch, uint16_t size,
+                        uint8_t* buf, bbzverify_result_t* res);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // !BBZVERIFY_H
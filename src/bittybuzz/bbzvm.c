@@ -2,14 +2,145 @@
 #include "bbzheap.h"
 #include <stdio.h>
 #include "bbztype.h"
+#include "bbzverify.h"
 
-bbzvm_t* vm; // Global extern variable 'vm'.
+THREAD_LOCAL bbzvm_t* vm; // Global extern variable 'vm'.
+
+/*
+ * Value of the VM's call pointer when no call was started with
+ * bbzvm_function_call_begin(). It is lower than any block pointer, so
+ * that bbzvm_run_budget() runs the main program.
+ */
+#define BBZVM_NO_CALL (-2)
+
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_PROFILE
+/**
+ * @brief Clock used when the platform did not set one; only counts are
+ * profiled then.
+ */
+static uint32_t dflt_clock_fun() {
+    return 0;
+}
+
+/**
+ * @brief Accounts for an execution of an entry of the profile.
+ * @param[in] entry The entry (an instruction or a BBZVM_PROFILE_* value).
+ * @param[in] start The time the execution started at.
+ */
+static void bbzvm_profile_add(uint8_t entry, uint32_t start) {
+    ++vm->profile.count[entry];
+    vm->profile.time[entry] += vm->clock_fun() - start;
+}
+
+void bbzvm_profile_reset() {
+    for (uint8_t i = 0; i < BBZVM_PROFILE_SIZE; ++i) {
+        vm->profile.count[i] = 0;
+        vm->profile.time[i] = 0;
+    }
+}
+#endif // BBZ_PROFILE
+
+/****************************************/
+/****************************************/
+
+#if defined(BBZ_UNCHECKED) && !defined(BBZ_VERIFY_BCODE)
+#error "BBZ_UNCHECKED requires BBZ_VERIFY_BCODE: only verified bytecode may run unchecked."
+#endif
+
+/****************************************/
+/****************************************/
+
+#if BBZVM_ICACHE_SIZE > 0
+/**
+ * @brief Empties the inline caches, which may hold anything before the VM
+ * is constructed, or refer to the tables of other bytecode.
+ */
+static void bbzvm_icache_clear() {
+    for (uint16_t i = 0; i < BBZVM_ICACHE_SIZE; ++i) {
+        vm->icache[i].tseg = BBZVM_ICACHE_EMPTY;
+    }
+}
+#endif // BBZVM_ICACHE_SIZE > 0
+
+/****************************************/
+/****************************************/
+
+#if BBZVM_FLIST_INDEX_SIZE > 0
+/*
+ * Entries hold positions in the list on 8 bits, BBZVM_FLIST_INDEX_FREE
+ * excluded. The index is filled in the order of the list, so a full
+ * index of at most 128 entries only holds positions below 128.
+ */
+#if BBZVM_FLIST_INDEX_SIZE & (BBZVM_FLIST_INDEX_SIZE - 1) || BBZVM_FLIST_INDEX_SIZE > 128
+#error "BBZVM_FLIST_INDEX_SIZE must be a power of two no greater than 128."
+#endif
+#if BBZVM_FLIST_INDEX_SIZE >= BBZVM_FLIST_INDEX_FREE
+#error "BBZVM_FLIST_INDEX_SIZE must be lower than BBZVM_FLIST_INDEX_FREE."
+#endif
+
+/*
+ * Entry of the index of the function list to probe first for a key.
+ */
+#define bbzvm_flist_hash(key) ((uint8_t)((key) ^ ((key) >> 7)) & (BBZVM_FLIST_INDEX_SIZE - 1))
+
+/**
+ * @brief Computes the key of a function in the index of the function list.
+ * @param[in] f The function: an integer holding the bytecode address of a
+ * lambda, or a C closure.
+ * @return The key.
+ */
+static uint16_t bbzvm_flist_key(bbzheap_idx_t f) {
+    const bbzobj_t* o = bbzheap_obj_at(f);
+    return bbztype_isint(*o) ? (uint16_t)o->i.value : (uint16_t)o->u.value;
+}
+
+/**
+ * @brief Adds a function to the index of the function list, unless the
+ * index is full or the position does not fit in an entry.
+ * @param[in] key The key of the function.
+ * @param[in] pos The position of the function in the list.
+ */
+static void bbzvm_flist_index_add(uint16_t key, uint16_t pos) {
+    if (pos >= BBZVM_FLIST_INDEX_FREE) return;
+    uint8_t h = bbzvm_flist_hash(key);
+    for (uint16_t n = 0; n < BBZVM_FLIST_INDEX_SIZE; ++n) {
+        bbzvm_flist_index_t* e = vm->flist_index + h;
+        if (e->pos == BBZVM_FLIST_INDEX_FREE) {
+            e->key = key;
+            e->pos = (uint8_t)pos;
+            return;
+        }
+        h = (h + 1) & (BBZVM_FLIST_INDEX_SIZE - 1);
+    }
+}
+
+/**
+ * @brief Rebuilds the index of the function list from the list.
+ */
+static void bbzvm_flist_index_rebuild() {
+    for (uint16_t i = 0; i < BBZVM_FLIST_INDEX_SIZE; ++i) {
+        vm->flist_index[i].pos = BBZVM_FLIST_INDEX_FREE;
+    }
+    uint16_t size = bbzdarray_size(vm->flist);
+    for (uint16_t i = 0; i < size; ++i) {
+        bbzheap_idx_t f;
+        bbzdarray_get(vm->flist, i, &f);
+        bbzvm_flist_index_add(bbzvm_flist_key(f), i);
+    }
+}
+#endif // BBZVM_FLIST_INDEX_SIZE > 0
 
 /****************************************/
 /****************************************/
 
 void bbzvm_process_inmsgs() {
     bbzvm_assert_state();
+#ifdef BBZ_PROFILE
+    uint32_t start = vm->clock_fun();
+#endif // BBZ_PROFILE
     /* Go through the messages */
     uint8_t count = 0;
     while(!bbzinmsg_queue_isempty() && count++ < BBZMSG_IN_PROC_MAX) {
@@ -33,12 +164,18 @@ void bbzvm_process_inmsgs() {
                 break;
         }
     }
+#ifdef BBZ_PROFILE
+    bbzvm_profile_add(BBZVM_PROFILE_INMSGS, start);
+#endif // BBZ_PROFILE
 }
 
 /****************************************/
 /****************************************/
 
 void bbzvm_process_outmsgs() {
+#ifdef BBZ_PROFILE
+    uint32_t start = vm->clock_fun();
+#endif // BBZ_PROFILE
 #ifndef BBZ_DISABLE_NEIGHBORS
     if (!(vm->neighbors.clear_counter--)) {
         vm->neighbors.clear_counter = BBZNEIGHBORS_CLR_PERIOD;
@@ -50,6 +187,9 @@ void bbzvm_process_outmsgs() {
 #ifndef BBZ_DISABLE_SWARMLIST_BROADCASTS
     // TODO Send swarm message
 #endif // !BBZ_DISABLE_SWARMLIST_BROADCASTS
+#ifdef BBZ_PROFILE
+    bbzvm_profile_add(BBZVM_PROFILE_OUTMSGS, start);
+#endif // BBZ_PROFILE
 }
 
 /****************************************/
@@ -74,7 +214,7 @@ extern char* _error_desc[];
 extern char* _instr_desc[];
 #if defined(DEBUG) && !defined(BBZ_XTREME_MEMORY)
 char* _state_desc[] = {"BBZVM_STATE_NOCODE", "BBZVM_STATE_READY", "BBZVM_STATE_STOPPED", "BBZVM_STATE_DONE", "BBZVM_STATE_ERROR",
-                       "BBZVM_STATE_COUNT"};
+                       "BBZVM_STATE_YIELDED", "BBZVM_STATE_COUNT"};
 char* _error_desc[] = {"BBZVM_ERROR_NONE", "BBZVM_ERROR_INSTR", "BBZVM_ERROR_STACK", "BBZVM_ERROR_LNUM", "BBZVM_ERROR_PC",
                        "BBZVM_ERROR_FLIST", "BBZVM_ERROR_TYPE", "BBZVM_ERROR_OUTOFRANGE", "BBZVM_ERROR_NOTIMPL",
                        "BBZVM_ERROR_RET", "BBZVM_ERROR_STRING", "BBZVM_ERROR_SWARM", "BBZVM_ERROR_VSTIG", "BBZVM_ERROR_MEM",
@@ -82,7 +222,12 @@ char* _error_desc[] = {"BBZVM_ERROR_NONE", "BBZVM_ERROR_INSTR", "BBZVM_ERROR_STA
 char* _instr_desc[] = {"NOP", "DONE", "PUSHNIL", "DUP", "POP", "RET0", "RET1", "ADD", "SUB", "MUL", "DIV", "MOD", "POW",
                        "UNM", "LAND", "LOR", "LNOT","BAND","BOR","BNOT","LSHIFT","RSHIFT","EQ", "NEQ", "GT", "GTE", "LT", "LTE", "GLOAD", "GSTORE", "PUSHT", "TPUT",
                        "TGET", "CALLC", "CALLS", "PUSHF", "PUSHI", "PUSHS", "PUSHCN", "PUSHCC", "PUSHL", "LLOAD", "LSTORE","LREMOVE",
-                       "JUMP", "JUMPZ", "JUMPNZ", "COUNT"};
+                       "JUMP", "JUMPZ", "JUMPNZ", "GLOADS", "TGETS", "LLOAD2", "INCL", "CMPJEQ", "CMPJNEQ", "CMPJGT",
+                       "CMPJGTE", "CMPJLT", "CMPJLTE", "ADDII", "SUBII", "MULII", "ADDFF", "SUBFF", "MULFF",
+                       "DIVFF", "EQII", "NEQII", "GTII", "GTEII", "LTII", "LTEII", "CMPJEQII", "CMPJNEQII", "CMPJGTII",
+                       "CMPJGTEII", "CMPJLTII", "CMPJLTEII", "TCALLC", "PUSHI8", "PUSHS8", "LLOAD8",
+                       "LSTORE8", "JUMP8", "JUMPZ8", "JUMPNZ8", "RMOV", "RSETI", "RADD", "RSUB", "RMUL",
+                       "RADDI", "RGETF", "COUNT"};
 #endif // DEBUG && !BBZ_XTREME_MEMORY
 
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -98,16 +243,38 @@ ALWAYS_INLINE void dftl_error_receiver(bbzvm_error errcode) {
 
 void bbzvm_construct(bbzrobot_id_t robot) {
     vm->bcode_fetch_fun = NULL;
+    vm->bcode_ptr = NULL;
+#ifndef BBZ_DISABLE_QUICKENING
+    vm->bcode_rw = NULL;
+#endif
+#ifdef BBZ_ENABLE_AOT
+    vm->aot_fun = NULL;
+#endif
     vm->bcode_size = 0;
     vm->pc = 0;
     vm->state = BBZVM_STATE_NOCODE;
     vm->error = BBZVM_ERROR_NONE;
     vm->error_receiver_fun = dftl_error_receiver;
+#ifdef BBZ_PROFILE
+    vm->clock_fun = dflt_clock_fun;
+    bbzvm_profile_reset();
+#endif // BBZ_PROFILE
+#ifdef BBZ_PC_SAMPLING
+    vm->samples = NULL;
+    vm->sample_period = 0;
+#endif // BBZ_PC_SAMPLING
+#ifdef BBZ_VERIFY_BCODE
+    vm->verify_buf = NULL;
+#endif // BBZ_VERIFY_BCODE
     vm->stackptr = -1;
     vm->blockptr = vm->stackptr;
-    vm->lsyms = 0;
+    vm->localptr = vm->blockptr + 1;
+    vm->callptr = BBZVM_NO_CALL;
     vm->robot = robot;
     vm->flist = 0;
+#if BBZVM_ICACHE_SIZE > 0
+    bbzvm_icache_clear();
+#endif // BBZVM_ICACHE_SIZE > 0
 
     // Setup things
     bbzheap_clear();
@@ -115,9 +282,7 @@ void bbzvm_construct(bbzrobot_id_t robot) {
     bbzoutmsg_queue_construct();
 
     // Allocate singleton objects
-    bbzheap_obj_alloc(BBZTYPE_NIL, &vm->nil);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->nil));
-    bbzheap_obj_at(vm->nil)->i.value = 0;
+    vm->nil = BBZHEAP_IDX_NIL;
     bbzdarray_new(&vm->dflt_actrec);
     bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->dflt_actrec));
     bbzdarray_push(vm->dflt_actrec, vm->nil);
@@ -125,10 +290,18 @@ void bbzvm_construct(bbzrobot_id_t robot) {
     // Create various arrays
     bbzdarray_new(&vm->flist);
     bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->flist));
+#if BBZVM_FLIST_INDEX_SIZE > 0
+    bbzvm_flist_index_rebuild();
+#endif // BBZVM_FLIST_INDEX_SIZE > 0
 
     // Create global symbols table
     bbzheap_obj_alloc(BBZTYPE_TABLE, &vm->gsyms);
     bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->gsyms));
+#if BBZVM_GSYM_SLOTS > 0
+    for (uint16_t i = 0; i < BBZVM_GSYM_SLOTS; ++i) {
+        vm->gslots[i] = vm->nil;
+    }
+#endif // BBZVM_GSYM_SLOTS > 0
 
     bbzvm_register_globals();
 
@@ -153,6 +326,15 @@ void bbzvm_destruct() {
 /****************************************/
 /****************************************/
 
+bbzvm_t* bbzvm_switch(bbzvm_t* ctx) {
+    bbzvm_t* prev = vm;
+    vm = ctx;
+    return prev;
+}
+
+/****************************************/
+/****************************************/
+
 void bbzvm_seterror(bbzvm_error errcode) {
     // Set the error
     vm->state = BBZVM_STATE_ERROR;
@@ -164,20 +346,61 @@ void bbzvm_seterror(bbzvm_error errcode) {
 /****************************************/
 /****************************************/
 
-void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size) {
+/*
+ * Number of local symbols in the current frame (0 outside of calls).
+ */
+#define bbzvm_lsyms_size() (vm->blockptr + 1 - vm->localptr)
+
+/*
+ * Reads bytecode. When it is directly addressable, the fetcher function is
+ * bypassed.
+ */
+#define bcode_at(OFFSET, SIZE) (vm->bcode_ptr ? vm->bcode_ptr + (OFFSET) : vm->bcode_fetch_fun((OFFSET), (SIZE)))
+
+/**
+ * @brief Loads the bytecode and runs its prelude.
+ * @param[in] bcode_fetch_fun The function to call to read bytecode data.
+ * @param[in] bcode_size The size (in bytes) of the bytecode.
+ */
+static void bbzvm_load_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size) {
     // 1) Set the bytecode
     vm->bcode_fetch_fun = bcode_fetch_fun;
     vm->bcode_size = bcode_size;
+#ifdef BBZ_ENABLE_AOT
+    vm->aot_fun = NULL;
+#endif
 
     // 2) Reset the VM
     vm->state = BBZVM_STATE_READY;
     vm->error = BBZVM_ERROR_NONE;
+    vm->callptr = BBZVM_NO_CALL;
+#if BBZVM_ICACHE_SIZE > 0
+    bbzvm_icache_clear();
+#endif // BBZVM_ICACHE_SIZE > 0
+
+#ifdef BBZ_VERIFY_BCODE
+    // 3) Verify the bytecode ; an unchecked VM does not run it otherwise
+#ifndef BBZ_UNCHECKED
+    if (vm->verify_buf)
+#endif // !BBZ_UNCHECKED
+    {
+        vm->pc = 0;
+        bbzvm_assert_exec(bcode_size <= vm->verify_size, BBZVM_ERROR_MEM);
+        bbzverify_result_t res;
+        if (!bbzverify_bcode(bcode_fetch_fun, bcode_size, vm->verify_buf, &res)) {
+            vm->pc = res.pc;
+            bbzvm_seterror(res.error);
+            return;
+        }
+        bbzvm_assert_exec(res.max_stack <= BBZSTACK_SIZE, BBZVM_ERROR_STACK);
+    }
+#endif // BBZ_VERIFY_BCODE
 
-    // 3) Register global strings
+    // 4) Register global strings
     vm->pc = sizeof(uint16_t);
 
-    // 4) Register Buzz's built-in functions
-    while(*vm->bcode_fetch_fun(vm->pc, sizeof(uint8_t)) != BBZVM_INSTR_NOP) {
+    // 5) Register Buzz's built-in functions
+    while(*bcode_at(vm->pc, sizeof(uint8_t)) != BBZVM_INSTR_NOP) {
         bbzvm_step();
         if(vm->state != BBZVM_STATE_READY) return;
     }
@@ -185,257 +408,1206 @@ void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size)
     bbzvm_step();
 }
 
+void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size) {
+    vm->bcode_ptr = NULL;
+#ifndef BBZ_DISABLE_QUICKENING
+    vm->bcode_rw = NULL;
+#endif
+    bbzvm_load_bcode(bcode_fetch_fun, bcode_size);
+}
+
+/**
+ * @brief Bytecode fetcher for directly addressable bytecode, for code which
+ * calls the fetcher function itself.
+ */
+static const uint8_t* bbzvm_bcode_ptr_fetch(bbzpc_t offset, uint8_t size) {
+    RM_UNUSED_WARN(size);
+    return vm->bcode_ptr + offset;
+}
+
+void bbzvm_set_bcode_ptr(const uint8_t* bcode, uint16_t bcode_size) {
+    vm->bcode_ptr = bcode;
+#ifndef BBZ_DISABLE_QUICKENING
+    vm->bcode_rw = NULL;
+#endif
+    bbzvm_load_bcode(bbzvm_bcode_ptr_fetch, bcode_size);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_set_bcode_rw(uint8_t* bcode, uint16_t bcode_size) {
+    vm->bcode_ptr = bcode;
+#ifndef BBZ_DISABLE_QUICKENING
+    vm->bcode_rw = bcode;
+#endif
+    bbzvm_load_bcode(bbzvm_bcode_ptr_fetch, bcode_size);
+}
+
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_VERIFY_BCODE
+void bbzvm_set_verify_buffer(uint8_t* buf, uint16_t size) {
+    vm->verify_buf = buf;
+    vm->verify_size = buf ? size : 0;
+}
+#endif // BBZ_VERIFY_BCODE
+
+/****************************************/
+/****************************************/
+
+/*
+ * Boot images. All values are little-endian. An image holds, in order:
+ *  1) BBZVM_IMAGE_MAGIC and the configuration of the VM it depends on;
+ *  2) the size of the bytecode, the PC after its prelude and the robot id
+ *     the image was made with;
+ *  3) the heap indices held by the VM and its swarm, vstig and neighbors
+ *     structures;
+ *  4) the number of objects and of table segments of the heap;
+ *  5) the objects, each as its metadata followed by a 16-bit value;
+ *  6) the table segments, as they are in memory;
+ *  7) the global symbol slots.
+ */
+#define BBZVM_IMAGE_MAGIC 0xB17B
+
+/**
+ * @brief Bits of the features of the VM that change the content of a
+ * boot image.
+ */
+static uint8_t bbzvm_image_features() {
+    uint8_t f = 0;
+#ifndef BBZ_DISABLE_SWARMS
+    f |= 0x01;
+#ifdef BBZ_DISABLE_SWARMLIST_BROADCASTS
+    f |= 0x02;
+#endif // BBZ_DISABLE_SWARMLIST_BROADCASTS
+#endif // !BBZ_DISABLE_SWARMS
+#ifndef BBZ_DISABLE_VSTIGS
+    f |= 0x04;
+#endif // !BBZ_DISABLE_VSTIGS
+#ifndef BBZ_DISABLE_NEIGHBORS
+    f |= 0x08;
+#endif // !BBZ_DISABLE_NEIGHBORS
+#ifdef BBZ_UNCHECKED
+    f |= 0x10; // The image's bytecode was verified
+#endif // BBZ_UNCHECKED
+    return f;
+}
+
+/**
+ * @brief Writes a value to a boot image.
+ * @param[in,out] p Where to write; incremented even past @p end.
+ * @param[in] end The end of the image's buffer.
+ * @param[in] v The value.
+ * @param[in] size The size (in bytes) of the value.
+ */
+static void bbzvm_image_put(uint8_t** p, const uint8_t* end, uint16_t v, uint8_t size) {
+    for (uint8_t i = 0; i < size; ++i, ++*p) {
+        if (*p < end) **p = (uint8_t)(v >> (8 * i));
+    }
+}
+
+uint16_t bbzvm_save_image(uint8_t* buf, uint16_t cap,
+                          bbzvm_funp* natives, uint8_t* nnatives) {
+    if (vm->state != BBZVM_STATE_READY || vm->stackptr != -1) return 0;
+    bbzvm_gc();
+
+    uint8_t* p = buf;
+    const uint8_t* end = buf + cap;
+#define image_put(V, SIZE) bbzvm_image_put(&p, end, (uint16_t)(V), (SIZE))
+    uint16_t nobjs = (uint16_t)((vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t));
+    uint16_t ntsegs = (uint16_t)((vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t));
+
+    // 1-2) Header
+    image_put(BBZVM_IMAGE_MAGIC, 2);
+    image_put(BBZHEAP_ELEMS_PER_TSEG, 1);
+    image_put(BBZHEAP_RSV_ACTREC_MAX, 1);
+    image_put(BBZVM_GSYM_SLOTS, 2);
+    image_put(bbzvm_image_features(), 1);
+    image_put(vm->bcode_size, 2);
+    image_put(vm->pc, 2);
+    image_put(vm->robot, 2);
+
+    // 3-4) Heap indices and heap size
+    image_put(vm->gsyms, 2);
+    image_put(vm->dflt_actrec, 2);
+    image_put(vm->flist, 2);
+#ifndef BBZ_DISABLE_SWARMS
+    image_put(vm->swarm.hpos, 2);
+    image_put(vm->swarm.swarmstack, 2);
+#ifdef BBZ_DISABLE_SWARMLIST_BROADCASTS
+    image_put(vm->swarm.my_swarmlist, 1);
+#endif // BBZ_DISABLE_SWARMLIST_BROADCASTS
+#endif // !BBZ_DISABLE_SWARMS
+#ifndef BBZ_DISABLE_VSTIGS
+    image_put(vm->vstig.hpos, 2);
+#endif // !BBZ_DISABLE_VSTIGS
+#ifndef BBZ_DISABLE_NEIGHBORS
+    image_put(vm->neighbors.hpos, 2);
+    image_put(vm->neighbors.listeners, 2);
+#endif // !BBZ_DISABLE_NEIGHBORS
+    image_put(nobjs, 2);
+    image_put(ntsegs, 2);
+
+    // 5) Objects
+    uint8_t nn = 0;
+    for (uint16_t i = 0; i < nobjs; ++i) {
+        bbzobj_t* o = bbzheap_obj_at(i);
+        uint16_t v = 0;
+        if (bbzheap_obj_isvalid(*o)) {
+            switch (bbztype(*o)) {
+                case BBZTYPE_NIL:    break;
+                case BBZTYPE_INT:    v = (uint16_t)o->i.value; break;
+                case BBZTYPE_FLOAT:  v = o->f.value; break;
+                case BBZTYPE_STRING: v = o->s.value; break;
+                case BBZTYPE_TABLE:  v = o->t.value; break;
+                case BBZTYPE_CLOSURE:
+                    if (bbztype_isclosurelambda(*o)) {
+                        v = o->l.value.ref | (o->l.value.actrec << 8);
+                    }
+                    else if (bbztype_isclosurenative(*o)) {
+                        v = (uint16_t)(uintptr_t)o->c.value;
+                    }
+                    else {
+                        // C closure: save its index in 'natives'
+                        for (v = 0; v < nn && natives[v] != o->c.value; ++v);
+                        if (v == nn) {
+                            if (nn == *nnatives) return 0;
+                            natives[nn++] = o->c.value;
+                        }
+                    }
+                    break;
+                default: return 0; // Userdata holds pointers
+            }
+        }
+        image_put(o->mdata, 1);
+        image_put(v, 2);
+    }
+
+    // 6) Table segments
+    for (uint16_t i = 0; i < ntsegs; ++i) {
+        const uint8_t* s = (const uint8_t*)bbzheap_tseg_at(i);
+        for (uint8_t j = 0; j < sizeof(bbzheap_tseg_t); ++j) {
+            image_put(s[j], 1);
+        }
+    }
+
+    // 7) Global symbol slots
+#if BBZVM_GSYM_SLOTS > 0
+    for (uint16_t i = 0; i < BBZVM_GSYM_SLOTS; ++i) {
+        image_put(vm->gslots[i], 2);
+    }
+#endif // BBZVM_GSYM_SLOTS > 0
+#undef image_put
+
+    if (p > end) return 0;
+    *nnatives = nn;
+    return (uint16_t)(p - buf);
+}
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Reads a value of a boot image.
+ * @param[in] image_fetch_fun The function to call to read image data.
+ * @param[in,out] pos The offset of the value, then of the next one.
+ * @param[in] size The size (in bytes) of the value.
+ * @return The value.
+ */
+static uint16_t bbzvm_image_get(bbzvm_bcode_fetch_fun image_fetch_fun, bbzpc_t* pos, uint8_t size) {
+    uint16_t v = 0;
+    for (uint8_t i = 0; i < size; ++i) {
+        v |= (uint16_t)*image_fetch_fun((*pos)++, 1) << (8 * i);
+    }
+    return v;
+}
+
+uint8_t bbzvm_restore_image(bbzrobot_id_t robot,
+                            bbzvm_bcode_fetch_fun image_fetch_fun,
+                            const bbzvm_funp* natives,
+                            bbzvm_bcode_fetch_fun bcode_fetch_fun) {
+    bbzpc_t pos = 0;
+#define image_get(SIZE) bbzvm_image_get(image_fetch_fun, &pos, (SIZE))
+    vm->bcode_ptr = NULL;
+#ifndef BBZ_DISABLE_QUICKENING
+    vm->bcode_rw = NULL;
+#endif
+#ifdef BBZ_ENABLE_AOT
+    vm->aot_fun = NULL;
+#endif
+    vm->state = BBZVM_STATE_NOCODE;
+    vm->error = BBZVM_ERROR_NONE;
+    vm->error_receiver_fun = dftl_error_receiver;
+#ifdef BBZ_PROFILE
+    vm->clock_fun = dflt_clock_fun;
+    bbzvm_profile_reset();
+#endif // BBZ_PROFILE
+#ifdef BBZ_PC_SAMPLING
+    vm->samples = NULL;
+    vm->sample_period = 0;
+#endif // BBZ_PC_SAMPLING
+#ifdef BBZ_VERIFY_BCODE
+    vm->verify_buf = NULL;
+#endif // BBZ_VERIFY_BCODE
+    vm->stackptr = -1;
+    vm->blockptr = vm->stackptr;
+    vm->localptr = vm->blockptr + 1;
+    vm->callptr = BBZVM_NO_CALL;
+    vm->robot = robot;
+    vm->nil = BBZHEAP_IDX_NIL;
+#if BBZVM_ICACHE_SIZE > 0
+    bbzvm_icache_clear();
+#endif // BBZVM_ICACHE_SIZE > 0
+
+    // 1-2) Header
+    if (image_get(2) != BBZVM_IMAGE_MAGIC ||
+        image_get(1) != BBZHEAP_ELEMS_PER_TSEG ||
+        image_get(1) != BBZHEAP_RSV_ACTREC_MAX ||
+        image_get(2) != BBZVM_GSYM_SLOTS ||
+        image_get(1) != bbzvm_image_features()) return 0;
+    uint16_t bcode_size = image_get(2);
+    bbzpc_t pc = image_get(2);
+    bbzrobot_id_t image_robot = image_get(2);
+    RM_UNUSED_WARN(image_robot);
+
+    // 3-4) Heap indices and heap size
+    vm->gsyms = image_get(2);
+    vm->dflt_actrec = image_get(2);
+    vm->flist = image_get(2);
+#ifndef BBZ_DISABLE_SWARMS
+    vm->swarm.hpos = image_get(2);
+    vm->swarm.swarmstack = image_get(2);
+#ifdef BBZ_DISABLE_SWARMLIST_BROADCASTS
+    vm->swarm.my_swarmlist = (bbzswarmlist_t)image_get(1);
+#endif // BBZ_DISABLE_SWARMLIST_BROADCASTS
+#endif // !BBZ_DISABLE_SWARMS
+#ifndef BBZ_DISABLE_VSTIGS
+    vm->vstig.hpos = image_get(2);
+#endif // !BBZ_DISABLE_VSTIGS
+#ifndef BBZ_DISABLE_NEIGHBORS
+    vm->neighbors.hpos = image_get(2);
+    vm->neighbors.listeners = image_get(2);
+#endif // !BBZ_DISABLE_NEIGHBORS
+    uint16_t nobjs = image_get(2);
+    uint16_t ntsegs = image_get(2);
+    if ((uint32_t)nobjs * sizeof(bbzobj_t) +
+        (uint32_t)ntsegs * sizeof(bbzheap_tseg_t) > BBZHEAP_SIZE) return 0;
+
+    // 5) Objects
+    bbzheap_clear();
+    vm->heap.rtobj = vm->heap.data + nobjs * sizeof(bbzobj_t);
+    vm->heap.ltseg = vm->heap.data + BBZHEAP_SIZE - ntsegs * sizeof(bbzheap_tseg_t);
+    for (uint16_t i = 0; i < nobjs; ++i) {
+        bbzobj_t* o = bbzheap_obj_at(i);
+        o->biggest.value = 0;
+        o->mdata = (uint8_t)image_get(1);
+        uint16_t v = image_get(2);
+        if (!bbztype_isclosure(*o)) {
+            o->i.value = (int16_t)v;
+        }
+        else if (bbztype_isclosurelambda(*o)) {
+            o->l.value.ref = (uint8_t)v;
+            o->l.value.actrec = (uint8_t)(v >> 8);
+        }
+        else if (bbztype_isclosurenative(*o)) {
+            o->c.value = (bbzvm_funp)(uintptr_t)v;
+        }
+        else {
+            o->c.value = natives[v];
+        }
+    }
+
+    // 6) Table segments
+    for (uint16_t i = 0; i < ntsegs; ++i) {
+        uint8_t* s = (uint8_t*)bbzheap_tseg_at(i);
+        for (uint8_t j = 0; j < sizeof(bbzheap_tseg_t); ++j) {
+            s[j] = (uint8_t)image_get(1);
+        }
+    }
+
+    // 7) Global symbol slots
+#if BBZVM_GSYM_SLOTS > 0
+    for (uint16_t i = 0; i < BBZVM_GSYM_SLOTS; ++i) {
+        vm->gslots[i] = image_get(2);
+    }
+#endif // BBZVM_GSYM_SLOTS > 0
+#undef image_get
+
+    // Set up what the image does not hold
+#if BBZVM_FLIST_INDEX_SIZE > 0
+    bbzvm_flist_index_rebuild();
+#endif // BBZVM_FLIST_INDEX_SIZE > 0
+    bbzinmsg_queue_construct();
+    bbzoutmsg_queue_construct();
+    bbzvstig_construct();
+#ifndef BBZ_DISABLE_NEIGHBORS
+    vm->neighbors.clear_counter = BBZNEIGHBORS_CLR_PERIOD;
+#ifdef BBZ_XTREME_MEMORY
+    bbzringbuf_construct(&vm->neighbors.rb, (uint8_t *) vm->neighbors.data,
+                         sizeof(bbzneighbors_elem_t),
+                         BBZNEIGHBORS_CAP + 1);
+#endif // BBZ_XTREME_MEMORY
+    bbzvm_push(vm->neighbors.hpos);
+    bbzneighbors_reset();
+    bbzvm_pop();
+#endif // !BBZ_DISABLE_NEIGHBORS
+    vm->bcode_fetch_fun = bcode_fetch_fun;
+    vm->bcode_size = bcode_size;
+    vm->pc = pc;
+    vm->state = BBZVM_STATE_READY;
+
+    // Make the image's robot-dependent data ours
+    bbzvm_register_globals();
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+    if (robot != image_robot) {
+        bbzswarm_rmentry(image_robot);
+        bbzswarm_addmember(robot, 0);
+        bbzswarm_rmmember(robot, 0);
+    }
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    return vm->state == BBZVM_STATE_READY;
+}
+
 /****************************************/
 /****************************************/
 
+#ifdef BBZ_PROFILE
+/*
+ * Profile dumps. All values are little-endian. A dump holds
+ * BBZVM_PROFILE_MAGIC, the number of entries, then the count and the time
+ * of each entry as 32-bit values.
+ */
+#define BBZVM_PROFILE_MAGIC 0xB1F0
+
+uint16_t bbzvm_profile_dump(uint8_t* buf, uint16_t cap) {
+    uint8_t* p = buf;
+    const uint8_t* end = buf + cap;
+    bbzvm_image_put(&p, end, BBZVM_PROFILE_MAGIC, 2);
+    bbzvm_image_put(&p, end, BBZVM_PROFILE_SIZE, 1);
+    for (uint8_t i = 0; i < BBZVM_PROFILE_SIZE; ++i) {
+        bbzvm_image_put(&p, end, (uint16_t)vm->profile.count[i], 2);
+        bbzvm_image_put(&p, end, (uint16_t)(vm->profile.count[i] >> 16), 2);
+        bbzvm_image_put(&p, end, (uint16_t)vm->profile.time[i], 2);
+        bbzvm_image_put(&p, end, (uint16_t)(vm->profile.time[i] >> 16), 2);
+    }
+    if (p > end) return 0;
+    return (uint16_t)(p - buf);
+}
+#endif // BBZ_PROFILE
+
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_PC_SAMPLING
+void bbzvm_set_sampling(uint16_t* samples, uint16_t nsamples,
+                        uint8_t shift, uint16_t period) {
+    vm->samples = samples;
+    vm->nsamples = samples ? nsamples : 0;
+    vm->sample_shift = shift;
+    vm->sample_period = samples ? period : 0;
+    vm->sample_countdown = period;
+    for (uint16_t i = 0; i < vm->nsamples; ++i) {
+        samples[i] = 0;
+    }
+}
+
+/**
+ * @brief Records a sample of the program counter.
+ * @param[in] pc The sampled PC.
+ */
+static void bbzvm_sample_at(bbzpc_t pc) {
+    vm->sample_countdown = vm->sample_period;
+    uint16_t i = pc >> vm->sample_shift;
+    if (i < vm->nsamples && vm->samples[i] != UINT16_MAX) ++vm->samples[i];
+}
+
+void bbzvm_sample() {
+    bbzvm_sample_at(vm->pc);
+}
+
+/*
+ * PC histogram dumps. All values are little-endian. A dump holds
+ * BBZVM_SAMPLES_MAGIC, the log2 of the number of bytecode bytes per
+ * bucket, the number of buckets, then the buckets as 16-bit values.
+ */
+#define BBZVM_SAMPLES_MAGIC 0xB15A
+
+uint16_t bbzvm_samples_dump(uint8_t* buf, uint16_t cap) {
+    uint8_t* p = buf;
+    const uint8_t* end = buf + cap;
+    bbzvm_image_put(&p, end, BBZVM_SAMPLES_MAGIC, 2);
+    bbzvm_image_put(&p, end, vm->sample_shift, 1);
+    bbzvm_image_put(&p, end, vm->nsamples, 2);
+    for (uint16_t i = 0; i < vm->nsamples; ++i) {
+        bbzvm_image_put(&p, end, vm->samples[i], 2);
+    }
+    if (p > end) return 0;
+    return (uint16_t)(p - buf);
+}
+#endif // BBZ_PC_SAMPLING
+
+/****************************************/
+/****************************************/
+
+/*
+ * With GCC and Clang, instructions are dispatched through a table of label
+ * addresses (threaded code): each instruction jumps directly to the next
+ * one, which the branch predictor handles much better than the single
+ * indirect jump of a switch. Other compilers use the switch.
+ */
+#if !defined(BBZ_DISABLE_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define BBZVM_THREADED_DISPATCH
+#endif
+
 #define assert_pc(IDX) if((IDX) > vm->bcode_size) { bbzvm_seterror(BBZVM_ERROR_PC); return; }
 
-#define inc_pc() assert_pc(vm->pc); ++vm->pc;
+/*
+ * Checks made by the interpreter itself, rather than by the functions it
+ * calls, which C code may call too. Verified bytecode only jumps to
+ * instructions, ends every path with DONE, a return or a jump, and finds
+ * its operands on the stack: with BBZ_UNCHECKED, which only runs verified
+ * bytecode, these checks are dropped.
+ */
+#ifndef BBZ_UNCHECKED
+#define exec_assert_pc(IDX) if((IDX) > vm->bcode_size) { bbzvm_seterror(BBZVM_ERROR_PC); goto stop; }
+
+#define exec_assert_stack(SIZE) if(bbzvm_stack_size() < (SIZE)) { bbzvm_seterror(BBZVM_ERROR_STACK); goto stop; }
+#else
+#define exec_assert_pc(IDX)
+
+#define exec_assert_stack(SIZE)
+#endif // !BBZ_UNCHECKED
 
-#define get_arg(TYPE) assert_pc(vm->pc + sizeof(TYPE)); TYPE arg; {TYPE* parg = ((TYPE*)vm->bcode_fetch_fun(vm->pc, sizeof(TYPE))); bbzvm_assign(&arg, parg);} vm->pc += sizeof(TYPE);
+#define inc_pc() exec_assert_pc(vm->pc); ++vm->pc;
+
+#define get_arg(TYPE) exec_assert_pc(vm->pc + sizeof(TYPE)); TYPE arg; {const TYPE* parg = ((const TYPE*)bcode_at(vm->pc, sizeof(TYPE))); bbzvm_assign(&arg, parg);} vm->pc += sizeof(TYPE);
+
+#define get_regs(N) exec_assert_pc(vm->pc + (N)); uint8_t regs[N]; for (uint8_t r_ = 0; r_ < (N); ++r_) regs[r_] = *bcode_at(vm->pc + r_, sizeof(uint8_t)); vm->pc += (N);
+
+#ifdef DEBUG
+#define fetch_instr_dbg() vm->dbg_pc = vm->pc; vm->instr = (bbzvm_instr)instr;
+#else
+#define fetch_instr_dbg()
+#endif
+
+#ifdef BBZ_PROFILE
+#define profile_instr_begin() instrStart = vm->clock_fun();
+#define profile_instr_end() bbzvm_profile_add(instr, instrStart);
+#else
+#define profile_instr_begin()
+#define profile_instr_end()
+#endif // BBZ_PROFILE
+
+#ifdef BBZ_PC_SAMPLING
+#define sample_instr() if (vm->sample_period && !--vm->sample_countdown) bbzvm_sample_at(instrOffset);
+#else
+#define sample_instr()
+#endif // BBZ_PC_SAMPLING
+
+/*
+ * Reads the next instruction, collecting garbage beforehand if needed.
+ */
+#define fetch_instr()                                   \
+    if (bbzheap_gc_isdue()) bbzvm_gc();                 \
+    profile_instr_begin()                               \
+    instrOffset = vm->pc;                               \
+    instr = *bcode_at(vm->pc, 1);                       \
+    fetch_instr_dbg()                                   \
+    if (instr != BBZVM_INSTR_DONE) { inc_pc(); }
+
+#ifdef BBZVM_THREADED_DISPATCH
+#define instr_case(INSTR) do_##INSTR
+#ifndef BBZ_UNCHECKED
+#define dispatch_instr() if (instr >= BBZVM_INSTR_COUNT) goto invalid; goto *instr_labels[instr];
+#else
+#define dispatch_instr() goto *instr_labels[instr];
+#endif // !BBZ_UNCHECKED
+#else
+#define instr_case(INSTR) case BBZVM_INSTR_##INSTR
+#define dispatch_instr() continue;
+#endif
+
+/*
+ * Ends an instruction and, unless we should stop, executes the next one.
+ */
+#define next_instr()                                                \
+    profile_instr_end()                                             \
+    sample_instr()                                                  \
+    if (vm->state != BBZVM_STATE_READY) goto stop;                  \
+    if (!--budget || vm->blockptr <= blockptr) return;              \
+    fetch_instr();                                                  \
+    dispatch_instr();
 
 void bbzvm_gc() {
+#ifdef BBZ_PROFILE
+    uint32_t start = vm->clock_fun();
+#endif // BBZ_PROFILE
     bbzheap_gc(vm->stack, (uint16_t)bbzvm_stack_size());
+#ifdef BBZ_PROFILE
+    bbzvm_profile_add(BBZVM_PROFILE_GC, start);
+#endif // BBZ_PROFILE
 }
 
+/*
+ * Quickening: in bytecode set with bbzvm_set_bcode_rw(), generic arithmetic
+ * and comparison instructions rewrite themselves into variants specialized
+ * for the type of their operands. These variants check the type of their
+ * operands, and rewrite themselves back into the generic instruction if
+ * the check fails.
+ */
+#ifndef BBZ_DISABLE_QUICKENING
 /**
- * @brief Executes a single Buzz instruction.
+ * @brief Reads the two integer operands at the top of the stack.
+ * @param[out] lhs The left-hand side (stack #1).
+ * @param[out] rhs The right-hand side (stack #0).
+ * @return 1 if both operands are integers, 0 otherwise.
  */
-//ALWAYS_INLINE
-static void bbzvm_exec_instr() {
-    bbzpc_t instrOffset = vm->pc; // Save PC in case of error or DONE.
+static uint8_t bbzvm_quick_ints(int16_t* lhs, int16_t* rhs) {
+#ifndef BBZ_UNCHECKED
+    if (vm->stackptr < 1) return 0;
+#endif // !BBZ_UNCHECKED
+    bbzheap_idx_t l = vm->stack[vm->stackptr - 1];
+    bbzheap_idx_t r = vm->stack[vm->stackptr];
+    if (bbzheap_idx_isimmint(l) && bbzheap_idx_isimmint(r)) {
+        *lhs = bbzheap_idx_toint(l);
+        *rhs = bbzheap_idx_toint(r);
+        return 1;
+    }
+    bbzobj_t* lo = bbzheap_obj_at(l);
+    bbzobj_t* ro = bbzheap_obj_at(r);
+    if (!bbztype_isint(*lo) || !bbztype_isint(*ro)) return 0;
+    *lhs = lo->i.value;
+    *rhs = ro->i.value;
+    return 1;
+}
 
-    uint8_t instr = *(*vm->bcode_fetch_fun)(vm->pc, 1);
-#ifdef DEBUG
-    vm->dbg_pc = vm->pc;
-    vm->instr = (bbzvm_instr)instr;
+/**
+ * @brief Reads the two float operands at the top of the stack.
+ * @param[out] lhs The left-hand side (stack #1).
+ * @param[out] rhs The right-hand side (stack #0).
+ * @return 1 if both operands are floats, 0 otherwise (or if float
+ * operations are disabled).
+ */
+static uint8_t bbzvm_quick_floats(float* lhs, float* rhs) {
+#ifdef BBZ_ENABLE_FLOAT_OPERATIONS
+#ifndef BBZ_UNCHECKED
+    if (vm->stackptr < 1) return 0;
+#endif // !BBZ_UNCHECKED
+    bbzobj_t* lo = bbzheap_obj_at(vm->stack[vm->stackptr - 1]);
+    bbzobj_t* ro = bbzheap_obj_at(vm->stack[vm->stackptr]);
+    if (!bbztype_isfloat(*lo) || !bbztype_isfloat(*ro)) return 0;
+    *lhs = bbzfloat_tofloat(lo->f.value);
+    *rhs = bbzfloat_tofloat(ro->f.value);
+    return 1;
+#else
+    RM_UNUSED_WARN(lhs);
+    RM_UNUSED_WARN(rhs);
+    return 0;
+#endif // BBZ_ENABLE_FLOAT_OPERATIONS
+}
+
+/*
+ * Rewrites the current instruction into II or FF if its operands are
+ * two integers or two floats (BBZVM_INSTR_NOP: no such variant).
+ */
+#define quicken(II, FF)                                                 \
+    if (vm->bcode_rw) {                                                 \
+        int16_t qi_, qj_; float qf_, qg_;                               \
+        if ((II) != BBZVM_INSTR_NOP && bbzvm_quick_ints(&qi_, &qj_))    \
+            vm->bcode_rw[instrOffset] = (II);                           \
+        else if ((FF) != BBZVM_INSTR_NOP && bbzvm_quick_floats(&qf_, &qg_)) \
+            vm->bcode_rw[instrOffset] = (FF);                           \
+    }
+
+/*
+ * Rewrites the current (quickened) instruction back into INSTR.
+ */
+#define deopt(INSTR) if (vm->bcode_rw) vm->bcode_rw[instrOffset] = BBZVM_INSTR_##INSTR;
+
+/*
+ * Body of a quickened arithmetic instruction on two integers. Falls back to
+ * GENERIC, the generic instruction INSTR, for other operands.
+ */
+#define quick_ii(INSTR, GENERIC, EXPR)                                  \
+    int16_t lhs, rhs;                                                   \
+    if (bbzvm_quick_ints(&lhs, &rhs)) {                                 \
+        --vm->stackptr;                                                 \
+        vm->stack[vm->stackptr] = bbzint_new((int16_t)(EXPR));          \
+    }                                                                   \
+    else {                                                              \
+        deopt(INSTR);                                                   \
+        GENERIC;                                                        \
+    }
+
+/*
+ * Body of a quickened arithmetic instruction on two floats.
+ */
+#define quick_ff(INSTR, GENERIC, EXPR)                                  \
+    float lhs, rhs;                                                     \
+    if (bbzvm_quick_floats(&lhs, &rhs)) {                               \
+        --vm->stackptr;                                                 \
+        vm->stack[vm->stackptr] = bbzfloat_new(bbzfloat_fromfloat(EXPR)); \
+    }                                                                   \
+    else {                                                              \
+        deopt(INSTR);                                                   \
+        GENERIC;                                                        \
+    }
+
+/*
+ * Body of a quickened comparison and conditional jump on two integers.
+ */
+#define quick_cmpj_ii(INSTR, GENERIC, EXPR)                             \
+    get_arg(uint16_t);                                                  \
+    int16_t lhs, rhs;                                                   \
+    if (bbzvm_quick_ints(&lhs, &rhs)) {                                 \
+        vm->stackptr -= 2;                                              \
+        if (!(EXPR)) {                                                  \
+            vm->pc = arg;                                               \
+            exec_assert_pc(vm->pc);                                     \
+        }                                                               \
+    }                                                                   \
+    else {                                                              \
+        deopt(INSTR);                                                   \
+        GENERIC;                                                        \
+    }
+
+#else
+#define quicken(II, FF)
+#endif // !BBZ_DISABLE_QUICKENING
+
+void bbzvm_ret(uint8_t hasval) {
+    /* Make sure there is a call frame, and a return value if needed */
+    int16_t frame = vm->localptr - 3;
+    bbzvm_assert_exec(frame >= 0 && vm->blockptr >= vm->localptr &&
+                      (!hasval || vm->stackptr > vm->blockptr), BBZVM_ERROR_STACK);
+    bbzheap_idx_t ret = hasval ? vm->stack[vm->stackptr] : vm->nil;
+    vm->pc       = (bbzpc_t)vm->stack[frame];
+    vm->localptr = (int16_t)vm->stack[frame + 1];
+    vm->blockptr = (int16_t)vm->stack[frame + 2];
+    /* The return value replaces the frame */
+    vm->stack[frame] = ret;
+    vm->stackptr = frame;
+}
+
+/**
+ * @brief Executes Buzz instructions.
+ * @details Should there be an error, or in the case of
+ * BBZVM_INSTR_DONE, the program counter stays on the instruction that
+ * caused it.
+ * @param[in] blockptr Execution stops as soon as the VM's block pointer
+ * is lower than or equal to this value, i.e., when the closure call
+ * that was made with this block pointer returned.
+ * @param[in] budget The maximum number of instructions to execute, or 0
+ * for 65536 of them.
+ */
+static void bbzvm_exec(int16_t blockptr, uint16_t budget) {
+    bbzpc_t instrOffset; // Saved PC in case of error or DONE.
+    uint8_t instr;
+#ifdef BBZ_PROFILE
+    uint32_t instrStart; // Time the instruction started at.
+#endif // BBZ_PROFILE
+#ifdef BBZVM_THREADED_DISPATCH
+    static const void* const instr_labels[BBZVM_INSTR_COUNT] = {
+        &&do_NOP,   &&do_DONE,  &&do_PUSHNIL, &&do_DUP,    &&do_POP,
+        &&do_RET0,  &&do_RET1,  &&do_ADD,     &&do_SUB,    &&do_MUL,
+        &&do_DIV,   &&do_MOD,   &&do_POW,     &&do_UNM,    &&do_LAND,
+        &&do_LOR,   &&do_LNOT,  &&do_BAND,    &&do_BOR,    &&do_BNOT,
+        &&invalid,  &&invalid,  &&do_EQ,      &&do_NEQ,    &&do_GT,
+        &&do_GTE,   &&do_LT,    &&do_LTE,     &&do_GLOAD,  &&do_GSTORE,
+        &&do_PUSHT, &&do_TPUT,  &&do_TGET,    &&do_CALLC,  &&do_CALLS,
+        &&do_PUSHF, &&do_PUSHI, &&do_PUSHS,   &&do_PUSHCN, &&do_PUSHCC,
+        &&do_PUSHL, &&do_LLOAD, &&do_LSTORE,  &&do_LREMOVE,&&do_JUMP,
+        &&do_JUMPZ, &&do_JUMPNZ,&&do_GLOADS,  &&do_TGETS,  &&do_LLOAD2,
+        &&do_INCL,  &&do_CMPJEQ,&&do_CMPJNEQ, &&do_CMPJGT, &&do_CMPJGTE,
+        &&do_CMPJLT,&&do_CMPJLTE,
+#ifndef BBZ_DISABLE_QUICKENING
+        &&do_ADDII, &&do_SUBII, &&do_MULII,   &&do_ADDFF,  &&do_SUBFF,
+        &&do_MULFF, &&do_DIVFF, &&do_EQII,    &&do_NEQII,  &&do_GTII,
+        &&do_GTEII, &&do_LTII,  &&do_LTEII,   &&do_CMPJEQII, &&do_CMPJNEQII,
+        &&do_CMPJGTII, &&do_CMPJGTEII, &&do_CMPJLTII, &&do_CMPJLTEII,
+#else
+        &&invalid,  &&invalid,  &&invalid,    &&invalid,   &&invalid,
+        &&invalid,  &&invalid,  &&invalid,    &&invalid,   &&invalid,
+        &&invalid,  &&invalid,  &&invalid,    &&invalid,   &&invalid,
+        &&invalid,  &&invalid,  &&invalid,    &&invalid,
+#endif // !BBZ_DISABLE_QUICKENING
+        &&do_TCALLC,
+        &&do_PUSHI8, &&do_PUSHS8, &&do_LLOAD8, &&do_LSTORE8, &&do_JUMP8,
+        &&do_JUMPZ8, &&do_JUMPNZ8,
+#ifdef BBZ_REGISTER_BCODE
+        &&do_RMOV,  &&do_RSETI, &&do_RADD,    &&do_RSUB,   &&do_RMUL,
+        &&do_RADDI, &&do_RGETF
+#else
+        &&invalid,  &&invalid,  &&invalid,    &&invalid,   &&invalid,
+        &&invalid,  &&invalid
+#endif // BBZ_REGISTER_BCODE
+    };
 #endif
-    if (instr != BBZVM_INSTR_DONE) inc_pc();
+
+#ifdef BBZ_ENABLE_AOT
+    if (vm->aot_fun) {
+        vm->aot_fun(blockptr, budget);
+        return;
+    }
+#endif // BBZ_ENABLE_AOT
+    if (vm->state != BBZVM_STATE_READY) return;
+    fetch_instr();
+#ifdef BBZVM_THREADED_DISPATCH
+    dispatch_instr();
+#else
+    for (;;) {
     switch(instr) {
-        case BBZVM_INSTR_NOP: {
-            break;
+#endif
+        instr_case(NOP): {
+            next_instr();
         }
-        case BBZVM_INSTR_DONE: {
+        instr_case(DONE): {
             bbzvm_done();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHNIL: {
+        instr_case(PUSHNIL): {
             bbzvm_pushnil();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_DUP: {
+        instr_case(DUP): {
             bbzvm_dup();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_POP: {
-            bbzvm_pop();
-            break;
+        instr_case(POP): {
+            exec_assert_stack(1);
+            --vm->stackptr;
+            next_instr();
         }
-        case BBZVM_INSTR_RET0: {
-            bbzvm_ret0();
+        instr_case(RET0): {
+            bbzvm_ret(0);
             if (vm->state == BBZVM_STATE_READY) {
-                assert_pc(vm->pc);
+                exec_assert_pc(vm->pc);
             }
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_RET1: {
-            bbzvm_ret1();
+        instr_case(RET1): {
+            bbzvm_ret(1);
             if (vm->state == BBZVM_STATE_READY) {
-                assert_pc(vm->pc);
+                exec_assert_pc(vm->pc);
             }
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_ADD: {
+        instr_case(ADD): {
+            quicken(BBZVM_INSTR_ADDII, BBZVM_INSTR_ADDFF);
             bbzvm_add();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_SUB: {
+        instr_case(SUB): {
+            quicken(BBZVM_INSTR_SUBII, BBZVM_INSTR_SUBFF);
             bbzvm_sub();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_MUL: {
+        instr_case(MUL): {
+            quicken(BBZVM_INSTR_MULII, BBZVM_INSTR_MULFF);
             bbzvm_mul();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_DIV: {
+        instr_case(DIV): {
+            quicken(BBZVM_INSTR_NOP, BBZVM_INSTR_DIVFF);
             bbzvm_div();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_MOD: {
+        instr_case(MOD): {
             bbzvm_mod();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_POW: {
+        instr_case(POW): {
             bbzvm_pow();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_UNM: {
+        instr_case(UNM): {
             bbzvm_unm();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_LAND: {
-	    bbzvm_land();
-            break;
+        instr_case(LAND): {
+            bbzvm_land();
+            next_instr();
         }
-        case BBZVM_INSTR_LOR: {
+        instr_case(LOR): {
             bbzvm_lor();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_LNOT: {
+        instr_case(LNOT): {
             bbzvm_lnot();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_BAND: {
+        instr_case(BAND): {
             bbzvm_band();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_BOR: {
+        instr_case(BOR): {
             bbzvm_bor();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_BNOT: {
+        instr_case(BNOT): {
             bbzvm_bnot();
-            break;
+            next_instr();
         }
-	  /*    case BBZVM_INSTR_LSHIFT: {
+	  /*    instr_case(LSHIFT): {
             bbzvm_lshift();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_RSHIFT: {
+        instr_case(RSHIFT): {
             bbzvm_rshift();
-            break;
+            next_instr();
 	    }  */
-        case BBZVM_INSTR_EQ: {
+        instr_case(EQ): {
+            quicken(BBZVM_INSTR_EQII, BBZVM_INSTR_NOP);
             bbzvm_eq();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_NEQ: {
+        instr_case(NEQ): {
+            quicken(BBZVM_INSTR_NEQII, BBZVM_INSTR_NOP);
             bbzvm_neq();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_GT: {
+        instr_case(GT): {
+            quicken(BBZVM_INSTR_GTII, BBZVM_INSTR_NOP);
             bbzvm_gt();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_GTE: {
+        instr_case(GTE): {
+            quicken(BBZVM_INSTR_GTEII, BBZVM_INSTR_NOP);
             bbzvm_gte();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_LT: {
+        instr_case(LT): {
+            quicken(BBZVM_INSTR_LTII, BBZVM_INSTR_NOP);
             bbzvm_lt();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_LTE: {
+        instr_case(LTE): {
+            quicken(BBZVM_INSTR_LTEII, BBZVM_INSTR_NOP);
             bbzvm_lte();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_GLOAD: {
+        instr_case(GLOAD): {
             bbzvm_gload();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_GSTORE: {
+        instr_case(GSTORE): {
             bbzvm_gstore();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHT: {
+        instr_case(PUSHT): {
             bbzvm_pusht();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_TPUT: {
+        instr_case(TPUT): {
             bbzvm_tput();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_TGET: {
+        instr_case(TGET): {
             bbzvm_tget();
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_CALLC: {
+        instr_case(CALLC): {
             bbzvm_callc();
             if (vm->state == BBZVM_STATE_READY) {
-                assert_pc(vm->pc);
+                exec_assert_pc(vm->pc);
+            }
+            next_instr();
+        }
+        instr_case(TCALLC): {
+            bbzvm_tcallc();
+            if (vm->state == BBZVM_STATE_READY) {
+                exec_assert_pc(vm->pc);
             }
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_CALLS: { // For compatibility only
-            break;
+        instr_case(CALLS): { // For compatibility only
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHF: {
+        instr_case(PUSHF): {
             get_arg(bbzfloat);
             bbzvm_pushf(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHI: {
+        instr_case(PUSHI): {
             get_arg(int16_t);
             bbzvm_pushi(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHS: {
+        instr_case(PUSHS): {
             get_arg(uint16_t);
             bbzvm_pushs(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHCN: {
+        instr_case(PUSHCN): {
             get_arg(uint16_t);
             bbzvm_pushcn(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHCC: { // _FIXME I don't think that a buzz script should/would ever use this instruction... Neither is it used in the buzz parser.
+        instr_case(PUSHCC): { // _FIXME I don't think that a buzz script should/would ever use this instruction... Neither is it used in the buzz parser.
             get_arg(int16_t);
             bbzvm_pushcc((bbzvm_funp)(intptr_t)arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_PUSHL: {
+        instr_case(PUSHL): {
             get_arg(uint16_t);
             bbzvm_pushl(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_LLOAD: {
+        instr_case(LLOAD): {
             get_arg(uint16_t);
             bbzvm_lload(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_LSTORE: {
+        instr_case(LSTORE): {
             get_arg(uint16_t);
             bbzvm_lstore(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_LREMOVE: {
+        instr_case(LREMOVE): {
             get_arg(uint16_t);
             bbzvm_lremove(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_JUMP: {
+        instr_case(JUMP): {
             get_arg(uint16_t);
             bbzvm_jump(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_JUMPZ: {
+        instr_case(JUMPZ): {
             get_arg(uint16_t);
             bbzvm_jumpz(arg);
-            break;
+            next_instr();
         }
-        case BBZVM_INSTR_JUMPNZ: {
+        instr_case(JUMPNZ): {
             get_arg(uint16_t);
             bbzvm_jumpnz(arg);
-            break;
+            next_instr();
+        }
+        instr_case(PUSHI8): {
+            get_arg(int8_t);
+            bbzvm_pushi(arg);
+            next_instr();
+        }
+        instr_case(PUSHS8): {
+            get_arg(uint8_t);
+            bbzvm_pushs(arg);
+            next_instr();
+        }
+        instr_case(LLOAD8): {
+            get_arg(uint8_t);
+            bbzvm_lload(arg);
+            next_instr();
+        }
+        instr_case(LSTORE8): {
+            get_arg(uint8_t);
+            bbzvm_lstore(arg);
+            next_instr();
+        }
+        instr_case(JUMP8): {
+            get_arg(int8_t);
+            bbzvm_jump((uint16_t)(vm->pc + arg));
+            next_instr();
+        }
+        instr_case(JUMPZ8): {
+            get_arg(int8_t);
+            bbzvm_jumpz((uint16_t)(vm->pc + arg));
+            next_instr();
+        }
+        instr_case(JUMPNZ8): {
+            get_arg(int8_t);
+            bbzvm_jumpnz((uint16_t)(vm->pc + arg));
+            next_instr();
+        }
+#ifdef BBZ_REGISTER_BCODE
+        instr_case(RMOV): {
+            get_regs(2);
+            bbzvm_rmov(regs[0], regs[1]);
+            next_instr();
+        }
+        instr_case(RSETI): {
+            get_regs(2);
+            bbzvm_rseti(regs[0], (int8_t)regs[1]);
+            next_instr();
+        }
+        instr_case(RADD): {
+            get_regs(3);
+            bbzvm_radd(regs[0], regs[1], regs[2]);
+            next_instr();
+        }
+        instr_case(RSUB): {
+            get_regs(3);
+            bbzvm_rsub(regs[0], regs[1], regs[2]);
+            next_instr();
+        }
+        instr_case(RMUL): {
+            get_regs(3);
+            bbzvm_rmul(regs[0], regs[1], regs[2]);
+            next_instr();
+        }
+        instr_case(RADDI): {
+            get_regs(3);
+            bbzvm_raddi(regs[0], regs[1], (int8_t)regs[2]);
+            next_instr();
+        }
+        instr_case(RGETF): {
+            get_regs(3);
+            bbzvm_rgetf(regs[0], regs[1], regs[2]);
+            next_instr();
+        }
+#endif // BBZ_REGISTER_BCODE
+        instr_case(GLOADS): {
+            get_arg(uint16_t);
+            bbzvm_gloads(arg);
+            next_instr();
+        }
+        instr_case(TGETS): {
+            get_arg(uint16_t);
+            bbzvm_tgets(arg);
+            next_instr();
+        }
+        instr_case(LLOAD2): {
+            get_arg(uint16_t);
+            bbzvm_lload2(arg);
+            next_instr();
+        }
+        instr_case(INCL): {
+            get_arg(uint16_t);
+            bbzvm_incl(arg);
+            next_instr();
+        }
+        instr_case(CMPJEQ): {
+            quicken(BBZVM_INSTR_CMPJEQII, BBZVM_INSTR_NOP);
+            get_arg(uint16_t);
+            bbzvm_cmpjeq(arg);
+            next_instr();
+        }
+        instr_case(CMPJNEQ): {
+            quicken(BBZVM_INSTR_CMPJNEQII, BBZVM_INSTR_NOP);
+            get_arg(uint16_t);
+            bbzvm_cmpjneq(arg);
+            next_instr();
+        }
+        instr_case(CMPJGT): {
+            quicken(BBZVM_INSTR_CMPJGTII, BBZVM_INSTR_NOP);
+            get_arg(uint16_t);
+            bbzvm_cmpjgt(arg);
+            next_instr();
+        }
+        instr_case(CMPJGTE): {
+            quicken(BBZVM_INSTR_CMPJGTEII, BBZVM_INSTR_NOP);
+            get_arg(uint16_t);
+            bbzvm_cmpjgte(arg);
+            next_instr();
+        }
+        instr_case(CMPJLT): {
+            quicken(BBZVM_INSTR_CMPJLTII, BBZVM_INSTR_NOP);
+            get_arg(uint16_t);
+            bbzvm_cmpjlt(arg);
+            next_instr();
+        }
+        instr_case(CMPJLTE): {
+            quicken(BBZVM_INSTR_CMPJLTEII, BBZVM_INSTR_NOP);
+            get_arg(uint16_t);
+            bbzvm_cmpjlte(arg);
+            next_instr();
         }
+#ifndef BBZ_DISABLE_QUICKENING
+        instr_case(ADDII): {
+            quick_ii(ADD, bbzvm_add(), lhs + rhs);
+            next_instr();
+        }
+        instr_case(SUBII): {
+            quick_ii(SUB, bbzvm_sub(), lhs - rhs);
+            next_instr();
+        }
+        instr_case(MULII): {
+            quick_ii(MUL, bbzvm_mul(), lhs * rhs);
+            next_instr();
+        }
+        instr_case(ADDFF): {
+            quick_ff(ADD, bbzvm_add(), lhs + rhs);
+            next_instr();
+        }
+        instr_case(SUBFF): {
+            quick_ff(SUB, bbzvm_sub(), lhs - rhs);
+            next_instr();
+        }
+        instr_case(MULFF): {
+            quick_ff(MUL, bbzvm_mul(), lhs * rhs);
+            next_instr();
+        }
+        instr_case(DIVFF): {
+            quick_ff(DIV, bbzvm_div(), lhs / rhs);
+            next_instr();
+        }
+        instr_case(EQII): {
+            quick_ii(EQ, bbzvm_eq(), lhs == rhs);
+            next_instr();
+        }
+        instr_case(NEQII): {
+            quick_ii(NEQ, bbzvm_neq(), lhs != rhs);
+            next_instr();
+        }
+        instr_case(GTII): {
+            quick_ii(GT, bbzvm_gt(), lhs > rhs);
+            next_instr();
+        }
+        instr_case(GTEII): {
+            quick_ii(GTE, bbzvm_gte(), lhs >= rhs);
+            next_instr();
+        }
+        instr_case(LTII): {
+            quick_ii(LT, bbzvm_lt(), lhs < rhs);
+            next_instr();
+        }
+        instr_case(LTEII): {
+            quick_ii(LTE, bbzvm_lte(), lhs <= rhs);
+            next_instr();
+        }
+        instr_case(CMPJEQII): {
+            quick_cmpj_ii(CMPJEQ, bbzvm_cmpjeq(arg), lhs == rhs);
+            next_instr();
+        }
+        instr_case(CMPJNEQII): {
+            quick_cmpj_ii(CMPJNEQ, bbzvm_cmpjneq(arg), lhs != rhs);
+            next_instr();
+        }
+        instr_case(CMPJGTII): {
+            quick_cmpj_ii(CMPJGT, bbzvm_cmpjgt(arg), lhs > rhs);
+            next_instr();
+        }
+        instr_case(CMPJGTEII): {
+            quick_cmpj_ii(CMPJGTE, bbzvm_cmpjgte(arg), lhs >= rhs);
+            next_instr();
+        }
+        instr_case(CMPJLTII): {
+            quick_cmpj_ii(CMPJLT, bbzvm_cmpjlt(arg), lhs < rhs);
+            next_instr();
+        }
+        instr_case(CMPJLTEII): {
+            quick_cmpj_ii(CMPJLTE, bbzvm_cmpjlte(arg), lhs <= rhs);
+            next_instr();
+        }
+#endif // !BBZ_DISABLE_QUICKENING
+#ifndef BBZVM_THREADED_DISPATCH
         default:
-            bbzvm_seterror(BBZVM_ERROR_INSTR);
-            break;
+            goto invalid;
     }
-
-    if (vm->state != BBZVM_STATE_READY) {
-        // Stay on the instruction that caused the error,
-        // or, in the case of BBZVM_INSTR_DONE, loop on it.
-        vm->pc = instrOffset;
     }
+#endif
+
+invalid:
+    bbzvm_seterror(BBZVM_ERROR_INSTR);
+stop:
+    // Stay on the instruction that caused the error,
+    // or, in the case of BBZVM_INSTR_DONE, loop on it.
+    vm->pc = instrOffset;
 }
 
 void bbzvm_step() {
-    if(vm->state == BBZVM_STATE_READY) {
-        bbzvm_gc();
-        bbzvm_exec_instr();
-    }
+    bbzvm_exec(0, 1);
 }
 
 /****************************************/
@@ -782,151 +1954,445 @@ void bbzvm_bnot() {
 typedef uint8_t (*binary_op_cmp)(int8_t cmp);
 
 /**
- * @brief Performs an arithmetic binary operation.
- * @details Pops both operand, and pushes the result.
- * @param[in] op The operation to perform.
+ * @brief Performs an arithmetic binary operation.
+ * @details Pops both operand, and pushes the result.
+ * @param[in] op The operation to perform.
+ */
+static void bbzvm_binary_op_cmp(binary_op_cmp op) {
+    bbzvm_assert_stack(2);
+    bbzheap_idx_t rhs = bbzvm_stack_at(0);
+    bbzheap_idx_t lhs = bbzvm_stack_at(1);
+    bbzvm_pop();
+    bbzvm_pop();
+
+    bbzvm_pushi((*op)(bbzheap_idx_cmp(lhs, rhs)));
+}
+
+static uint8_t bbzeq (int8_t cmp) { return (uint8_t) (cmp == 0); }
+static uint8_t bbzneq(int8_t cmp) { return (uint8_t) (cmp != 0); }
+static uint8_t bbzgt (int8_t cmp) { return (uint8_t) (cmp >  0); }
+static uint8_t bbzgte(int8_t cmp) { return (uint8_t) (cmp >= 0); }
+static uint8_t bbzlt (int8_t cmp) { return (uint8_t) (cmp <  0); }
+static uint8_t bbzlte(int8_t cmp) { return (uint8_t) (cmp <= 0); }
+
+/****************************************/
+/****************************************/
+
+void bbzvm_eq() {
+    return bbzvm_binary_op_cmp(&bbzeq);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_neq() {
+    return bbzvm_binary_op_cmp(&bbzneq);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_gt() {
+    return bbzvm_binary_op_cmp(&bbzgt);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_gte() {
+    return bbzvm_binary_op_cmp(&bbzgte);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_lt() {
+    return bbzvm_binary_op_cmp(&bbzlt);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_lte() {
+    return bbzvm_binary_op_cmp(&bbzlte);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_pusht() {
+    bbzvm_push(bbztable_new());
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_lload(uint16_t idx) {
+    bbzvm_assert_exec(idx < bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    return bbzvm_push(bbzvm_locals_at(idx));
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_lstore(uint16_t idx) {
+    bbzvm_assert_stack(1);
+    bbzheap_idx_t o = bbzvm_stack_at(0);
+    bbzvm_pop();
+    uint16_t size = bbzvm_lsyms_size();
+    if (idx >= size) {
+        // New local symbols go between the frame's others and the stack.
+        uint16_t n = idx + 1 - size;
+        bbzvm_assert_exec(vm->stackptr + n < BBZSTACK_SIZE, BBZVM_ERROR_STACK);
+        for (int16_t i = vm->stackptr; i > vm->blockptr; --i) {
+            vm->stack[i + n] = vm->stack[i];
+        }
+        for (uint16_t i = 1; i <= n; ++i) {
+            vm->stack[vm->blockptr + i] = vm->nil;
+        }
+        vm->blockptr += n;
+        vm->stackptr += n;
+    }
+    bbzvm_locals_at(idx) = o;
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_lremove(uint16_t num) {
+    bbzvm_assert_exec(num <= bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    for (int16_t i = vm->blockptr + 1; i <= vm->stackptr; ++i) {
+        vm->stack[i - num] = vm->stack[i];
+    }
+    vm->blockptr -= num;
+    vm->stackptr -= num;
+}
+
+
+/****************************************/
+/****************************************/
+
+void bbzvm_jump(uint16_t offset) {
+    vm->pc = offset;
+    assert_pc(vm->pc);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_jumpz(uint16_t offset) {
+    bbzvm_assert_stack(1);
+    bbzobj_t* o = bbzheap_obj_at(bbzvm_stack_at(0));
+
+    switch(bbztype(*o)) {
+        case BBZTYPE_NIL: // fallthrough
+        case BBZTYPE_INT: if (o->i.value == 0) vm->pc = offset; assert_pc(vm->pc); break;
+        default: bbzvm_seterror(BBZVM_ERROR_TYPE); return;
+    }
+    assert_pc(vm->pc);
+    return bbzvm_pop();
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_jumpnz(uint16_t offset) {
+    bbzvm_assert_stack(1);
+    bbzobj_t* o = bbzheap_obj_at(bbzvm_stack_at(0));
+
+    switch(bbztype(*o)) {
+        case BBZTYPE_NIL: // fallthrough
+        case BBZTYPE_INT: if (o->i.value != 0) vm->pc = offset; assert_pc(vm->pc); break;
+        default: bbzvm_seterror(BBZVM_ERROR_TYPE); return;
+    }
+    return bbzvm_pop();
+}
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Looks up a string key in a table, through the inline cache of the
+ * current instruction if there is one.
+ * @param[in] t The table.
+ * @param[in] strid The string ID of the key.
+ * @return The value, or nil if the key is not in the table.
+ */
+static bbzheap_idx_t bbzvm_table_gets(bbzheap_idx_t t, uint16_t strid) {
+    bbzheap_idx_t v = vm->nil;
+    uint8_t hops, slot;
+#if BBZVM_ICACHE_SIZE > 0
+#if BBZVM_ICACHE_SIZE & (BBZVM_ICACHE_SIZE - 1)
+#error "BBZVM_ICACHE_SIZE must be a power of two."
+#endif
+    // Each lookup instruction has its own entry (barring collisions). The
+    // entry is only a hint, so a stale one costs a lookup, not correctness.
+    bbzvm_icache_t* ic = vm->icache + (vm->pc & (BBZVM_ICACHE_SIZE - 1));
+    uint16_t tseg = bbzheap_obj_at(t)->t.value;
+    if (ic->tseg == tseg &&
+        bbztable_get_at(t, strid, ic->hops, ic->slot, &v)) {
+        return v;
+    }
+    if (bbztable_find_str(t, strid, &hops, &slot)) {
+        ic->tseg = tseg;
+        ic->hops = hops;
+        ic->slot = slot;
+        bbztable_get_at(t, strid, hops, slot, &v);
+    }
+#else
+    if (bbztable_find_str(t, strid, &hops, &slot)) {
+        bbztable_get_at(t, strid, hops, slot, &v);
+    }
+#endif // BBZVM_ICACHE_SIZE > 0
+    return v;
+}
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Gets the value of a global symbol.
+ * @param[in] strid The string ID of the symbol.
+ * @return The value, or nil if the symbol is not set.
  */
-static void bbzvm_binary_op_cmp(binary_op_cmp op) {
-    bbzvm_assert_stack(2);
-    bbzobj_t* rhs = bbzheap_obj_at(bbzvm_stack_at(0));
-    bbzobj_t* lhs = bbzheap_obj_at(bbzvm_stack_at(1));
-    bbzvm_pop();
-    bbzvm_pop();
-
-    bbzvm_pushi((*op)(bbztype_cmp(lhs, rhs)));
+static bbzheap_idx_t bbzvm_gsym_get(uint16_t strid) {
+#if BBZVM_GSYM_SLOTS > 0
+    if (strid < BBZVM_GSYM_SLOTS) return vm->gslots[strid];
+#endif // BBZVM_GSYM_SLOTS > 0
+    return bbzvm_table_gets(vm->gsyms, strid);
 }
 
-static uint8_t bbzeq (int8_t cmp) { return (uint8_t) (cmp == 0); }
-static uint8_t bbzneq(int8_t cmp) { return (uint8_t) (cmp != 0); }
-static uint8_t bbzgt (int8_t cmp) { return (uint8_t) (cmp >  0); }
-static uint8_t bbzgte(int8_t cmp) { return (uint8_t) (cmp >= 0); }
-static uint8_t bbzlt (int8_t cmp) { return (uint8_t) (cmp <  0); }
-static uint8_t bbzlte(int8_t cmp) { return (uint8_t) (cmp <= 0); }
-
 /****************************************/
 /****************************************/
 
-void bbzvm_eq() {
-    return bbzvm_binary_op_cmp(&bbzeq);
+void bbzvm_gloads(uint16_t strid) {
+    // Get and push the associated value
+    bbzvm_push(bbzvm_gsym_get(strid));
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_neq() {
-    return bbzvm_binary_op_cmp(&bbzneq);
+void bbzvm_tgets(uint16_t strid) {
+    bbzvm_assert_stack(1);
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+    bbzvm_assert_type(t, BBZTYPE_TABLE);
+
+    // Replace the table by the value
+    vm->stack[vm->stackptr] = bbzvm_table_gets(t, strid);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_gt() {
-    return bbzvm_binary_op_cmp(&bbzgt);
+void bbzvm_lload2(uint16_t idx) {
+    bbzvm_lload(idx & 0xFF);
+    bbzvm_assert_state();
+    bbzvm_lload(idx >> 8);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_gte() {
-    return bbzvm_binary_op_cmp(&bbzgte);
+void bbzvm_incl(uint16_t idx) {
+    bbzvm_assert_exec(idx < bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    bbzheap_idx_t x = bbzvm_locals_at(idx);
+    if (bbzheap_idx_isimmint(x) && bbzheap_idx_toint(x) < BBZHEAP_IMMINT_MAX) {
+        // Immediate integer: no need to go through the stack.
+        bbzvm_locals_at(idx) = bbzheap_idx_fromint(bbzheap_idx_toint(x) + 1);
+        return;
+    }
+    bbzvm_push(x);
+    bbzvm_pushi(1);
+    bbzvm_assert_state();
+    bbzvm_add();
+    bbzvm_assert_state();
+    bbzvm_lstore(idx);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_lt() {
-    return bbzvm_binary_op_cmp(&bbzlt);
+#ifdef BBZ_REGISTER_BCODE
+/**
+ * @brief Reads two integer operands of a register instruction.
+ * @param[in] dst The index of the local variable the result goes to.
+ * @param[in] l The left-hand side.
+ * @param[in] r The right-hand side.
+ * @param[out] lhs The value of the left-hand side.
+ * @param[out] rhs The value of the right-hand side.
+ * @return 1 if both operands are integers and the local variable exists,
+ * so that the result can be stored without going through the stack.
+ */
+static uint8_t bbzvm_reg_ints(uint8_t dst, bbzheap_idx_t l, bbzheap_idx_t r,
+                              int16_t* lhs, int16_t* rhs) {
+    if (dst >= bbzvm_lsyms_size()) return 0;
+    if (bbzheap_idx_isimmint(l) && bbzheap_idx_isimmint(r)) {
+        *lhs = bbzheap_idx_toint(l);
+        *rhs = bbzheap_idx_toint(r);
+        return 1;
+    }
+    bbzobj_t* lo = bbzheap_obj_at(l);
+    bbzobj_t* ro = bbzheap_obj_at(r);
+    if (!bbztype_isint(*lo) || !bbztype_isint(*ro)) return 0;
+    *lhs = lo->i.value;
+    *rhs = ro->i.value;
+    return 1;
+}
+
+/**
+ * @brief Performs a register instruction through the stack, for the
+ * operands bbzvm_reg_ints() does not handle.
+ * @param[in] dst The index of the local variable the result goes to.
+ * @param[in] l The left-hand side.
+ * @param[in] r The right-hand side.
+ * @param[in] op The stack instruction.
+ */
+static void bbzvm_reg_generic(uint8_t dst, bbzheap_idx_t l, bbzheap_idx_t r, void (*op)()) {
+    bbzvm_push(l);
+    bbzvm_push(r);
+    bbzvm_assert_state();
+    op();
+    bbzvm_assert_state();
+    bbzvm_lstore(dst);
+}
+
+/*
+ * Body of the three-address arithmetic instructions.
+ */
+#define bbzvm_reg_arith(DST, L, R, OP, GENERIC)                         \
+    int16_t lhs_, rhs_;                                                 \
+    if (bbzvm_reg_ints((DST), (L), (R), &lhs_, &rhs_)) {                \
+        bbzvm_locals_at(DST) = bbzint_new((int16_t)(lhs_ OP rhs_));     \
+        return;                                                         \
+    }                                                                   \
+    bbzvm_reg_generic((DST), (L), (R), (GENERIC));
+
+void bbzvm_rmov(uint8_t dst, uint8_t src) {
+    bbzvm_assert_exec(src < bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    if (dst < bbzvm_lsyms_size()) {
+        bbzvm_locals_at(dst) = bbzvm_locals_at(src);
+        return;
+    }
+    bbzvm_push(bbzvm_locals_at(src));
+    bbzvm_assert_state();
+    bbzvm_lstore(dst);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_lte() {
-    return bbzvm_binary_op_cmp(&bbzlte);
+void bbzvm_rseti(uint8_t dst, int8_t val) {
+    if (dst < bbzvm_lsyms_size()) {
+        bbzvm_locals_at(dst) = bbzheap_idx_fromint(val);
+        return;
+    }
+    bbzvm_pushi(val);
+    bbzvm_assert_state();
+    bbzvm_lstore(dst);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_pusht() {
-    bbzvm_push(bbztable_new());
+void bbzvm_radd(uint8_t dst, uint8_t lhs, uint8_t rhs) {
+    bbzvm_assert_exec(lhs < bbzvm_lsyms_size() && rhs < bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    bbzvm_reg_arith(dst, bbzvm_locals_at(lhs), bbzvm_locals_at(rhs), +, &bbzvm_add);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_lload(uint16_t idx) {
-    bbzheap_idx_t id = vm->nil;
-    bbzvm_assert_exec(bbzdarray_get(vm->lsyms, idx, &id), BBZVM_ERROR_LNUM);
-    return bbzvm_push(id);
+void bbzvm_rsub(uint8_t dst, uint8_t lhs, uint8_t rhs) {
+    bbzvm_assert_exec(lhs < bbzvm_lsyms_size() && rhs < bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    bbzvm_reg_arith(dst, bbzvm_locals_at(lhs), bbzvm_locals_at(rhs), -, &bbzvm_sub);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_lstore(uint16_t idx) {
-    bbzheap_idx_t o = bbzvm_stack_at(0);
-    uint16_t size = bbzdarray_size(vm->lsyms);
-    while (size++ <= idx) {
-        bbzvm_assert_exec(bbzdarray_push(vm->lsyms, vm->nil), BBZVM_ERROR_MEM);
-    }
-    bbzdarray_set(vm->lsyms, idx, o);
-    return bbzvm_pop();
+void bbzvm_rmul(uint8_t dst, uint8_t lhs, uint8_t rhs) {
+    bbzvm_assert_exec(lhs < bbzvm_lsyms_size() && rhs < bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    bbzvm_reg_arith(dst, bbzvm_locals_at(lhs), bbzvm_locals_at(rhs), *, &bbzvm_mul);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_lremove(uint16_t num) {
-    uint16_t i;
-    for( i = 0 ; i < num ; i++ )
-      bbzvm_assert_exec(bbzdarray_pop(vm->lsyms), BBZVM_ERROR_LNUM);
+void bbzvm_raddi(uint8_t dst, uint8_t lhs, int8_t val) {
+    bbzvm_assert_exec(lhs < bbzvm_lsyms_size(), BBZVM_ERROR_LNUM);
+    bbzvm_reg_arith(dst, bbzvm_locals_at(lhs), bbzheap_idx_fromint(val), +, &bbzvm_add);
 }
 
-
 /****************************************/
 /****************************************/
 
-void bbzvm_jump(uint16_t offset) {
-    vm->pc = offset;
-    assert_pc(vm->pc);
+void bbzvm_rgetf(uint8_t dst, uint8_t tbl, uint8_t strid) {
+    bbzvm_lload(tbl);
+    bbzvm_assert_state();
+    bbzvm_tgets(strid);
+    bbzvm_assert_state();
+    bbzvm_lstore(dst);
 }
+#endif // BBZ_REGISTER_BCODE
 
 /****************************************/
 /****************************************/
 
-void bbzvm_jumpz(uint16_t offset) {
-    bbzvm_assert_stack(1);
-    bbzobj_t* o = bbzheap_obj_at(bbzvm_stack_at(0));
+/**
+ * @brief Performs a comparison and a conditional jump.
+ * @details Pops both operands, and jumps to the given offset if the
+ * result of the comparison is zero.
+ * @param[in] op The comparison to perform.
+ * @param[in] offset The offset to jump to.
+ */
+static void bbzvm_binary_op_cmpj(binary_op_cmp op, uint16_t offset) {
+    bbzvm_assert_stack(2);
+    bbzheap_idx_t rhs = bbzvm_stack_at(0);
+    bbzheap_idx_t lhs = bbzvm_stack_at(1);
+    bbzvm_pop();
+    bbzvm_pop();
 
-    switch(bbztype(*o)) {
-        case BBZTYPE_NIL: // fallthrough
-        case BBZTYPE_INT: if (o->i.value == 0) vm->pc = offset; assert_pc(vm->pc); break;
-        default: bbzvm_seterror(BBZVM_ERROR_TYPE); return;
+    if (!(*op)(bbzheap_idx_cmp(lhs, rhs))) {
+        vm->pc = offset;
+        assert_pc(vm->pc);
     }
-    assert_pc(vm->pc);
-    return bbzvm_pop();
 }
 
-/****************************************/
-/****************************************/
+void bbzvm_cmpjeq(uint16_t offset) {
+    return bbzvm_binary_op_cmpj(&bbzeq, offset);
+}
 
-void bbzvm_jumpnz(uint16_t offset) {
-    bbzvm_assert_stack(1);
-    bbzobj_t* o = bbzheap_obj_at(bbzvm_stack_at(0));
+void bbzvm_cmpjneq(uint16_t offset) {
+    return bbzvm_binary_op_cmpj(&bbzneq, offset);
+}
 
-    switch(bbztype(*o)) {
-        case BBZTYPE_NIL: // fallthrough
-        case BBZTYPE_INT: if (o->i.value != 0) vm->pc = offset; assert_pc(vm->pc); break;
-        default: bbzvm_seterror(BBZVM_ERROR_TYPE); return;
-    }
-    return bbzvm_pop();
+void bbzvm_cmpjgt(uint16_t offset) {
+    return bbzvm_binary_op_cmpj(&bbzgt, offset);
+}
+
+void bbzvm_cmpjgte(uint16_t offset) {
+    return bbzvm_binary_op_cmpj(&bbzgte, offset);
+}
+
+void bbzvm_cmpjlt(uint16_t offset) {
+    return bbzvm_binary_op_cmpj(&bbzlt, offset);
+}
+
+void bbzvm_cmpjlte(uint16_t offset) {
+    return bbzvm_binary_op_cmpj(&bbzlte, offset);
 }
 
 /****************************************/
 /****************************************/
 
 uint8_t bbzvm_gsym_register(uint16_t sid, bbzheap_idx_t v) {
+#if BBZVM_GSYM_SLOTS > 0
+    if (sid < BBZVM_GSYM_SLOTS) {
+        vm->gslots[sid] = v;
+        return 1;
+    }
+#endif // BBZVM_GSYM_SLOTS > 0
     bbzvm_pushs(sid);
     bbzvm_push(v);
     bbzvm_gstore();
@@ -938,6 +2404,7 @@ uint8_t bbzvm_gsym_register(uint16_t sid, bbzheap_idx_t v) {
 /****************************************/
 
 bbzheap_idx_t bbzint_new(int16_t val) {
+    if (bbzheap_imm_fits(val)) return bbzheap_idx_fromint(val);
     bbzheap_idx_t o;
     bbzvm_assert_mem_alloc(BBZTYPE_INT, &o, vm->nil);
     bbzheap_obj_at(o)->i.value = val;
@@ -1003,29 +2470,27 @@ bbzheap_idx_t bbzvm_stack_at(int16_t idx) { return vm->stack[vm->stackptr - idx]
 
 void bbzvm_closure_call(uint16_t argc) {
     bbzvm_assert_state();
+    /* A call may be made while another one is yielded; it then runs to
+     * completion, and the VM is yielded again */
+    uint8_t yielded = (vm->state == BBZVM_STATE_YIELDED);
+    if (yielded) vm->state = BBZVM_STATE_READY;
     bbzvm_pushi(argc);
     int16_t blockptr = vm->blockptr;
     bbzvm_callc();
-    while(blockptr < vm->blockptr) {
-        if(vm->state != BBZVM_STATE_READY) return;
-        bbzvm_step();
+    while (blockptr < vm->blockptr && vm->state == BBZVM_STATE_READY) {
+        bbzvm_exec(blockptr, 0);
     }
+    if (yielded && vm->state == BBZVM_STATE_READY) vm->state = BBZVM_STATE_YIELDED;
 }
 
 /****************************************/
 /****************************************/
 
-void bbzvm_function_call(uint16_t fname, uint16_t argc) {
-    /* Reset the VM state if it's DONE */
-    if (vm->state == BBZVM_STATE_DONE)
-        vm->state = BBZVM_STATE_READY;
-    /* Don't continue if the VM has an error */
-    bbzvm_assert_state();
-    /* Push the function name (return with error if not found) */
-    bbzvm_pushs(fname);
-    bbzvm_assert_state();
-    /* Get associated symbol */
-    bbzvm_gload();
+/**
+ * @brief Moves the closure at the top of the stack below its arguments.
+ * @param[in] argc The number of arguments.
+ */
+static void bbzvm_function_insert(uint16_t argc) {
     /* Make sure it's a closure */
     bbzvm_assert_type(bbzvm_stack_at(0), BBZTYPE_CLOSURE);
     /* Move closure before arguments */
@@ -1037,8 +2502,116 @@ void bbzvm_function_call(uint16_t fname, uint16_t argc) {
         }
         vm->stack[vm->stackptr - argc] = c;
     }
+}
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Pushes the closure of a Buzz function below its arguments.
+ * @param[in] fname The function name (bbzheap_idx_t pointing to a bbzstring_t).
+ * @param[in] argc The number of arguments.
+ */
+static void bbzvm_function_push(uint16_t fname, uint16_t argc) {
+    /* Reset the VM state if it's DONE */
+    if (vm->state == BBZVM_STATE_DONE)
+        vm->state = BBZVM_STATE_READY;
+    /* Don't continue if the VM has an error */
+    bbzvm_assert_state();
+    /* Push the function name (return with error if not found) */
+    bbzvm_pushs(fname);
+    bbzvm_assert_state();
+    /* Get associated symbol */
+    bbzvm_gload();
+    bbzvm_function_insert(argc);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_function_call(uint16_t fname, uint16_t argc) {
+    bbzvm_function_push(fname, argc);
+    bbzvm_assert_state();
+    /* Call the closure */
+    bbzvm_closure_call(argc);
+}
+
+/****************************************/
+/****************************************/
+
+bbzvm_function_handle_t bbzvm_function_resolve(uint16_t fname) {
+    bbzvm_function_handle_t h = { .fname = fname, .hops = 0, .slot = 0 };
+#if BBZVM_GSYM_SLOTS > 0
+    if (fname < BBZVM_GSYM_SLOTS) return h;
+#endif // BBZVM_GSYM_SLOTS > 0
+    bbztable_find_str(vm->gsyms, fname, &h.hops, &h.slot);
+    return h;
+}
+
+/****************************************/
+/****************************************/
+
+bbzheap_idx_t bbzvm_function_lookup(bbzvm_function_handle_t* h) {
+#if BBZVM_GSYM_SLOTS > 0
+    if (h->fname < BBZVM_GSYM_SLOTS) return vm->gslots[h->fname];
+#endif // BBZVM_GSYM_SLOTS > 0
+    // GSTORE changes the value in place, so the position only changes if
+    // the symbol was removed, or defined after the handle was made.
+    bbzheap_idx_t v = vm->nil;
+    if (!bbztable_get_at(vm->gsyms, h->fname, h->hops, h->slot, &v) &&
+        bbztable_find_str(vm->gsyms, h->fname, &h->hops, &h->slot)) {
+        bbztable_get_at(vm->gsyms, h->fname, h->hops, h->slot, &v);
+    }
+    return v;
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_function_call_handle(bbzvm_function_handle_t* h, uint16_t argc) {
+    /* Reset the VM state if it's DONE */
+    if (vm->state == BBZVM_STATE_DONE)
+        vm->state = BBZVM_STATE_READY;
+    /* Don't continue if the VM has an error */
+    bbzvm_assert_state();
+    bbzvm_push(bbzvm_function_lookup(h));
+    bbzvm_assert_state();
+    bbzvm_function_insert(argc);
+    bbzvm_assert_state();
     /* Call the closure */
-    return bbzvm_closure_call(argc);
+    bbzvm_closure_call(argc);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_function_call_begin(uint16_t fname, uint16_t argc) {
+    bbzvm_function_push(fname, argc);
+    bbzvm_assert_state();
+    /* Set up the call frame; bbzvm_run_budget() runs the call */
+    bbzvm_pushi(argc);
+    vm->callptr = vm->blockptr;
+    bbzvm_callc();
+}
+
+/****************************************/
+/****************************************/
+
+bbzvm_state bbzvm_run_budget(uint16_t max_instructions) {
+    if (vm->state == BBZVM_STATE_YIELDED) vm->state = BBZVM_STATE_READY;
+    int16_t callptr = vm->callptr;
+    if (max_instructions) {
+        if (callptr < vm->blockptr) bbzvm_exec(callptr, max_instructions);
+    }
+    else {
+        while (callptr < vm->blockptr && vm->state == BBZVM_STATE_READY) {
+            bbzvm_exec(callptr, 0);
+        }
+    }
+    if (vm->state == BBZVM_STATE_READY && callptr < vm->blockptr) {
+        vm->state = BBZVM_STATE_YIELDED;
+    }
+    return vm->state;
 }
 
 /****************************************/
@@ -1061,78 +2634,137 @@ bbzheap_idx_t bbzvm_function_register(int16_t fnameid, bbzvm_funp funp) {
 /****************************************/
 /****************************************/
 
+/**
+ * @brief Copies an activation record entry into the frame being built by
+ * bbzvm_callc().
+ * @param[in] d The activation record.
+ * @param[in] v The entry.
+ * @param[in,out] params The position of the next local symbol in the stack.
+ */
+static void bbzvm_actrec_copy(bbzheap_idx_t d, bbzheap_idx_t v, void* params) {
+    RM_UNUSED_WARN(d);
+    vm->stack[(*(int16_t*)params)++] = v;
+}
+
 void bbzvm_callc() {
     /* Get argument number and pop it */
     bbzvm_assert_stack(1);
     bbzvm_assert_type(bbzvm_stack_at(0), BBZTYPE_INT);
     uint16_t argn = (uint16_t)bbzheap_obj_at(bbzvm_stack_at(0))->i.value;
     bbzvm_pop();
-    /* Make sure the stack has enough elements */
-    bbzvm_assert_stack(argn+1);
+    /* Make sure the stack has enough elements (arguments, closure and self) */
+    bbzvm_assert_stack(argn+2);
     /* Make sure the closure is where expected */
     bbzvm_assert_type(bbzvm_stack_at(argn), BBZTYPE_CLOSURE);
     bbzobj_t* c = bbzheap_obj_at(bbzvm_stack_at(argn));
     /* Make sure that the data about lambda closures is correct */
     bbzvm_assert_exec(!(bbztype_isclosurelambda(*c) && ((c->l.value.ref) >= bbzdarray_size(vm->flist))),
                       BBZVM_ERROR_FLIST);
-    /* Keep a refererence to the old local symbol list */
-    bbzheap_idx_t oldLsyms = vm->lsyms;
-    /* Create a new local symbol list copying the parent's */
-    if (!bbztype_isclosurelambda(*c) ||
-        (c->l.value.actrec) == BBZHEAP_CLOSURE_DFLT_ACTREC) {
-        bbzvm_assert_exec(bbzdarray_clone(vm->dflt_actrec, &vm->lsyms), BBZVM_ERROR_MEM);
+    /* C closures read their arguments in place: self overwrites the
+     * closure's reference, and the caller's pointers are kept on the C stack */
+    if (!bbztype_isclosurenative(*c)) {
+        bbzvm_funp f = c->c.value;
+        int16_t frame = vm->stackptr - (int16_t)argn - 1;
+        int16_t localptr = vm->localptr;
+        int16_t blockptr = vm->blockptr;
+        vm->stack[frame + 1] = vm->stack[frame];
+        vm->localptr = frame + 1;
+        vm->blockptr = vm->stackptr;
+        f();
+        /* The return value (nil if nothing was pushed) replaces the frame */
+        vm->stack[frame] = (vm->stackptr > vm->blockptr) ? vm->stack[vm->stackptr] : vm->nil;
+        vm->stackptr = frame;
+        vm->localptr = localptr;
+        vm->blockptr = blockptr;
+        return;
     }
-    else {
-        bbzvm_assert_exec(bbzdarray_clone(c->l.value.actrec, &vm->lsyms), BBZVM_ERROR_MEM);
-    }
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->lsyms));
-    /* Add function arguments to the local symbols */
-    /* and */
-    /* Get rid of the function arguments */
-    uint16_t i;
-    for (i = argn; i; --i) {
-        bbzdarray_push(vm->lsyms, bbzvm_stack_at(i - (uint16_t)1));
-    }
-    vm->stackptr -= argn + 1; // Get rid of the closure's reference on the stack.
-    /* Recover and pop the self table */
-    if (!bbztype_isclosurelambda(*c) ||
-        c->l.value.actrec == BBZHEAP_CLOSURE_DFLT_ACTREC ||
-        !bbztype_darray_hasself(*bbzheap_obj_at(c->l.value.actrec))) {
-        bbzdarray_set(vm->lsyms, 0, bbzvm_stack_at(0));
+    /* Get the activation record */
+    bbzheap_idx_t ar = vm->dflt_actrec;
+    if (bbztype_isclosurelambda(*c) &&
+        c->l.value.actrec != BBZHEAP_CLOSURE_DFLT_ACTREC) {
+        ar = c->l.value.actrec;
     }
-    bbzvm_pop();
-    /* Push return address */
-    bbzvm_pushi(vm->pc);
-    bbzvm_assert_state();
-    /* Push old local symbol list */
-    bbzvm_push(oldLsyms);
-    bbzvm_assert_state();
-    /* Push block pointer */
-    bbzvm_pushi(vm->blockptr);
-    bbzvm_assert_state();
-    vm->blockptr = vm->stackptr;
-    /* Jump to/execute the function */
-    uintptr_t x;
+    uint16_t arn = bbzdarray_size(ar);
+    /* Fetch the function's address */
+    bbzpc_t addr;
     if (bbztype_isclosurelambda(*c)) {
-        bbzdarray_get(vm->flist, c->l.value.ref, &i);
-        x = bbzheap_obj_at((uint16_t)i)->biggest.value;
+        bbzheap_idx_t f;
+        bbzdarray_get(vm->flist, c->l.value.ref, &f);
+        addr = (bbzpc_t)bbzheap_obj_at(f)->i.value;
     }
     else {
-        x = c->biggest.value;
+        addr = (bbzpc_t)c->biggest.value;
     }
-    if (bbztype_isclosurenative(*c)) {
-        vm->pc = (bbzpc_t)x;
+    /* The frame starts where the self table is. The header takes three
+     * slots, then come the activation record and the arguments. */
+    int16_t frame = vm->stackptr - (int16_t)argn - 1;
+    int16_t localptr = frame + 3;
+    bbzvm_assert_exec(localptr + arn + argn <= BBZSTACK_SIZE, BBZVM_ERROR_STACK);
+    bbzheap_idx_t self = vm->stack[frame];
+    /* Move the arguments after the activation record (the closure's reference
+     * is overwritten) */
+    for (int16_t i = argn; i-- > 0;) {
+        vm->stack[localptr + arn + i] = vm->stack[frame + 2 + i];
     }
-    else {
-        ((bbzvm_funp)x)();
+    /* Copy the activation record, keeping its self table if it has one */
+    int16_t pos = localptr;
+    bbzdarray_foreach(ar, bbzvm_actrec_copy, &pos);
+    if (ar == vm->dflt_actrec || !bbztype_darray_hasself(*bbzheap_obj_at(ar))) {
+        vm->stack[localptr] = self;
+    }
+    /* Fill in the header: return address, local pointer and block pointer */
+    vm->stack[frame]     = (bbzheap_idx_t)vm->pc;
+    vm->stack[frame + 1] = (bbzheap_idx_t)vm->localptr;
+    vm->stack[frame + 2] = (bbzheap_idx_t)vm->blockptr;
+    vm->localptr = localptr;
+    vm->blockptr = localptr + arn + argn - 1;
+    vm->stackptr = vm->blockptr;
+    /* Jump to the function */
+    vm->pc = addr;
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_tcallc() {
+    /* Get argument number */
+    bbzvm_assert_stack(1);
+    bbzvm_assert_type(bbzvm_stack_at(0), BBZTYPE_INT);
+    uint16_t argn = (uint16_t)bbzheap_obj_at(bbzvm_stack_at(0))->i.value;
+    /* Make a regular call at the top level, where there is no frame to
+     * reuse, and for C closures, which return to the current closure */
+    int16_t frame = vm->localptr - 3;
+    if (frame < 0 || bbzvm_stack_size() < argn + 3 ||
+        !bbztype_isclosure(*bbzheap_obj_at(bbzvm_stack_at(argn + 1))) ||
+        !bbztype_isclosurenative(*bbzheap_obj_at(bbzvm_stack_at(argn + 1)))) {
+        bbzvm_callc();
+        return;
+    }
+    bbzvm_pop();
+    /* Keep the header of the current frame: the callee returns where the
+     * current closure would have */
+    bbzpc_t pc       = (bbzpc_t)vm->stack[frame];
+    int16_t localptr = (int16_t)vm->stack[frame + 1];
+    int16_t blockptr = (int16_t)vm->stack[frame + 2];
+    /* Move self, the closure and the arguments over the current frame */
+    int16_t src = vm->stackptr - (int16_t)argn - 1;
+    for (int16_t i = 0; i < (int16_t)argn + 2; ++i) {
+        vm->stack[frame + i] = vm->stack[src + i];
     }
+    vm->stackptr = frame + (int16_t)argn + 1;
+    vm->pc = pc;
+    vm->localptr = localptr;
+    vm->blockptr = blockptr;
+    /* Call as usual, which writes the same header again */
+    bbzvm_pushi((int16_t)argn);
+    bbzvm_callc();
 }
 
 /****************************************/
 /****************************************/
 
 void bbzvm_pop() {
-    bbzvm_assert_exec(bbzvm_stack_size() > 0, BBZVM_ERROR_STACK);
+    bbzvm_assert_stack(1);
     --vm->stackptr;
 }
 
@@ -1142,6 +2774,16 @@ void bbzvm_pop() {
 void bbzvm_dup() {
     uint16_t stack_size = (uint16_t)bbzvm_stack_size();
     bbzvm_assert_exec(stack_size > 0 && stack_size < BBZSTACK_SIZE, BBZVM_ERROR_STACK);
+    // Immediate values cannot be modified ; no need for a copy.
+    if (bbzheap_idx_isimm(bbzvm_stack_at(0))) return bbzvm_push(bbzvm_stack_at(0));
+    // Neither can integers, floats and strings: operations on them always
+    // allocate their result, so the object can be shared.
+    switch (bbztype(*bbzheap_obj_at(bbzvm_stack_at(0)))) {
+        case BBZTYPE_INT:    // fallthrough
+        case BBZTYPE_FLOAT:  // fallthrough
+        case BBZTYPE_STRING: return bbzvm_push(bbzvm_stack_at(0));
+        default: break;
+    }
     bbzheap_idx_t idx;
     bbzvm_assert_mem_alloc(BBZTYPE_USERDATA, &idx);
     bbzheap_obj_copy(bbzvm_stack_at(0), idx);
@@ -1205,28 +2847,72 @@ void bbzvm_pushs(uint16_t strid) {
 /****************************************/
 /****************************************/
 
+/**
+ * @brief Finds a function in the function list, and adds it if the list
+ * does not hold it yet.
+ * @param[in] f The function: an integer holding the bytecode address of a
+ * lambda, or a C closure. It is freed if the list already holds it.
+ * @return The position of the function in the list.
+ */
+static uint16_t bbzvm_flist_register(bbzheap_idx_t f) {
+    uint16_t pos;
+#if BBZVM_FLIST_INDEX_SIZE > 0
+    // Until it is full, the index holds every function of the list, so a
+    // free entry ends the search.
+    uint16_t key = bbzvm_flist_key(f);
+    uint8_t h = bbzvm_flist_hash(key);
+    uint16_t n = 0;
+    for (; n < BBZVM_FLIST_INDEX_SIZE; ++n) {
+        bbzvm_flist_index_t* e = vm->flist_index + h;
+        if (e->pos == BBZVM_FLIST_INDEX_FREE) break;
+        bbzheap_idx_t g;
+        if (e->key == key &&
+            bbzdarray_get(vm->flist, e->pos, &g) &&
+            bbztype_cmp(bbzheap_obj_at(g), bbzheap_obj_at(f)) == 0) {
+            bbzheap_obj_makeinvalid(*bbzheap_obj_at(f));
+            return e->pos;
+        }
+        h = (h + 1) & (BBZVM_FLIST_INDEX_SIZE - 1);
+    }
+    pos = n < BBZVM_FLIST_INDEX_SIZE ?
+          bbzdarray_size(vm->flist) :
+          bbzdarray_find(vm->flist, bbztype_cmp, f);
+#else
+    pos = bbzdarray_find(vm->flist, bbztype_cmp, f);
+#endif // BBZVM_FLIST_INDEX_SIZE > 0
+    /* If the function isn't in the list yet, add it; else, free it */
+    if (pos == bbzdarray_size(vm->flist)) {
+        bbzvm_assert_exec(bbzdarray_push(vm->flist, f), BBZVM_ERROR_MEM, pos);
+#if BBZVM_FLIST_INDEX_SIZE > 0
+        bbzvm_flist_index_add(key, pos);
+#endif // BBZVM_FLIST_INDEX_SIZE > 0
+    }
+    else {
+        bbzheap_obj_makeinvalid(*bbzheap_obj_at(f));
+    }
+    return pos;
+}
+
+/****************************************/
+/****************************************/
+
 void bbzvm_pushl(uint16_t addr) {
     bbzheap_idx_t o;
     bbzvm_assert_mem_alloc(BBZTYPE_CLOSURE, &o);
     bbzclosure_make_native(*bbzheap_obj_at(o));
     bbzclosure_make_lambda(*bbzheap_obj_at(o));
-    bbzheap_idx_t idx;
-    bbzvm_assert_mem_alloc(BBZTYPE_INT, &idx);
-    bbzheap_obj_at(idx)->i.value = addr;
-    addr = bbzdarray_find(vm->flist, bbztype_cmp, idx);
-    /* If the function isn't in the list yet, ... */
-    if (addr == bbzdarray_size(vm->flist)) {
-        /* ... Add the bbzuserdata_t to the function list */
-        bbzvm_assert_exec(bbzdarray_push(vm->flist, idx), BBZVM_ERROR_MEM);
-    }
-    else {
-        /* ... else, Free the memory used by the buffer */
-        bbzheap_obj_makeinvalid(*bbzheap_obj_at(idx));
-    }
+    /* Most addresses fit in an immediate, which needs no allocation */
+    bbzheap_idx_t idx = bbzint_new((int16_t)addr);
+    bbzvm_assert_state();
+    addr = bbzvm_flist_register(idx);
+    bbzvm_assert_state();
     bbzheap_obj_at(o)->l.value.ref = (uint8_t)addr;
-    if (vm->lsyms) {
+    /* Inside a call, the lambda captures the frame's local symbols */
+    if (bbzvm_lsyms_size() > 0) {
         bbzvm_assert_exec(
-                bbzdarray_lambda_alloc(vm->lsyms, &bbzheap_obj_at(o)->l.value.actrec),
+                bbzdarray_lambda_alloc_from(&bbzvm_locals_at(0),
+                                            bbzvm_lsyms_size(),
+                                            &bbzheap_obj_at(o)->l.value.actrec),
                 BBZVM_ERROR_MEM);
     }
 
@@ -1253,35 +2939,21 @@ void bbzvm_tput() {
         bbztype_isclosurelambda(*vObj) &&
         vObj->l.value.actrec != BBZHEAP_CLOSURE_DFLT_ACTREC &&
         !bbztype_darray_hasself(*bbzheap_obj_at(vObj->l.value.actrec))) {
-        // Method call
-        bbzheap_idx_t o, ar, o2;
+        // Method call. The method shares the function of the closure,
+        // which PUSHL registered already.
+        bbzheap_idx_t o;
+        bbzheap_idx_t ar = vObj->l.value.actrec;
+        uint8_t ref = vObj->l.value.ref;
+        bbzvm_assert_exec(ref < bbzdarray_size(vm->flist), BBZVM_ERROR_FLIST);
         bbzvm_assert_mem_alloc(BBZTYPE_USERDATA, &o);
         bbzheap_obj_copy(v, o);
         bbzclosure_make_lambda(*bbzheap_obj_at(o));
 
-        bbzvm_assert_mem_alloc(bbztype_isclosurenative(*vObj) ? BBZTYPE_INT : BBZTYPE_USERDATA, &v);
-        if(bbztype_isclosurelambda(*vObj)) {
-            ar = vObj->l.value.actrec;
-            bbzvm_assert_exec(bbzdarray_get(vm->flist, (uint16_t)vObj->l.value.ref, &o2), BBZVM_ERROR_FLIST);
-            bbzheap_obj_at(v)->u.value = bbzheap_obj_at(o2)->u.value;
-        }
-        else {
-            ar = vm->dflt_actrec;
-            bbzheap_obj_at(v)->c.value = vObj->c.value;
-        }
-        o2 = bbzdarray_find(vm->flist, bbztype_cmp, v);
-        if (o2 == bbzdarray_size(vm->flist)) {
-            bbzvm_assert_exec(bbzdarray_push(vm->flist, v), BBZVM_ERROR_MEM);
-        }
-        else {
-            bbzheap_obj_makeinvalid(*bbzheap_obj_at(v));
-        }
-
         bbzvm_assert_exec(
                 bbzdarray_lambda_alloc(ar, &bbzheap_obj_at(o)->l.value.actrec),
                 BBZVM_ERROR_MEM);
         bbztype_darray_markself(*bbzheap_obj_at(bbzheap_obj_at(o)->l.value.actrec));
-        bbzheap_obj_at(o)->l.value.ref = (uint8_t)o2;
+        bbzheap_obj_at(o)->l.value.ref = ref;
         bbzvm_assert_exec(bbzdarray_set(bbzheap_obj_at(o)->l.value.actrec, 0, t), BBZVM_ERROR_FLIST);
         bbzvm_assert_exec(bbztable_set(t, k, o), BBZVM_ERROR_MEM);
     }
@@ -1321,13 +2993,7 @@ void bbzvm_gload() {
     bbzvm_assert_state();
 
     // Get and push the associated value
-    bbzheap_idx_t o;
-    if(bbztable_get(vm->gsyms, str, &o)) {
-        bbzvm_push(o);
-    }
-    else {
-        bbzvm_pushnil();
-    }
+    bbzvm_push(bbzvm_gsym_get(bbzheap_obj_at(str)->s.value));
 }
 
 /****************************************/
@@ -1344,6 +3010,13 @@ void bbzvm_gstore() {
     bbzvm_assert_state();
 
     // Store the value
+#if BBZVM_GSYM_SLOTS > 0
+    uint16_t strid = bbzheap_obj_at(str)->s.value;
+    if (strid < BBZVM_GSYM_SLOTS) {
+        vm->gslots[strid] = o;
+        return;
+    }
+#endif // BBZVM_GSYM_SLOTS > 0
     bbzvm_assert_exec(bbztable_set(vm->gsyms, str, o), BBZVM_ERROR_MEM);
 }
 
@@ -1351,54 +3024,16 @@ void bbzvm_gstore() {
 /****************************************/
 
 void bbzvm_ret0() {
-    /* Make sure there's enough elements on the stack */
-    bbzvm_assert_stack(3);
-    /* Pop block pointer and stack */
+    /* Drop the C closure's temporaries; the call returns nil */
     vm->stackptr = vm->blockptr;
-    vm->blockptr = bbzheap_obj_at(vm->stack[vm->stackptr])->i.value;
-    bbzvm_pop();
-    /* Pop local symbol table */
-    bbzheap_obj_unmake_permanent(*bbzheap_obj_at(vm->lsyms));
-    bbzdarray_destroy(vm->lsyms);
-    vm->lsyms = bbzvm_stack_at(0);
-    bbzvm_pop();
-    /* Make sure the stack contains at least one element */
-    bbzvm_assert_stack(1);
-    /* Make sure that element is an integer */
-    bbzvm_assert_type(bbzvm_stack_at(0), BBZTYPE_INT);
-    /* Use that element as program counter */
-    vm->pc = (bbzpc_t)bbzheap_obj_at(bbzvm_stack_at(0))->i.value;
-    /* Pop the return address */
-    bbzvm_pop();
-    /* Push nil as the return value */
-    return bbzvm_pushnil(vm);
 }
 
 /****************************************/
 /****************************************/
 
 void bbzvm_ret1() {
-    /* Make sure there's enough elements on the stack */
-    bbzvm_assert_stack(4);
-    /* Save it, it's the return value to pass to the lower stack */
-    bbzheap_idx_t ret = bbzvm_stack_at(0);
-    /* Pop block pointer and stack */
-    vm->stackptr = vm->blockptr;
-    vm->blockptr = bbzheap_obj_at(vm->stack[vm->blockptr])->i.value;
-    bbzvm_pop();
-    /* Pop local symbol table */
-    bbzheap_obj_unmake_permanent(*bbzheap_obj_at(vm->lsyms));
-    bbzdarray_destroy(vm->lsyms);
-    vm->lsyms = bbzvm_stack_at(0);
-    bbzvm_pop();
-    /* Make sure that element is an integer */
-    bbzvm_assert_type(bbzvm_stack_at(0), BBZTYPE_INT);
-    /* Use that element as program counter */
-    vm->pc = (bbzpc_t)bbzheap_obj_at(bbzvm_stack_at(0))->i.value;
-    /* Pop the return address */
-    bbzvm_pop();
-    /* Push the return value */
-    bbzvm_push(ret);
+    /* Make sure there's a return value; it stays at the top of the stack */
+    bbzvm_assert_exec(vm->stackptr > vm->blockptr, BBZVM_ERROR_STACK);
 }
 
 /****************************************/
@@ -57,9 +57,121 @@ extern "C" {
 
     /**
      * @brief Type for the pointer to a C-closure.
+     * @details Garbage is collected between instructions, so the objects
+     * a C closure holds in variables stay valid for the whole call, unless
+     * #BBZ_HEAP_GC_RETRY is defined. Allocations may then collect garbage:
+     * a C closure must keep the objects it holds across allocations on the
+     * stack, or pin them with bbzheap_pin() and unpin them before it
+     * returns.
      */
     typedef void (*bbzvm_funp)();
 
+#ifdef BBZ_ENABLE_AOT
+    /**
+     * @brief Type for the pointer to bytecode compiled ahead of time to C.
+     * @details The function executes the bytecode from the VM's program
+     * counter on, exactly as the interpreter would. Such functions are
+     * generated by the bbo2c tool.
+     * @param[in] blockptr Execution stops as soon as the VM's block pointer
+     * is lower than or equal to this value.
+     * @param[in] budget The maximum number of instructions to execute, or 0
+     * for 65536 of them.
+     * @see bbzvm_set_aot
+     */
+    typedef void (*bbzvm_aot_fun)(int16_t blockptr, uint16_t budget);
+#endif // BBZ_ENABLE_AOT
+
+#ifdef BBZ_PROFILE
+    /**
+     * @brief Type for the pointer to the clock read by the profiler.
+     * @details Any counter which increases with time will do, such as a
+     * timer's tick count or a cycle counter. It may wrap around.
+     * @return The current time, in any unit.
+     */
+    typedef uint32_t (*bbzvm_clock_fun)();
+
+/**
+ * @brief Profile entry of the garbage collector.
+ */
+#define BBZVM_PROFILE_GC      (BBZVM_INSTR_COUNT)
+/**
+ * @brief Profile entry of bbzvm_process_inmsgs().
+ */
+#define BBZVM_PROFILE_INMSGS  (BBZVM_INSTR_COUNT + 1)
+/**
+ * @brief Profile entry of bbzvm_process_outmsgs().
+ */
+#define BBZVM_PROFILE_OUTMSGS (BBZVM_INSTR_COUNT + 2)
+/**
+ * @brief Number of profile entries: the instructions, then the above.
+ */
+#define BBZVM_PROFILE_SIZE    (BBZVM_INSTR_COUNT + 3)
+
+    /**
+     * @brief Execution profile of the VM.
+     * @details Entries are indexed by opcode, then by BBZVM_PROFILE_*.
+     * Times are inclusive: that of BBZVM_INSTR_CALLC includes the C
+     * closures it calls, and the garbage collections they make are
+     * accounted for in BBZVM_PROFILE_GC as well.
+     */
+    typedef struct PACKED bbzvm_profile_t {
+        uint32_t count[BBZVM_PROFILE_SIZE]; /**< @brief Number of executions of each entry */
+        uint32_t time[BBZVM_PROFILE_SIZE];  /**< @brief Cumulative time spent in each entry */
+    } bbzvm_profile_t;
+#endif // BBZ_PROFILE
+
+#if BBZVM_ICACHE_SIZE > 0
+    /**
+     * @brief Inline cache entry of a constant-key table lookup.
+     * @details Remembers the position of the key found by the last lookup
+     * made by the instructions mapped to this entry.
+     * @see bbztable_find_str
+     */
+    typedef struct PACKED bbzvm_icache_t {
+        uint16_t tseg; /**< @brief First segment of the table */
+        uint8_t hops;  /**< @brief Segment of the key, counted from the first one */
+        uint8_t slot;  /**< @brief Slot of the key in its segment */
+    } bbzvm_icache_t;
+
+    /**
+     * @brief Value of bbzvm_icache_t::tseg for an empty entry. No table
+     * starts at this segment.
+     */
+#define BBZVM_ICACHE_EMPTY 0xFFFF
+#endif // BBZVM_ICACHE_SIZE > 0
+
+#if BBZVM_FLIST_INDEX_SIZE > 0
+    /**
+     * @brief Value of bbzvm_flist_index_t::pos for a free entry.
+     */
+#define BBZVM_FLIST_INDEX_FREE 0xFF
+
+    /**
+     * @brief Entry of the index of the function list.
+     * @details The index maps the functions PUSHL and TPUT register to
+     * their position in the list with open addressing, keyed by bytecode
+     * address (or C closure).
+     */
+    typedef struct PACKED bbzvm_flist_index_t {
+        uint16_t key; /**< @brief Key of the function */
+        uint8_t pos;  /**< @brief Position of the function in the list */
+    } bbzvm_flist_index_t;
+#endif // BBZVM_FLIST_INDEX_SIZE > 0
+
+    /**
+     * @brief Handle of a Buzz function, to call it by name without looking
+     * the name up each time.
+     * @details Remembers where the name is in the global symbols, which
+     * is checked at each use: the handle always calls the function the name
+     * is currently bound to.
+     * @see bbzvm_function_resolve
+     */
+    typedef struct PACKED bbzvm_function_handle_t {
+        uint16_t fname; /**< @brief String ID of the function's name */
+        uint8_t hops;   /**< @brief Segment of the name in the global symbol table, counted from the first one */
+        uint8_t slot;   /**< @brief Slot of the name in its segment */
+    } bbzvm_function_handle_t;
+
     /**
      * @brief The BittyBuzz Virtual Machine.
      *
@@ -71,13 +183,25 @@ extern "C" {
         bbzvm_error_receiver_fun error_receiver_fun; /**< @brief Error receiver. */
         bbzvm_bcode_fetch_fun bcode_fetch_fun; /**< @brief Bytecode fetcher function */
         uint16_t bcode_size;       /**< @brief Size of the loaded bytecode */
+        const uint8_t* bcode_ptr;  /**< @brief Bytecode set with bbzvm_set_bcode_ptr() (NULL otherwise) */
+#ifndef BBZ_DISABLE_QUICKENING
+        uint8_t* bcode_rw;         /**< @brief Bytecode set with bbzvm_set_bcode_rw(), which is quickened (NULL otherwise) */
+#endif
+#ifdef BBZ_ENABLE_AOT
+        bbzvm_aot_fun aot_fun;     /**< @brief Compiled bytecode set with bbzvm_set_aot() (NULL otherwise) */
+#endif
         bbzpc_t pc;                /**< @brief Program counter */
-        bbzheap_idx_t lsyms;       /**< @brief Current local variable table */
-        bbzheap_idx_t gsyms;       /**< @brief Global symbols */
+        bbzheap_idx_t gsyms;       /**< @brief Global symbols not held by #gslots */
+#if BBZVM_GSYM_SLOTS > 0
+        bbzheap_idx_t gslots[BBZVM_GSYM_SLOTS]; /**< @brief Global symbols, indexed by string ID (nil if unset) */
+#endif
         bbzheap_t heap;            /**< @brief Heap content */
-        bbzheap_idx_t nil;         /**< @brief Singleton bbznil_t */
+        bbzheap_idx_t nil;         /**< @brief Singleton bbznil_t (the immediate #BBZHEAP_IDX_NIL) */
         bbzheap_idx_t dflt_actrec; /**< @brief Singleton bbzdarray_t for the default activations record */
         bbzheap_idx_t flist;       /**< @brief Registered lambda functions */
+#if BBZVM_FLIST_INDEX_SIZE > 0
+        bbzvm_flist_index_t flist_index[BBZVM_FLIST_INDEX_SIZE]; /**< @brief Positions in #flist, hashed by function */
+#endif
         bbzswarm_t swarm;          /**< @brief Swarm data */
         bbzinmsg_queue_t inmsgs;   /**< @brief Input messages FIFO */
         bbzoutmsg_queue_t outmsgs; /**< @brief Output messages FIFO */
@@ -86,19 +210,43 @@ extern "C" {
         bbzvm_state state;         /**< @brief Current VM state */
         bbzvm_error error;         /**< @brief Current VM error */
         bbzrobot_id_t robot;       /**< @brief This robot's id */
+#if BBZVM_ICACHE_SIZE > 0
+        bbzvm_icache_t icache[BBZVM_ICACHE_SIZE]; /**< @brief Inline caches, indexed by instruction offset */
+#endif
+#ifdef BBZ_PROFILE
+        bbzvm_clock_fun clock_fun; /**< @brief Clock read by the profiler */
+        bbzvm_profile_t profile;   /**< @brief Execution profile */
+#endif // BBZ_PROFILE
+#ifdef BBZ_PC_SAMPLING
+        uint16_t* samples;         /**< @brief Histogram of the sampled PCs (NULL if sampling is off) */
+        uint16_t nsamples;         /**< @brief Number of buckets of #samples */
+        uint8_t sample_shift;      /**< @brief log2 of the number of bytecode bytes per bucket */
+        uint16_t sample_period;    /**< @brief Number of instructions between samples (0: none) */
+        uint16_t sample_countdown; /**< @brief Number of instructions before the next sample */
+#endif // BBZ_PC_SAMPLING
+#ifdef BBZ_VERIFY_BCODE
+        uint8_t* verify_buf;       /**< @brief State buffer of the bytecode verifier (NULL if bytecode is not verified) */
+        uint16_t verify_size;      /**< @brief Size of #verify_buf */
+#endif // BBZ_VERIFY_BCODE
 #ifdef DEBUG
         bbzpc_t dbg_pc;            /**< @brief PC value used for debugging purpose. */
         bbzvm_instr instr;         /**< @brief Current instruction */
 #endif
         int16_t stackptr;          /**< @brief Stack pointer (Index of the last valid element of the stack) */
-        int16_t blockptr;          /**< @brief Block pointer (Index of the previous block pointer in the stack) */
+        int16_t blockptr;          /**< @brief Block pointer (Index of the last local symbol in the stack) */
+        int16_t localptr;          /**< @brief Local pointer (Index of the first local symbol in the stack) */
+        int16_t callptr;           /**< @brief Block pointer to which the call resumed by bbzvm_run_budget() returns */
         bbzheap_idx_t stack[BBZSTACK_SIZE] __attribute__((aligned(2))); /**< @brief Current stack content */
     } bbzvm_t;
 
     /**
      * @brief Virtual Machine instance. Available from anywhere.
+     * @details All BittyBuzz functions work on this VM. When
+     * #BBZ_USE_THREAD_LOCAL_VM is defined, each thread has its own, so that
+     * threads may run different VMs in parallel.
+     * @see bbzvm_switch
      */
-    extern bbzvm_t* vm;
+    extern THREAD_LOCAL bbzvm_t* vm;
 
 
 
@@ -117,6 +265,16 @@ extern "C" {
      */
     void bbzvm_destruct();
 
+    /**
+     * @brief Makes a VM the current one (#vm) of the calling thread.
+     * @details A VM must not be current in two threads at the same time.
+     * All the state of a VM is in its bbzvm_t, so a thread may run many
+     * VMs by switching between them.
+     * @param[in] ctx The VM to use.
+     * @return The VM that was current in the calling thread.
+     */
+    bbzvm_t* bbzvm_switch(bbzvm_t* ctx);
+
     /**
      * @brief Sets the error state of the VM.
      * @note It is possible for a user to create and pass their own error
@@ -131,12 +289,188 @@ extern "C" {
      * @warning The passed buffer should not be deleted until the VM is done with it.
      * @warning The function provider should take endianness
      * into account if copying byte-by-byte.
+     * @note With BBZ_UNCHECKED, the bytecode is not run unless a buffer of
+     * at least @p bcode_size bytes was first set with
+     * bbzvm_set_verify_buffer(). Otherwise the VM's state is set to
+     * BBZVM_STATE_ERROR with error BBZVM_ERROR_MEM and a PC of 0, which no
+     * instruction of the bytecode can have.
      * @param[in] bcode_fetch_fun The function to call to read bytecode data.
      * @param[in] bcode_size The size (in bytes) of the bytecode.
      * @return 0 if everything OK, a non-zero value in case of error
      */
     void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size);
 
+    /**
+     * @brief Sets bytecode that is directly addressable (in RAM, in
+     * memory-mapped flash or in a memory-mapped file).
+     * @details The VM reads instructions and operands straight from the
+     * buffer instead of calling a fetcher function. Use
+     * bbzvm_set_bcode() for bytecode that must be copied before use, such
+     * as bytecode in AVR program memory.
+     * @note Like bbzvm_set_bcode(), fails with BBZVM_ERROR_MEM at PC 0 when
+     * BBZ_UNCHECKED is defined and no large enough verification buffer is set.
+     * @warning The passed buffer should not be deleted until the VM is done with it.
+     * @param[in] bcode The bytecode.
+     * @param[in] bcode_size The size (in bytes) of the bytecode.
+     */
+    void bbzvm_set_bcode_ptr(const uint8_t* bcode, uint16_t bcode_size);
+
+    /**
+     * @brief Sets directly addressable bytecode which the VM may modify.
+     * @details Same as bbzvm_set_bcode_ptr(), but the VM quickens the
+     * bytecode as it runs it: arithmetic and comparison instructions are
+     * rewritten into variants specialized for the type of the operands they
+     * were first executed on (e.g., BBZVM_INSTR_ADD becomes
+     * BBZVM_INSTR_ADDII for two integers). A specialized instruction whose
+     * operands have other types is rewritten back to the generic one.
+     *
+     * The buffer is typically a copy of the bytecode in RAM. Quickened
+     * bytecode remains valid bytecode, and can be set again.
+     * @note The verification buffer required by BBZ_UNCHECKED is the same as
+     * for bbzvm_set_bcode().
+     * @warning The passed buffer should not be deleted until the VM is done with it.
+     * @param[in] bcode The bytecode.
+     * @param[in] bcode_size The size (in bytes) of the bytecode.
+     * @see BBZ_DISABLE_QUICKENING
+     */
+    void bbzvm_set_bcode_rw(uint8_t* bcode, uint16_t bcode_size);
+
+#ifdef BBZ_VERIFY_BCODE
+    /**
+     * @brief Sets the buffer used to verify bytecode when it is set.
+     * @details While a buffer is set, bbzvm_set_bcode() and its variants
+     * verify the bytecode with bbzverify_bcode() before running its
+     * prelude. Bytecode which is larger than the buffer, fails the
+     * verification or needs more stack than BBZSTACK_SIZE for a single
+     * frame is not run: the VM's PC is set to the faulty instruction and
+     * its error to that found by the verifier (BBZVM_ERROR_MEM for a
+     * buffer too small, at PC 0).
+     * @note With BBZ_UNCHECKED, bytecode is only run once verified: without
+     * a buffer, setting it fails with BBZVM_ERROR_MEM at PC 0.
+     * @param[in] buf The buffer, or NULL to stop verifying bytecode.
+     * @param[in] size The size (in bytes) of the buffer.
+     */
+    void bbzvm_set_verify_buffer(uint8_t* buf, uint16_t size);
+#endif // BBZ_VERIFY_BCODE
+
+    /**
+     * @brief Saves the VM in a boot image.
+     * @details The image holds the heap, the global symbols and the fields of
+     * the VM that refer to the heap, so that bbzvm_restore_image() can
+     * replace bbzvm_construct() and the execution of the bytecode's prelude.
+     * It is typically made at build time (see the bbzimagegen tool), right
+     * after bbzvm_set_bcode().
+     *
+     * Garbage is collected first. The values of the image are
+     * little-endian and independent from the size of pointers: C closures
+     * are saved as indices in the @p natives array.
+     * @warning The stack must be empty, and the heap must not hold userdata.
+     * @param[out] buf The buffer to write the image to.
+     * @param[in] cap The capacity (in bytes) of the buffer.
+     * @param[out] natives The C closures referred to by the image.
+     * @param[in,out] nnatives The capacity of @p natives, then the number of
+     * C closures written to it.
+     * @return The size of the image, or 0 if it could not be made.
+     */
+    uint16_t bbzvm_save_image(uint8_t* buf, uint16_t cap,
+                              bbzvm_funp* natives, uint8_t* nnatives);
+
+    /**
+     * @brief Sets up the VM from a boot image made by bbzvm_save_image().
+     * @details This is equivalent to bbzvm_construct() followed by
+     * bbzvm_set_bcode() with the bytecode the image was made with, without
+     * running the bytecode's prelude. Platform-specific C closures must be
+     * registered afterwards, as after bbzvm_set_bcode().
+     * @warning The passed image, C closures and bytecode should not be
+     * deleted until the VM is done with them.
+     * @param[in] robot The robot id.
+     * @param[in] image_fetch_fun The function to call to read image data.
+     * @param[in] natives The C closures referred to by the image.
+     * @param[in] bcode_fetch_fun The function to call to read bytecode data.
+     * @return 1 if the image was restored, 0 if it was made with another
+     * configuration of the VM. In this case, the VM must be constructed
+     * normally.
+     */
+    uint8_t bbzvm_restore_image(bbzrobot_id_t robot,
+                                bbzvm_bcode_fetch_fun image_fetch_fun,
+                                const bbzvm_funp* natives,
+                                bbzvm_bcode_fetch_fun bcode_fetch_fun);
+
+#ifdef BBZ_ENABLE_AOT
+    /**
+     * @brief Runs the bytecode through its C translation made by the bbo2c
+     * tool instead of interpreting it.
+     * @details Must be called after the bytecode it was made from is set,
+     * e.g., with bbzvm_set_bcode(), which runs the prelude with the
+     * interpreter and unsets the compiled bytecode. Closures, calls and
+     * instruction budgets behave as with the interpreter.
+     * @param[in] aot_fun The compiled bytecode, or NULL to interpret it.
+     */
+    ALWAYS_INLINE
+    void bbzvm_set_aot(bbzvm_aot_fun aot_fun) { vm->aot_fun = aot_fun; }
+#endif // BBZ_ENABLE_AOT
+
+#ifdef BBZ_PROFILE
+    /**
+     * @brief Sets the clock read by the profiler.
+     * @details Until it is set, only the number of executions of each
+     * profile entry is recorded.
+     * @param[in] clock_fun The clock.
+     */
+    ALWAYS_INLINE
+    void bbzvm_set_clock(bbzvm_clock_fun clock_fun) { vm->clock_fun = clock_fun; }
+
+    /**
+     * @brief Clears the execution profile.
+     */
+    void bbzvm_profile_reset();
+
+    /**
+     * @brief Writes the execution profile in a platform-independent
+     * format, to be sent to a computer and read by the bbzprofile tool.
+     * @details Instructions run through bbzvm_set_aot() are not profiled.
+     * @param[out] buf The buffer to write the profile to.
+     * @param[in] cap The capacity (in bytes) of the buffer.
+     * @return The size of the dump, or 0 if the buffer is too small.
+     */
+    uint16_t bbzvm_profile_dump(uint8_t* buf, uint16_t cap);
+#endif // BBZ_PROFILE
+
+#ifdef BBZ_PC_SAMPLING
+    /**
+     * @brief Starts sampling the program counter into a histogram.
+     * @details Bucket @c i counts the samples of the PCs from
+     * <tt>i << shift</tt> to <tt>((i + 1) << shift) - 1</tt>; buckets
+     * saturate at 65535. Samples are taken every @p period instructions
+     * the interpreter runs, and by each call to bbzvm_sample(), e.g.,
+     * from a timer interrupt.
+     * @warning The histogram should not be deleted until sampling is
+     * stopped.
+     * @param[in] samples The histogram, which is cleared, or NULL to stop
+     * sampling.
+     * @param[in] nsamples The number of buckets of the histogram.
+     * @param[in] shift log2 of the number of bytecode bytes per bucket.
+     * @param[in] period The number of instructions between samples, or 0
+     * to sample with bbzvm_sample() only.
+     */
+    void bbzvm_set_sampling(uint16_t* samples, uint16_t nsamples,
+                            uint8_t shift, uint16_t period);
+
+    /**
+     * @brief Samples the program counter.
+     */
+    void bbzvm_sample();
+
+    /**
+     * @brief Writes the PC histogram in a platform-independent format,
+     * to be sent to a computer and read by the bbzhotspots tool.
+     * @param[out] buf The buffer to write the histogram to.
+     * @param[in] cap The capacity (in bytes) of the buffer.
+     * @return The size of the dump, or 0 if the buffer is too small.
+     */
+    uint16_t bbzvm_samples_dump(uint8_t* buf, uint16_t cap);
+#endif // BBZ_PC_SAMPLING
+
     /**
      * @brief Sets the error receiver.
      * @see bbzvm_error_receiver_fun
@@ -164,6 +498,10 @@ extern "C" {
      * @brief Executes the next step in the bytecode, if possible.
      * @details Should there be an error during stepping, the VM's
      * program counter will point to the instruction that caused the error.
+     *
+     * Garbage is collected before the instruction once
+     * #BBZHEAP_GC_ALLOC_THRESHOLD allocations were made since the last
+     * collection (or every time, if it is 0).
      */
     void bbzvm_step();
 
@@ -188,6 +526,8 @@ extern "C" {
 
     /**
      * @brief Duplicates the current stack top.
+     * @details Integers, floats and strings are never modified in place, so
+     * the copy refers to the same heap object. Other types are copied.
      * @see BBZVM_INSTR_DUP
      */
     void bbzvm_dup();
@@ -200,33 +540,32 @@ extern "C" {
     void bbzvm_pop();
 
     /**
-     * @brief Returns from a closure without setting a return value.
-     * @details Internally checks whether the operation is valid.
-     *
-     * This function expects at least two stacks to be present. The
-     * first stack is popped. The stack beneath, now the top stack, is
-     * expected to have at least one element: the return address at
-     * stack #0. The return address is popped and used to update the program
-     * counter.
-     * @see BBZVM_INSTR_RET0
+     * @brief Returns from a C closure without setting a return value.
+     * @details Drops the elements the closure pushed, so that bbzvm_callc()
+     * returns nil. Calling it is optional: a C closure that pushes nothing
+     * returns nil as well.
      */
     void bbzvm_ret0();
 
     /**
-     * @brief Returns from a closure setting a return value.
-     * @details Internally checks whether the operation is valid.
-     *
-     * This function expects at least two stacks to be present. The
-     * first stack must have at least one element, which is saved as
-     * the return value of the call. The stack is then popped. The
-     * stack beneath, now the top stack, is expected to have at least
-     * one element: the return address at stack #0. The return address is
-     * popped and used to update the program counter. Then, the saved
-     * return value is pushed on the stack.
-     * @see BBZVM_INSTR_RET1
+     * @brief Returns from a C closure setting a return value.
+     * @details Checks that the closure pushed its return value, which is
+     * the element at the top of the stack. Calling it is optional: a C closure
+     * only needs to push its return value.
      */
     void bbzvm_ret1();
 
+    /**
+     * @brief Returns from a Buzz closure, popping its call frame and
+     * restoring the caller's program counter, local pointer and block
+     * pointer.
+     * @param[in] hasval Whether the element at the top of the stack is
+     * returned (BBZVM_INSTR_RET1) or nil is (BBZVM_INSTR_RET0).
+     * @see BBZVM_INSTR_RET0
+     * @see BBZVM_INSTR_RET1
+     */
+    void bbzvm_ret(uint8_t hasval);
+
     /**
      * @brief Performs an addition.
      * @see BBZVM_INSTR_ADD
@@ -433,6 +772,66 @@ extern "C" {
      */
     void bbzvm_function_call(uint16_t fname, uint16_t argc);
 
+    /**
+     * @brief Finds a function defined in Buzz, to call it with
+     * bbzvm_function_call_handle().
+     * @details The function does not need to be defined yet, and may be
+     * redefined later: the handle stays valid for the lifetime of the VM.
+     * @param[in] fname The function name (string ID).
+     * @return The function's handle.
+     */
+    bbzvm_function_handle_t bbzvm_function_resolve(uint16_t fname);
+
+    /**
+     * @brief Gets the value of the global symbol of a function handle.
+     * @details This costs a few comparisons, unless the symbol moved in
+     * the global symbol table since the last use of the handle.
+     * @param[in,out] h The handle.
+     * @return The value, or nil if the symbol is not set.
+     * @see bbzvm_function_resolve
+     */
+    bbzheap_idx_t bbzvm_function_lookup(bbzvm_function_handle_t* h);
+
+    /**
+     * @brief Calls a function defined in Buzz through its handle.
+     * @details Same as bbzvm_function_call(), without the lookup of the
+     * function's name.
+     * @param[in,out] h The function's handle.
+     * @param[in] argc The number of arguments.
+     * @see bbzvm_function_resolve
+     */
+    void bbzvm_function_call_handle(bbzvm_function_handle_t* h, uint16_t argc);
+
+    /**
+     * @brief Starts calling a function defined in Buzz, without running it.
+     * @details Same as bbzvm_function_call(), except that the function's
+     * call frame is only set up. The call is then run by bbzvm_run_budget().
+     * @param[in] fname The function name (bbzheap_idx_t pointing to a bbzstring_t).
+     * @param[in] argc The number of arguments.
+     * @see bbzvm_run_budget
+     */
+    void bbzvm_function_call_begin(uint16_t fname, uint16_t argc);
+
+    /**
+     * @brief Runs or resumes the call started by bbzvm_function_call_begin()
+     * for at most a given number of instructions.
+     * @details When the call returns, its return value is left at the top
+     * of the stack, as with bbzvm_function_call(), and the VM is in the
+     * BBZVM_STATE_READY state. When it does not return within the budget,
+     * the VM is left in the BBZVM_STATE_YIELDED state with the call's frame
+     * on the stack, and the next call to this function resumes it.
+     *
+     * Closures may still be called while the VM is yielded (e.g., to
+     * process incoming messages), as long as the stack is left as it was.
+     *
+     * Once the call returned, this function does nothing. When no call was
+     * started since the bytecode was set, it runs the main program.
+     * @param[in] max_instructions The maximum number of instructions to
+     * execute, or 0 for no limit.
+     * @return The state of the VM.
+     */
+    bbzvm_state bbzvm_run_budget(uint16_t max_instructions);
+
     /**
      * @brief Registers a function in the VM.
      * @param[in] fnameid The symbol ID of the function's name.
@@ -452,15 +851,38 @@ extern "C" {
      * N   -> Closure arg1<br/>
      * N+1 -> Closure
      *
-     * This function pushes a new stack and a new local variable table filled with the
-     * activation record entries and the closure arguments. In addition, it leaves the stack
-     * beneath as follows:
-     * 0   -> The previous value of the block pointer (used when returning from a call)
-     * 1   -> The parent local symbol table
-     * 2   -> An integer for the return address
+     * N+2 -> Self table
+     *
+     * This function replaces these elements by a call frame, and makes the
+     * local pointer and the block pointer delimit the frame's local symbols:
+     * 0   -> Self table, or the one bound in the activation record
+     * 1.. -> The other activation record entries, then the closure arguments
+     *
+     * For a Buzz closure, the frame is preceded by the return address, then
+     * the previous values of the local pointer and the block pointer. These
+     * are raw values, not heap indexes; no heap object is allocated by a call.
+     *
+     * A C closure is called directly, without a frame header: the self table
+     * overwrites the closure, and the arguments are left where they are (see
+     * bbzvm_argc() and bbzvm_argv()). When the C function returns, the element
+     * at the top of the stack, or nil if it pushed nothing, replaces the
+     * self table and the arguments.
      */
     void bbzvm_callc();
 
+    /**
+     * @brief Calls a closure in place of the current one, as in
+     * <code>return f(...)</code>.
+     * @details The stack must be as for bbzvm_callc(). The frame of the
+     * current closure is replaced by that of the callee, which returns
+     * directly to the caller of the current closure. This way, recursion
+     * in tail position does not use any stack.
+     *
+     * At the top level, and for C closures, this is a regular call.
+     * @see BBZVM_INSTR_TCALLC
+     */
+    void bbzvm_tcallc();
+
     /**
      * @brief Pushes a variable on the stack.
      * @param[in] v The variable.
@@ -581,6 +1003,172 @@ extern "C" {
      */
     void bbzvm_jumpnz(uint16_t offset);
 
+    /**
+     * @brief Pushes the global variable with the given name.
+     * @details Equivalent to bbzvm_pushs() followed by bbzvm_gload().
+     * @see BBZVM_INSTR_GLOADS
+     * @param[in] strid The string ID of the global variable's name.
+     */
+    void bbzvm_gloads(uint16_t strid);
+
+    /**
+     * @brief Replaces the table at the stack top by its value for a string key.
+     * @details Equivalent to bbzvm_pushs() followed by bbzvm_tget().
+     * @see BBZVM_INSTR_TGETS
+     * @param[in] strid The string ID of the key.
+     */
+    void bbzvm_tgets(uint16_t strid);
+
+    /**
+     * @brief Pushes two local variables.
+     * @details Equivalent to two calls to bbzvm_lload().
+     * @see BBZVM_INSTR_LLOAD2
+     * @param[in] idx The index of the first local variable in the low byte,
+     * and that of the second one in the high byte.
+     */
+    void bbzvm_lload2(uint16_t idx);
+
+    /**
+     * @brief Increments a local variable.
+     * @details Equivalent to bbzvm_lload(), bbzvm_pushi(1), bbzvm_add() and
+     * bbzvm_lstore().
+     * @see BBZVM_INSTR_INCL
+     * @param[in] idx The index of the local variable.
+     */
+    void bbzvm_incl(uint16_t idx);
+
+#ifdef BBZ_REGISTER_BCODE
+    /**
+     * @brief Copies a local variable into another one.
+     * @details Equivalent to bbzvm_lload() followed by bbzvm_lstore().
+     * @see BBZVM_INSTR_RMOV
+     * @param[in] dst The index of the local variable to set.
+     * @param[in] src The index of the local variable to copy.
+     */
+    void bbzvm_rmov(uint8_t dst, uint8_t src);
+
+    /**
+     * @brief Sets a local variable to an integer.
+     * @details Equivalent to bbzvm_pushi() followed by bbzvm_lstore().
+     * The integer is an 8-bit operand: bo2bbo only emits RSETI for
+     * constants in [-128,127], and keeps the stack code for the others.
+     * @see BBZVM_INSTR_RSETI
+     * @param[in] dst The index of the local variable to set.
+     * @param[in] val The integer.
+     */
+    void bbzvm_rseti(uint8_t dst, int8_t val);
+
+    /**
+     * @brief Sets a local variable to the sum of two others.
+     * @details Equivalent to two calls to bbzvm_lload(), then bbzvm_add()
+     * and bbzvm_lstore(). Integers are added without going through the
+     * stack.
+     * @see BBZVM_INSTR_RADD
+     * @param[in] dst The index of the local variable to set.
+     * @param[in] lhs The index of the left-hand side.
+     * @param[in] rhs The index of the right-hand side.
+     */
+    void bbzvm_radd(uint8_t dst, uint8_t lhs, uint8_t rhs);
+
+    /**
+     * @brief Sets a local variable to the difference of two others.
+     * @details As bbzvm_radd(), with bbzvm_sub().
+     * @see BBZVM_INSTR_RSUB
+     * @param[in] dst The index of the local variable to set.
+     * @param[in] lhs The index of the left-hand side.
+     * @param[in] rhs The index of the right-hand side.
+     */
+    void bbzvm_rsub(uint8_t dst, uint8_t lhs, uint8_t rhs);
+
+    /**
+     * @brief Sets a local variable to the product of two others.
+     * @details As bbzvm_radd(), with bbzvm_mul().
+     * @see BBZVM_INSTR_RMUL
+     * @param[in] dst The index of the local variable to set.
+     * @param[in] lhs The index of the left-hand side.
+     * @param[in] rhs The index of the right-hand side.
+     */
+    void bbzvm_rmul(uint8_t dst, uint8_t lhs, uint8_t rhs);
+
+    /**
+     * @brief Sets a local variable to the sum of another one and an integer.
+     * @details Equivalent to bbzvm_lload(), bbzvm_pushi(), bbzvm_add() and
+     * bbzvm_lstore(). As with bbzvm_rseti(), the integer must fit in 8 bits:
+     * bo2bbo only emits RADDI for an addition or subtraction of a constant
+     * in [-128,127].
+     * @see BBZVM_INSTR_RADDI
+     * @param[in] dst The index of the local variable to set.
+     * @param[in] lhs The index of the left-hand side.
+     * @param[in] val The integer to add.
+     */
+    void bbzvm_raddi(uint8_t dst, uint8_t lhs, int8_t val);
+
+    /**
+     * @brief Sets a local variable to the value of a table, held by another
+     * one, for a string key.
+     * @details Equivalent to bbzvm_lload(), bbzvm_tgets() and
+     * bbzvm_lstore(). The string ID is an 8-bit operand, so RGETF only
+     * applies to keys whose string ID is at most 255: bo2bbo keeps the
+     * stack code for the others.
+     * @see BBZVM_INSTR_RGETF
+     * @param[in] dst The index of the local variable to set.
+     * @param[in] tbl The index of the local variable holding the table.
+     * @param[in] strid The string ID of the key.
+     */
+    void bbzvm_rgetf(uint8_t dst, uint8_t tbl, uint8_t strid);
+#endif // BBZ_REGISTER_BCODE
+
+    /**
+     * @brief Compares the two objects at the stack top and jumps to the
+     * given offset unless they are equal. Pops operands.
+     * @details Equivalent to bbzvm_eq() followed by bbzvm_jumpz().
+     * @see BBZVM_INSTR_CMPJEQ
+     * @param[in] offset The offset to jump to.
+     */
+    void bbzvm_cmpjeq(uint16_t offset);
+
+    /**
+     * @brief Compares the two objects at the stack top and jumps to the
+     * given offset unless they are different. Pops operands.
+     * @see BBZVM_INSTR_CMPJNEQ
+     * @param[in] offset The offset to jump to.
+     */
+    void bbzvm_cmpjneq(uint16_t offset);
+
+    /**
+     * @brief Compares the two objects at the stack top and jumps to the
+     * given offset unless stack #1 is greater than stack #0. Pops operands.
+     * @see BBZVM_INSTR_CMPJGT
+     * @param[in] offset The offset to jump to.
+     */
+    void bbzvm_cmpjgt(uint16_t offset);
+
+    /**
+     * @brief Compares the two objects at the stack top and jumps to the
+     * given offset unless stack #1 is greater than or equal to stack #0.
+     * Pops operands.
+     * @see BBZVM_INSTR_CMPJGTE
+     * @param[in] offset The offset to jump to.
+     */
+    void bbzvm_cmpjgte(uint16_t offset);
+
+    /**
+     * @brief Compares the two objects at the stack top and jumps to the
+     * given offset unless stack #1 is less than stack #0. Pops operands.
+     * @see BBZVM_INSTR_CMPJLT
+     * @param[in] offset The offset to jump to.
+     */
+    void bbzvm_cmpjlt(uint16_t offset);
+
+    /**
+     * @brief Compares the two objects at the stack top and jumps to the
+     * given offset unless stack #1 is less than or equal to stack #0.
+     * Pops operands.
+     * @see BBZVM_INSTR_CMPJLTE
+     * @param[in] offset The offset to jump to.
+     */
+    void bbzvm_cmpjlte(uint16_t offset);
+
     /**
      * @brief Register a global symbol.
      * @param[in] sid The string ID representing the global symbol.
@@ -672,18 +1260,41 @@ extern "C" {
      * @brief Gets the element at given local symbols position,
      * where 0 is the self table (the table we are calling the closure on) and
      * >0 are the closure's arguments (e.g., 3 -> third argument).
+     * @details In C closures, bbzvm_self() and bbzvm_argv() give the same
+     * elements.
      * @warning This function performs no sanity check on the passed index.
      * @param[in] idx The local symbols index.
      * @return The heap index of the element at given local symbols index.
      */
-    #define bbzvm_locals_at(idx) ({ bbzheap_idx_t ret; bbzdarray_get(vm->lsyms, idx, &ret); ret; })
+    #define bbzvm_locals_at(idx) (vm->stack[vm->localptr + (idx)])
 
     /**
      * @brief Determines how many arguments were passed to the closure that
      * is being executed.
      * @return The number of arguments.
      */
-    #define bbzvm_locals_count() (bbzdarray_size(vm->lsyms) - 1)
+    #define bbzvm_locals_count() (uint16_t)(vm->blockptr - vm->localptr)
+
+    /**
+     * @brief Gets the number of arguments passed to the running C closure.
+     * @return The number of arguments.
+     */
+    #define bbzvm_argc() bbzvm_locals_count()
+
+    /**
+     * @brief Gets the arguments of the running C closure, as an array of
+     * heap indexes which lives on the stack (0 -> first argument).
+     * @warning This function performs no sanity check; valid indexes go from
+     * 0 to bbzvm_argc()-1.
+     * @return A pointer to the first argument.
+     */
+    #define bbzvm_argv() (&vm->stack[vm->localptr + 1])
+
+    /**
+     * @brief Gets the self table of the running closure.
+     * @return The heap index of the self table.
+     */
+    #define bbzvm_self() (vm->stack[vm->localptr])
 
     /**
      * @brief Assert the correct execution of a boolean returning function.
@@ -36,7 +36,7 @@ void bbzvstig_create() {
 
     // Create a table, and register some fields in it.
     bbzvm_pusht();
-    bbztable_add_data(__BBZSTRID_id, bbzvm_locals_at(1));
+    bbztable_add_data(__BBZSTRID_id, bbzvm_argv()[0]);
     bbztable_add_function(__BBZSTRID_put,  bbzvstig_put);
     bbztable_add_function(__BBZSTRID_get,  bbzvstig_get);
     bbzvm_gc();
@@ -59,7 +59,7 @@ void bbzvstig_onconflict() {
 
     bbzvm_push(vm->vstig.hpos);
     bbzvm_gc();
-    bbztable_add_data(BBZVSTIG_ONCONFLICT_FIELD, bbzvm_locals_at(1));
+    bbztable_add_data(BBZVSTIG_ONCONFLICT_FIELD, bbzvm_argv()[0]);
     bbzvm_gc();
 
     bbzvm_ret0();
@@ -74,7 +74,7 @@ void bbzvstig_onconflictlost() {
 
     bbzvm_push(vm->vstig.hpos);
     bbzvm_gc();
-    bbztable_add_data(BBZVSTIG_ONCONFLICTLOST_FIELD, bbzvm_locals_at(1));
+    bbztable_add_data(BBZVSTIG_ONCONFLICTLOST_FIELD, bbzvm_argv()[0]);
     bbzvm_gc();
 
     bbzvm_ret0();
@@ -88,7 +88,7 @@ void bbzvstig_get() {
     bbzvm_assert_lnum(1);
 
     // Get args
-    bbzheap_idx_t key = bbzvm_locals_at(1);
+    bbzheap_idx_t key = bbzvm_argv()[0];
 
     bbzvm_gc();
 
@@ -132,8 +132,8 @@ void bbzvstig_put() {
     bbzvm_assert_lnum(2);
 
     // Get args
-    bbzheap_idx_t key   = bbzvm_locals_at(1);
-    bbzheap_idx_t value = bbzvm_locals_at(2);
+    bbzheap_idx_t key   = bbzvm_argv()[0];
+    bbzheap_idx_t value = bbzvm_argv()[1];
     // BittyBuzz's virtual stigmertgie cannot handle composite types.
     bbzvm_assert_exec(!bbztype_istable(*bbzheap_obj_at(value)), BBZVM_ERROR_TYPE);
 
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bittybuzz/bbzenums.h"
+
+/**
+ * @brief Kind of the C code an instruction is translated to.
+ */
+typedef enum {
+    KIND_INVALID = 0, /**< @brief Sets BBZVM_ERROR_INSTR */
+    KIND_NOP,         /**< @brief Does nothing */
+    KIND_CALL,        /**< @brief Calls a primitive without argument */
+    KIND_CALL_ARG,    /**< @brief Calls a primitive with an unsigned argument */
+    KIND_CALL_INT,    /**< @brief Calls a primitive with a signed argument */
+    KIND_CALL_CC,     /**< @brief Calls a primitive with a C closure argument */
+    KIND_DONE,        /**< @brief Terminates the script */
+    KIND_RET,         /**< @brief Returns from a closure */
+    KIND_CALLC,       /**< @brief Calls a closure */
+    KIND_JUMP,        /**< @brief Jumps unconditionally */
+    KIND_BRANCH,      /**< @brief Jumps conditionally */
+    KIND_REGS,        /**< @brief Calls a primitive with the register operands */
+    KIND_REGS_INT     /**< @brief Idem, the last operand being signed */
+} instr_kind;
+
+/**
+ * @brief Translation of each instruction, by opcode. Quickened
+ * instructions are translated as the generic instruction they stand for.
+ */
+static const struct {
+    instr_kind kind;
+    const char* fun;
+} instrs[BBZVM_INSTR_COUNT] = {
+    [BBZVM_INSTR_NOP]       = { KIND_NOP,      NULL },
+    [BBZVM_INSTR_DONE]      = { KIND_DONE,     NULL },
+    [BBZVM_INSTR_PUSHNIL]   = { KIND_CALL,     "bbzvm_pushnil" },
+    [BBZVM_INSTR_DUP]       = { KIND_CALL,     "bbzvm_dup" },
+    [BBZVM_INSTR_POP]       = { KIND_CALL,     "bbzvm_pop" },
+    [BBZVM_INSTR_RET0]      = { KIND_RET,      "0" },
+    [BBZVM_INSTR_RET1]      = { KIND_RET,      "1" },
+    [BBZVM_INSTR_ADD]       = { KIND_CALL,     "bbzvm_add" },
+    [BBZVM_INSTR_SUB]       = { KIND_CALL,     "bbzvm_sub" },
+    [BBZVM_INSTR_MUL]       = { KIND_CALL,     "bbzvm_mul" },
+    [BBZVM_INSTR_DIV]       = { KIND_CALL,     "bbzvm_div" },
+    [BBZVM_INSTR_MOD]       = { KIND_CALL,     "bbzvm_mod" },
+    [BBZVM_INSTR_POW]       = { KIND_CALL,     "bbzvm_pow" },
+    [BBZVM_INSTR_UNM]       = { KIND_CALL,     "bbzvm_unm" },
+    [BBZVM_INSTR_LAND]      = { KIND_CALL,     "bbzvm_land" },
+    [BBZVM_INSTR_LOR]       = { KIND_CALL,     "bbzvm_lor" },
+    [BBZVM_INSTR_LNOT]      = { KIND_CALL,     "bbzvm_lnot" },
+    [BBZVM_INSTR_BAND]      = { KIND_CALL,     "bbzvm_band" },
+    [BBZVM_INSTR_BOR]       = { KIND_CALL,     "bbzvm_bor" },
+    [BBZVM_INSTR_BNOT]      = { KIND_CALL,     "bbzvm_bnot" },
+    [BBZVM_INSTR_EQ]        = { KIND_CALL,     "bbzvm_eq" },
+    [BBZVM_INSTR_NEQ]       = { KIND_CALL,     "bbzvm_neq" },
+    [BBZVM_INSTR_GT]        = { KIND_CALL,     "bbzvm_gt" },
+    [BBZVM_INSTR_GTE]       = { KIND_CALL,     "bbzvm_gte" },
+    [BBZVM_INSTR_LT]        = { KIND_CALL,     "bbzvm_lt" },
+    [BBZVM_INSTR_LTE]       = { KIND_CALL,     "bbzvm_lte" },
+    [BBZVM_INSTR_GLOAD]     = { KIND_CALL,     "bbzvm_gload" },
+    [BBZVM_INSTR_GSTORE]    = { KIND_CALL,     "bbzvm_gstore" },
+    [BBZVM_INSTR_PUSHT]     = { KIND_CALL,     "bbzvm_pusht" },
+    [BBZVM_INSTR_TPUT]      = { KIND_CALL,     "bbzvm_tput" },
+    [BBZVM_INSTR_TGET]      = { KIND_CALL,     "bbzvm_tget" },
+    [BBZVM_INSTR_CALLC]     = { KIND_CALLC,    "bbzvm_callc" },
+    [BBZVM_INSTR_CALLS]     = { KIND_NOP,      NULL },
+    [BBZVM_INSTR_PUSHF]     = { KIND_CALL_ARG, "bbzvm_pushf" },
+    [BBZVM_INSTR_PUSHI]     = { KIND_CALL_INT, "bbzvm_pushi" },
+    [BBZVM_INSTR_PUSHS]     = { KIND_CALL_ARG, "bbzvm_pushs" },
+    [BBZVM_INSTR_PUSHCN]    = { KIND_CALL_ARG, "bbzvm_pushcn" },
+    [BBZVM_INSTR_PUSHCC]    = { KIND_CALL_CC,  "bbzvm_pushcc" },
+    [BBZVM_INSTR_PUSHL]     = { KIND_CALL_ARG, "bbzvm_pushl" },
+    [BBZVM_INSTR_LLOAD]     = { KIND_CALL_ARG, "bbzvm_lload" },
+    [BBZVM_INSTR_LSTORE]    = { KIND_CALL_ARG, "bbzvm_lstore" },
+    [BBZVM_INSTR_LREMOVE]   = { KIND_CALL_ARG, "bbzvm_lremove" },
+    [BBZVM_INSTR_JUMP]      = { KIND_JUMP,     "bbzvm_jump" },
+    [BBZVM_INSTR_JUMPZ]     = { KIND_BRANCH,   "bbzvm_jumpz" },
+    [BBZVM_INSTR_JUMPNZ]    = { KIND_BRANCH,   "bbzvm_jumpnz" },
+    [BBZVM_INSTR_GLOADS]    = { KIND_CALL_ARG, "bbzvm_gloads" },
+    [BBZVM_INSTR_TGETS]     = { KIND_CALL_ARG, "bbzvm_tgets" },
+    [BBZVM_INSTR_LLOAD2]    = { KIND_CALL_ARG, "bbzvm_lload2" },
+    [BBZVM_INSTR_INCL]      = { KIND_CALL_ARG, "bbzvm_incl" },
+    [BBZVM_INSTR_CMPJEQ]    = { KIND_BRANCH,   "bbzvm_cmpjeq" },
+    [BBZVM_INSTR_CMPJNEQ]   = { KIND_BRANCH,   "bbzvm_cmpjneq" },
+    [BBZVM_INSTR_CMPJGT]    = { KIND_BRANCH,   "bbzvm_cmpjgt" },
+    [BBZVM_INSTR_CMPJGTE]   = { KIND_BRANCH,   "bbzvm_cmpjgte" },
+    [BBZVM_INSTR_CMPJLT]    = { KIND_BRANCH,   "bbzvm_cmpjlt" },
+    [BBZVM_INSTR_CMPJLTE]   = { KIND_BRANCH,   "bbzvm_cmpjlte" },
+    [BBZVM_INSTR_ADDII]     = { KIND_CALL,     "bbzvm_add" },
+    [BBZVM_INSTR_SUBII]     = { KIND_CALL,     "bbzvm_sub" },
+    [BBZVM_INSTR_MULII]     = { KIND_CALL,     "bbzvm_mul" },
+    [BBZVM_INSTR_ADDFF]     = { KIND_CALL,     "bbzvm_add" },
+    [BBZVM_INSTR_SUBFF]     = { KIND_CALL,     "bbzvm_sub" },
+    [BBZVM_INSTR_MULFF]     = { KIND_CALL,     "bbzvm_mul" },
+    [BBZVM_INSTR_DIVFF]     = { KIND_CALL,     "bbzvm_div" },
+    [BBZVM_INSTR_EQII]      = { KIND_CALL,     "bbzvm_eq" },
+    [BBZVM_INSTR_NEQII]     = { KIND_CALL,     "bbzvm_neq" },
+    [BBZVM_INSTR_GTII]      = { KIND_CALL,     "bbzvm_gt" },
+    [BBZVM_INSTR_GTEII]     = { KIND_CALL,     "bbzvm_gte" },
+    [BBZVM_INSTR_LTII]      = { KIND_CALL,     "bbzvm_lt" },
+    [BBZVM_INSTR_LTEII]     = { KIND_CALL,     "bbzvm_lte" },
+    [BBZVM_INSTR_CMPJEQII]  = { KIND_BRANCH,   "bbzvm_cmpjeq" },
+    [BBZVM_INSTR_CMPJNEQII] = { KIND_BRANCH,   "bbzvm_cmpjneq" },
+    [BBZVM_INSTR_CMPJGTII]  = { KIND_BRANCH,   "bbzvm_cmpjgt" },
+    [BBZVM_INSTR_CMPJGTEII] = { KIND_BRANCH,   "bbzvm_cmpjgte" },
+    [BBZVM_INSTR_CMPJLTII]  = { KIND_BRANCH,   "bbzvm_cmpjlt" },
+    [BBZVM_INSTR_CMPJLTEII] = { KIND_BRANCH,   "bbzvm_cmpjlte" },
+    [BBZVM_INSTR_TCALLC]    = { KIND_CALLC,    "bbzvm_tcallc" },
+    [BBZVM_INSTR_PUSHI8]    = { KIND_CALL_INT, "bbzvm_pushi" },
+    [BBZVM_INSTR_PUSHS8]    = { KIND_CALL_ARG, "bbzvm_pushs" },
+    [BBZVM_INSTR_LLOAD8]    = { KIND_CALL_ARG, "bbzvm_lload" },
+    [BBZVM_INSTR_LSTORE8]   = { KIND_CALL_ARG, "bbzvm_lstore" },
+    [BBZVM_INSTR_JUMP8]     = { KIND_JUMP,     "bbzvm_jump" },
+    [BBZVM_INSTR_JUMPZ8]    = { KIND_BRANCH,   "bbzvm_jumpz" },
+    [BBZVM_INSTR_JUMPNZ8]   = { KIND_BRANCH,   "bbzvm_jumpnz" },
+    [BBZVM_INSTR_RMOV]      = { KIND_REGS,     "bbzvm_rmov" },
+    [BBZVM_INSTR_RSETI]     = { KIND_REGS_INT, "bbzvm_rseti" },
+    [BBZVM_INSTR_RADD]      = { KIND_REGS,     "bbzvm_radd" },
+    [BBZVM_INSTR_RSUB]      = { KIND_REGS,     "bbzvm_rsub" },
+    [BBZVM_INSTR_RMUL]      = { KIND_REGS,     "bbzvm_rmul" },
+    [BBZVM_INSTR_RADDI]     = { KIND_REGS_INT, "bbzvm_raddi" },
+    [BBZVM_INSTR_RGETF]     = { KIND_REGS,     "bbzvm_rgetf" },
+};
+
+/**
+ * @brief Bytecode read from the .bbo file.
+ */
+static uint8_t* bcode;
+
+/**
+ * @brief Size of the bytecode.
+ */
+static uint16_t bcode_size;
+
+/**
+ * @brief Per-byte flags of the bytecode.
+ */
+static uint8_t* flags;
+#define FLAG_INSTR  0x01 /**< @brief An instruction starts at this offset */
+#define FLAG_ENTRY  0x02 /**< @brief A closure starts at this offset */
+#define FLAG_TARGET 0x04 /**< @brief A jump targets this offset */
+
+/**
+ * @brief Number of register operands of an instruction.
+ */
+static uint8_t reg_count(uint8_t opcode) {
+    if (opcode >= BBZVM_INSTR_RMOV && opcode <= BBZVM_INSTR_RSETI) return 2;
+    return (opcode >= BBZVM_INSTR_RADD && opcode <= BBZVM_INSTR_RGETF) ? 3 : 0;
+}
+
+/**
+ * @brief Size (in bytes) of the argument of an instruction, not counting
+ * register operands.
+ */
+static uint8_t arg_size(uint8_t opcode) {
+    if ((opcode >= BBZVM_INSTR_PUSHF && opcode <= BBZVM_INSTR_CMPJLTE) ||
+        (opcode >= BBZVM_INSTR_CMPJEQII && opcode <= BBZVM_INSTR_CMPJLTEII)) {
+        return 2;
+    }
+    return (opcode >= BBZVM_INSTR_PUSHI8 && opcode <= BBZVM_INSTR_JUMPNZ8) ? 1 : 0;
+}
+
+/**
+ * @brief Offset of the instruction after the one at an offset.
+ */
+static uint32_t next_pc(uint16_t pc) {
+    return pc + 1u + arg_size(bcode[pc]) + reg_count(bcode[pc]);
+}
+
+/**
+ * @brief Reads the argument of the instruction at an offset. Short
+ * arguments are widened, and short jumps made absolute.
+ */
+static uint16_t get_arg(uint16_t pc) {
+    uint8_t opcode = bcode[pc];
+    if (arg_size(opcode) == 2) return (uint16_t)(bcode[pc + 1] | (bcode[pc + 2] << 8));
+    if (opcode >= BBZVM_INSTR_JUMP8) return (uint16_t)(next_pc(pc) + (int8_t)bcode[pc + 1]);
+    if (opcode == BBZVM_INSTR_PUSHI8) return (uint16_t)(int8_t)bcode[pc + 1];
+    return bcode[pc + 1];
+}
+
+/**
+ * @brief Start of the function containing an offset.
+ */
+static uint16_t entry_of(uint16_t pc) {
+    while (pc > sizeof(uint16_t) && !(flags[pc] & FLAG_ENTRY)) --pc;
+    return pc;
+}
+
+/**
+ * @brief Whether a jump from an offset to another one can be translated
+ * to a goto, i.e., whether both are instructions of the same function.
+ */
+static int is_local(uint16_t from, uint32_t to) {
+    return to < bcode_size && (flags[to] & FLAG_INSTR) && entry_of(from) == entry_of((uint16_t)to);
+}
+
+/**
+ * @brief Writes the translation of the instruction at an offset.
+ */
+static void write_instr(FILE* f, uint16_t pc) {
+    uint8_t opcode = bcode[pc];
+    uint32_t next = next_pc(pc);
+    instr_kind kind = opcode < BBZVM_INSTR_COUNT ? instrs[opcode].kind : KIND_INVALID;
+    const char* fun = opcode < BBZVM_INSTR_COUNT ? instrs[opcode].fun : NULL;
+    uint16_t arg = arg_size(opcode) ? get_arg(pc) : 0;
+
+    fprintf(f, "        case %u:", pc);
+    if (flags[pc] & FLAG_TARGET) fprintf(f, " L%u:", pc);
+    fprintf(f, "\n");
+    switch (kind) {
+        case KIND_INVALID:
+            fprintf(f, "            bbzvm_seterror(BBZVM_ERROR_INSTR);\n");
+            fprintf(f, "            vm->pc = %u;\n", pc);
+            fprintf(f, "            return 0;\n");
+            return;
+        case KIND_NOP:
+            fprintf(f, "            vm->pc = %u;\n", next);
+            break;
+        case KIND_CALL:
+            fprintf(f, "            vm->pc = %u; %s();\n", next, fun);
+            break;
+        case KIND_CALL_ARG:
+            fprintf(f, "            vm->pc = %u; %s(%u);\n", next, fun, arg);
+            break;
+        case KIND_CALL_INT:
+            fprintf(f, "            vm->pc = %u; %s(%d);\n", next, fun, (int16_t)arg);
+            break;
+        case KIND_CALL_CC:
+            fprintf(f, "            vm->pc = %u; %s((bbzvm_funp)(intptr_t)%d);\n", next, fun, (int16_t)arg);
+            break;
+        case KIND_DONE:
+            fprintf(f, "            vm->pc = %u; bbzvm_done();\n", pc);
+            fprintf(f, "            BBZAOT_NEXT(%u);\n", pc);
+            fprintf(f, "            return budget;\n");
+            return;
+        case KIND_RET:
+            fprintf(f, "            vm->pc = %u; bbzvm_ret(%s); BBZAOT_CHECK_PC();\n", next, fun);
+            fprintf(f, "            BBZAOT_NEXT(%u);\n", pc);
+            fprintf(f, "            return budget;\n");
+            return;
+        case KIND_CALLC:
+            fprintf(f, "            vm->pc = %u; %s(); BBZAOT_CHECK_PC();\n", next, fun);
+            fprintf(f, "            BBZAOT_NEXT(%u);\n", pc);
+            fprintf(f, "            if (vm->pc != %u) return budget;\n", next);
+            return;
+        case KIND_JUMP:
+            fprintf(f, "            vm->pc = %u; %s(%u);\n", next, fun, arg);
+            fprintf(f, "            BBZAOT_NEXT(%u);\n", pc);
+            if (is_local(pc, arg)) fprintf(f, "            goto L%u;\n", arg);
+            else                   fprintf(f, "            return budget;\n");
+            return;
+        case KIND_BRANCH:
+            fprintf(f, "            vm->pc = %u; %s(%u);\n", next, fun, arg);
+            fprintf(f, "            BBZAOT_NEXT(%u);\n", pc);
+            if (arg == next) return;
+            if (is_local(pc, arg)) fprintf(f, "            if (vm->pc == %u) goto L%u;\n", arg, arg);
+            else                   fprintf(f, "            if (vm->pc != %u) return budget;\n", next);
+            return;
+        case KIND_REGS:     // fallthrough
+        case KIND_REGS_INT: {
+            uint8_t n = reg_count(opcode);
+            fprintf(f, "            vm->pc = %u; %s(", next, fun);
+            for (uint8_t i = 0; i < n; ++i) {
+                if (i) fprintf(f, ", ");
+                if (i + 1 == n && kind == KIND_REGS_INT) fprintf(f, "%d", (int8_t)bcode[pc + 1 + i]);
+                else                                     fprintf(f, "%u", bcode[pc + 1 + i]);
+            }
+            fprintf(f, ");\n");
+            break;
+        }
+    }
+    fprintf(f, "            BBZAOT_NEXT(%u);\n", pc);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3 && argc != 4) {
+        printf("Usage: \n\tbbo2c <script.bbo> <outfile.h> [function name]\n\n\n"
+
+               "Compiles a BittyBuzz object (.bbo) file generated by bo2bbo \n"
+               "ahead of time to C. Each closure of the script becomes a C \n"
+               "function which calls the VM's primitives directly ; jumps \n"
+               "within a closure become gotos.\n\n"
+
+               "The generated header defines 'void <function name>(int16_t, \n"
+               "uint16_t)' (bbz_aot by default), to be passed to \n"
+               "bbzvm_set_aot() after setting the bytecode, which remains \n"
+               "needed for its prelude. It must be included in a single \n"
+               "translation unit.\n\n"
+
+               "The VM must be built with BBZ_ENABLE_AOT.\n");
+        return 1;
+    }
+
+    // Sanitize the function name
+    char* name = strdup(argc == 4 ? argv[3] : "bbz_aot");
+    for (char* c = name; *c; ++c) {
+        if (!isalnum((unsigned char)*c)) *c = '_';
+    }
+    if (isdigit((unsigned char)*name)) *name = '_';
+
+    // Read the bytecode
+    FILE* f_in = fopen(argv[1], "rb");
+    if (!f_in) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 2;
+    }
+    fseek(f_in, 0, SEEK_END);
+    long fsize = ftell(f_in);
+    fseek(f_in, 0, SEEK_SET);
+    if (fsize <= (long)sizeof(uint16_t) || fsize > UINT16_MAX ||
+        !(bcode = calloc((size_t)fsize + 2, 1)) ||
+        !(flags = calloc((size_t)fsize + 2, 1)) ||
+        fread(bcode, 1, (size_t)fsize, f_in) != (size_t)fsize) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 2;
+    }
+    fclose(f_in);
+    bcode_size = (uint16_t)fsize;
+
+    // Find the instructions, the closures and the jump targets. The
+    // bytecode starts with the number of strings, then has instructions only.
+    flags[sizeof(uint16_t)] |= FLAG_ENTRY;
+    for (uint32_t pc = sizeof(uint16_t); pc < bcode_size; pc = next_pc((uint16_t)pc)) {
+        flags[pc] |= FLAG_INSTR;
+    }
+    for (uint32_t pc = sizeof(uint16_t); pc < bcode_size; pc = next_pc((uint16_t)pc)) {
+        uint8_t opcode = bcode[pc];
+        if (!arg_size(opcode)) continue;
+        uint16_t arg = get_arg((uint16_t)pc);
+        if (arg >= bcode_size || !(flags[arg] & FLAG_INSTR)) continue;
+        if (opcode == BBZVM_INSTR_PUSHCN || opcode == BBZVM_INSTR_PUSHL) {
+            flags[arg] |= FLAG_ENTRY;
+        }
+    }
+    for (uint32_t pc = sizeof(uint16_t); pc < bcode_size; pc = next_pc((uint16_t)pc)) {
+        uint8_t opcode = bcode[pc];
+        if (opcode < BBZVM_INSTR_COUNT &&
+            (instrs[opcode].kind == KIND_JUMP || instrs[opcode].kind == KIND_BRANCH) &&
+            is_local((uint16_t)pc, get_arg((uint16_t)pc))) {
+            flags[get_arg((uint16_t)pc)] |= FLAG_TARGET;
+        }
+    }
+
+    FILE* f_out = fopen(argv[2], "w");
+    if (!f_out) {
+        fprintf(stderr, "Cannot open %s\n", argv[2]);
+        return 2;
+    }
+
+    fprintf(f_out, "#ifndef BBO2C_%s_H\n", name);
+    fprintf(f_out, "#define BBO2C_%s_H\n\n", name);
+    fprintf(f_out, "#include <bittybuzz/bbzvm.h>\n\n");
+    fprintf(f_out, "#ifndef BBZAOT_NEXT\n");
+    fprintf(f_out, "/*\n");
+    fprintf(f_out, " * Ends the instruction at OFF as the interpreter does.\n");
+    fprintf(f_out, " */\n");
+    fprintf(f_out, "#define BBZAOT_NEXT(OFF)                                            \\\n");
+    fprintf(f_out, "    if (vm->state != BBZVM_STATE_READY) { vm->pc = (OFF); return 0; } \\\n");
+    fprintf(f_out, "    if (!--budget || vm->blockptr <= blockptr) return 0;            \\\n");
+    fprintf(f_out, "    if (bbzheap_gc_isdue()) bbzvm_gc();\n");
+    fprintf(f_out, "/*\n");
+    fprintf(f_out, " * Checks the PC after a call or a return.\n");
+    fprintf(f_out, " */\n");
+    fprintf(f_out, "#define BBZAOT_CHECK_PC()                                           \\\n");
+    fprintf(f_out, "    if (vm->state == BBZVM_STATE_READY && vm->pc > vm->bcode_size)  \\\n");
+    fprintf(f_out, "        bbzvm_seterror(BBZVM_ERROR_PC);\n");
+    fprintf(f_out, "#endif // !BBZAOT_NEXT\n\n");
+
+    // One function per closure, which returns the remaining budget when
+    // execution leaves it, or 0 when it must stop.
+    uint16_t nfuns = 0;
+    for (uint32_t pc = sizeof(uint16_t); pc < bcode_size; pc = next_pc((uint16_t)pc)) {
+        if (flags[pc] & FLAG_ENTRY) {
+            if (nfuns++) {
+                fprintf(f_out, "            return budget;\n");
+                fprintf(f_out, "        default:\n");
+                fprintf(f_out, "            break;\n");
+                fprintf(f_out, "    }\n");
+                fprintf(f_out, "    bbzvm_seterror(BBZVM_ERROR_INSTR);\n");
+                fprintf(f_out, "    return 0;\n");
+                fprintf(f_out, "}\n\n");
+            }
+            fprintf(f_out, "static uint16_t %s_%u(int16_t blockptr, uint16_t budget) {\n", name, (unsigned)pc);
+            fprintf(f_out, "    switch (vm->pc) {\n");
+        }
+        if (next_pc((uint16_t)pc) > bcode_size) {
+            fprintf(f_out, "        case %u:\n", (unsigned)pc);
+            fprintf(f_out, "            vm->pc = %u; bbzvm_seterror(BBZVM_ERROR_PC);\n", (unsigned)pc);
+            fprintf(f_out, "            return 0;\n");
+            break;
+        }
+        write_instr(f_out, (uint16_t)pc);
+    }
+    fprintf(f_out, "            return budget;\n");
+    fprintf(f_out, "        default:\n");
+    fprintf(f_out, "            break;\n");
+    fprintf(f_out, "    }\n");
+    fprintf(f_out, "    bbzvm_seterror(BBZVM_ERROR_INSTR);\n");
+    fprintf(f_out, "    return 0;\n");
+    fprintf(f_out, "}\n\n");
+
+    // Function lookup by PC
+    fprintf(f_out, "static const bbzpc_t %s_entries[] = {", name);
+    uint16_t i = 0;
+    for (uint32_t pc = sizeof(uint16_t); pc < bcode_size; pc = next_pc((uint16_t)pc)) {
+        if (flags[pc] & FLAG_ENTRY) fprintf(f_out, i++ ? ", %u" : "%u", (unsigned)pc);
+    }
+    fprintf(f_out, "};\n\n");
+    fprintf(f_out, "static uint16_t (* const %s_funs[])(int16_t, uint16_t) = {\n", name);
+    for (uint32_t pc = sizeof(uint16_t); pc < bcode_size; pc = next_pc((uint16_t)pc)) {
+        if (flags[pc] & FLAG_ENTRY) fprintf(f_out, "    %s_%u,\n", name, (unsigned)pc);
+    }
+    fprintf(f_out, "};\n\n");
+
+    fprintf(f_out, "void %s(int16_t blockptr, uint16_t budget) {\n", name);
+    fprintf(f_out, "    if (vm->state != BBZVM_STATE_READY) return;\n");
+    fprintf(f_out, "    if (bbzheap_gc_isdue()) bbzvm_gc();\n");
+    fprintf(f_out, "    do {\n");
+    fprintf(f_out, "        uint16_t i = %u;\n", nfuns - 1);
+    fprintf(f_out, "        while (i && vm->pc < %s_entries[i]) --i;\n", name);
+    fprintf(f_out, "        budget = %s_funs[i](blockptr, budget);\n", name);
+    fprintf(f_out, "    } while (budget);\n");
+    fprintf(f_out, "}\n\n");
+
+    fprintf(f_out, "#endif // !BBO2C_%s_H\n", name);
+
+    fclose(f_out);
+    free(bcode);
+    free(flags);
+    free(name);
+
+    return 0;
+}
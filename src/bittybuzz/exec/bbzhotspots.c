@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Magic number of PC histogram dumps.
+ * @see bbzvm_samples_dump
+ */
+#define SAMPLES_MAGIC 0xB15A
+
+/**
+ * @brief An instruction, as listed in the remap file made by bo2bbo.
+ */
+typedef struct {
+    long bo;     /**< @brief Offset in the .bo file */
+    long bbo;    /**< @brief Offset in the .bbo file */
+    double hits; /**< @brief Samples attributed to the instruction */
+} instr_t;
+
+/**
+ * @brief A debug entry of the .bdb file.
+ */
+typedef struct {
+    long offset;    /**< @brief Offset in the .bo file */
+    uint64_t line;  /**< @brief Line in the Buzz script */
+    uint32_t fname; /**< @brief Index of the Buzz script's file name */
+} dbg_t;
+
+/**
+ * @brief Samples attributed to a line of a Buzz script.
+ */
+typedef struct {
+    const char* fname;
+    uint64_t line;
+    double hits;
+} line_t;
+
+static instr_t* instrs;
+static size_t ninstrs;
+static dbg_t* dbgs;
+static size_t ndbgs;
+static char** fnames;
+static uint32_t nfnames;
+
+/**
+ * @brief Reads a little-endian value.
+ * @return 1 if the value was read, 0 at the end of the file.
+ */
+static int read_le(FILE* f, uint64_t* v, uint8_t size) {
+    *v = 0;
+    for (uint8_t i = 0; i < size; ++i) {
+        int c = fgetc(f);
+        if (c == EOF) return 0;
+        *v |= (uint64_t)c << (8 * i);
+    }
+    return 1;
+}
+
+static int cmp_bbo(const void* a, const void* b) {
+    const instr_t* lhs = (const instr_t*)a;
+    const instr_t* rhs = (const instr_t*)b;
+    if (lhs->bbo != rhs->bbo) return lhs->bbo < rhs->bbo ? -1 : 1;
+    return lhs->bo < rhs->bo ? -1 : lhs->bo > rhs->bo;
+}
+
+static int cmp_offset(const void* a, const void* b) {
+    const dbg_t* lhs = (const dbg_t*)a;
+    const dbg_t* rhs = (const dbg_t*)b;
+    return lhs->offset < rhs->offset ? -1 : lhs->offset > rhs->offset;
+}
+
+static int cmp_hits(const void* a, const void* b) {
+    const line_t* lhs = (const line_t*)a;
+    const line_t* rhs = (const line_t*)b;
+    if (lhs->hits != rhs->hits) return lhs->hits < rhs->hits ? 1 : -1;
+    int c = strcmp(lhs->fname, rhs->fname);
+    if (c) return c;
+    return lhs->line < rhs->line ? -1 : lhs->line > rhs->line;
+}
+
+/**
+ * @brief Reads the remap file made by bo2bbo. Only the first .bo
+ * instruction of each .bbo instruction is kept, superinstructions
+ * standing for several .bo instructions.
+ * @return 1 on success, 0 otherwise.
+ */
+static int read_remap(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    size_t cap = 64;
+    instrs = malloc(cap * sizeof(instr_t));
+    long bo, bbo;
+    while (fscanf(f, "%ld %ld", &bo, &bbo) == 2) {
+        if (ninstrs == cap) {
+            cap *= 2;
+            instrs = realloc(instrs, cap * sizeof(instr_t));
+        }
+        instrs[ninstrs].bo = bo;
+        instrs[ninstrs].bbo = bbo;
+        instrs[ninstrs].hits = 0;
+        ++ninstrs;
+    }
+    fclose(f);
+    qsort(instrs, ninstrs, sizeof(instr_t), cmp_bbo);
+    size_t n = 0;
+    for (size_t i = 0; i < ninstrs; ++i) {
+        if (!n || instrs[n - 1].bbo != instrs[i].bbo) instrs[n++] = instrs[i];
+    }
+    ninstrs = n;
+    return ninstrs > 0;
+}
+
+/**
+ * @brief Reads the .bdb file made by bzzasm: the number of file names
+ * (32 bits), the null-terminated file names, then until the end of the
+ * file, for each instruction, its offset (32 bits), line (64 bits), column
+ * (64 bits) and file name index (32 bits).
+ * @return 1 on success, 0 otherwise.
+ */
+static int read_bdb(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    uint64_t v;
+    if (!read_le(f, &v, 4) || v > 0xFFFF) { fclose(f); return 0; }
+    nfnames = (uint32_t)v;
+    fnames = calloc(nfnames, sizeof(char*));
+    for (uint32_t i = 0; i < nfnames; ++i) {
+        size_t len = 0, cap = 64;
+        fnames[i] = malloc(cap);
+        int c;
+        while ((c = fgetc(f)) != EOF && c != 0) {
+            if (len + 1 == cap) fnames[i] = realloc(fnames[i], cap *= 2);
+            fnames[i][len++] = (char)c;
+        }
+        fnames[i][len] = 0;
+        if (c == EOF) { fclose(f); return 0; }
+    }
+    size_t cap = 64;
+    dbgs = malloc(cap * sizeof(dbg_t));
+    uint64_t offset, line, col, fname;
+    while (read_le(f, &offset, 4)) {
+        if (!read_le(f, &line, 8) || !read_le(f, &col, 8) ||
+            !read_le(f, &fname, 4) || fname >= nfnames) {
+            fclose(f);
+            return 0;
+        }
+        if (ndbgs == cap) {
+            cap *= 2;
+            dbgs = realloc(dbgs, cap * sizeof(dbg_t));
+        }
+        dbgs[ndbgs].offset = (long)(int32_t)offset;
+        dbgs[ndbgs].line = line;
+        dbgs[ndbgs].fname = (uint32_t)fname;
+        ++ndbgs;
+    }
+    fclose(f);
+    qsort(dbgs, ndbgs, sizeof(dbg_t), cmp_offset);
+    return 1;
+}
+
+/**
+ * @brief Finds the last instruction which starts before or at an offset
+ * of the .bbo file.
+ * @return Its index, or ninstrs if there is none.
+ */
+static size_t find_instr(long bbo) {
+    size_t lo = 0, hi = ninstrs;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (instrs[mid].bbo <= bbo) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo ? lo - 1 : ninstrs;
+}
+
+/**
+ * @brief Finds the debug entry of an offset of the .bo file, i.e., the
+ * last one at or before it.
+ * @return The entry, or NULL if there is none.
+ */
+static const dbg_t* find_dbg(long bo) {
+    size_t lo = 0, hi = ndbgs;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (dbgs[mid].offset <= bo) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo ? dbgs + lo - 1 : NULL;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        printf("Usage: \n\tbbzhotspots <samples dump> <script.bmap> <script.bdb>\n\n\n"
+
+               "Attributes the program counter samples written by \n"
+               "bbzvm_samples_dump() in a VM built with BBZ_PC_SAMPLING to the \n"
+               "lines of the Buzz script, and prints them from the most to the \n"
+               "least sampled. The remap file is made by bo2bbo, and the .bdb \n"
+               "file by bzzasm, along with the script's .bo file.\n\n"
+
+               "Samples of a bucket of the histogram are split evenly between \n"
+               "the instructions which start in it.\n");
+        return 1;
+    }
+
+    // Read the histogram
+    FILE* f_in = fopen(argv[1], "rb");
+    if (!f_in) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 2;
+    }
+    uint64_t magic, shift, nsamples;
+    if (!read_le(f_in, &magic, 2) || magic != SAMPLES_MAGIC ||
+        !read_le(f_in, &shift, 1) || shift > 15 ||
+        !read_le(f_in, &nsamples, 2)) {
+        fprintf(stderr, "%s is not a PC histogram dump\n", argv[1]);
+        fclose(f_in);
+        return 3;
+    }
+    uint16_t* samples = calloc(nsamples + 1, sizeof(uint16_t));
+    for (uint64_t i = 0; i < nsamples; ++i) {
+        uint64_t v;
+        if (!read_le(f_in, &v, 2)) {
+            fprintf(stderr, "%s is truncated\n", argv[1]);
+            fclose(f_in);
+            return 3;
+        }
+        samples[i] = (uint16_t)v;
+    }
+    fclose(f_in);
+
+    if (!read_remap(argv[2])) {
+        fprintf(stderr, "Cannot read %s\n", argv[2]);
+        return 2;
+    }
+    int has_dbg = read_bdb(argv[3]);
+    if (!has_dbg) {
+        fprintf(stderr, "Warning: cannot read %s; .bo offsets are printed "
+                        "instead of lines.\n", argv[3]);
+    }
+
+    // Attribute the samples to the instructions
+    double total = 0;
+    for (uint64_t i = 0; i < nsamples; ++i) {
+        if (!samples[i]) continue;
+        long lo = (long)(i << shift), hi = (long)((i + 1) << shift);
+        size_t first = find_instr(lo);
+        if (first == ninstrs) continue;
+        if (instrs[first].bbo < lo && first + 1 < ninstrs && instrs[first + 1].bbo < hi) {
+            ++first; // The bucket starts in an instruction which started before
+        }
+        size_t last = first;
+        while (last + 1 < ninstrs && instrs[last + 1].bbo < hi) ++last;
+        for (size_t j = first; j <= last; ++j) {
+            instrs[j].hits += (double)samples[i] / (double)(last - first + 1);
+        }
+        total += samples[i];
+    }
+
+    // Attribute the samples of the instructions to the lines
+    line_t* lines = calloc(ninstrs, sizeof(line_t));
+    size_t nlines = 0;
+    for (size_t i = 0; i < ninstrs; ++i) {
+        if (instrs[i].hits == 0) continue;
+        const dbg_t* d = has_dbg ? find_dbg(instrs[i].bo) : NULL;
+        const char* fname = d ? fnames[d->fname] : "?";
+        uint64_t line = d ? d->line : (uint64_t)instrs[i].bo;
+        size_t j = 0;
+        while (j < nlines && (lines[j].line != line || strcmp(lines[j].fname, fname))) ++j;
+        if (j == nlines) {
+            lines[j].fname = fname;
+            lines[j].line = line;
+            ++nlines;
+        }
+        lines[j].hits += instrs[i].hits;
+    }
+    qsort(lines, nlines, sizeof(line_t), cmp_hits);
+
+    printf("%10s %8s  %s\n", "samples", "%", has_dbg ? "file:line" : "file:.bo offset");
+    for (size_t i = 0; i < nlines; ++i) {
+        printf("%10.1f %7.2f%%  %s:%lu\n", lines[i].hits,
+               100.0 * lines[i].hits / total, lines[i].fname,
+               (unsigned long)lines[i].line);
+    }
+    printf("%10.0f           total\n", total);
+
+    return 0;
+}
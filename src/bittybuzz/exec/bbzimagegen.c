@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <bittybuzz/bbzvm.h>
+
+/**
+ * @brief VM the boot image is made with.
+ */
+static bbzvm_t vmObj;
+
+/**
+ * @brief Image buffer.
+ */
+static uint8_t image[0xFFFF];
+
+/**
+ * @brief Bytecode read from the .bbo file.
+ */
+static uint8_t* bcode;
+
+/**
+ * @brief The C closures the library registers when constructing the VM,
+ * along with their names.
+ */
+static const struct {
+    bbzvm_funp fun;
+    const char* name;
+} builtins[] = {
+#define BUILTIN(f) { (bbzvm_funp)f, #f }
+#ifndef BBZ_DISABLE_VSTIGS
+    BUILTIN(bbzvstig_create),
+#endif // !BBZ_DISABLE_VSTIGS
+#ifndef BBZ_DISABLE_SWARMS
+    BUILTIN(bbzswarm_create),
+    BUILTIN(bbzswarm_id),
+#ifndef BBZ_DISABLE_SWARMLIST_BROADCASTS
+    BUILTIN(bbzswarm_intersection),
+    BUILTIN(bbzswarm_union),
+    BUILTIN(bbzswarm_difference),
+#endif // !BBZ_DISABLE_SWARMLIST_BROADCASTS
+#endif // !BBZ_DISABLE_SWARMS
+#ifndef BBZ_DISABLE_NEIGHBORS
+    BUILTIN(bbzneighbors_broadcast),
+    BUILTIN(bbzneighbors_listen),
+    BUILTIN(bbzneighbors_ignore),
+    BUILTIN(bbzneighbors_foreach),
+    BUILTIN(bbzneighbors_map),
+    BUILTIN(bbzneighbors_get),
+    BUILTIN(bbzneighbors_reduce),
+    BUILTIN(bbzneighbors_count),
+#endif // !BBZ_DISABLE_NEIGHBORS
+#undef BUILTIN
+    { NULL, NULL }
+};
+
+static const uint8_t* bcode_fetch(bbzpc_t offset, uint8_t size) {
+    RM_UNUSED_WARN(size);
+    return bcode + offset;
+}
+
+static void error_receiver(bbzvm_error errcode) {
+    fprintf(stderr, "VM error %d at pc %d\n", errcode, vm->pc);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: \n\tbbzimagegen <script.bbo> <outfile.h>\n\n\n"
+
+               "Metaprogram which runs the prelude of a BittyBuzz object \n"
+               "(.bbo) file generated by bo2bbo, and generates a header file \n"
+               "containing the boot image of the VM, that is, its heap and \n"
+               "global symbols right after the prelude.\n\n"
+
+               "The image is available as 'const uint8_t bbz_image[]', and \n"
+               "the C closures it refers to as 'const bbzvm_funp \n"
+               "bbz_image_natives[]'. Define BBZIMAGE_ATTR before including \n"
+               "the header to place the image, e.g., in program memory. Pass \n"
+               "both to bbzvm_restore_image() instead of calling \n"
+               "bbzvm_construct() and bbzvm_set_bcode().\n\n"
+
+               "This program must be built with the configuration of the \n"
+               "target VM.\n");
+        return 1;
+    }
+
+    // Read the bytecode
+    FILE* f_in = fopen(argv[1], "rb");
+    if (!f_in) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 2;
+    }
+    fseek(f_in, 0, SEEK_END);
+    long bcode_size = ftell(f_in);
+    fseek(f_in, 0, SEEK_SET);
+    if (bcode_size <= 0 || bcode_size > UINT16_MAX ||
+        !(bcode = malloc((size_t)bcode_size)) ||
+        fread(bcode, 1, (size_t)bcode_size, f_in) != (size_t)bcode_size) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 2;
+    }
+    fclose(f_in);
+
+    // Construct the VM and run the prelude
+    vm = &vmObj;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(error_receiver);
+#ifdef BBZ_VERIFY_BCODE
+    uint8_t* verify_buf = malloc((size_t)bcode_size);
+    if (!verify_buf) {
+        fprintf(stderr, "Cannot verify %s\n", argv[1]);
+        return 2;
+    }
+    bbzvm_set_verify_buffer(verify_buf, (uint16_t)bcode_size);
+#endif // BBZ_VERIFY_BCODE
+    bbzvm_set_bcode(bcode_fetch, (uint16_t)bcode_size);
+    if (vm->state != BBZVM_STATE_READY) {
+        fprintf(stderr, "Cannot run the prelude of %s\n", argv[1]);
+        return 3;
+    }
+
+    // Save the image
+    bbzvm_funp natives[sizeof(builtins) / sizeof(builtins[0])];
+    uint8_t nnatives = sizeof(natives) / sizeof(natives[0]);
+    uint16_t image_size = bbzvm_save_image(image, sizeof(image), natives, &nnatives);
+    if (!image_size) {
+        fprintf(stderr, "Cannot make the boot image of %s\n", argv[1]);
+        return 3;
+    }
+
+    FILE* f_out = fopen(argv[2], "w");
+    if (!f_out) {
+        fprintf(stderr, "Cannot open %s\n", argv[2]);
+        return 2;
+    }
+
+    fprintf(f_out, "#ifndef BBZIMAGEGEN_H\n");
+    fprintf(f_out, "#define BBZIMAGEGEN_H\n\n");
+    fprintf(f_out, "#include <bittybuzz/bbzvm.h>\n\n");
+    fprintf(f_out, "#ifndef BBZIMAGE_ATTR\n");
+    fprintf(f_out, "#define BBZIMAGE_ATTR\n");
+    fprintf(f_out, "#endif // !BBZIMAGE_ATTR\n\n");
+
+    fprintf(f_out, "BBZIMAGE_ATTR const uint8_t bbz_image[] = {");
+    for (uint16_t i = 0; i < image_size; ++i) {
+        fprintf(f_out, i ? ",%" PRIu8 : "%" PRIu8, image[i]);
+    }
+    fprintf(f_out, "};\n\n");
+    fprintf(f_out, "const uint16_t bbz_image_size = %" PRIu16 ";\n\n", image_size);
+
+    fprintf(f_out, "const bbzvm_funp bbz_image_natives[] = {");
+    for (uint8_t i = 0; i < nnatives; ++i) {
+        uint8_t j = 0;
+        while (builtins[j].fun && builtins[j].fun != natives[i]) ++j;
+        if (!builtins[j].fun) {
+            fprintf(stderr, "Unknown C closure in the boot image of %s\n", argv[1]);
+            fclose(f_out);
+            remove(argv[2]);
+            return 3;
+        }
+        fprintf(f_out, "%s, ", builtins[j].name);
+    }
+    fprintf(f_out, "NULL};\n\n");
+
+    fprintf(f_out, "#endif // !BBZIMAGEGEN_H\n");
+
+    fclose(f_out);
+    bbzvm_destruct();
+    free(bcode);
+
+    return 0;
+}
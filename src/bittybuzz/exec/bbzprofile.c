@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Magic number of profile dumps.
+ * @see bbzvm_profile_dump
+ */
+#define PROFILE_MAGIC 0xB1F0
+
+/**
+ * @brief Names of the profile entries: the instructions, then the other
+ * entries.
+ */
+static const char* const entry_names[] = {
+    "NOP", "DONE", "PUSHNIL", "DUP", "POP", "RET0", "RET1", "ADD", "SUB",
+    "MUL", "DIV", "MOD", "POW", "UNM", "LAND", "LOR", "LNOT", "BAND", "BOR",
+    "BNOT", "LSHIFT", "RSHIFT", "EQ", "NEQ", "GT", "GTE", "LT", "LTE",
+    "GLOAD", "GSTORE", "PUSHT", "TPUT", "TGET", "CALLC", "CALLS", "PUSHF",
+    "PUSHI", "PUSHS", "PUSHCN", "PUSHCC", "PUSHL", "LLOAD", "LSTORE",
+    "LREMOVE", "JUMP", "JUMPZ", "JUMPNZ", "GLOADS", "TGETS", "LLOAD2", "INCL",
+    "CMPJEQ", "CMPJNEQ", "CMPJGT", "CMPJGTE", "CMPJLT", "CMPJLTE", "ADDII",
+    "SUBII", "MULII", "ADDFF", "SUBFF", "MULFF", "DIVFF", "EQII", "NEQII",
+    "GTII", "GTEII", "LTII", "LTEII", "CMPJEQII", "CMPJNEQII", "CMPJGTII",
+    "CMPJGTEII", "CMPJLTII", "CMPJLTEII", "TCALLC", "PUSHI8", "PUSHS8",
+    "LLOAD8", "LSTORE8", "JUMP8", "JUMPZ8", "JUMPNZ8", "RMOV", "RSETI",
+    "RADD", "RSUB", "RMUL", "RADDI", "RGETF",
+    "<gc>", "<inmsgs>", "<outmsgs>"
+};
+#define NUM_ENTRY_NAMES (sizeof(entry_names) / sizeof(entry_names[0]))
+
+/**
+ * @brief Instructions with operands, as ranges of entry_names, and the
+ * size (in bytes) of their operands.
+ */
+static const struct {
+    const char* first;
+    const char* last;
+    uint8_t size;
+} operand_ranges[] = {
+    { "PUSHF",    "CMPJLTE",   2 },
+    { "CMPJEQII", "CMPJLTEII", 2 },
+    { "PUSHI8",   "JUMPNZ8",   1 },
+    { "RMOV",     "RSETI",     2 },
+    { "RADD",     "RGETF",     3 },
+};
+
+/**
+ * @brief Finds the id of a profile entry.
+ * @return The id of the entry, or NUM_ENTRY_NAMES if it does not exist.
+ */
+static uint32_t entry_id(const char* name) {
+    uint32_t id = 0;
+    while (id < NUM_ENTRY_NAMES && strcmp(entry_names[id], name)) ++id;
+    return id;
+}
+
+/**
+ * @brief Finds the size of the operands of an instruction.
+ * @param[in] id The id of the instruction's profile entry.
+ * @param[out] fetches The number of calls to the bytecode fetcher which
+ * read the operands: one per operand.
+ * @return The size of the operands, in bytes.
+ */
+static uint8_t operand_size(uint32_t id, uint8_t* fetches) {
+    for (size_t i = 0; i < sizeof(operand_ranges) / sizeof(operand_ranges[0]); ++i) {
+        if (id >= entry_id(operand_ranges[i].first) && id <= entry_id(operand_ranges[i].last)) {
+            // Register instructions read each of their operands on its own
+            *fetches = (id >= entry_id("RMOV")) ? operand_ranges[i].size : 1;
+            return operand_ranges[i].size;
+        }
+    }
+    *fetches = 0;
+    return 0;
+}
+
+/**
+ * @brief A profile entry.
+ */
+typedef struct {
+    uint8_t id;
+    uint32_t count;
+    uint32_t time;
+} entry_t;
+
+/**
+ * @brief Reads a little-endian value.
+ * @return 1 if the value was read, 0 at the end of the file.
+ */
+static int read_le(FILE* f, uint32_t* v, uint8_t size) {
+    *v = 0;
+    for (uint8_t i = 0; i < size; ++i) {
+        int c = fgetc(f);
+        if (c == EOF) return 0;
+        *v |= (uint32_t)c << (8 * i);
+    }
+    return 1;
+}
+
+/**
+ * @brief Sorts entries by decreasing time, then by decreasing count.
+ */
+static int cmp_entries(const void* a, const void* b) {
+    const entry_t* lhs = (const entry_t*)a;
+    const entry_t* rhs = (const entry_t*)b;
+    if (lhs->time != rhs->time) return lhs->time < rhs->time ? 1 : -1;
+    if (lhs->count != rhs->count) return lhs->count < rhs->count ? 1 : -1;
+    return (int)lhs->id - (int)rhs->id;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        printf("Usage: \n\tbbzprofile <profile dump>\n\n\n"
+
+               "Prints the execution profile written by bbzvm_profile_dump() \n"
+               "in a VM built with BBZ_PROFILE: the number of executions and \n"
+               "the time spent per instruction, in garbage collection \n"
+               "(<gc>) and in message processing (<inmsgs>, <outmsgs>), \n"
+               "from the most to the least time-consuming. Times are in the \n"
+               "unit of the clock set with bbzvm_set_clock(). Also prints \n"
+               "the bytes of bytecode the instructions fetched (one lpm \n"
+               "each on the kilobot), the calls to the bytecode fetcher, \n"
+               "and the bytes the short forms of instructions saved.\n");
+        return 1;
+    }
+
+    FILE* f_in = fopen(argv[1], "rb");
+    if (!f_in) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 2;
+    }
+
+    uint32_t magic, size;
+    if (!read_le(f_in, &magic, 2) || magic != PROFILE_MAGIC ||
+        !read_le(f_in, &size, 1)) {
+        fprintf(stderr, "%s is not a profile dump\n", argv[1]);
+        fclose(f_in);
+        return 3;
+    }
+    if (size != NUM_ENTRY_NAMES) {
+        fprintf(stderr, "Warning: %s has %u entries instead of %u; "
+                        "names may be wrong.\n",
+                argv[1], (unsigned)size, (unsigned)NUM_ENTRY_NAMES);
+    }
+
+    entry_t entries[256];
+    uint64_t total_count = 0, total_time = 0;
+    uint64_t fetched = 0, fetches = 0, saved = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+        entries[i].id = (uint8_t)i;
+        if (!read_le(f_in, &entries[i].count, 4) ||
+            !read_le(f_in, &entries[i].time, 4)) {
+            fprintf(stderr, "%s is truncated\n", argv[1]);
+            fclose(f_in);
+            return 3;
+        }
+        total_count += entries[i].count;
+        total_time += entries[i].time;
+        if (i < entry_id("<gc>")) {
+            uint8_t operand_fetches;
+            uint8_t size = operand_size(i, &operand_fetches);
+            fetched += (uint64_t)entries[i].count * (1 + size);
+            fetches += (uint64_t)entries[i].count * (1 + operand_fetches);
+            // The long form of a short instruction has a 16-bit operand
+            if (i >= entry_id("PUSHI8") && i <= entry_id("JUMPNZ8")) saved += entries[i].count;
+        }
+    }
+    fclose(f_in);
+
+    qsort(entries, size, sizeof(entries[0]), cmp_entries);
+
+    printf("%-12s %12s %8s %12s %8s %10s\n",
+           "entry", "count", "count%", "time", "time%", "time/count");
+    for (uint32_t i = 0; i < size; ++i) {
+        const entry_t* e = entries + i;
+        if (!e->count) continue;
+        printf("%-12s %12lu %7.2f%% %12lu %7.2f%% %10.2f\n",
+               e->id < NUM_ENTRY_NAMES ? entry_names[e->id] : "?",
+               (unsigned long)e->count,
+               total_count ? 100.0 * e->count / total_count : 0.0,
+               (unsigned long)e->time,
+               total_time ? 100.0 * e->time / total_time : 0.0,
+               (double)e->time / e->count);
+    }
+    printf("%-12s %12lu %8s %12lu\n", "total",
+           (unsigned long)total_count, "", (unsigned long)total_time);
+    printf("\nBytecode fetched: %lu bytes in %lu fetcher calls, %lu bytes saved by short operands\n",
+           (unsigned long)fetched, (unsigned long)fetches, (unsigned long)saved);
+
+    return 0;
+}
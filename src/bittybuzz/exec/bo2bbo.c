@@ -3,6 +3,7 @@
 #include <stdlib.h>
 
 #include "bittybuzz/bbzfloat.h"
+#include "bittybuzz/bbzverify.h"
 
 #define read_write(buf) {\
     (void)fread(&(buf),sizeof(buf),1,f_in);\
@@ -66,6 +67,37 @@ typedef enum {
     INSTR_COUNT
 } instr;
 
+/**
+ * Superinstructions, which only appear in the output file (see bbzenums.h).
+ */
+typedef enum {
+    INSTR_GLOADS = INSTR_COUNT, // PUSHS s; GLOAD
+    INSTR_TGETS,                // PUSHS s; TGET
+    INSTR_LLOAD2,               // LLOAD a; LLOAD b
+    INSTR_INCL,                 // LLOAD a; PUSHI 1; ADD; LSTORE a
+    INSTR_CMPJEQ,               // EQ; JUMPZ t
+    INSTR_CMPJNEQ,              // NEQ; JUMPZ t
+    INSTR_CMPJGT,               // GT; JUMPZ t
+    INSTR_CMPJGTE,              // GTE; JUMPZ t
+    INSTR_CMPJLT,               // LT; JUMPZ t
+    INSTR_CMPJLTE,              // LTE; JUMPZ t
+    INSTR_TCALLC = 76,          // CALLC; RET1 (the RET1 is kept)
+    INSTR_PUSHI8,               // PUSHI i, -128 <= i <= 127
+    INSTR_PUSHS8,               // PUSHS s, s <= 255
+    INSTR_LLOAD8,               // LLOAD a, a <= 255
+    INSTR_LSTORE8,              // LSTORE a, a <= 255
+    INSTR_JUMP8,                // JUMP t, t within a signed byte of the next instruction
+    INSTR_JUMPZ8,               // JUMPZ t, idem
+    INSTR_JUMPNZ8,              // JUMPNZ t, idem
+    INSTR_RMOV,                 // LLOAD a; LSTORE d
+    INSTR_RSETI,                // PUSHI k; LSTORE d
+    INSTR_RADD,                 // LLOAD a; LLOAD b; ADD; LSTORE d
+    INSTR_RSUB,                 // LLOAD a; LLOAD b; SUB; LSTORE d
+    INSTR_RMUL,                 // LLOAD a; LLOAD b; MUL; LSTORE d
+    INSTR_RADDI,                // LLOAD a; PUSHI k; ADD; LSTORE d (or SUB with -k)
+    INSTR_RGETF                 // LLOAD a; PUSHS k; TGET; LSTORE d
+} superinstr;
+
 typedef struct PACKED darray {
     void* *array;
     size_t used;
@@ -159,26 +191,338 @@ int8_t cmpint(void* a, void* b) {
     return 0;
 }
 
-typedef struct PACKED foreachint_params {
-    FILE* f_out;
-    dtable* refs;
-} foreachint_params;
-
-void foreachint(void* key, void* value, void* params) {
-    foreachint_params* p = (foreachint_params*)params;
-    fseek(p->f_out, (long)key, SEEK_SET);
-    int16_t v = (int16_t)(intptr_t)getTable(p->refs, value);
-    fwrite(&v, sizeof(v), 1, p->f_out);
-    /* Prints corresponding addresses from the input file to the output file on the terminal. */
-    //printf("%d => %d\n", (int)(intptr_t)value, (int)v);
+void foreachremap(void* key, void* value, void* params) {
+    fprintf((FILE*)params, "%d %d\n", (int)(intptr_t)key, (int)(intptr_t)value);
+}
+
+/**
+ * An instruction of the input file.
+ */
+typedef struct bo_instr {
+    long    pos;    // Position in the input file
+    uint8_t opcode;
+    uint8_t hasarg; // Whether the instruction has an operand
+    uint8_t reloc;  // Whether the operand is a position in the input file
+    uint8_t target; // Whether a relocated operand refers to this instruction
+    int32_t argi;   // Operand as read (for relocated operands)
+    int16_t bufi;   // Operand as written
+    uint8_t regs[3]; // Operands of a register instruction
+} bo_instr;
+
+/**
+ * Finds the instruction at some position of the input file.
+ * Returns the number of instructions if there is none.
+ */
+size_t findInstr(bo_instr* instrs, size_t count, long pos) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (instrs[mid].pos < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < count && instrs[lo].pos == pos) ? lo : count;
+}
+
+/**
+ * Whether the len instructions starting at i exist and can be fused,
+ * i.e., none of them but the first one is the target of a jump or closure.
+ */
+int canFuse(bo_instr* instrs, size_t count, size_t i, size_t len) {
+    if (i + len > count) return 0;
+    for (size_t j = i + 1; j < i + len; ++j) {
+        if (instrs[j].target) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Number of operands of a register instruction, 0 for other instructions.
+ */
+uint8_t regCount(uint8_t opcode) {
+    if (opcode == INSTR_RMOV || opcode == INSTR_RSETI) return 2;
+    return (opcode >= INSTR_RADD && opcode <= INSTR_RGETF) ? 3 : 0;
+}
+
+#ifdef BBZ_REGISTER_BCODE
+/**
+ * Whether the operand of an instruction fits in a register operand.
+ */
+int isReg(const bo_instr* in) {
+    return (uint16_t)in->bufi <= UINT8_MAX;
+}
+
+/**
+ * Makes *out a register instruction standing for len input instructions.
+ * Returns len.
+ */
+size_t regInstr(bo_instr* out, uint8_t opcode, size_t len, int r0, int r1, int r2) {
+    out->opcode = opcode;
+    out->hasarg = 0;
+    out->reloc = 0;
+    out->regs[0] = (uint8_t)r0;
+    out->regs[1] = (uint8_t)r1;
+    out->regs[2] = (uint8_t)r2;
+    return len;
+}
+
+/**
+ * Register pass: replaces the instruction sequence starting at i, which
+ * moves local symbols through the stack, with a register instruction over
+ * the local symbols if possible.
+ * Returns the number of input instructions replaced by *out, or 0.
+ */
+size_t fuseRegInstr(bo_instr* instrs, size_t count, size_t i, bo_instr* out) {
+    bo_instr* in = instrs + i;
+    if (in[0].opcode == INSTR_PUSHI) {
+        if (canFuse(instrs, count, i, 2) &&
+            in[1].opcode == INSTR_LSTORE && isReg(in + 1) &&
+            in[0].bufi >= INT8_MIN && in[0].bufi <= INT8_MAX) {
+            return regInstr(out, INSTR_RSETI, 2, in[1].bufi, in[0].bufi, 0);
+        }
+        return 0;
+    }
+    if (in[0].opcode != INSTR_LLOAD || !isReg(in)) return 0;
+    if (canFuse(instrs, count, i, 2) &&
+        in[1].opcode == INSTR_LSTORE && isReg(in + 1)) {
+        return regInstr(out, INSTR_RMOV, 2, in[1].bufi, in[0].bufi, 0);
+    }
+    if (!canFuse(instrs, count, i, 4) ||
+        in[3].opcode != INSTR_LSTORE || !isReg(in + 3)) {
+        return 0;
+    }
+    switch (in[2].opcode) {
+        case INSTR_ADD: // fallthrough
+        case INSTR_SUB: // fallthrough
+        case INSTR_MUL:
+            if (in[1].opcode == INSTR_LLOAD && isReg(in + 1)) {
+                return regInstr(out, (uint8_t)(INSTR_RADD + (in[2].opcode - INSTR_ADD)), 4,
+                                in[3].bufi, in[0].bufi, in[1].bufi);
+            }
+            if (in[1].opcode == INSTR_PUSHI && in[2].opcode != INSTR_MUL) {
+                int k = (in[2].opcode == INSTR_ADD) ? in[1].bufi : -in[1].bufi;
+                if (k >= INT8_MIN && k <= INT8_MAX) {
+                    return regInstr(out, INSTR_RADDI, 4, in[3].bufi, in[0].bufi, k);
+                }
+            }
+            break;
+        case INSTR_TGET:
+            if (in[1].opcode == INSTR_PUSHS && isReg(in + 1)) {
+                return regInstr(out, INSTR_RGETF, 4, in[3].bufi, in[0].bufi, in[1].bufi);
+            }
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+#endif // BBZ_REGISTER_BCODE
+
+/**
+ * Peephole pass: replaces the instruction sequence starting at i with a
+ * superinstruction if possible.
+ * Returns the number of input instructions replaced by *out, which
+ * is 1 if no superinstruction applies.
+ */
+size_t fuseInstr(bo_instr* instrs, size_t count, size_t i, bo_instr* out) {
+    bo_instr* in = instrs + i;
+    *out = *in;
+#ifdef BBZ_REGISTER_BCODE
+    size_t len;
+#endif // BBZ_REGISTER_BCODE
+    switch (in[0].opcode) {
+        case INSTR_PUSHS:
+            if (canFuse(instrs, count, i, 2) &&
+                (in[1].opcode == INSTR_GLOAD || in[1].opcode == INSTR_TGET)) {
+                out->opcode = (in[1].opcode == INSTR_GLOAD) ? INSTR_GLOADS : INSTR_TGETS;
+                return 2;
+            }
+            break;
+        case INSTR_LLOAD:
+            if (canFuse(instrs, count, i, 4) &&
+                in[1].opcode == INSTR_PUSHI && in[1].bufi == 1 &&
+                in[2].opcode == INSTR_ADD &&
+                in[3].opcode == INSTR_LSTORE && in[3].bufi == in[0].bufi) {
+                out->opcode = INSTR_INCL;
+                return 4;
+            }
+#ifdef BBZ_REGISTER_BCODE
+            /* Checked after INCL, which is shorter */
+            if ((len = fuseRegInstr(instrs, count, i, out))) return len;
+#endif // BBZ_REGISTER_BCODE
+            if (canFuse(instrs, count, i, 2) &&
+                in[1].opcode == INSTR_LLOAD &&
+                (uint16_t)in[0].bufi <= UINT8_MAX && (uint16_t)in[1].bufi <= UINT8_MAX) {
+                out->opcode = INSTR_LLOAD2;
+                out->bufi = (int16_t)((uint16_t)in[0].bufi | ((uint16_t)in[1].bufi << 8));
+                return 2;
+            }
+            break;
+#ifdef BBZ_REGISTER_BCODE
+        case INSTR_PUSHI:
+            if ((len = fuseRegInstr(instrs, count, i, out))) return len;
+            break;
+#endif // BBZ_REGISTER_BCODE
+        case INSTR_EQ:  // fallthrough
+        case INSTR_NEQ: // fallthrough
+        case INSTR_GT:  // fallthrough
+        case INSTR_GTE: // fallthrough
+        case INSTR_LT:  // fallthrough
+        case INSTR_LTE:
+            if (canFuse(instrs, count, i, 2) && in[1].opcode == INSTR_JUMPZ) {
+                *out = in[1];
+                out->pos = in[0].pos;
+                out->target = in[0].target;
+                out->opcode = (uint8_t)(INSTR_CMPJEQ + (in[0].opcode - INSTR_EQ));
+                return 2;
+            }
+            break;
+        case INSTR_CALLC:
+            /* The RET1 stays, for jumps to it and for the calls the VM cannot
+             * make in place */
+            if (i + 1 < count && in[1].opcode == INSTR_RET1) {
+                out->opcode = INSTR_TCALLC;
+            }
+            break;
+        default:
+            break;
+    }
+    return 1;
+}
+
+/**
+ * An instruction of the output file.
+ */
+typedef struct bbo_instr {
+    bo_instr instr;  // The instruction, possibly a superinstruction
+    size_t  first;   // Index of its first input instruction
+    size_t  len;     // Number of input instructions it stands for
+    size_t  target;  // For a relocated operand, index of the instruction it refers to
+    long    pos;     // Position in the output file
+    uint8_t shortop; // Opcode of the short form, or 0 for the long one
+} bbo_instr;
+
+/**
+ * Returns the opcode of the short form of an instruction, i.e., with a
+ * 1-byte operand, or 0 if the operand does not fit. Jumps get a short form
+ * as long as they have a target, which layoutInstrs() takes back if the
+ * target is too far.
+ */
+uint8_t shortForm(const bbo_instr* o, size_t nouts) {
+    const bo_instr* in = &o->instr;
+    switch (in->opcode) {
+        case INSTR_PUSHI:
+            return (in->bufi >= INT8_MIN && in->bufi <= INT8_MAX) ? INSTR_PUSHI8 : 0;
+        case INSTR_PUSHS:  // fallthrough
+        case INSTR_LLOAD:  // fallthrough
+        case INSTR_LSTORE:
+            if ((uint16_t)in->bufi > UINT8_MAX) return 0;
+            return (in->opcode == INSTR_PUSHS) ? INSTR_PUSHS8 :
+                   (in->opcode == INSTR_LLOAD) ? INSTR_LLOAD8 : INSTR_LSTORE8;
+        case INSTR_JUMP:   // fallthrough
+        case INSTR_JUMPZ:  // fallthrough
+        case INSTR_JUMPNZ:
+            return (o->target < nouts) ? (uint8_t)(INSTR_JUMP8 + (in->opcode - INSTR_JUMP)) : 0;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Size of an instruction in the output file.
+ */
+long instrSize(const bbo_instr* o) {
+    if (!o->instr.hasarg) return 1 + regCount(o->instr.opcode);
+    return o->shortop ? 2 : 3;
+}
+
+/**
+ * Computes the position of the output instructions. Short jumps whose
+ * target is out of reach get their long form back, which may move other
+ * targets out of reach; as instructions only grow, this ends.
+ * Returns the size of the output file.
+ */
+long layoutInstrs(bbo_instr* outs, size_t nouts) {
+    for (;;) {
+        long pos = sizeof(uint16_t);
+        for (size_t k = 0; k < nouts; ++k) {
+            outs[k].pos = pos;
+            pos += instrSize(outs + k);
+        }
+        int changed = 0;
+        for (size_t k = 0; k < nouts; ++k) {
+            if (!outs[k].shortop || !outs[k].instr.reloc) continue;
+            long rel = outs[outs[k].target].pos - (outs[k].pos + 2);
+            if (rel < INT8_MIN || rel > INT8_MAX) {
+                outs[k].shortop = 0;
+                changed = 1;
+            }
+        }
+        if (!changed) return pos;
+    }
+}
+
+/**
+ * The output file, as read back for verification.
+ */
+uint8_t* bbo;
+
+const uint8_t* fetchBbo(bbzpc_t offset, uint8_t size) {
+    (void)size;
+    return bbo + offset;
+}
+
+/**
+ * Verifies the output file, and prints the maximum stack depth of a frame.
+ * Returns 0 if the bytecode is valid, 3 otherwise.
+ */
+int verifyBbo(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 3;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > UINT16_MAX) {
+        fprintf(stderr, "Error [%s]: The bytecode is larger than 64 KiB.\n", path);
+        fclose(f);
+        return 3;
+    }
+    bbo = malloc(size + 1);
+    uint8_t* state = malloc(size + 1);
+    size = (long)fread(bbo, 1, size, f);
+    fclose(f);
+    bbzverify_result_t res;
+    int ret = 0;
+    if (bbzverify_bcode(fetchBbo, (uint16_t)size, state, &res)) {
+        printf("%s: maximum stack depth of a frame: %d\n", path, res.max_stack);
+    }
+    else {
+        const char* what =
+            res.error == BBZVM_ERROR_INSTR ? "Unknown instruction" :
+            res.error == BBZVM_ERROR_PC    ? "Operand or jump target out of place" :
+                                             "Stack underflow, overflow or depth mismatch";
+        fprintf(stderr, "Error [%s:%d]: %s (opcode %d).\n",
+                path, res.pc, what, res.pc < size ? bbo[res.pc] : -1);
+        ret = 3;
+    }
+    free(state);
+    free(bbo);
+    return ret;
 }
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-result"
 int main(int argc, char **argv) {
-    if (argc != 3) {
+    if (argc != 3 && argc != 4) {
         printf("Reformat buzz object file in a format compatible with BittyBuzz VM.\n");
-        printf("Usage:\n\t%s <buzzbinary.bo> <outputfile.bbo>\n", argv[0]);
+        printf("Usage:\n\t%s <buzzbinary.bo> <outputfile.bbo> [<remapfile.bmap>]\n", argv[0]);
+        printf("The remap file lists the offset in the output file of each\n");
+        printf("instruction of the input file, one '<.bo offset> <.bbo offset>'\n");
+        printf("pair per line.\n");
+        printf("The output file is verified, and the maximum stack depth of a\n");
+        printf("frame is printed; the exit status is 3 if the bytecode is invalid.\n");
         return 1;
     }
 
@@ -198,9 +542,8 @@ int main(int argc, char **argv) {
     long fsize = ftell(f_in);
     fseek(f_in, 0, SEEK_SET);
 
-    dtable refs, repl;
+    dtable refs;
     initTable(&refs, 10, cmpint);
-    initTable(&repl, 10, cmpint);
 
     uint16_t str_cnt;
     read_write(str_cnt);
@@ -209,13 +552,26 @@ int main(int argc, char **argv) {
         do (void)fread(&charBuf,1,1,f_in);
         while (charBuf != 0);
     }
+
+    /* Read the instructions */
+    size_t count = 0, capacity = 64;
+    bo_instr* instrs = malloc(capacity * sizeof(bo_instr));
     uint8_t  opcode;
     int32_t  argi;
     float    argf;
     int16_t  bufi;
     do {
-        setTable(&refs, (void*)(intptr_t)(uint32_t)ftell(f_in), (void*)(intptr_t)(int16_t)ftell(f_out));
-        read_write(opcode);
+        if (count == capacity) {
+            capacity *= 2;
+            instrs = realloc(instrs, capacity * sizeof(bo_instr));
+        }
+        bo_instr* cur = instrs + count++;
+        cur->pos = ftell(f_in);
+        cur->hasarg = 0;
+        cur->reloc = 0;
+        cur->target = 0;
+        (void)fread(&opcode,sizeof(opcode),1,f_in);
+        cur->opcode = opcode;
         switch(opcode) {
             case INSTR_NOP:     // fallthrough
             case INSTR_DONE:    // fallthrough
@@ -256,7 +612,8 @@ int main(int argc, char **argv) {
             case INSTR_PUSHF:
                 (void)fread(&argf,sizeof(argf),1,f_in);
                 bufi = (uint16_t)bbzfloat_fromfloat(argf);
-                fwrite(&bufi,sizeof(bufi),1,f_out);
+                cur->hasarg = 1;
+                cur->bufi = bufi;
                 break;
             case INSTR_PUSHI:   // fallthrough
             case INSTR_PUSHS:   // fallthrough
@@ -265,7 +622,8 @@ int main(int argc, char **argv) {
 	    case INSTR_LREMOVE: // fallthrough
                 (void)fread(&argi,sizeof(argi),1,f_in);
                 bufi = (uint16_t)argi;
-                fwrite(&bufi,sizeof(bufi),1,f_out);
+                cur->hasarg = 1;
+                cur->bufi = bufi;
                 if (argi > INT16_MAX || argi < INT16_MIN) {
                     fprintf(stderr, "Warning [%s:%d]: Integer (0x%08X) at position %d "
                                     "is out of 16 bit integer range. "
@@ -284,9 +642,11 @@ int main(int argc, char **argv) {
             case INSTR_PUSHCN:  // fallthrough
             case INSTR_PUSHCC:
                 (void)fread(&argi,sizeof(argi),1,f_in);
-                insertTable(&repl, (void *) (intptr_t)ftell(f_out), (void *) (intptr_t)argi);
                 bufi = (uint16_t)(argi);
-                fwrite(&bufi,sizeof(bufi),1,f_out);
+                cur->hasarg = 1;
+                cur->reloc = 1;
+                cur->argi = argi;
+                cur->bufi = bufi;
                 break;
             default:
                 fprintf(stderr,"Warning [%s:%d]: Unknown opcode (0x%08X).\n",
@@ -297,14 +657,97 @@ int main(int argc, char **argv) {
         }
     } while (ftell(f_in) < fsize);
 
-    foreachint_params p = {f_out, &refs};
-    foreachTable(&repl, foreachint, &p);
+    /* Mark the instructions which are referred to by a relocated operand */
+    for (size_t i = 0; i < count; ++i) {
+        if (instrs[i].reloc) {
+            size_t t = findInstr(instrs, count, instrs[i].argi);
+            if (t < count) instrs[t].target = 1;
+        }
+    }
 
+    /* Fuse common sequences */
+    size_t nouts = 0;
+    bbo_instr* outs = malloc(count * sizeof(bbo_instr));
+    size_t* outOf = malloc(count * sizeof(size_t)); // Output instruction of each input one
+    for (size_t i = 0; i < count; ) {
+        bbo_instr* o = outs + nouts;
+        o->first = i;
+        o->len = fuseInstr(instrs, count, i, &o->instr);
+        for (size_t j = i; j < i + o->len; ++j) outOf[j] = nouts;
+        i += o->len;
+        ++nouts;
+    }
+
+    /* Resolve the relocated operands and choose the short forms */
+    long longSize = sizeof(uint16_t);
+    for (size_t k = 0; k < nouts; ++k) {
+        bbo_instr* o = outs + k;
+        o->target = nouts;
+        if (o->instr.reloc) {
+            size_t t = findInstr(instrs, count, o->instr.argi);
+            if (t < count) o->target = outOf[t];
+        }
+        o->shortop = o->instr.hasarg ? shortForm(o, nouts) : 0;
+        longSize += o->instr.hasarg ? 3 : 1 + regCount(o->instr.opcode);
+    }
+    long size = layoutInstrs(outs, nouts);
+
+    /* Write the instructions */
+    unsigned nshort = 0;
+    for (size_t k = 0; k < nouts; ++k) {
+        bbo_instr* o = outs + k;
+        for (size_t j = o->first; j < o->first + o->len; ++j) {
+            setTable(&refs, (void*)(intptr_t)(uint32_t)instrs[j].pos, (void*)(intptr_t)(int16_t)o->pos);
+        }
+        uint8_t opcode = o->shortop ? o->shortop : o->instr.opcode;
+        fwrite(&opcode,sizeof(opcode),1,f_out);
+        fwrite(o->instr.regs,sizeof(uint8_t),regCount(opcode),f_out);
+        if (!o->instr.hasarg) continue;
+        int16_t arg = o->instr.bufi;
+        if (o->instr.reloc) {
+            /* Operands referring to no instruction are written as 0 */
+            arg = (o->target < nouts) ? (int16_t)outs[o->target].pos : 0;
+            if (o->shortop) arg = (int16_t)(arg - (o->pos + 2));
+        }
+        if (o->shortop) {
+            int8_t arg8 = (int8_t)arg;
+            fwrite(&arg8,sizeof(arg8),1,f_out);
+            ++nshort;
+        }
+        else {
+            fwrite(&arg,sizeof(arg),1,f_out);
+        }
+    }
+    /* Every byte of an instruction is one lpm on the kilobot */
+    printf("%s: %zu instructions (%zu in the input), %ld bytes, %ld saved by %u short operands, "
+           "%.2f bytes fetched per instruction (%.2f in long forms)\n",
+           argv[2], nouts, count, size, longSize - size, nshort,
+           nouts ? (double)(size - sizeof(uint16_t)) / nouts : 0.0,
+           nouts ? (double)(longSize - sizeof(uint16_t)) / nouts : 0.0);
+    free(outs);
+    free(outOf);
+    fclose(f_out);
+
+    /* Verify the output file */
+    int ret = verifyBbo(argv[2]);
+
+    /* Write the remap table */
+    if (argc == 4) {
+        FILE* f_map = fopen(argv[3], "w");
+        if (!f_map) {
+            fprintf(stderr, "Cannot open %s\n", argv[3]);
+            if (!ret) ret = 2;
+        }
+        else {
+            foreachTable(&refs, foreachremap, f_map);
+            fclose(f_map);
+        }
+    }
+
+    free(instrs);
     freeTable(&refs);
-    freeTable(&repl);
     fclose(f_in);
-    fclose(f_out);
 
-    return 0;
+    return ret;
 }
 #pragma GCC diagnostic pop
@@ -19,6 +19,7 @@ config_value(BBZOUTMSG_QUEUE_CAP 10)
 config_value(BBZHEAP_RSV_ACTREC_MAX 28)
 config_value(BBZLAMPORT_THRESHOLD 50)
 config_value(BBZHEAP_GCMARK_DEPTH 8)
+config_value(BBZHEAP_GC_ALLOC_THRESHOLD 16)
 config_value(BBZMSG_IN_PROC_MAX 10)
 config_value(BBZNEIGHBORS_CLR_PERIOD 10)
 config_value(BBZNEIGHBORS_MARK_TIME 4)
@@ -36,6 +37,73 @@ option(BBZ_BYTEWISE_ASSIGNMENT "Whether to make assignment byte per byte." OFF)
 option(BBZ_NEIGHBORS_USE_FLOATS "Whether to use floats for the neighbor's range and bearing measurments." ON)
 option(BBZ_ENABLE_FLOAT_OPERATIONS "Whether to enable floats operations" ON)
 
+# The table of label addresses used by threaded dispatch lives in RAM, which
+# is scarce on most robots.
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_DISABLE_THREADED_DISPATCH "Whether to dispatch instructions with a switch only." ON)
+else()
+    option(BBZ_DISABLE_THREADED_DISPATCH "Whether to dispatch instructions with a switch only." OFF)
+endif ()
+
+# Quickening rewrites instructions in place, so it only applies to bytecode
+# in RAM, and its handlers take program memory.
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_DISABLE_QUICKENING "Whether to disable the rewriting of instructions into type-specialized variants." ON)
+else()
+    option(BBZ_DISABLE_QUICKENING "Whether to disable the rewriting of instructions into type-specialized variants." OFF)
+endif ()
+
+# Robots run a single VM, and may not support thread-local storage.
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_USE_THREAD_LOCAL_VM "Whether the current VM is thread-local, so that threads may run VMs in parallel." OFF)
+else()
+    option(BBZ_USE_THREAD_LOCAL_VM "Whether the current VM is thread-local, so that threads may run VMs in parallel." ON)
+endif ()
+
+# Compiled bytecode takes much more program memory than bytecode.
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_ENABLE_AOT "Whether the VM may run bytecode compiled ahead of time to C by bbo2c." OFF)
+else()
+    option(BBZ_ENABLE_AOT "Whether the VM may run bytecode compiled ahead of time to C by bbo2c." ON)
+endif ()
+
+option(BBZ_PROFILE "Whether to record the executions and the time spent per instruction, garbage collection and message processing." OFF)
+option(BBZ_PC_SAMPLING "Whether the program counter may be sampled into a histogram, to find hot spots." OFF)
+
+# The bytecode is verified by bo2bbo, so robots need not do it again.
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_VERIFY_BCODE "Whether bytecode may be verified when it is loaded." OFF)
+else()
+    option(BBZ_VERIFY_BCODE "Whether bytecode may be verified when it is loaded." ON)
+endif ()
+option(BBZ_UNCHECKED "Whether the interpreter skips the PC, opcode and stack checks which verified bytecode cannot fail. Requires BBZ_VERIFY_BCODE." OFF)
+
+# Collecting garbage in the middle of an instruction requires C closures to
+# pin the objects they hold across allocations.
+option(BBZ_HEAP_GC_RETRY "Whether an allocation which finds the heap full collects garbage and retries, in the middle of an instruction." OFF)
+
+# The handlers of register instructions take program memory.
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_REGISTER_BCODE "Whether bo2bbo translates stack code over local symbols into register instructions." OFF)
+else()
+    option(BBZ_REGISTER_BCODE "Whether bo2bbo translates stack code over local symbols into register instructions." ON)
+endif ()
+
+# Inline caches of field accesses cost 4 bytes of RAM each, global
+# symbol slots and string intern table entries 2 bytes each, and function
+# list index entries 3 bytes each.
+if (CMAKE_CROSSCOMPILING)
+    config_value(BBZVM_ICACHE_SIZE 0)
+    config_value(BBZVM_GSYM_SLOTS 0)
+    config_value(BBZVM_FLIST_INDEX_SIZE 0)
+    config_value(BBZHEAP_STR_INTERN_SIZE 0)
+else()
+    config_value(BBZVM_ICACHE_SIZE 32)
+    config_value(BBZVM_GSYM_SLOTS 256)
+    config_value(BBZVM_FLIST_INDEX_SIZE 32)
+    config_value(BBZHEAP_STR_INTERN_SIZE 64)
+endif ()
+
 # TODO Currently, there is no implementation of swarmlist broadcasts because
 # neighbors.kin and neighbors.nonkin, which are the only closures that would
 # make use of it, are not implemented.
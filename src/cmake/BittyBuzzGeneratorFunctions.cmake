@@ -4,6 +4,10 @@ find_program(PRINTF "printf")
 # Generates a BittyBuzz object file. (produce a target that will generate the .bbo when needed)
 # bst_source is optional. You may specify a nonexistent file (such as the
 # empty string "") in order not to use any BST file.
+# If IMAGE is passed after bst_source, the boot image of the script is
+# generated as well, in <bzz_outdir>/<script>_image.h (see bbzimagegen).
+# If AOT is passed after bst_source, the script is compiled to C as well, in
+# <bzz_outdir>/<script>_aot.h, as the function bbzaot_<script> (see bbo2c).
 function(generate_bbo _TARGET bzz_outdir bzz_source bst_source)
     get_filename_component(BZZ_BASENAME ${bzz_source} NAME_WE)
     set(BZZ_BASEPATH "${bzz_outdir}/${BZZ_BASENAME}")
@@ -13,6 +17,7 @@ function(generate_bbo _TARGET bzz_outdir bzz_source bst_source)
     set(BO_FILE   ${BZZ_BASEPATH}.bo)
     set(BDB_FILE  ${BZZ_BASEPATH}.bdb)
     set(BBO_FILE  ${BZZ_BASEPATH}.bbo)
+    set(BMAP_FILE ${BZZ_BASEPATH}.bmap)
 
     # .bzz -> .basm
     # file(READ   "${BBZ_BASE_BST_FILE}" BBZ_BASE_BST)
@@ -33,13 +38,31 @@ function(generate_bbo _TARGET bzz_outdir bzz_source bst_source)
             COMMAND ${BZZASM} ${BASM_FILE} ${BO_FILE} ${BDB_FILE}
             DEPENDS ${BZZASM} ${BASM_FILE})
 
-    # .bo -> .bbo
-    add_custom_command(OUTPUT ${BBO_FILE}
-            COMMAND "$<TARGET_FILE:bo2bbo>" ${BO_FILE} ${BBO_FILE}
+    # .bo -> .bbo ; .bo -> .bmap (offsets in the .bbo of those in the .bo and .bdb)
+    add_custom_command(OUTPUT ${BBO_FILE} ${BMAP_FILE}
+            COMMAND "$<TARGET_FILE:bo2bbo>" ${BO_FILE} ${BBO_FILE} ${BMAP_FILE}
             DEPENDS ${BO_FILE})
 
+    # .bbo -> _image.h
+    set(IMAGE_FILE)
+    if ("IMAGE" IN_LIST ARGN)
+        set(IMAGE_FILE ${BZZ_BASEPATH}_image.h)
+        add_custom_command(OUTPUT ${IMAGE_FILE}
+                COMMAND "$<TARGET_FILE:bbzimagegen>" ${BBO_FILE} ${IMAGE_FILE}
+                DEPENDS ${BBO_FILE} bbzimagegen)
+    endif ()
+
+    # .bbo -> _aot.h
+    set(AOT_FILE)
+    if ("AOT" IN_LIST ARGN)
+        set(AOT_FILE ${BZZ_BASEPATH}_aot.h)
+        add_custom_command(OUTPUT ${AOT_FILE}
+                COMMAND "$<TARGET_FILE:bbo2c>" ${BBO_FILE} ${AOT_FILE} bbzaot_${BZZ_BASENAME}
+                DEPENDS ${BBO_FILE} bbo2c)
+    endif ()
+
     # Add the main target
-    add_custom_target(${_TARGET} DEPENDS ${BBO_FILE} "$<TARGET_FILE:bo2bbo>")
+    add_custom_target(${_TARGET} DEPENDS ${BBO_FILE} ${IMAGE_FILE} ${AOT_FILE} "$<TARGET_FILE:bo2bbo>")
 endfunction()
 
 
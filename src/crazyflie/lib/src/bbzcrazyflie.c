@@ -45,9 +45,7 @@ uint8_t myId = 0;
 
 extern Position robotPosition;
 extern float robotOrientation;
-bbzheap_idx_t pos_x_idx;
-bbzheap_idx_t pos_y_idx;
-bbzheap_idx_t pos_orientation_idx;
+bbzheap_idx_t pos_idx;
 
 volatile message_tx_t         message_tx;
 volatile message_tx_success_t message_tx_success;
@@ -56,6 +54,7 @@ volatile message_rx_t         message_rx;
 static void bbzTask(void * prm);
 
 static uint8_t has_setup = 0;
+static bbzvm_function_handle_t step_fun;
 
 uint16_t idX = 0.0;
 uint16_t idY = 0.0;
@@ -93,12 +92,9 @@ Position getCurrentPosition() {
     return pos;
 }
 
-void bbz_func_call(uint16_t strid) {
-    bbzvm_pushs(strid);
-    bbzheap_idx_t l = bbzvm_stack_at(0);
-    bbzvm_pop();
-//     DEBUG_PRINT("The value of bbztable_get1: %d.\n", bbztable_get(vmObj.gsyms, l, &l));
-    if(bbztable_get(vm->gsyms, l, &l)) {
+void bbz_func_call(bbzvm_function_handle_t* h) {
+    bbzheap_idx_t l = bbzvm_function_lookup(h);
+    if (bbztype_isclosure(*bbzheap_obj_at(l))) {
         bbzvm_pushnil(); // Push self table
         bbzvm_push(l);
         bbzvm_closure_call(0);
@@ -120,13 +116,10 @@ void handleOutgoingRadioMessage() {
     }
 }
 
-void bbzcrazyflie_func_call(uint16_t strid) {
-    bbzvm_pushs(strid);
-    bbzheap_idx_t l = bbzvm_stack_at(0);
-    bbzvm_pop();
-    // DEBUG_PRINT("The value of bbztable_get2: %d.\n", bbztable_get(vm->gsyms, l, &l));
-    if(bbztable_get(vm->gsyms, l, &l)) {
-        DEBUG_PRINT("bbztable_get called.\n");
+void bbzcrazyflie_func_call(bbzvm_function_handle_t* h) {
+    bbzheap_idx_t l = bbzvm_function_lookup(h);
+    if (bbztype_isclosure(*bbzheap_obj_at(l))) {
+        DEBUG_PRINT("Function found.\n");
         bbzvm_pushnil(); // Push self table
         bbzvm_push(l);
 
@@ -294,7 +287,9 @@ void bbzTask(void * param)
             else {
                 init_done = 1;
                 vm->state = BBZVM_STATE_READY;
-                bbz_func_call(__BBZSTRID_init);
+                bbzvm_function_handle_t init_fun = bbzvm_function_resolve(__BBZSTRID_init);
+                bbz_func_call(&init_fun);
+                step_fun = bbzvm_function_resolve(__BBZSTRID_step);
                 DEBUG_PRINT("VM: State Ready.\n");
 #ifndef BBZ_DISABLE_MESSAGES
                 message_tx = bbzwhich_msg_tx;
@@ -308,7 +303,7 @@ void bbzTask(void * param)
         else {
             if (vm->state != BBZVM_STATE_ERROR) {
                 bbzvm_process_inmsgs();
-                bbzcrazyflie_func_call(__BBZSTRID_step);
+                bbzcrazyflie_func_call(&step_fun);
                 DEBUG_PRINT("VM: bbzcrazyflie_func_call(__BBZSTRID_ step) called.\n");
                 bbzvm_process_outmsgs();
             }
@@ -321,21 +316,23 @@ void bbzTask(void * param)
 
 void bbz_createPosObject() {
     bbzvm_pusht(); // "pos"
-    pos_x_idx = bbzint_new(0);
-    pos_y_idx = bbzint_new(0);
-    pos_orientation_idx = bbzfloat_new(bbzfloat_fromint(0));
-    bbztable_add_data(__BBZSTRID_x, pos_x_idx);
-    bbztable_add_data(__BBZSTRID_y, pos_y_idx);
-    bbztable_add_data(__BBZSTRID_orientation, pos_orientation_idx);
+    pos_idx = bbzvm_stack_at(0);
+    bbztable_add_data(__BBZSTRID_x, bbzint_new(0));
+    bbztable_add_data(__BBZSTRID_y, bbzint_new(0));
+    bbztable_add_data(__BBZSTRID_orientation, bbzfloat_new(bbzfloat_fromint(0)));
     bbzvm_gsym_register(__BBZSTRID_pos, bbzvm_stack_at(0));
     bbzheap_obj_make_permanent(*bbzheap_obj_at(bbzvm_stack_at(0)));
     bbzvm_pop();
 }
 
 void bbz_updatePosObject() {
-    bbzvm_assign(&bbzheap_obj_at(pos_x_idx)->i.value, &robotPosition.x);
-    bbzvm_assign(&bbzheap_obj_at(pos_y_idx)->i.value, &robotPosition.y);
-    bbzheap_obj_at(pos_orientation_idx)->f.value = bbzfloat_fromfloat(robotOrientation);
+    // Numbers may be shared by several variables: store new ones instead of
+    // modifying the current ones.
+    bbzvm_push(pos_idx);
+    bbztable_add_data(__BBZSTRID_x, bbzint_new((int16_t)robotPosition.x));
+    bbztable_add_data(__BBZSTRID_y, bbzint_new((int16_t)robotPosition.y));
+    bbztable_add_data(__BBZSTRID_orientation, bbzfloat_new(bbzfloat_fromfloat(robotOrientation)));
+    bbzvm_pop();
 }
 
 void bbz_start(void (*setup)(void))
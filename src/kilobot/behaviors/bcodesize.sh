@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# Prints the size of the bytecode of each behavior, as reported by bo2bbo
+# when the behaviors were built: the size of the .bbo file, the bytes saved
+# by the short forms of instructions (operands of 8 bits instead of 16
+# bits), and the bytes the kilobot fetches per instruction (one lpm each)
+# with and without short forms. These are static counts; the bytes fetched
+# over a run are printed by bbzprofile from a profile dump. The build copies
+# this script next to the behaviors' directories.
+#
+# Usage: bcodesize.sh [<build directory of the behaviors>]
+
+BEHAVIORS_DIR=${1:-$(dirname "$0")}
+
+printf "%-32s %8s %8s %8s %10s %10s\n" "behavior" "bytes" "saved" "ratio" "lpm/instr" "long form"
+found=0
+for log in "${BEHAVIORS_DIR}"/*/log.txt; do
+    [ -f "${log}" ] || continue
+    # <file>.bbo: N instructions (M in the input), X bytes, Y saved by Z short operands,
+    #             F bytes fetched per instruction (L in long forms)
+    line=$(grep "bytes, .* saved by .* short operands" "${log}" | tail -1)
+    [ -n "${line}" ] || continue
+    name=$(basename "$(dirname "${log}")")
+    size=$(echo "${line}" | sed -E 's/.*, ([0-9]+) bytes, .*/\1/')
+    saved=$(echo "${line}" | sed -E 's/.* ([0-9]+) saved by .*/\1/')
+    fetched=$(echo "${line}" | sed -E 's/.* ([0-9.]+) bytes fetched per instruction .*/\1/')
+    longfetched=$(echo "${line}" | sed -E 's/.*\(([0-9.]+) in long forms\).*/\1/')
+    awk -v n="${name}" -v s="${size}" -v d="${saved}" -v f="${fetched}" -v l="${longfetched}" \
+        'BEGIN { printf("%-32s %8d %8d %7.1f%% %10.2f %10.2f\n", n, s, d, 100.0 * d / (s + d), f, l) }'
+    found=1
+done
+
+if [ "${found}" = "0" ]; then
+    echo "No behavior found in ${BEHAVIORS_DIR}. Build the behaviors first." >&2
+    exit 1
+fi
@@ -231,11 +231,11 @@ void inject_bc(int16_t val, bbzrobot_id_t rid, uint8_t dist) {
 #endif // !BBZ_DISABLE_NEIGHBORS
 #endif // DEBUG
 
-void bbzkilo_func_call(uint16_t strid) {
-    bbzvm_pushs(strid);
-    bbzheap_idx_t l = bbzvm_stack_at(0);
-    bbzvm_pop();
-    if(bbztable_get(kilo_vmObj.gsyms, l, &l)) {
+static bbzvm_function_handle_t step_fun;
+
+void bbzkilo_func_call(bbzvm_function_handle_t* h) {
+    bbzheap_idx_t l = bbzvm_function_lookup(h);
+    if (bbztype_isclosure(*bbzheap_obj_at(l))) {
         bbzvm_pushnil(); // Push self table
         bbzvm_push(l);
         bbzvm_closure_call(0);
@@ -319,7 +319,9 @@ void bbzkilo_start(void (*setup)(void)) {
                 else {
                     kilo_state = RUNNING;
                     vm->state = BBZVM_STATE_READY;
-                    bbzkilo_func_call(__BBZSTRID_init);
+                    bbzvm_function_handle_t init_fun = bbzvm_function_resolve(__BBZSTRID_init);
+                    bbzkilo_func_call(&init_fun);
+                    step_fun = bbzvm_function_resolve(__BBZSTRID_step);
 #ifndef BBZ_DISABLE_MESSAGES
                     kilo_message_tx = bbzwhich_msg_tx;
                     kilo_message_tx_success = bbzoutmsg_queue_next;
@@ -330,7 +332,7 @@ void bbzkilo_start(void (*setup)(void)) {
             case RUNNING:
                 if (vm->state != BBZVM_STATE_ERROR) {
                     bbzvm_process_inmsgs();
-                    bbzkilo_func_call(__BBZSTRID_step);
+                    bbzkilo_func_call(&step_fun);
                     bbzvm_process_outmsgs();
                 }
                 break;
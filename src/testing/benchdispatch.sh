@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# Runs benchvm with the interpreter's threaded dispatch and with its switch
+# dispatch (benchvm_switch), and prints the ratio of their throughputs on
+# each program. The build copies this script next to both executables.
+#
+# Usage: benchdispatch.sh [<directory of benchvm and benchvm_switch>]
+
+BENCH_DIR=${1:-$(dirname "$0")}
+
+for bench in benchvm benchvm_switch; do
+    if [ ! -x "${BENCH_DIR}/${bench}" ]; then
+        echo "${BENCH_DIR}/${bench} not found. Build it with BBZ_DISABLE_THREADED_DISPATCH=OFF." >&2
+        exit 1
+    fi
+done
+
+threaded=$("${BENCH_DIR}/benchvm") || exit 1
+switch=$("${BENCH_DIR}/benchvm_switch") || exit 1
+
+# Each table of benchvm has rows "program before after speedup": compare
+# the third column of the rows of both runs.
+awk '
+    FNR == 1 { ++run; table = 0 }
+    $1 == "program" {
+        ++table
+        heading[table] = substr($0, 33, 22)
+        next
+    }
+    NF == 4 && $2 ~ /^[0-9.]+$/ && $3 ~ /^[0-9.]+$/ {
+        key = table SUBSEP $1
+        if (run == 1) { threaded[key] = $3; rows[++nrows] = key; name[key] = $1; tbl[key] = table }
+        else          { switched[key] = $3 }
+    }
+    END {
+        last = 0
+        for (i = 1; i <= nrows; ++i) {
+            key = rows[i]
+            if (tbl[key] != last) {
+                last = tbl[key]
+                gsub(/^ +/, "", heading[last])
+                printf("\n%s\n%-8s %22s %22s %8s\n", heading[last], "program", "threaded", "switch", "ratio")
+            }
+            if (switched[key] > 0) {
+                printf("%-8s %22.0f %22.0f %7.2fx\n", name[key], threaded[key], switched[key], threaded[key] / switched[key])
+            }
+        }
+    }
+' <(echo "${threaded}") <(echo "${switch}")
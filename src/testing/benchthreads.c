@@ -0,0 +1,250 @@
+/**
+ * @file benchthreads.c
+ * @brief Host benchmark of VMs run in parallel threads.
+ * @details Runs the same pool of VMs with 1, 2 and 4 threads, and with as
+ * many threads as there are online processors, and reports the number of
+ * instructions executed per second by the whole pool. Each thread runs its
+ * VMs as testthreads does, switching between them every #SLICE
+ * instructions. This is not a unit test ; it is built along with the tests
+ * when BBZ_USE_THREAD_LOCAL_VM is ON, but not registered with CTest.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <bittybuzz/bbzvm.h>
+
+#include "testingvm.h"
+
+/**
+ * @brief Number of VMs run by the thread pool.
+ */
+#define NUM_VMS 256
+
+/**
+ * @brief Maximum number of threads of the pool.
+ */
+#define MAX_THREADS 64
+
+/**
+ * @brief Number of instructions a VM runs before its thread switches to
+ * the next one.
+ */
+#define SLICE 50
+
+/**
+ * @brief Number of iterations of the benchmark loop.
+ */
+#define BENCH_LOOP_COUNT 2000
+
+/**
+ * @brief Number of runs of which the fastest is kept, for each number of
+ * threads.
+ */
+#define BENCH_BEST_OF 3
+
+#define ARG(x) (uint8_t)((x) & 0xFF), (uint8_t)(((x) >> 8) & 0xFF)
+
+#define STRID_X  (_BBZSTRID_COUNT_ + 0)
+#define STRID_I  (_BBZSTRID_COUNT_ + 1)
+#define STRID_T  (_BBZSTRID_COUNT_ + 2)
+#define STRID_V  (_BBZSTRID_COUNT_ + 3)
+#define STRID_ID (_BBZSTRID_COUNT_ + 4)
+
+/**
+ * @brief Same program as testthreads'.
+ * @details Equivalent Buzz code:
+ *
+ *     x = rid()
+ *     i = 0
+ *     while (i < BENCH_LOOP_COUNT) {
+ *         t = {}
+ *         t.v = x * 7 + i
+ *         x = t.v % 1000
+ *         i = i + 1
+ *     }
+ */
+static const uint8_t bcode[] = {
+    ARG(0),
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /*  6 */ BBZVM_INSTR_PUSHNIL,
+    /*  7 */ BBZVM_INSTR_PUSHS, ARG(STRID_ID),
+    /* 10 */ BBZVM_INSTR_GLOAD,
+    /* 11 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 14 */ BBZVM_INSTR_CALLC,
+    /* 15 */ BBZVM_INSTR_GSTORE,
+    /* 16 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 19 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 22 */ BBZVM_INSTR_GSTORE,
+    /* 23 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 26 */ BBZVM_INSTR_GLOAD,
+    /* 27 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 30 */ BBZVM_INSTR_LT,
+    /* 31 */ BBZVM_INSTR_JUMPZ, ARG(91),
+    /* 34 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 37 */ BBZVM_INSTR_PUSHT,
+    /* 38 */ BBZVM_INSTR_GSTORE,
+    /* 39 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 42 */ BBZVM_INSTR_GLOAD,
+    /* 43 */ BBZVM_INSTR_PUSHS, ARG(STRID_V),
+    /* 46 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 49 */ BBZVM_INSTR_GLOAD,
+    /* 50 */ BBZVM_INSTR_PUSHI, ARG(7),
+    /* 53 */ BBZVM_INSTR_MUL,
+    /* 54 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 57 */ BBZVM_INSTR_GLOAD,
+    /* 58 */ BBZVM_INSTR_ADD,
+    /* 59 */ BBZVM_INSTR_TPUT,
+    /* 60 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 63 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 66 */ BBZVM_INSTR_GLOAD,
+    /* 67 */ BBZVM_INSTR_PUSHS, ARG(STRID_V),
+    /* 70 */ BBZVM_INSTR_TGET,
+    /* 71 */ BBZVM_INSTR_PUSHI, ARG(1000),
+    /* 74 */ BBZVM_INSTR_MOD,
+    /* 75 */ BBZVM_INSTR_GSTORE,
+    /* 76 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 79 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 82 */ BBZVM_INSTR_GLOAD,
+    /* 83 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 86 */ BBZVM_INSTR_ADD,
+    /* 87 */ BBZVM_INSTR_GSTORE,
+    /* 88 */ BBZVM_INSTR_JUMP, ARG(23),
+    /* 91 */ BBZVM_INSTR_DONE,                            // Loop exit
+};
+
+static bbzvm_t* vms;
+static uint16_t num_threads;
+
+/**
+ * @brief Final state of each VM.
+ */
+static bbzvm_state states[NUM_VMS];
+
+/**
+ * @brief C closure returning the id of the robot of the current VM.
+ */
+static void rid() {
+    bbzvm_pushi(vm->robot);
+}
+
+/**
+ * @brief Sets up the current VM to run the benchmark program.
+ * @param[in] robot The id of the VM's robot.
+ * @param[in] verify_buf State buffer of the bytecode verifier, of
+ * <code>sizeof(bcode)</code> bytes.
+ */
+static void bench_setup(bbzrobot_id_t robot, uint8_t* verify_buf) {
+    testing_vm_construct_with(robot, verify_buf, sizeof(bcode));
+    bbzvm_function_register(STRID_ID, rid);
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+}
+
+/**
+ * @brief Runs the VMs of a worker thread, switching between them every
+ * #SLICE instructions.
+ * @param[in] arg The index of the thread. Its VMs are the ones whose index
+ * is equal to it modulo the number of threads.
+ */
+static void* worker(void* arg) {
+    uint16_t first = (uint16_t)(uintptr_t)arg;
+    uint8_t verify_buf[sizeof(bcode)];
+    for (uint16_t i = first; i < NUM_VMS; i += num_threads) {
+        bbzvm_switch(&vms[i]);
+        bench_setup(i, verify_buf);
+    }
+    uint8_t running = 1;
+    while (running) {
+        running = 0;
+        for (uint16_t i = first; i < NUM_VMS; i += num_threads) {
+            bbzvm_switch(&vms[i]);
+            if (bbzvm_run_budget(SLICE) == BBZVM_STATE_YIELDED) running = 1;
+        }
+    }
+    for (uint16_t i = first; i < NUM_VMS; i += num_threads) {
+        bbzvm_switch(&vms[i]);
+        states[i] = vm->state;
+        bbzvm_destruct();
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs the pool of VMs with a number of threads.
+ * @param[in] threads The number of threads.
+ * @return The duration of the run (s), or a negative value on error.
+ */
+static double bench_pool(uint16_t threads) {
+    num_threads = threads;
+    pthread_t tids[MAX_THREADS];
+    struct timespec start, end;
+    // clock() would add up the time of all threads
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint16_t t = 0; t < num_threads; ++t) {
+        if (pthread_create(&tids[t], NULL, worker, (void*)(uintptr_t)t) != 0) {
+            fprintf(stderr, "Could not create thread %d\n", t);
+            return -1.0;
+        }
+    }
+    for (uint16_t t = 0; t < num_threads; ++t) {
+        pthread_join(tids[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (uint16_t i = 0; i < NUM_VMS; ++i) {
+        if (states[i] != BBZVM_STATE_DONE) {
+            fprintf(stderr, "VM %d ended in state %d\n", i, states[i]);
+            return -1.0;
+        }
+    }
+    return (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main() {
+    bbzvm_t mainObj;
+    bbzvm_switch(&mainObj);
+
+    // Number of instructions run by each VM
+    static uint8_t verify_buf[sizeof(bcode)];
+    bench_setup(0, verify_buf);
+    uint32_t instr = 0;
+    while (vm->state == BBZVM_STATE_READY) {
+        bbzvm_step();
+        ++instr;
+    }
+    if (vm->state != BBZVM_STATE_DONE) {
+        fprintf(stderr, "VM error %d at pc %d\n", vm->error, vm->pc);
+        return 1;
+    }
+    bbzvm_destruct();
+    const double total = (double)instr * NUM_VMS;
+
+    vms = (bbzvm_t*)malloc(NUM_VMS * sizeof(bbzvm_t));
+    if (!vms) return 1;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    uint16_t nmax = (ncpu < 1) ? 1 : (ncpu > MAX_THREADS) ? MAX_THREADS : (uint16_t)ncpu;
+    uint16_t counts[] = { 1, 2, 4, nmax };
+    uint8_t ncounts = (nmax == 1 || nmax == 2 || nmax == 4) ? 3 : 4;
+
+    printf("NUM_VMS = %d, %u instructions per VM, %d online processors\n\n",
+           NUM_VMS, instr, (int)ncpu);
+    printf("%-8s %22s %22s %8s\n", "threads", "pool (instr/s)", "thread (instr/s)", "speedup");
+    double base = 0.0;
+    for (uint8_t c = 0; c < ncounts; ++c) {
+        double best = 0.0;
+        for (uint8_t b = 0; b < BENCH_BEST_OF; ++b) {
+            double secs = bench_pool(counts[c]);
+            if (secs < 0.0) {
+                free(vms);
+                return 1;
+            }
+            if (secs > 0.0 && total / secs > best) best = total / secs;
+        }
+        if (c == 0) base = best;
+        printf("%-8d %22.0f %22.0f %7.2fx\n", counts[c], best, best / counts[c], best / base);
+    }
+    free(vms);
+    return 0;
+}
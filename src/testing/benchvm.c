@@ -0,0 +1,784 @@
+/**
+ * @file benchvm.c
+ * @brief Host benchmark of the VM's instruction throughput.
+ * @details Runs small bytecode programs and reports the number of
+ * instructions executed per second. This is not a unit test ; it is built
+ * along with the tests but not registered with CTest. It is also built as
+ * benchvm_switch, with the switch dispatch of the interpreter, and
+ * benchdispatch.sh compares the two.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <bittybuzz/bbzvm.h>
+
+#include "testingvm.h"
+
+/**
+ * @brief Number of times each program is run.
+ */
+#define BENCH_REPEAT 20
+
+/**
+ * @brief Number of iterations of the benchmark loops.
+ */
+#define BENCH_LOOP_COUNT 2000
+
+/**
+ * @brief Number of runs of which the fastest is kept, when comparing two
+ * forms of a program.
+ */
+#define BENCH_BEST_OF 9
+
+/**
+ * @brief Encodes a 16-bit operand (host byte order is little-endian).
+ */
+#define ARG(x) (uint8_t)((x) & 0xFF), (uint8_t)(((x) >> 8) & 0xFF)
+
+/*
+ * String IDs used by the benchmark programs. They do not clash with
+ * BittyBuzz's own string IDs.
+ */
+#define STRID_I (_BBZSTRID_COUNT_ + 0)
+#define STRID_T (_BBZSTRID_COUNT_ + 1)
+#define STRID_X (_BBZSTRID_COUNT_ + 2)
+#define STRID_F (_BBZSTRID_COUNT_ + 3)
+#define STRID_K(i) (_BBZSTRID_COUNT_ + 4 + (i))
+
+/**
+ * @brief Sets the field STRID_K(i) of the global table t to 1 (10 bytes).
+ */
+#define FIELD_SET(i) BBZVM_INSTR_GLOADS, ARG(STRID_T),                      \
+                     BBZVM_INSTR_PUSHS, ARG(STRID_K(i)),                    \
+                     BBZVM_INSTR_PUSHI, ARG(1),                             \
+                     BBZVM_INSTR_TPUT
+
+/**
+ * @brief Table and arithmetic loop.
+ * @details Equivalent Buzz code:
+ *
+ *     i = 0
+ *     while (i < BENCH_LOOP_COUNT) {
+ *         t = {}
+ *         t.x = i * 3
+ *         i = i + 1
+ *     }
+ */
+static const uint8_t bcode_loop[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /*  6 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 13 */ BBZVM_INSTR_GLOAD,
+    /* 14 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 17 */ BBZVM_INSTR_LT,
+    /* 18 */ BBZVM_INSTR_JUMPZ, ARG(57),
+    /* 21 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 24 */ BBZVM_INSTR_PUSHT,
+    /* 25 */ BBZVM_INSTR_GSTORE,
+    /* 26 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 29 */ BBZVM_INSTR_GLOAD,
+    /* 30 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 33 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 36 */ BBZVM_INSTR_GLOAD,
+    /* 37 */ BBZVM_INSTR_PUSHI, ARG(3),
+    /* 40 */ BBZVM_INSTR_MUL,
+    /* 41 */ BBZVM_INSTR_TPUT,
+    /* 42 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 45 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 48 */ BBZVM_INSTR_GLOAD,
+    /* 49 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 52 */ BBZVM_INSTR_ADD,
+    /* 53 */ BBZVM_INSTR_GSTORE,
+    /* 54 */ BBZVM_INSTR_JUMP, ARG(10),
+    /* 57 */ BBZVM_INSTR_DONE,                            // Loop exit
+};
+
+/**
+ * @brief Same loop as #bcode_loop, in a function.
+ * @details Equivalent Buzz code:
+ *
+ *     function f() {
+ *         i = 0
+ *         while (i < BENCH_LOOP_COUNT) {
+ *             t = {}
+ *             t.x = i * 3
+ *             i = i + 1
+ *         }
+ *     }
+ */
+static const uint8_t bcode_func[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  6 */ BBZVM_INSTR_PUSHL, ARG(11),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_DONE,
+    /* 11 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Function f
+    /* 14 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 17 */ BBZVM_INSTR_GSTORE,
+    /* 18 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 21 */ BBZVM_INSTR_GLOAD,
+    /* 22 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 25 */ BBZVM_INSTR_LT,
+    /* 26 */ BBZVM_INSTR_JUMPZ, ARG(65),
+    /* 29 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 32 */ BBZVM_INSTR_PUSHT,
+    /* 33 */ BBZVM_INSTR_GSTORE,
+    /* 34 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 37 */ BBZVM_INSTR_GLOAD,
+    /* 38 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 41 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 44 */ BBZVM_INSTR_GLOAD,
+    /* 45 */ BBZVM_INSTR_PUSHI, ARG(3),
+    /* 48 */ BBZVM_INSTR_MUL,
+    /* 49 */ BBZVM_INSTR_TPUT,
+    /* 50 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 53 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 56 */ BBZVM_INSTR_GLOAD,
+    /* 57 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 60 */ BBZVM_INSTR_ADD,
+    /* 61 */ BBZVM_INSTR_GSTORE,
+    /* 62 */ BBZVM_INSTR_JUMP, ARG(18),
+    /* 65 */ BBZVM_INSTR_RET0,                            // Loop exit
+};
+
+/**
+ * @brief Function call loop.
+ * @details Equivalent Buzz code:
+ *
+ *     function f(x) { return x + 1 }
+ *     i = 0
+ *     do {
+ *         i = f(i)
+ *     } while (i < BENCH_LOOP_COUNT)
+ */
+static const uint8_t bcode_calls[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  5 */ BBZVM_INSTR_PUSHL, ARG(46),
+    /*  8 */ BBZVM_INSTR_GSTORE,
+    /*  9 */ BBZVM_INSTR_NOP,
+    /* 10 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 13 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 16 */ BBZVM_INSTR_GSTORE,
+    /* 17 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 20 */ BBZVM_INSTR_PUSHNIL,
+    /* 21 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /* 24 */ BBZVM_INSTR_GLOAD,
+    /* 25 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 28 */ BBZVM_INSTR_GLOAD,
+    /* 29 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 32 */ BBZVM_INSTR_CALLC,
+    /* 33 */ BBZVM_INSTR_GSTORE,
+    /* 34 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 37 */ BBZVM_INSTR_GLOAD,
+    /* 38 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 41 */ BBZVM_INSTR_LT,
+    /* 42 */ BBZVM_INSTR_JUMPNZ, ARG(17),
+    /* 45 */ BBZVM_INSTR_DONE,                            // Loop exit
+    /* 46 */ BBZVM_INSTR_LLOAD, ARG(1),                   // Function f
+    /* 49 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 52 */ BBZVM_INSTR_ADD,
+    /* 53 */ BBZVM_INSTR_RET1,
+};
+
+/**
+ * @brief Field access loop, with generic table lookups.
+ * @details Equivalent Buzz code:
+ *
+ *     t = { .k0 = 1, .k1 = 1, ..., .k7 = 1 }
+ *     i = 0
+ *     while (i < BENCH_LOOP_COUNT) {
+ *         t.k7 + t.k0
+ *         i = i + 1
+ *     }
+ */
+static const uint8_t bcode_field[] = {
+    ARG(0),                                              // String count
+    /*   2 */ BBZVM_INSTR_NOP,
+    /*   3 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /*   6 */ BBZVM_INSTR_PUSHT,
+    /*   7 */ BBZVM_INSTR_GSTORE,
+    /*   8 */ FIELD_SET(0), FIELD_SET(1), FIELD_SET(2), FIELD_SET(3),
+    /*  48 */ FIELD_SET(4), FIELD_SET(5), FIELD_SET(6), FIELD_SET(7),
+    /*  88 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /*  91 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /*  94 */ BBZVM_INSTR_GSTORE,
+    /*  95 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),            // Loop head
+    /*  98 */ BBZVM_INSTR_GLOAD,
+    /*  99 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 102 */ BBZVM_INSTR_LT,
+    /* 103 */ BBZVM_INSTR_JUMPZ, ARG(142),
+    /* 106 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 109 */ BBZVM_INSTR_GLOAD,
+    /* 110 */ BBZVM_INSTR_PUSHS, ARG(STRID_K(7)),
+    /* 113 */ BBZVM_INSTR_TGET,
+    /* 114 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 117 */ BBZVM_INSTR_GLOAD,
+    /* 118 */ BBZVM_INSTR_PUSHS, ARG(STRID_K(0)),
+    /* 121 */ BBZVM_INSTR_TGET,
+    /* 122 */ BBZVM_INSTR_ADD,
+    /* 123 */ BBZVM_INSTR_POP,
+    /* 124 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 127 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 130 */ BBZVM_INSTR_GLOAD,
+    /* 131 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 134 */ BBZVM_INSTR_ADD,
+    /* 135 */ BBZVM_INSTR_GSTORE,
+    /* 136 */ BBZVM_INSTR_JUMP, ARG(95),
+    /* 139 */ BBZVM_INSTR_NOP,
+    /* 140 */ BBZVM_INSTR_NOP,
+    /* 141 */ BBZVM_INSTR_NOP,
+    /* 142 */ BBZVM_INSTR_DONE,                           // Loop exit
+};
+
+/**
+ * @brief Same loop as #bcode_field, with constant-key lookups (GLOADS and
+ * TGETS), which go through the VM's inline caches.
+ */
+static const uint8_t bcode_field_const[] = {
+    ARG(0),                                              // String count
+    /*   2 */ BBZVM_INSTR_NOP,
+    /*   3 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /*   6 */ BBZVM_INSTR_PUSHT,
+    /*   7 */ BBZVM_INSTR_GSTORE,
+    /*   8 */ FIELD_SET(0), FIELD_SET(1), FIELD_SET(2), FIELD_SET(3),
+    /*  48 */ FIELD_SET(4), FIELD_SET(5), FIELD_SET(6), FIELD_SET(7),
+    /*  88 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /*  91 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /*  94 */ BBZVM_INSTR_GSTORE,
+    /*  95 */ BBZVM_INSTR_GLOADS, ARG(STRID_I),           // Loop head
+    /*  98 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 101 */ BBZVM_INSTR_CMPJLT, ARG(132),
+    /* 104 */ BBZVM_INSTR_GLOADS, ARG(STRID_T),
+    /* 107 */ BBZVM_INSTR_TGETS, ARG(STRID_K(7)),
+    /* 110 */ BBZVM_INSTR_GLOADS, ARG(STRID_T),
+    /* 113 */ BBZVM_INSTR_TGETS, ARG(STRID_K(0)),
+    /* 116 */ BBZVM_INSTR_ADD,
+    /* 117 */ BBZVM_INSTR_POP,
+    /* 118 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 121 */ BBZVM_INSTR_GLOADS, ARG(STRID_I),
+    /* 124 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 127 */ BBZVM_INSTR_ADD,
+    /* 128 */ BBZVM_INSTR_GSTORE,
+    /* 129 */ BBZVM_INSTR_JUMP, ARG(95),
+    /* 132 */ BBZVM_INSTR_DONE,                           // Loop exit
+};
+
+/**
+ * @brief C closure called by bcode_native: returns its argument plus one.
+ */
+static void bench_inc() {
+    bbzvm_pushi(bbzheap_obj_at(bbzvm_argv()[0])->i.value + 1);
+}
+
+/**
+ * @brief C closure call loop.
+ * @details Same as bcode_calls, but f is bench_inc(), registered by
+ * bench_run().
+ */
+static const uint8_t bcode_native[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /*  6 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 13 */ BBZVM_INSTR_PUSHNIL,
+    /* 14 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /* 17 */ BBZVM_INSTR_GLOAD,
+    /* 18 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 21 */ BBZVM_INSTR_GLOAD,
+    /* 22 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 25 */ BBZVM_INSTR_CALLC,
+    /* 26 */ BBZVM_INSTR_GSTORE,
+    /* 27 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 30 */ BBZVM_INSTR_GLOAD,
+    /* 31 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 34 */ BBZVM_INSTR_LT,
+    /* 35 */ BBZVM_INSTR_JUMPNZ, ARG(10),
+    /* 38 */ BBZVM_INSTR_DONE,                            // Loop exit
+};
+
+/**
+ * @brief Integer arithmetic loop, in a function.
+ * @details Equivalent Buzz code:
+ *
+ *     function f() {
+ *         x = 0
+ *         i = 0
+ *         while (i < BENCH_LOOP_COUNT) {
+ *             x = i * 3 - x
+ *             i = i + 1
+ *         }
+ *     }
+ */
+static const uint8_t bcode_arith[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  6 */ BBZVM_INSTR_PUSHL, ARG(11),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_DONE,
+    /* 11 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),             // Function f
+    /* 14 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 17 */ BBZVM_INSTR_GSTORE,
+    /* 18 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 21 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 24 */ BBZVM_INSTR_GSTORE,
+    /* 25 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 28 */ BBZVM_INSTR_GLOAD,
+    /* 29 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 32 */ BBZVM_INSTR_LT,
+    /* 33 */ BBZVM_INSTR_JUMPZ, ARG(68),
+    /* 36 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 39 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 42 */ BBZVM_INSTR_GLOAD,
+    /* 43 */ BBZVM_INSTR_PUSHI, ARG(3),
+    /* 46 */ BBZVM_INSTR_MUL,
+    /* 47 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 50 */ BBZVM_INSTR_GLOAD,
+    /* 51 */ BBZVM_INSTR_SUB,
+    /* 52 */ BBZVM_INSTR_GSTORE,
+    /* 53 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 56 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 59 */ BBZVM_INSTR_GLOAD,
+    /* 60 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 63 */ BBZVM_INSTR_ADD,
+    /* 64 */ BBZVM_INSTR_GSTORE,
+    /* 65 */ BBZVM_INSTR_JUMP, ARG(25),
+    /* 68 */ BBZVM_INSTR_RET0,                            // Loop exit
+};
+
+/**
+ * @brief Float arithmetic loop, in a function.
+ * @details Equivalent Buzz code:
+ *
+ *     function f() {
+ *         x = 1.0
+ *         i = 0
+ *         while (i < BENCH_LOOP_COUNT) {
+ *             x = x * 0.75 + 0.5 - 0.25
+ *             i = i + 1
+ *         }
+ *     }
+ */
+static const uint8_t bcode_farith[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  6 */ BBZVM_INSTR_PUSHL, ARG(11),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_DONE,
+    /* 11 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),             // Function f
+    /* 14 */ BBZVM_INSTR_PUSHF, ARG(0x3E00),              // 1.0
+    /* 17 */ BBZVM_INSTR_GSTORE,
+    /* 18 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 21 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 24 */ BBZVM_INSTR_GSTORE,
+    /* 25 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 28 */ BBZVM_INSTR_GLOAD,
+    /* 29 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 32 */ BBZVM_INSTR_LT,
+    /* 33 */ BBZVM_INSTR_JUMPZ, ARG(71),
+    /* 36 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 39 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 42 */ BBZVM_INSTR_GLOAD,
+    /* 43 */ BBZVM_INSTR_PUSHF, ARG(0x3D00),              // 0.75
+    /* 46 */ BBZVM_INSTR_MUL,
+    /* 47 */ BBZVM_INSTR_PUSHF, ARG(0x3C00),              // 0.5
+    /* 50 */ BBZVM_INSTR_ADD,
+    /* 51 */ BBZVM_INSTR_PUSHF, ARG(0x3A00),              // 0.25
+    /* 54 */ BBZVM_INSTR_SUB,
+    /* 55 */ BBZVM_INSTR_GSTORE,
+    /* 56 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 59 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 62 */ BBZVM_INSTR_GLOAD,
+    /* 63 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 66 */ BBZVM_INSTR_ADD,
+    /* 67 */ BBZVM_INSTR_GSTORE,
+    /* 68 */ BBZVM_INSTR_JUMP, ARG(25),
+    /* 71 */ BBZVM_INSTR_RET0,                            // Loop exit
+};
+
+#ifdef BBZ_REGISTER_BCODE
+/**
+ * @brief Integer arithmetic loop on local variables, in stack bytecode.
+ * @details Equivalent Buzz code:
+ *
+ *     function f() {
+ *         var x = 0
+ *         var i = 0
+ *         var k = 3
+ *         var y = 0
+ *         while (i < BENCH_LOOP_COUNT) {
+ *             x = i * k - x
+ *             i = i + 1
+ *         }
+ *     }
+ *
+ * Instructions have the short forms bo2bbo would give them.
+ */
+static const uint8_t bcode_sarith[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  6 */ BBZVM_INSTR_PUSHL, ARG(11),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_DONE,
+    /* 11 */ BBZVM_INSTR_PUSHI8, 0,                       // Function f
+    /* 13 */ BBZVM_INSTR_LSTORE8, 1,
+    /* 15 */ BBZVM_INSTR_PUSHI8, 0,
+    /* 17 */ BBZVM_INSTR_LSTORE8, 2,
+    /* 19 */ BBZVM_INSTR_PUSHI8, 3,
+    /* 21 */ BBZVM_INSTR_LSTORE8, 3,
+    /* 23 */ BBZVM_INSTR_PUSHI8, 0,
+    /* 25 */ BBZVM_INSTR_LSTORE8, 4,
+    /* 27 */ BBZVM_INSTR_LLOAD8, 2,                       // Loop head
+    /* 29 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 32 */ BBZVM_INSTR_LT,
+    /* 33 */ BBZVM_INSTR_JUMPZ8, 19,                      // To 54
+    /* 35 */ BBZVM_INSTR_LLOAD8, 2,
+    /* 37 */ BBZVM_INSTR_LLOAD8, 3,
+    /* 39 */ BBZVM_INSTR_MUL,
+    /* 40 */ BBZVM_INSTR_LLOAD8, 1,
+    /* 42 */ BBZVM_INSTR_SUB,
+    /* 43 */ BBZVM_INSTR_LSTORE8, 1,
+    /* 45 */ BBZVM_INSTR_LLOAD8, 2,
+    /* 47 */ BBZVM_INSTR_PUSHI8, 1,
+    /* 49 */ BBZVM_INSTR_ADD,
+    /* 50 */ BBZVM_INSTR_LSTORE8, 2,
+    /* 52 */ BBZVM_INSTR_JUMP8, (uint8_t)-27,             // To 27
+    /* 54 */ BBZVM_INSTR_RET0,                            // Loop exit
+};
+
+/**
+ * @brief Same loop as #bcode_sarith, with register instructions. Local y
+ * holds the product.
+ */
+static const uint8_t bcode_rarith[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  6 */ BBZVM_INSTR_PUSHL, ARG(11),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_DONE,
+    /* 11 */ BBZVM_INSTR_RSETI, 1, 0,                     // Function f
+    /* 14 */ BBZVM_INSTR_RSETI, 2, 0,
+    /* 17 */ BBZVM_INSTR_RSETI, 3, 3,
+    /* 20 */ BBZVM_INSTR_RSETI, 4, 0,
+    /* 23 */ BBZVM_INSTR_LLOAD8, 2,                       // Loop head
+    /* 25 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 28 */ BBZVM_INSTR_LT,
+    /* 29 */ BBZVM_INSTR_JUMPZ8, 14,                      // To 45
+    /* 31 */ BBZVM_INSTR_RMUL, 4, 2, 3,
+    /* 35 */ BBZVM_INSTR_RSUB, 1, 4, 1,
+    /* 39 */ BBZVM_INSTR_RADDI, 2, 2, 1,
+    /* 43 */ BBZVM_INSTR_JUMP8, (uint8_t)-22,             // To 23
+    /* 45 */ BBZVM_INSTR_RET0,                            // Loop exit
+};
+
+/**
+ * @brief Field sum loop on local variables, in stack bytecode.
+ * @details Equivalent Buzz code:
+ *
+ *     function f() {
+ *         var t = {}
+ *         t.x = 5
+ *         var s = 0
+ *         var i = 0
+ *         var v = 0
+ *         while (i < BENCH_LOOP_COUNT) {
+ *             v = t.x
+ *             s = s + v
+ *             i = i + 1
+ *         }
+ *     }
+ */
+static const uint8_t bcode_sfield[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  6 */ BBZVM_INSTR_PUSHL, ARG(11),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_DONE,
+    /* 11 */ BBZVM_INSTR_PUSHT,                           // Function f
+    /* 12 */ BBZVM_INSTR_LSTORE8, 1,
+    /* 14 */ BBZVM_INSTR_LLOAD8, 1,
+    /* 16 */ BBZVM_INSTR_PUSHS8, STRID_X,
+    /* 18 */ BBZVM_INSTR_PUSHI8, 5,
+    /* 20 */ BBZVM_INSTR_TPUT,
+    /* 21 */ BBZVM_INSTR_PUSHI8, 0,
+    /* 23 */ BBZVM_INSTR_LSTORE8, 2,
+    /* 25 */ BBZVM_INSTR_PUSHI8, 0,
+    /* 27 */ BBZVM_INSTR_LSTORE8, 3,
+    /* 29 */ BBZVM_INSTR_PUSHI8, 0,
+    /* 31 */ BBZVM_INSTR_LSTORE8, 4,
+    /* 33 */ BBZVM_INSTR_LLOAD8, 3,                       // Loop head
+    /* 35 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 38 */ BBZVM_INSTR_LT,
+    /* 39 */ BBZVM_INSTR_JUMPZ8, 23,                      // To 64
+    /* 41 */ BBZVM_INSTR_LLOAD8, 1,
+    /* 43 */ BBZVM_INSTR_TGETS, ARG(STRID_X),
+    /* 46 */ BBZVM_INSTR_LSTORE8, 4,
+    /* 48 */ BBZVM_INSTR_LLOAD8, 2,
+    /* 50 */ BBZVM_INSTR_LLOAD8, 4,
+    /* 52 */ BBZVM_INSTR_ADD,
+    /* 53 */ BBZVM_INSTR_LSTORE8, 2,
+    /* 55 */ BBZVM_INSTR_LLOAD8, 3,
+    /* 57 */ BBZVM_INSTR_PUSHI8, 1,
+    /* 59 */ BBZVM_INSTR_ADD,
+    /* 60 */ BBZVM_INSTR_LSTORE8, 3,
+    /* 62 */ BBZVM_INSTR_JUMP8, (uint8_t)-31,             // To 33
+    /* 64 */ BBZVM_INSTR_RET0,                            // Loop exit
+};
+
+/**
+ * @brief Same loop as #bcode_sfield, with register instructions.
+ */
+static const uint8_t bcode_rfield[] = {
+    ARG(0),                                              // String count
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_F),
+    /*  6 */ BBZVM_INSTR_PUSHL, ARG(11),
+    /*  9 */ BBZVM_INSTR_GSTORE,
+    /* 10 */ BBZVM_INSTR_DONE,
+    /* 11 */ BBZVM_INSTR_PUSHT,                           // Function f
+    /* 12 */ BBZVM_INSTR_LSTORE8, 1,
+    /* 14 */ BBZVM_INSTR_LLOAD8, 1,
+    /* 16 */ BBZVM_INSTR_PUSHS8, STRID_X,
+    /* 18 */ BBZVM_INSTR_PUSHI8, 5,
+    /* 20 */ BBZVM_INSTR_TPUT,
+    /* 21 */ BBZVM_INSTR_RSETI, 2, 0,
+    /* 24 */ BBZVM_INSTR_RSETI, 3, 0,
+    /* 27 */ BBZVM_INSTR_RSETI, 4, 0,
+    /* 30 */ BBZVM_INSTR_LLOAD8, 3,                       // Loop head
+    /* 32 */ BBZVM_INSTR_PUSHI, ARG(BENCH_LOOP_COUNT),
+    /* 35 */ BBZVM_INSTR_LT,
+    /* 36 */ BBZVM_INSTR_JUMPZ8, 14,                      // To 52
+    /* 38 */ BBZVM_INSTR_RGETF, 4, 1, STRID_X,
+    /* 42 */ BBZVM_INSTR_RADD, 2, 2, 4,
+    /* 46 */ BBZVM_INSTR_RADDI, 3, 3, 1,
+    /* 50 */ BBZVM_INSTR_JUMP8, (uint8_t)-22,             // To 30
+    /* 52 */ BBZVM_INSTR_RET0,                            // Loop exit
+};
+#endif // BBZ_REGISTER_BCODE
+
+static const uint8_t* bench_bcode;
+
+static const uint8_t* bench_fetch(bbzpc_t offset, uint8_t size) {
+    RM_UNUSED_WARN(size);
+    return bench_bcode + offset;
+}
+
+static bbzvm_t vmObj;
+
+/**
+ * @brief Constructs the VM.
+ */
+static void bench_construct() {
+    vm = &vmObj;
+    testing_vm_construct(0);
+}
+
+/**
+ * @brief Duration of the last benchmark (s).
+ */
+static double bench_secs;
+
+/**
+ * @brief Runs a program #BENCH_REPEAT times.
+ * @param[in] name Name of the program.
+ * @param[in] bcode The bytecode.
+ * @param[in] size Size of the bytecode.
+ * @param[in] gc_every_step Whether to collect garbage before every
+ * instruction, as the VM did before garbage collections were paced by
+ * allocations.
+ * @return The number of instructions per second, or a negative value on error.
+ */
+static double bench_run(const char* name,
+                        const uint8_t* bcode,
+                        uint16_t size,
+                        uint8_t gc_every_step) {
+    bench_construct();
+    bbzvm_function_register(STRID_F, bench_inc);
+    bench_bcode = bcode;
+    uint32_t instr = 0;
+    clock_t start = clock();
+    for (uint8_t r = 0; r < BENCH_REPEAT; ++r) {
+        bbzvm_set_bcode(bench_fetch, size);
+        while (vm->state == BBZVM_STATE_READY) {
+            if (gc_every_step) bbzvm_gc();
+            bbzvm_step();
+            ++instr;
+        }
+        if (vm->state == BBZVM_STATE_ERROR) {
+            fprintf(stderr, "%s: VM error %d at pc %d\n", name, vm->error, vm->pc);
+            bbzvm_destruct();
+            return -1.0;
+        }
+    }
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    bench_secs = secs;
+    bbzvm_destruct();
+    return secs > 0.0 ? instr / secs : 0.0;
+}
+
+/**
+ * @brief Calls the function #STRID_F of a program #BENCH_REPEAT times.
+ * @param[in] name Name of the program.
+ * @param[in] bcode The bytecode.
+ * @param[in] size Size of the bytecode.
+ * @param[in] stepped Whether to execute the function one bbzvm_step() at
+ * a time rather than through bbzvm_closure_call().
+ * @param[in,out] instr Number of instructions executed by a call, computed
+ * when \c stepped is non-zero.
+ * @param[in] rw Buffer of \c size bytes in which the bytecode is copied
+ * and quickened by the VM, or NULL to run the bytecode read-only.
+ * @return The number of instructions per second, or a negative value on error.
+ */
+static double bench_call(const char* name,
+                         const uint8_t* bcode,
+                         uint16_t size,
+                         uint8_t stepped,
+                         uint32_t* instr,
+                         uint8_t* rw) {
+    bench_construct();
+    bench_bcode = bcode;
+    if (rw) {
+        memcpy(rw, bcode, size);
+        bbzvm_set_bcode_rw(rw, size);
+    }
+    else {
+        bbzvm_set_bcode(bench_fetch, size);
+    }
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    vm->state = BBZVM_STATE_READY;
+    bbzvm_pushs(STRID_F);
+    bbzvm_gload();
+    bbzheap_idx_t f = bbzvm_stack_at(0);
+    bbzvm_pop();
+    int16_t stackptr = vm->stackptr;
+    if (stepped) *instr = 0;
+    clock_t start = clock();
+    for (uint8_t r = 0; r < BENCH_REPEAT && vm->state == BBZVM_STATE_READY; ++r) {
+        bbzvm_pushnil(); // Push self table
+        bbzvm_push(f);
+        if (stepped) {
+            bbzvm_pushi(0);
+            int16_t blockptr = vm->blockptr;
+            bbzvm_callc();
+            while (blockptr < vm->blockptr && vm->state == BBZVM_STATE_READY) {
+                bbzvm_step();
+                ++*instr;
+            }
+        }
+        else {
+            bbzvm_closure_call(0);
+        }
+        vm->stackptr = stackptr;
+    }
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    bench_secs = secs;
+    if (vm->state == BBZVM_STATE_ERROR) {
+        fprintf(stderr, "%s: VM error %d at pc %d\n", name, vm->error, vm->pc);
+        bbzvm_destruct();
+        return -1.0;
+    }
+    bbzvm_destruct();
+    return secs > 0.0 ? *instr / secs : 0.0;
+}
+
+int main() {
+    printf("BBZHEAP_SIZE = %d, BBZHEAP_GC_ALLOC_THRESHOLD = %d, BBZVM_ICACHE_SIZE = %d\n",
+           BBZHEAP_SIZE, BBZHEAP_GC_ALLOC_THRESHOLD, BBZVM_ICACHE_SIZE);
+#ifdef BBZ_DISABLE_THREADED_DISPATCH
+    printf("Dispatch: switch\n\n");
+#else
+    printf("Dispatch: threaded (if supported by the compiler)\n\n");
+#endif
+    printf("%-8s %22s %22s %8s\n", "program", "gc/instr (instr/s)", "paced gc (instr/s)", "speedup");
+    double before = bench_run("loop", bcode_loop, sizeof(bcode_loop), 1);
+    double after  = bench_run("loop", bcode_loop, sizeof(bcode_loop), 0);
+    if (before <= 0.0 || after <= 0.0) return 1;
+    printf("%-8s %22.0f %22.0f %7.2fx\n", "loop", before, after, after / before);
+    before = bench_run("calls", bcode_calls, sizeof(bcode_calls), 1);
+    after  = bench_run("calls", bcode_calls, sizeof(bcode_calls), 0);
+    if (before <= 0.0 || after <= 0.0) return 1;
+    printf("%-8s %22.0f %22.0f %7.2fx\n", "calls", before, after, after / before);
+    before = bench_run("native", bcode_native, sizeof(bcode_native), 1);
+    after  = bench_run("native", bcode_native, sizeof(bcode_native), 0);
+    if (before <= 0.0 || after <= 0.0) return 1;
+    printf("%-8s %22.0f %22.0f %7.2fx\n", "native", before, after, after / before);
+
+    printf("\n%-8s %22s %22s %8s\n", "program", "step (instr/s)", "call (instr/s)", "speedup");
+    uint32_t instr;
+    before = bench_call("func", bcode_func, sizeof(bcode_func), 1, &instr, NULL);
+    after  = bench_call("func", bcode_func, sizeof(bcode_func), 0, &instr, NULL);
+    if (before <= 0.0 || after <= 0.0) return 1;
+    printf("%-8s %22.0f %22.0f %7.2fx\n", "func", before, after, after / before);
+
+    printf("\n%-8s %22s %22s %8s\n", "program", "generic (instr/s)", "quickened (instr/s)", "speedup");
+    static uint8_t rw[sizeof(bcode_farith)];
+    const struct { const char* name; const uint8_t* bcode; uint16_t size; } quick[] = {
+        { "func",   bcode_func,   sizeof(bcode_func)   },
+        { "arith",  bcode_arith,  sizeof(bcode_arith)  },
+#ifdef BBZ_ENABLE_FLOAT_OPERATIONS
+        { "farith", bcode_farith, sizeof(bcode_farith) },
+#endif
+    };
+    for (uint8_t q = 0; q < sizeof(quick) / sizeof(*quick); ++q) {
+        if (bench_call(quick[q].name, quick[q].bcode, quick[q].size, 1, &instr, NULL) <= 0.0) return 1;
+        before = bench_call(quick[q].name, quick[q].bcode, quick[q].size, 0, &instr, NULL);
+        after  = bench_call(quick[q].name, quick[q].bcode, quick[q].size, 0, &instr, rw);
+        if (before <= 0.0 || after <= 0.0) return 1;
+        printf("%-8s %22.0f %22.0f %7.2fx\n", quick[q].name, before, after, after / before);
+    }
+
+    printf("\n%-8s %22s %22s %8s\n", "program", "TGET (loops/s)", "TGETS (loops/s)", "speedup");
+    const double loops = (double)BENCH_REPEAT * BENCH_LOOP_COUNT;
+    if (bench_run("field", bcode_field, sizeof(bcode_field), 0) <= 0.0) return 1;
+    before = loops / bench_secs;
+    if (bench_run("field", bcode_field_const, sizeof(bcode_field_const), 0) <= 0.0) return 1;
+    after = loops / bench_secs;
+    printf("%-8s %22.0f %22.0f %7.2fx\n", "field", before, after, after / before);
+
+#ifdef BBZ_REGISTER_BCODE
+    // Same loops in stack and register bytecode: instructions per call,
+    // then loops per second
+    const struct { const char* name; const uint8_t* sbcode; uint16_t ssize;
+                   const uint8_t* rbcode; uint16_t rsize; } regs[] = {
+        { "arith", bcode_sarith, sizeof(bcode_sarith), bcode_rarith, sizeof(bcode_rarith) },
+        { "field", bcode_sfield, sizeof(bcode_sfield), bcode_rfield, sizeof(bcode_rfield) },
+    };
+    uint32_t sinstr[sizeof(regs) / sizeof(*regs)], rinstr[sizeof(regs) / sizeof(*regs)];
+    double sloops[sizeof(regs) / sizeof(*regs)], rloops[sizeof(regs) / sizeof(*regs)];
+    for (uint8_t q = 0; q < sizeof(regs) / sizeof(*regs); ++q) {
+        if (bench_call(regs[q].name, regs[q].sbcode, regs[q].ssize, 1, &sinstr[q], NULL) <= 0.0) return 1;
+        if (bench_call(regs[q].name, regs[q].rbcode, regs[q].rsize, 1, &rinstr[q], NULL) <= 0.0) return 1;
+        // Runs are short: keep the best of a few, alternating both forms
+        sloops[q] = rloops[q] = 0.0;
+        for (uint8_t b = 0; b < BENCH_BEST_OF; ++b) {
+            if (bench_call(regs[q].name, regs[q].sbcode, regs[q].ssize, 0, &sinstr[q], NULL) <= 0.0) return 1;
+            if (loops / bench_secs > sloops[q]) sloops[q] = loops / bench_secs;
+            if (bench_call(regs[q].name, regs[q].rbcode, regs[q].rsize, 0, &rinstr[q], NULL) <= 0.0) return 1;
+            if (loops / bench_secs > rloops[q]) rloops[q] = loops / bench_secs;
+        }
+    }
+    printf("\n%-8s %22s %22s %8s\n", "program", "stack (instr/call)", "register (instr/call)", "ratio");
+    for (uint8_t q = 0; q < sizeof(regs) / sizeof(*regs); ++q) {
+        printf("%-8s %22.0f %22.0f %7.2fx\n", regs[q].name,
+               (double)sinstr[q] / BENCH_REPEAT, (double)rinstr[q] / BENCH_REPEAT,
+               (double)sinstr[q] / rinstr[q]);
+    }
+    printf("\n%-8s %22s %22s %8s\n", "program", "stack (loops/s)", "register (loops/s)", "speedup");
+    for (uint8_t q = 0; q < sizeof(regs) / sizeof(*regs); ++q) {
+        printf("%-8s %22.0f %22.0f %7.2fx\n", regs[q].name, sloops[q], rloops[q], rloops[q] / sloops[q]);
+    }
+#endif // BBZ_REGISTER_BCODE
+    return 0;
+}
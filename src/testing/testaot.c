@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <bittybuzz/bbzvm.h>
+
+#define NUM_TEST_CASES 4
+#define TEST_MODULE aot
+#include "testingconfig.h"
+
+/*
+ * The test scripts, compiled ahead of time by bbo2c.
+ */
+#include "resources/1_InstrTest_aot.h"
+#include "resources/2_IfTest_aot.h"
+#include "resources/3_test1_aot.h"
+#include "resources/4_AllFeaturesTest_aot.h"
+
+    // ======================================
+    // =                MISC                =
+    // ======================================
+
+/**
+ * @brief Number of instructions per call to bbzvm_run_budget() in the
+ * sliced runs.
+ */
+#define SLICE 7
+
+/**
+ * @brief Maximum number of calls to bbzvm_run_budget(), in case a script
+ * does not terminate.
+ */
+#define MAX_SLICES 100000
+
+static bbzvm_t vm_interp;
+static bbzvm_t vm_aot;
+static bbzvm_t vm_aot_sliced;
+static uint8_t* bcode;
+static uint16_t bcode_size;
+
+static void dummy_error_receiver(bbzvm_error errcode) {
+    RM_UNUSED_WARN(errcode);
+}
+
+static void bbzvm_dummy() {
+    bbzvm_ret0();
+}
+
+/**
+ * @brief Reads a script.
+ * @param[in] fname The path of the .bbo file.
+ * @return 1 if the script was read, 0 otherwise.
+ */
+static uint8_t read_bcode(const char* fname) {
+    FILE* f = fopen(fname, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    free(bcode);
+    bcode = malloc((size_t)fsize);
+    uint8_t ok = fsize > 0 && bcode &&
+                 fread(bcode, 1, (size_t)fsize, f) == (size_t)fsize;
+    fclose(f);
+    bcode_size = (uint16_t)fsize;
+    return ok;
+}
+
+/**
+ * @brief Runs the script in a VM until it terminates.
+ * @param[in] ctx The VM.
+ * @param[in] aot_fun The compiled script, or NULL to interpret it.
+ * @param[in] slice The number of instructions per call to
+ * bbzvm_run_budget(), or 0 for no limit.
+ * @return The time the script took to run.
+ */
+static clock_t run(bbzvm_t* ctx, bbzvm_aot_fun aot_fun, uint16_t slice) {
+    vm = ctx;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(dummy_error_receiver);
+    bbzvm_set_bcode_ptr(bcode, bcode_size);
+    for (int16_t i = 0; i < 6; ++i) {
+        bbzvm_function_register(_BBZSTRID_COUNT_ + i, bbzvm_dummy);
+    }
+    bbzvm_set_aot(aot_fun);
+    clock_t start = clock();
+    uint32_t n = 0;
+    while (bbzvm_run_budget(slice) == BBZVM_STATE_YIELDED && ++n < MAX_SLICES);
+    return clock() - start;
+}
+
+/**
+ * @brief Checks that two VMs are in the same state.
+ */
+static void assert_same(bbzvm_t* a, bbzvm_t* b) {
+    ASSERT_EQUAL(a->state, b->state);
+    ASSERT_EQUAL(a->error, b->error);
+    ASSERT_EQUAL(a->pc, b->pc);
+    ASSERT_EQUAL(a->stackptr, b->stackptr);
+    ASSERT_EQUAL(a->blockptr, b->blockptr);
+    ASSERT_EQUAL(a->localptr, b->localptr);
+    ASSERT(a->stackptr < 0 ||
+           !memcmp(a->stack, b->stack, (size_t)(a->stackptr + 1) * sizeof(a->stack[0])));
+    ASSERT_EQUAL(a->heap.rtobj - a->heap.data, b->heap.rtobj - b->heap.data);
+    ASSERT_EQUAL(a->heap.ltseg - a->heap.data, b->heap.ltseg - b->heap.data);
+    ASSERT(!memcmp(a->heap.data, b->heap.data, sizeof(a->heap.data)));
+    ASSERT_EQUAL(a->gsyms, b->gsyms);
+#if BBZVM_GSYM_SLOTS > 0
+    ASSERT(!memcmp(a->gslots, b->gslots, sizeof(a->gslots)));
+#endif // BBZVM_GSYM_SLOTS > 0
+}
+
+/**
+ * @brief Runs a script both interpreted and compiled, and checks that the
+ * results are the same.
+ * @param[in] fname The path of the .bbo file.
+ * @param[in] aot_fun The compiled script.
+ */
+static void compare(const char* fname, bbzvm_aot_fun aot_fun) {
+    REQUIRE(read_bcode(fname));
+    clock_t t_interp = run(&vm_interp, NULL, 0);
+    clock_t t_aot = run(&vm_aot, aot_fun, 0);
+    run(&vm_aot_sliced, aot_fun, SLICE);
+    ASSERT(vm_interp.state == BBZVM_STATE_DONE || vm_interp.state == BBZVM_STATE_ERROR);
+    assert_same(&vm_interp, &vm_aot);
+    assert_same(&vm_interp, &vm_aot_sliced);
+    printf("%s: interpreted %ld us, compiled %ld us\n", fname,
+           (long)(t_interp * 1000000 / CLOCKS_PER_SEC),
+           (long)(t_aot * 1000000 / CLOCKS_PER_SEC));
+    vm = &vm_interp;       bbzvm_destruct();
+    vm = &vm_aot;          bbzvm_destruct();
+    vm = &vm_aot_sliced;   bbzvm_destruct();
+}
+
+    // ======================================
+    // =             UNIT TESTS             =
+    // ======================================
+
+TEST(aot_instr_test) {
+    compare("resources/1_InstrTest.bbo", bbzaot_1_InstrTest);
+}
+
+TEST(aot_if_test) {
+    compare("resources/2_IfTest.bbo", bbzaot_2_IfTest);
+}
+
+TEST(aot_test1) {
+    compare("resources/3_test1.bbo", bbzaot_3_test1);
+}
+
+TEST(aot_all_features) {
+    compare("resources/4_AllFeaturesTest.bbo", bbzaot_4_AllFeaturesTest);
+}
+
+TEST_LIST {
+    ADD_TEST(aot_instr_test);
+    ADD_TEST(aot_if_test);
+    ADD_TEST(aot_test1);
+    ADD_TEST(aot_all_features);
+}
@@ -1,6 +1,6 @@
 #include <bittybuzz/bbzvm.h>
 
-#define NUM_TEST_CASES 5
+#define NUM_TEST_CASES 6
 #define TEST_MODULE heap
 #include "testingconfig.h"
 
@@ -159,7 +159,221 @@ TEST(clear) {
     bbzheap_clear();
 }
 
+TEST(immediates) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+
+    // Encoding and decoding of small integers
+    int16_t vals[] = {0, 1, -1, 42, BBZHEAP_IMMINT_MIN, BBZHEAP_IMMINT_MAX};
+    for (uint8_t i = 0; i < sizeof(vals)/sizeof(*vals); ++i) {
+        bbzheap_idx_t x = bbzint_new(vals[i]);
+        ASSERT(bbzheap_idx_isimmint(x));
+        ASSERT(bbztype_isint(*bbzheap_obj_at(x)));
+        ASSERT_EQUAL(bbzheap_obj_at(x)->i.value, vals[i]);
+    }
+    ASSERT(bbztype_isnil(*bbzheap_obj_at(vm->nil)));
+    ASSERT(!bbzheap_idx_isimmint(vm->nil));
+
+    // Integers out of range still live on the heap
+    bbzheap_idx_t big = bbzint_new(BBZHEAP_IMMINT_MAX + 1);
+    ASSERT(!bbzheap_idx_isimm(big));
+    ASSERT_EQUAL(bbzheap_obj_at(big)->i.value, BBZHEAP_IMMINT_MAX + 1);
+
+    // Pushing small integers does not allocate
+    uint16_t nobj = 0;
+    for (bbzheap_idx_t i = 0; i < (vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t); ++i) {
+        if (bbzheap_obj_isvalid(*bbzheap_obj_at(i))) ++nobj;
+    }
+    for (int16_t i = 0; i < 10; ++i) {
+        bbzvm_pushi(i * 100);
+    }
+    uint16_t nobj2 = 0;
+    for (bbzheap_idx_t i = 0; i < (vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t); ++i) {
+        if (bbzheap_obj_isvalid(*bbzheap_obj_at(i))) ++nobj2;
+    }
+    ASSERT_EQUAL(nobj2, nobj);
+
+    // Comparisons between immediate and heap integers
+    bbzheap_idx_t h;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &h));
+    bbzheap_obj_at(h)->i.value = 42;
+    ASSERT_EQUAL(bbzheap_idx_cmp(bbzint_new(42), h), 0);
+    ASSERT(bbzheap_idx_cmp(bbzint_new(41), h) < 0);
+    ASSERT(bbzheap_idx_cmp(bbzint_new(43), h) > 0);
+    ASSERT(bbzheap_idx_cmp(bbzint_new(-5), bbzint_new(3)) < 0);
+
+    bbzvm_destruct();
+}
+
+TEST(string_intern) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    const uint16_t K = _BBZSTRID_COUNT_;
+
+    // Strings with the same ID are the same object
+    bbzheap_idx_t hole = bbzint_new(BBZHEAP_IMMINT_MAX + 1);
+    bbzheap_idx_t s = bbzstring_get(K);
+    ASSERT_EQUAL(bbzheap_obj_at(s)->s.value, K);
+    ASSERT_EQUAL(bbzstring_get(K), s);
+#if BBZHEAP_GC_ALLOC_THRESHOLD > 0
+    // Getting an existing string does not count as an allocation
+    uint16_t nalloc = vm->heap.nalloc;
+    bbzstring_get(K);
+    ASSERT_EQUAL(vm->heap.nalloc, nalloc);
+#endif // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+#if BBZHEAP_STR_INTERN_SIZE > 0
+    // ... even when the heap has a free slot before it
+    bbzheap_obj_makeinvalid(*bbzheap_obj_at(hole));
+    ASSERT_EQUAL(bbzstring_get(K), s);
+
+    // IDs sharing an entry of the intern table
+    bbzheap_idx_t s2 = bbzstring_get(K + BBZHEAP_STR_INTERN_SIZE);
+    ASSERT(s2 != s);
+    ASSERT_EQUAL(bbzheap_obj_at(s2)->s.value, K + BBZHEAP_STR_INTERN_SIZE);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzstring_get(K))->s.value, K);
+#else
+    RM_UNUSED_WARN(hole);
+#endif // BBZHEAP_STR_INTERN_SIZE > 0
+
+    // Collected strings are made again
+#ifdef BBZ_HEAP_GC_RETRY
+    for (uint8_t i = 0; i < BBZHEAP_GC_PINS; ++i) {
+        bbzint_new(BBZHEAP_IMMINT_MAX + 1); // Unpin the strings
+    }
+#endif // BBZ_HEAP_GC_RETRY
+    bbzheap_idx_t stack[1] = { bbzint_new(0) };
+    bbzheap_gc(stack, 1);
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(s)));
+    s = bbzstring_get(K);
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(s)));
+    ASSERT(bbztype_isstring(*bbzheap_obj_at(s)));
+    ASSERT_EQUAL(bbzheap_obj_at(s)->s.value, K);
+
+    bbzvm_destruct();
+}
+
+#ifdef BBZ_HEAP_GC_RETRY
+/**
+ * @brief Allocates enough garbage to fill the heap several times, so that
+ * allocations collect garbage.
+ */
+static void alloc_garbage() {
+    for (uint16_t i = 0; i < 4 * BBZHEAP_SIZE / sizeof(bbzobj_t); ++i) {
+        REQUIRE(!bbzheap_idx_isimm(bbzint_new(BBZHEAP_IMMINT_MAX + 1)));
+    }
+}
+#endif // BBZ_HEAP_GC_RETRY
+
+TEST(pins) {
+#ifdef BBZ_HEAP_GC_RETRY
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+
+    // Only the last BBZHEAP_GC_PINS allocations survive a garbage collection
+    bbzheap_idx_t stack[1] = { bbzint_new(0) };
+    bbzheap_idx_t u = bbztable_new();
+    for (uint8_t i = 1; i < BBZHEAP_GC_PINS; ++i) {
+        bbzint_new(BBZHEAP_IMMINT_MAX + 1);
+    }
+    bbzheap_gc(stack, 1);
+    ASSERT(bbztype_istable(*bbzheap_obj_at(u)));
+    bbzint_new(BBZHEAP_IMMINT_MAX + 1);
+    bbzheap_gc(stack, 1);
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(u)));
+
+    // Older ones survive if pinned, along with what they refer to
+    bbzheap_idx_t t = bbztable_new();
+    REQUIRE(bbztable_set(t, bbzint_new(1), bbzint_new(BBZHEAP_IMMINT_MAX + 2)));
+    u = bbztable_new();
+    ASSERT(bbzheap_pin(t));
+    ASSERT(bbzheap_pin(u));
+    alloc_garbage();
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(t)));
+    ASSERT(bbztype_istable(*bbzheap_obj_at(t)));
+    bbzheap_idx_t v;
+    ASSERT(bbztable_get(t, bbzint_new(1), &v));
+    ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, BBZHEAP_IMMINT_MAX + 2);
+    ASSERT(bbztype_istable(*bbzheap_obj_at(u)));
+
+    // Pins are limited
+    for (uint8_t i = 2; i < BBZHEAP_GC_USER_PINS; ++i) {
+        ASSERT(bbzheap_pin(bbzint_new(0)));
+    }
+    ASSERT(!bbzheap_pin(u));
+
+    // Unpinned objects are collected
+    for (uint8_t i = 0; i < BBZHEAP_GC_USER_PINS - 1; ++i) {
+        bbzheap_unpin();
+    }
+    alloc_garbage();
+    ASSERT(bbztype_istable(*bbzheap_obj_at(t)));
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(u)) || !bbztype_istable(*bbzheap_obj_at(u)));
+    bbzheap_unpin();
+    bbzheap_unpin(); // Unbalanced unpins are ignored
+    alloc_garbage();
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(t)) || !bbztype_istable(*bbzheap_obj_at(t)));
+
+    bbzvm_destruct();
+#endif // BBZ_HEAP_GC_RETRY
+}
+
+TEST(gc_reserve) {
+#if BBZHEAP_GC_ALLOC_THRESHOLD > 0
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+
+    bbzheap_idx_t stack[1] = { bbzint_new(0) };
+    bbzheap_gc(stack, 1);
+    ASSERT(!bbzheap_gc_isdue());
+
+    // A nearly full heap makes a collection due, below the threshold too
+    bbzheap_idx_t first;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &first));
+    bbzheap_obj_at(first)->i.value = 42;
+    bbzheap_idx_t o;
+    while (vm->heap.ltseg >= vm->heap.rtobj + BBZHEAP_GC_RESERVE) {
+        vm->heap.nalloc = 0;
+        ASSERT(!bbzheap_gc_isdue());
+        REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &o));
+    }
+    vm->heap.nalloc = 0;
+    ASSERT(bbzheap_gc_isdue());
+
+#ifndef BBZ_HEAP_GC_RETRY
+    // A full heap fails allocations, and collects nothing until the next
+    // instruction: objects held by C code stay valid
+    while (bbzheap_obj_alloc(BBZTYPE_INT, &o)) {}
+    ASSERT(!bbzheap_tseg_alloc(&o));
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(first)));
+    ASSERT_EQUAL(bbzheap_obj_at(first)->i.value, 42);
+#else // !BBZ_HEAP_GC_RETRY
+    // Unpin the most recently allocated objects
+    for (uint8_t i = 0; i < BBZHEAP_GC_PINS; ++i) {
+        vm->heap.pins[i] = 0;
+    }
+#endif // !BBZ_HEAP_GC_RETRY
+
+    // Collecting the garbage makes room again
+    bbzheap_gc(stack, 1);
+    ASSERT(!bbzheap_gc_isdue());
+
+    bbzvm_destruct();
+#endif // BBZHEAP_GC_ALLOC_THRESHOLD > 0
+}
+
 TEST_LIST {
     ADD_TEST(all);
     ADD_TEST(clear);
+    ADD_TEST(immediates);
+    ADD_TEST(string_intern);
+    ADD_TEST(pins);
+    ADD_TEST(gc_reserve);
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+/**
+ * @file testingvm.h
+ * @brief Construction of the VMs of the tests and benchmarks.
+ * @details With BBZ_UNCHECKED, a VM only runs bytecode it has verified
+ * (see bbzvm_set_verify_buffer()). The tests and benchmarks construct
+ * their VMs with these functions, which give them a verification buffer
+ * in this case.
+ */
+
+#ifndef TESTING_VM_H
+#define TESTING_VM_H
+
+#include <bittybuzz/bbzvm.h>
+
+/**
+ * @brief Size (in bytes) of the verification buffer of
+ * testing_vm_construct(), i.e. of the largest bytecode it can run.
+ */
+#define TESTING_VERIFY_SIZE 8192
+
+/**
+ * @brief Constructs the current VM, with a verification buffer of its own.
+ * @details Use this function for VMs run by different threads at the same
+ * time.
+ * @param[in] robot The robot id.
+ * @param[in] verify_buf The verification buffer. It is only used with
+ * BBZ_UNCHECKED.
+ * @param[in] verify_size The size (in bytes) of the buffer.
+ */
+static inline void testing_vm_construct_with(bbzrobot_id_t robot,
+                                             uint8_t* verify_buf,
+                                             uint16_t verify_size) {
+    bbzvm_construct(robot);
+#ifdef BBZ_UNCHECKED
+    bbzvm_set_verify_buffer(verify_buf, verify_size);
+#else // BBZ_UNCHECKED
+    RM_UNUSED_WARN(verify_buf);
+    RM_UNUSED_WARN(verify_size);
+#endif // BBZ_UNCHECKED
+}
+
+/**
+ * @brief Constructs the current VM.
+ * @details With BBZ_UNCHECKED, the VM verifies its bytecode in a buffer of
+ * #TESTING_VERIFY_SIZE bytes shared by all the VMs of the calling file, so
+ * only one of them may set bytecode at a time.
+ * @param[in] robot The robot id.
+ */
+static inline void testing_vm_construct(bbzrobot_id_t robot) {
+#ifdef BBZ_UNCHECKED
+    static uint8_t verify_buf[TESTING_VERIFY_SIZE];
+    testing_vm_construct_with(robot, verify_buf, sizeof(verify_buf));
+#else // BBZ_UNCHECKED
+    testing_vm_construct_with(robot, NULL, 0);
+#endif // BBZ_UNCHECKED
+}
+
+#endif // !TESTING_VM_H
@@ -209,9 +209,8 @@ TEST(map) {
 void reduce_fun() {
     bbzvm_assert_lnum(3);
 
-    bbzheap_obj_at(bbzvm_locals_at(3))->i.value += 1;
-
-    bbzvm_lload(3);
+    // Integers are immutable ; return a new accumulator.
+    bbzvm_pushi(bbzheap_obj_at(bbzvm_locals_at(3))->i.value + 1);
     bbzvm_ret1();
 }
 
@@ -234,10 +233,9 @@ TEST(reduce) {
     bbzvm_tget();
     bbzvm_pushcc(reduce_fun);
     bbzvm_pushi(0);
-    bbzheap_idx_t ret = bbzvm_stack_at(0);
     bbzvm_closure_call(2);
     REQUIRE(vm->state != BBZVM_STATE_ERROR);
-    ASSERT_EQUAL(bbzheap_obj_at(ret)->i.value, 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 2);
 
     bbzvm_gc();
     bbzvm_destruct();
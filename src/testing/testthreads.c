@@ -0,0 +1,179 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <bittybuzz/bbzvm.h>
+
+#define NUM_TEST_CASES 1
+#define TEST_MODULE threads
+#include "testingconfig.h"
+#include "testingvm.h"
+
+/**
+ * @brief Number of VMs run by the thread pool.
+ */
+#define NUM_VMS 256
+
+/**
+ * @brief Number of instructions a VM runs before its thread switches to
+ * the next one.
+ */
+#define SLICE 50
+
+/**
+ * @brief Number of iterations of the test program's loop.
+ */
+#define LOOP_COUNT 200
+
+#define ARG(x) (uint8_t)((x) & 0xFF), (uint8_t)(((x) >> 8) & 0xFF)
+
+#define STRID_X  (_BBZSTRID_COUNT_ + 0)
+#define STRID_I  (_BBZSTRID_COUNT_ + 1)
+#define STRID_T  (_BBZSTRID_COUNT_ + 2)
+#define STRID_V  (_BBZSTRID_COUNT_ + 3)
+#define STRID_ID (_BBZSTRID_COUNT_ + 4)
+
+/**
+ * @brief Equivalent Buzz code:
+ *
+ *     x = rid()
+ *     i = 0
+ *     while (i < LOOP_COUNT) {
+ *         t = {}
+ *         t.v = x * 7 + i
+ *         x = t.v % 1000
+ *         i = i + 1
+ *     }
+ */
+static const uint8_t bcode[] = {
+    ARG(0),
+    /*  2 */ BBZVM_INSTR_NOP,
+    /*  3 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /*  6 */ BBZVM_INSTR_PUSHNIL,
+    /*  7 */ BBZVM_INSTR_PUSHS, ARG(STRID_ID),
+    /* 10 */ BBZVM_INSTR_GLOAD,
+    /* 11 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 14 */ BBZVM_INSTR_CALLC,
+    /* 15 */ BBZVM_INSTR_GSTORE,
+    /* 16 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 19 */ BBZVM_INSTR_PUSHI, ARG(0),
+    /* 22 */ BBZVM_INSTR_GSTORE,
+    /* 23 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),             // Loop head
+    /* 26 */ BBZVM_INSTR_GLOAD,
+    /* 27 */ BBZVM_INSTR_PUSHI, ARG(LOOP_COUNT),
+    /* 30 */ BBZVM_INSTR_LT,
+    /* 31 */ BBZVM_INSTR_JUMPZ, ARG(91),
+    /* 34 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 37 */ BBZVM_INSTR_PUSHT,
+    /* 38 */ BBZVM_INSTR_GSTORE,
+    /* 39 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 42 */ BBZVM_INSTR_GLOAD,
+    /* 43 */ BBZVM_INSTR_PUSHS, ARG(STRID_V),
+    /* 46 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 49 */ BBZVM_INSTR_GLOAD,
+    /* 50 */ BBZVM_INSTR_PUSHI, ARG(7),
+    /* 53 */ BBZVM_INSTR_MUL,
+    /* 54 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 57 */ BBZVM_INSTR_GLOAD,
+    /* 58 */ BBZVM_INSTR_ADD,
+    /* 59 */ BBZVM_INSTR_TPUT,
+    /* 60 */ BBZVM_INSTR_PUSHS, ARG(STRID_X),
+    /* 63 */ BBZVM_INSTR_PUSHS, ARG(STRID_T),
+    /* 66 */ BBZVM_INSTR_GLOAD,
+    /* 67 */ BBZVM_INSTR_PUSHS, ARG(STRID_V),
+    /* 70 */ BBZVM_INSTR_TGET,
+    /* 71 */ BBZVM_INSTR_PUSHI, ARG(1000),
+    /* 74 */ BBZVM_INSTR_MOD,
+    /* 75 */ BBZVM_INSTR_GSTORE,
+    /* 76 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 79 */ BBZVM_INSTR_PUSHS, ARG(STRID_I),
+    /* 82 */ BBZVM_INSTR_GLOAD,
+    /* 83 */ BBZVM_INSTR_PUSHI, ARG(1),
+    /* 86 */ BBZVM_INSTR_ADD,
+    /* 87 */ BBZVM_INSTR_GSTORE,
+    /* 88 */ BBZVM_INSTR_JUMP, ARG(23),
+    /* 91 */ BBZVM_INSTR_DONE,                            // Loop exit
+};
+
+static bbzvm_t* vms;
+static uint16_t num_threads;
+
+/**
+ * @brief Final state and value of x of each VM.
+ */
+static bbzvm_state states[NUM_VMS];
+static int16_t results[NUM_VMS];
+
+/**
+ * @brief C closure returning the id of the robot of the current VM.
+ */
+static void rid() {
+    bbzvm_pushi(vm->robot);
+}
+
+/**
+ * @brief Runs the VMs of a worker thread, switching between them every
+ * #SLICE instructions.
+ * @param[in] arg The index of the thread. Its VMs are the ones whose index
+ * is equal to it modulo the number of threads.
+ */
+static void* worker(void* arg) {
+    uint16_t first = (uint16_t)(uintptr_t)arg;
+    // The VMs of a thread verify their bytecode one after the other
+    uint8_t verify_buf[sizeof(bcode)];
+    for (uint16_t i = first; i < NUM_VMS; i += num_threads) {
+        bbzvm_switch(&vms[i]);
+        testing_vm_construct_with(i, verify_buf, sizeof(verify_buf));
+        bbzvm_function_register(STRID_ID, rid);
+        bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    }
+    uint8_t running = 1;
+    while (running) {
+        running = 0;
+        for (uint16_t i = first; i < NUM_VMS; i += num_threads) {
+            bbzvm_switch(&vms[i]);
+            if (bbzvm_run_budget(SLICE) == BBZVM_STATE_YIELDED) running = 1;
+        }
+    }
+    for (uint16_t i = first; i < NUM_VMS; i += num_threads) {
+        bbzvm_switch(&vms[i]);
+        states[i] = vm->state;
+        bbzvm_gloads(STRID_X);
+        results[i] = bbzheap_obj_at(bbzvm_stack_at(0))->i.value;
+        bbzvm_destruct();
+    }
+    return NULL;
+}
+
+TEST(thread_pool) {
+    bbzvm_t mainObj;
+    bbzvm_switch(&mainObj);
+
+    vms = (bbzvm_t*)malloc(NUM_VMS * sizeof(bbzvm_t));
+    REQUIRE(vms != NULL);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = (ncpu < 2) ? 2 : (ncpu > 16) ? 16 : (uint16_t)ncpu;
+
+    pthread_t threads[16];
+    for (uint16_t t = 0; t < num_threads; ++t) {
+        REQUIRE(pthread_create(&threads[t], NULL, worker, (void*)(uintptr_t)t) == 0);
+    }
+    for (uint16_t t = 0; t < num_threads; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+    // Each thread has its own current VM
+    ASSERT(bbzvm_switch(NULL) == &mainObj);
+
+    for (uint16_t i = 0; i < NUM_VMS; ++i) {
+        int16_t x = (int16_t)i;
+        for (int16_t j = 0; j < LOOP_COUNT; ++j) {
+            x = (int16_t)((x * 7 + j) % 1000);
+        }
+        ASSERT_EQUAL(states[i], BBZVM_STATE_DONE);
+        ASSERT_EQUAL(results[i], x);
+    }
+    free(vms);
+}
+
+TEST_LIST {
+    ADD_TEST(thread_pool);
+}
@@ -1,10 +1,14 @@
 #include <stdio.h>
+#include <string.h>
 #include <bittybuzz/bbztype.h>
 #include <bittybuzz/bbzvm.h>
+#include <bittybuzz/bbzbcode.h>
+#include <bittybuzz/bbzverify.h>
 
-#define NUM_TEST_CASES 17
+#define NUM_TEST_CASES 35
 #define TEST_MODULE vm
 #include "testingconfig.h"
+#include "testingvm.h"
 
     // ======================================
     // =                MISC                =
@@ -47,7 +51,7 @@ uint8_t buf[4];
 bbzvm_error last_error;
 static bbzvm_t vmObj;
 
-char* state_desc[] = {"BBZVM_STATE_NOCODE", "BBZVM_STATE_READY", "BBZVM_STATE_STOPPED", "BBZVM_STATE_DONE", "BBZVM_STATE_ERROR"};
+char* state_desc[] = {"BBZVM_STATE_NOCODE", "BBZVM_STATE_READY", "BBZVM_STATE_STOPPED", "BBZVM_STATE_DONE", "BBZVM_STATE_ERROR", "BBZVM_STATE_YIELDED"};
 char* error_desc[] = {"BBZVM_ERROR_NONE", "BBZVM_ERROR_INSTR", "BBZVM_ERROR_STACK", "BBZVM_ERROR_LNUM", "BBZVM_ERROR_PC",
                       "BBZVM_ERROR_FLIST", "BBZVM_ERROR_TYPE", "BBZVM_ERROR_OUTOFRANGE", "BBZVM_ERROR_NOTIMPL",
                       "BBZVM_ERROR_RET", "BBZVM_ERROR_STRING", "BBZVM_ERROR_SWARM", "BBZVM_ERROR_VSTIG", "BBZVM_ERROR_MEM",
@@ -55,7 +59,12 @@ char* error_desc[] = {"BBZVM_ERROR_NONE", "BBZVM_ERROR_INSTR", "BBZVM_ERROR_STAC
 char* instr_desc[] = {"NOP", "DONE", "PUSHNIL", "DUP", "POP", "RET0", "RET1", "ADD", "SUB", "MUL", "DIV", "MOD", "POW",
                       "UNM", "LAND", "LOR", "LNOT","BAND","BOR","BNOT", "LSHIFT", "RSHIFT", "EQ", "NEQ", "GT", "GTE", "LT", "LTE", "GLOAD", "GSTORE", "PUSHT", "TPUT",
                       "TGET", "CALLC", "CALLS", "PUSHF", "PUSHI", "PUSHS", "PUSHCN", "PUSHCC", "PUSHL", "LLOAD", "LSTORE", "LREMOVE",
-                      "JUMP", "JUMPZ", "JUMPNZ", "COUNT"};
+                      "JUMP", "JUMPZ", "JUMPNZ", "GLOADS", "TGETS", "LLOAD2", "INCL", "CMPJEQ", "CMPJNEQ", "CMPJGT",
+                      "CMPJGTE", "CMPJLT", "CMPJLTE", "ADDII", "SUBII", "MULII", "ADDFF", "SUBFF", "MULFF",
+                      "DIVFF", "EQII", "NEQII", "GTII", "GTEII", "LTII", "LTEII", "CMPJEQII", "CMPJNEQII", "CMPJGTII",
+                      "CMPJGTEII", "CMPJLTII", "CMPJLTEII", "TCALLC", "PUSHI8", "PUSHS8", "LLOAD8",
+                      "LSTORE8", "JUMP8", "JUMPZ8", "JUMPNZ8", "RMOV", "RSETI", "RADD", "RSUB", "RMUL",
+                      "RADDI", "RGETF", "COUNT"};
 
 /**
  * @brief Fetches bytecode from a FILE.
@@ -183,7 +192,7 @@ void logfunc() {
 }
 
 void bbzvm_log() {
-    uint16_t nArg = bbzdarray_size(vm->lsyms) - 1;
+    uint16_t nArg = bbzvm_locals_count();
     for (uint16_t i = 0; i < nArg; ++i) {
         bbzvm_lload(nArg - i);
     }
@@ -225,6 +234,19 @@ int8_t bbzvm_register_functions() {
 #define FILE_TEST3 "resources/3_test1.bbo"
 #define FILE_TEST4 "resources/4_AllFeaturesTest.bbo"
 
+/**
+ * @brief Counts the global symbols.
+ */
+static uint16_t gsyms_size() {
+    uint16_t sz = bbztable_size(vm->gsyms);
+#if BBZVM_GSYM_SLOTS > 0
+    for (uint16_t i = 0; i < BBZVM_GSYM_SLOTS; ++i) {
+        if (!bbztype_isnil(*bbzheap_obj_at(vm->gslots[i]))) ++sz;
+    }
+#endif // BBZVM_GSYM_SLOTS > 0
+    return sz;
+}
+
 TEST(vm_construct) {
     vm = &vmObj;
 
@@ -245,7 +267,7 @@ TEST(vm_construct) {
 
 TEST(vm_set_bytecode) {
     vm = &vmObj;
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_error_receiver(&set_last_error);
 
     // 1) Open bytecode file.
@@ -264,16 +286,61 @@ TEST(vm_set_bytecode) {
     ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
     ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
     ASSERT_EQUAL(bbzdarray_size(vm->flist), FLIST_COUNT);
-    ASSERT_EQUAL(bbztable_size(vm->gsyms), GSYMS_COUNT); // 'id', 'neighbors', 'stigmergy', 'swarm'
+    ASSERT_EQUAL(gsyms_size(), GSYMS_COUNT); // 'id', 'neighbors', 'stigmergy', 'swarm'
     ASSERT_EQUAL(*testBcode(vm->pc-1, 1), BBZVM_INSTR_NOP);
 
     bbzvm_destruct();
     fclose(fbcode);
 }
 
+TEST(vm_set_bytecode_ptr) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // 1) Open bytecode file, to compare with the mapped bytecode.
+    fbcode = fopen(FILE_TEST1, "rb");
+    REQUIRE(fbcode != NULL);
+    REQUIRE(fseek(fbcode, 0, SEEK_END) == 0);
+    fsize = ftell(fbcode);
+    REQUIRE(fsize > 0);
+    REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+
+    // 2) Map the bytecode and set it in the VM.
+    bbzbcode_file_t f;
+    REQUIRE(bbzbcode_load(&f, FILE_TEST1));
+
+    ASSERT_EQUAL((uintptr_t)vm->bcode_ptr, (uintptr_t)f.data);
+    ASSERT_EQUAL(vm->bcode_size, fsize);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(*vm->bcode_fetch_fun(vm->pc-1, 1), BBZVM_INSTR_NOP);
+    for (bbzpc_t i = 0; i < fsize - 2; ++i) {
+        ASSERT_EQUAL(*vm->bcode_fetch_fun(i, 1), *testBcode(i, 1));
+    }
+
+    // 3) Execute an instruction from the mapped bytecode.
+    vm->pc = 19;
+    REQUIRE(*testBcode(vm->pc, 1) == BBZVM_INSTR_ADD);
+    bbzvm_pushi(-21244);
+    bbzvm_pushi(8384);
+    bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, -12860);
+    ASSERT_EQUAL(vm->pc, 20);
+
+    // 4) Setting a fetcher function stops reading from the pointer.
+    bbzvm_set_bcode(&testBcode, fsize);
+    ASSERT_EQUAL((uintptr_t)vm->bcode_ptr, (uintptr_t)NULL);
+
+    bbzvm_destruct();
+    bbzbcode_unmap(&f);
+    fclose(fbcode);
+}
+
 #define vm_step_instr()                         \
     vm = &vmObj;                                \
-    bbzvm_construct(0);                         \
+    testing_vm_construct(0);                    \
     bbzvm_set_error_receiver(set_last_error);   \
     fbcode = fopen(FILE_TEST1, "rb");           \
     REQUIRE(fbcode != NULL);                    \
@@ -475,9 +542,1332 @@ TEST(vm_step_jumpnz) {
     fclose(fbcode);
 }
 
+/**
+ * @brief Encodes a 16-bit operand (host byte order is little-endian).
+ */
+#define ARG(x) (uint8_t)((x) & 0xFF), (uint8_t)(((x) >> 8) & 0xFF)
+
+TEST(vm_superinstructions) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_NOP,
+        /*  3 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  6 */ BBZVM_INSTR_PUSHI, ARG(42),
+        /*  9 */ BBZVM_INSTR_GSTORE,
+        /* 10 */ BBZVM_INSTR_GLOADS, ARG(K),
+        /* 13 */ BBZVM_INSTR_PUSHT,
+        /* 14 */ BBZVM_INSTR_DUP,
+        /* 15 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /* 18 */ BBZVM_INSTR_PUSHI, ARG(7),
+        /* 21 */ BBZVM_INSTR_TPUT,
+        /* 22 */ BBZVM_INSTR_TGETS, ARG(K),
+        /* 25 */ BBZVM_INSTR_LLOAD2, ARG(1 | (2 << 8)),
+        /* 28 */ BBZVM_INSTR_INCL, ARG(1),
+        /* 31 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 34 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /* 37 */ BBZVM_INSTR_CMPJLT, ARG(2),
+        /* 40 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 43 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /* 46 */ BBZVM_INSTR_CMPJGTE, ARG(52),
+        /* 49 */ BBZVM_INSTR_NOP,
+        /* 50 */ BBZVM_INSTR_NOP,
+        /* 51 */ BBZVM_INSTR_NOP,
+        /* 52 */ BBZVM_INSTR_DONE,
+    };
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    REQUIRE(vm->pc == 3);
+
+    // Local variables used by LLOAD2 and INCL
+    bbzvm_pushnil();
+    bbzvm_pushi(3);
+    bbzvm_pushi(4);
+    vm->localptr = 0;
+    vm->blockptr = 2;
+    const uint16_t L = 3; // Stack slots taken by the local variables
+
+    // GLOADS
+    bbzvm_step(); bbzvm_step(); bbzvm_step();
+    REQUIRE(bbzvm_stack_size() == L + 0);
+    bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(vm->pc, 13);
+    ASSERT_EQUAL(bbzvm_stack_size(), L + 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 42);
+    bbzvm_pop();
+
+    // TGETS
+    while (vm->pc < 22) bbzvm_step();
+    REQUIRE(bbzvm_stack_size() == L + 1);
+    bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_stack_size(), L + 1);
+    ASSERT(bbztype_isint(*bbzheap_obj_at(bbzvm_stack_at(0))));
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 7);
+    bbzvm_pop();
+
+    // LLOAD2
+    bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_stack_size(), L + 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 3);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 4);
+    bbzvm_pop();
+    bbzvm_pop();
+
+    // INCL
+    bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_stack_size(), L + 0);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_locals_at(1))->i.value, 4);
+
+    // CMPJ, condition true: no jump
+    bbzvm_step(); bbzvm_step(); bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_stack_size(), L + 0);
+    ASSERT_EQUAL(vm->pc, 40);
+
+    // CMPJ, condition false: jump
+    bbzvm_step(); bbzvm_step(); bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_stack_size(), L + 0);
+    ASSERT_EQUAL(vm->pc, 52);
+
+    bbzvm_destruct();
+}
+
+TEST(vm_call_frames) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*   2 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*   5 */ BBZVM_INSTR_PUSHL, ARG(50),
+        /*   8 */ BBZVM_INSTR_GSTORE,
+        /*   9 */ BBZVM_INSTR_NOP,
+        // r1 = mk(5)(10)
+        /*  10 */ BBZVM_INSTR_PUSHS, ARG(K + 1),
+        /*  13 */ BBZVM_INSTR_PUSHNIL,
+        /*  14 */ BBZVM_INSTR_PUSHNIL,
+        /*  15 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  18 */ BBZVM_INSTR_GLOAD,
+        /*  19 */ BBZVM_INSTR_PUSHI, ARG(5),
+        /*  22 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /*  25 */ BBZVM_INSTR_CALLC,
+        /*  26 */ BBZVM_INSTR_PUSHI, ARG(10),
+        /*  29 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /*  32 */ BBZVM_INSTR_CALLC,
+        /*  33 */ BBZVM_INSTR_GSTORE,
+        // r2 = blk(7)
+        /*  34 */ BBZVM_INSTR_PUSHS, ARG(K + 2),
+        /*  37 */ BBZVM_INSTR_PUSHNIL,
+        /*  38 */ BBZVM_INSTR_PUSHL, ARG(72),
+        /*  41 */ BBZVM_INSTR_PUSHI, ARG(7),
+        /*  44 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /*  47 */ BBZVM_INSTR_CALLC,
+        /*  48 */ BBZVM_INSTR_GSTORE,
+        /*  49 */ BBZVM_INSTR_DONE,
+        // function mk(x) { var z = 100; return function(y) { return x + y + z } }
+        /*  50 */ BBZVM_INSTR_PUSHI, ARG(100),
+        /*  53 */ BBZVM_INSTR_LSTORE, ARG(2),
+        /*  56 */ BBZVM_INSTR_PUSHL, ARG(60),
+        /*  59 */ BBZVM_INSTR_RET1,
+        /*  60 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /*  63 */ BBZVM_INSTR_LLOAD, ARG(3),
+        /*  66 */ BBZVM_INSTR_ADD,
+        /*  67 */ BBZVM_INSTR_LLOAD, ARG(2),
+        /*  70 */ BBZVM_INSTR_ADD,
+        /*  71 */ BBZVM_INSTR_RET1,
+        // function blk(a) { { var b = 1; var c = 2 } var d = 9; return a * d }
+        /*  72 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /*  75 */ BBZVM_INSTR_LSTORE, ARG(2),
+        /*  78 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /*  81 */ BBZVM_INSTR_LSTORE, ARG(3),
+        /*  84 */ BBZVM_INSTR_LREMOVE, ARG(2),
+        /*  87 */ BBZVM_INSTR_PUSHI, ARG(9),
+        /*  90 */ BBZVM_INSTR_LSTORE, ARG(2),
+        /*  93 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /*  96 */ BBZVM_INSTR_LLOAD, ARG(2),
+        /*  99 */ BBZVM_INSTR_MUL,
+        /* 100 */ BBZVM_INSTR_RET1,
+    };
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    // Stop inside blk(), after its locals grew back
+    while (vm->pc < 93 && vm->state == BBZVM_STATE_READY) bbzvm_step();
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_locals_count(), 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_locals_at(1))->i.value, 7);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_locals_at(2))->i.value, 9);
+    ASSERT_EQUAL(vm->stackptr, vm->blockptr);
+
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+    ASSERT_EQUAL(vm->blockptr, -1);
+    ASSERT_EQUAL(vm->localptr, 0);
+    bbzvm_gloads(K + 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 115);
+    bbzvm_gloads(K + 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 63);
+
+    bbzvm_destruct();
+}
+
+/**
+ * @brief C closures used for testing the native call ABI.
+ */
+static void native_sum() {
+    int16_t sum = 0;
+    for (uint16_t i = 0; i < bbzvm_argc(); ++i) {
+        sum += bbzheap_obj_at(bbzvm_argv()[i])->i.value;
+    }
+    bbzvm_pushi(sum);
+}
+
+static void native_self() {
+    bbzvm_pushi(1);
+    bbzvm_push(bbzvm_self());
+    bbzvm_ret1();
+}
+
+static void native_ret0() {
+    bbzvm_pushi(1);
+    bbzvm_pushi(2);
+    bbzvm_ret0();
+}
+
+TEST(vm_native_calls) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint16_t K = _BBZSTRID_COUNT_;
+    bbzheap_idx_t fsum  = bbzvm_function_register(K, native_sum);
+    bbzheap_idx_t fself = bbzvm_function_register(-1, native_self);
+    bbzheap_idx_t fret0 = bbzvm_function_register(-1, native_ret0);
+
+    // The return value replaces the self table, the closure and the arguments
+    bbzvm_pushi(42);
+    bbzvm_pushnil();
+    bbzvm_push(fsum);
+    bbzvm_pushi(4);
+    bbzvm_pushi(5);
+    bbzvm_pushi(6);
+    bbzvm_closure_call(3);
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+    REQUIRE(bbzvm_stack_size() == 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 15);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 42);
+    ASSERT_EQUAL(vm->localptr, 0);
+    ASSERT_EQUAL(vm->blockptr, -1);
+    bbzvm_pop();
+
+    bbzheap_idx_t t = bbztable_new();
+    bbzvm_push(t);
+    bbzvm_push(fself);
+    bbzvm_closure_call(0);
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+    REQUIRE(bbzvm_stack_size() == 2);
+    ASSERT_EQUAL(bbzvm_stack_at(0), t);
+    bbzvm_pop();
+
+    bbzvm_pushnil();
+    bbzvm_push(fret0);
+    bbzvm_pushi(3);
+    bbzvm_closure_call(1);
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+    REQUIRE(bbzvm_stack_size() == 2);
+    ASSERT(bbztype_isnil(*bbzheap_obj_at(bbzvm_stack_at(0))));
+    bbzvm_pop();
+    bbzvm_pop();
+
+    // Called from bytecode
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_NOP,
+        /*  3 */ BBZVM_INSTR_PUSHS, ARG(K + 1),
+        /*  6 */ BBZVM_INSTR_PUSHNIL,
+        /*  7 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /* 10 */ BBZVM_INSTR_GLOAD,
+        /* 11 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /* 14 */ BBZVM_INSTR_PUSHI, ARG(3),
+        /* 17 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /* 20 */ BBZVM_INSTR_CALLC,
+        /* 21 */ BBZVM_INSTR_GSTORE,
+        /* 22 */ BBZVM_INSTR_DONE,
+    };
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(vm->pc, 22);
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+    bbzvm_gloads(K + 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 5);
+
+    bbzvm_destruct();
+}
+
+TEST(vm_tail_calls) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const int16_t N = 4 * BBZSTACK_SIZE;
+    bbzvm_function_register(K + 4, native_sum);
+    uint8_t bcode[] = {
+        ARG(0),
+        /*   2 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*   5 */ BBZVM_INSTR_PUSHL, ARG(53),
+        /*   8 */ BBZVM_INSTR_GSTORE,
+        /*   9 */ BBZVM_INSTR_PUSHS, ARG(K + 2),
+        /*  12 */ BBZVM_INSTR_PUSHL, ARG(91),
+        /*  15 */ BBZVM_INSTR_GSTORE,
+        /*  16 */ BBZVM_INSTR_NOP,
+        // r1 = cnt(N, 0)
+        /*  17 */ BBZVM_INSTR_PUSHS, ARG(K + 1),
+        /*  20 */ BBZVM_INSTR_PUSHNIL,
+        /*  21 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  24 */ BBZVM_INSTR_GLOAD,
+        /*  25 */ BBZVM_INSTR_PUSHI, ARG(N),
+        /*  28 */ BBZVM_INSTR_PUSHI, ARG(0),
+        /*  31 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /*  34 */ BBZVM_INSTR_CALLC,
+        /*  35 */ BBZVM_INSTR_GSTORE,
+        // r3 = g(5), a tail call at the top level
+        /*  36 */ BBZVM_INSTR_PUSHS, ARG(K + 3),
+        /*  39 */ BBZVM_INSTR_PUSHNIL,
+        /*  40 */ BBZVM_INSTR_PUSHS, ARG(K + 2),
+        /*  43 */ BBZVM_INSTR_GLOAD,
+        /*  44 */ BBZVM_INSTR_PUSHI, ARG(5),
+        /*  47 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /*  50 */ BBZVM_INSTR_TCALLC,
+        /*  51 */ BBZVM_INSTR_GSTORE,
+        /*  52 */ BBZVM_INSTR_DONE,
+        // function cnt(n, acc) { if (n == 0) return acc; return cnt(n - 1, acc + 1) }
+        /*  53 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /*  56 */ BBZVM_INSTR_PUSHI, ARG(0),
+        /*  59 */ BBZVM_INSTR_EQ,
+        /*  60 */ BBZVM_INSTR_JUMPZ, ARG(67),
+        /*  63 */ BBZVM_INSTR_LLOAD, ARG(2),
+        /*  66 */ BBZVM_INSTR_RET1,
+        /*  67 */ BBZVM_INSTR_PUSHNIL,
+        /*  68 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  71 */ BBZVM_INSTR_GLOAD,
+        /*  72 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /*  75 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /*  78 */ BBZVM_INSTR_SUB,
+        /*  79 */ BBZVM_INSTR_LLOAD, ARG(2),
+        /*  82 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /*  85 */ BBZVM_INSTR_ADD,
+        /*  86 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /*  89 */ BBZVM_INSTR_TCALLC,
+        /*  90 */ BBZVM_INSTR_RET1,
+        // function g(a) { return sum(a, 1) }, sum being a C closure
+        /*  91 */ BBZVM_INSTR_PUSHNIL,
+        /*  92 */ BBZVM_INSTR_PUSHS, ARG(K + 4),
+        /*  95 */ BBZVM_INSTR_GLOAD,
+        /*  96 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /*  99 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 102 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /* 105 */ BBZVM_INSTR_TCALLC,
+        /* 106 */ BBZVM_INSTR_RET1,
+    };
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    // The recursion runs in the frame of the first call
+    int16_t maxptr = vm->stackptr;
+    while (vm->state == BBZVM_STATE_READY) {
+        bbzvm_step();
+        if (vm->stackptr > maxptr) maxptr = vm->stackptr;
+    }
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT(maxptr < 16);
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+    ASSERT_EQUAL(vm->blockptr, -1);
+    ASSERT_EQUAL(vm->localptr, 0);
+    bbzvm_gloads(K + 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, N);
+    bbzvm_gloads(K + 3);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 6);
+    bbzvm_destruct();
+
+    // The same recursion with regular calls overflows the stack
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error_no_print);
+    bbzvm_function_register(K + 4, native_sum);
+    bcode[89] = BBZVM_INSTR_CALLC;
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(get_last_error(), BBZVM_ERROR_STACK);
+
+    bbzvm_destruct();
+}
+
+TEST(vm_function_handles) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // Names held by the global symbol slots, and names held by the table
+    const uint16_t names[] = {_BBZSTRID_COUNT_, _BBZSTRID_COUNT_ + BBZVM_GSYM_SLOTS + 10};
+    for (uint8_t n = 0; n < 2; ++n) {
+        const uint16_t K = names[n];
+        // The function may be defined after its handle is made
+        bbzvm_function_handle_t h = bbzvm_function_resolve(K);
+        ASSERT(bbztype_isnil(*bbzheap_obj_at(bbzvm_function_lookup(&h))));
+        for (uint16_t i = 1; i <= 4; ++i) {
+            bbzvm_gsym_register(K + i, bbzint_new((int16_t)i));
+        }
+        bbzheap_idx_t fsum = bbzvm_function_register(K, native_sum);
+        ASSERT_EQUAL(bbzvm_function_lookup(&h), fsum);
+        bbzvm_pushnil();
+        bbzvm_pushi(4);
+        bbzvm_pushi(5);
+        bbzvm_function_call_handle(&h, 2);
+        REQUIRE(vm->state != BBZVM_STATE_ERROR);
+        ASSERT_EQUAL(bbzvm_stack_size(), 1);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 9);
+        bbzvm_pop();
+
+        // A handle made afterwards finds the same function
+        bbzvm_function_handle_t h2 = bbzvm_function_resolve(K);
+        ASSERT_EQUAL(bbzvm_function_lookup(&h2), fsum);
+
+        // Stores to the name are seen by the handle
+        bbzheap_idx_t fself = bbzvm_function_register(K, native_self);
+        ASSERT_EQUAL(bbzvm_function_lookup(&h), fself);
+        bbzvm_gsym_register(K + 2, vm->nil);
+        bbzvm_pushs(K);
+        bbzvm_push(fsum);
+        bbzvm_gstore();
+        ASSERT_EQUAL(bbzvm_function_lookup(&h), fsum);
+        ASSERT_EQUAL(bbzvm_function_lookup(&h2), fsum);
+        bbzvm_gsym_register(K, vm->nil);
+        ASSERT(bbztype_isnil(*bbzheap_obj_at(bbzvm_function_lookup(&h))));
+        bbzvm_function_register(K, native_sum);
+        bbzvm_pushnil();
+        bbzvm_pushi(1);
+        bbzvm_function_call_handle(&h, 1);
+        REQUIRE(vm->state != BBZVM_STATE_ERROR);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 1);
+        bbzvm_pop();
+        ASSERT_EQUAL(bbzvm_stack_size(), 0);
+    }
+
+    bbzvm_destruct();
+}
+
+/**
+ * @brief Bytecode fetcher for the bytecode verified by vm_verifier.
+ */
+static const uint8_t* verified_bcode;
+static const uint8_t* verifiedBcode(bbzpc_t offset, uint8_t size) {
+    (void)size;
+    return verified_bcode + offset;
+}
+
+TEST(vm_verifier) {
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  5 */ BBZVM_INSTR_PUSHL, ARG(21),
+        /*  8 */ BBZVM_INSTR_GSTORE,
+        /*  9 */ BBZVM_INSTR_NOP,
+        // f()
+        /* 10 */ BBZVM_INSTR_PUSHNIL,
+        /* 11 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /* 14 */ BBZVM_INSTR_GLOAD,
+        /* 15 */ BBZVM_INSTR_PUSHI, ARG(0),
+        /* 18 */ BBZVM_INSTR_CALLC,
+        /* 19 */ BBZVM_INSTR_POP,
+        /* 20 */ BBZVM_INSTR_DONE,
+        // function f() { var i = 0; while (i < 3) i = i + 1; return i }
+        /* 21 */ BBZVM_INSTR_PUSHI, ARG(0),
+        /* 24 */ BBZVM_INSTR_LSTORE, ARG(1),
+        /* 27 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 30 */ BBZVM_INSTR_PUSHI, ARG(3),
+        /* 33 */ BBZVM_INSTR_CMPJLT, ARG(49),
+        /* 36 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 39 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 42 */ BBZVM_INSTR_ADD,
+        /* 43 */ BBZVM_INSTR_LSTORE, ARG(1),
+        /* 46 */ BBZVM_INSTR_JUMP, ARG(27),
+        /* 49 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 52 */ BBZVM_INSTR_RET1,
+    };
+    uint8_t bad[sizeof(bcode)];
+    uint8_t buf[sizeof(bcode)];
+    bbzverify_result_t res;
+    verified_bcode = bad;
+
+    // Valid bytecode: the call needs self, the closure and the argument count
+    memcpy(bad, bcode, sizeof(bcode));
+    ASSERT(bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(res.max_stack, 3);
+
+    // Unknown opcode
+    bad[20] = BBZVM_INSTR_LSHIFT;
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_INSTR);
+    ASSERT_EQUAL(res.pc, 20);
+
+    // Jump into the operand of an instruction
+    memcpy(bad, bcode, sizeof(bcode));
+    bad[47] = 28;
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_PC);
+    ASSERT_EQUAL(res.pc, 46);
+
+    // Jump to an instruction reached with another stack depth
+    bad[47] = 30;
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_STACK);
+    ASSERT_EQUAL(res.pc, 46);
+
+    // Path falling off the end of the bytecode
+    memcpy(bad, bcode, sizeof(bcode));
+    bad[52] = BBZVM_INSTR_POP;
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_PC);
+    ASSERT_EQUAL(res.pc, 52);
+
+    // Call without self
+    memcpy(bad, bcode, sizeof(bcode));
+    bad[10] = BBZVM_INSTR_NOP;
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_STACK);
+    ASSERT_EQUAL(res.pc, 15);
+
+    // Call whose argument count is not known
+    memcpy(bad, bcode, sizeof(bcode));
+    bad[15] = bad[16] = bad[17] = BBZVM_INSTR_PUSHNIL;
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_STACK);
+    ASSERT_EQUAL(res.pc, 18);
+
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error_no_print);
+
+#ifdef BBZ_VERIFY_BCODE
+    // Bytecode is verified when it is set
+    bbzvm_set_verify_buffer(buf, sizeof(buf));
+    memcpy(bad, bcode, sizeof(bcode));
+    bad[47] = 30;
+    bbzvm_set_bcode_ptr(bad, sizeof(bad));
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(get_last_error(), BBZVM_ERROR_STACK);
+    ASSERT_EQUAL(vm->pc, 46);
+
+    // Bytecode larger than the buffer is not run
+    bbzvm_set_verify_buffer(buf, sizeof(buf) - 1);
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(get_last_error(), BBZVM_ERROR_MEM);
+    bbzvm_set_verify_buffer(buf, sizeof(buf));
+#endif // BBZ_VERIFY_BCODE
+#ifdef BBZ_UNCHECKED
+    // Unchecked VMs do not run bytecode they cannot verify
+    bbzvm_set_verify_buffer(NULL, 0);
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(get_last_error(), BBZVM_ERROR_MEM);
+    bbzvm_set_verify_buffer(buf, sizeof(buf));
+#endif // BBZ_UNCHECKED
+
+    // Verified bytecode runs
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+
+    // C code is checked, whatever the bytecode
+    bbzvm_reset_state();
+    bbzvm_pop();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(get_last_error(), BBZVM_ERROR_STACK);
+
+    bbzvm_destruct();
+}
+
+TEST(vm_short_forms) {
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_PUSHS8, K,
+        /*  4 */ BBZVM_INSTR_PUSHL, ARG(20),
+        /*  7 */ BBZVM_INSTR_GSTORE,
+        /*  8 */ BBZVM_INSTR_NOP,
+        // r = f()
+        /*  9 */ BBZVM_INSTR_PUSHS8, K + 1,
+        /* 11 */ BBZVM_INSTR_PUSHNIL,
+        /* 12 */ BBZVM_INSTR_PUSHS8, K,
+        /* 14 */ BBZVM_INSTR_GLOAD,
+        /* 15 */ BBZVM_INSTR_PUSHI8, 0,
+        /* 17 */ BBZVM_INSTR_CALLC,
+        /* 18 */ BBZVM_INSTR_GSTORE,
+        /* 19 */ BBZVM_INSTR_DONE,
+        // function f() { var i = 5; var s = 0; while (i) { s = s + i; i = i - 1 } if (s) return s - 100; return s }
+        /* 20 */ BBZVM_INSTR_PUSHI8, 5,
+        /* 22 */ BBZVM_INSTR_LSTORE8, 1,
+        /* 24 */ BBZVM_INSTR_PUSHI8, 0,
+        /* 26 */ BBZVM_INSTR_LSTORE8, 2,
+        /* 28 */ BBZVM_INSTR_LLOAD8, 1,
+        /* 30 */ BBZVM_INSTR_JUMPZ8, 48 - 32,
+        /* 32 */ BBZVM_INSTR_LLOAD8, 2,
+        /* 34 */ BBZVM_INSTR_LLOAD8, 1,
+        /* 36 */ BBZVM_INSTR_ADD,
+        /* 37 */ BBZVM_INSTR_LSTORE8, 2,
+        /* 39 */ BBZVM_INSTR_LLOAD8, 1,
+        /* 41 */ BBZVM_INSTR_PUSHI8, (uint8_t)-1,
+        /* 43 */ BBZVM_INSTR_ADD,
+        /* 44 */ BBZVM_INSTR_LSTORE8, 1,
+        /* 46 */ BBZVM_INSTR_JUMP8, (uint8_t)(28 - 48),
+        /* 48 */ BBZVM_INSTR_LLOAD8, 2,
+        /* 50 */ BBZVM_INSTR_LLOAD8, 2,
+        /* 52 */ BBZVM_INSTR_JUMPNZ8, 55 - 54,
+        /* 54 */ BBZVM_INSTR_RET1,
+        /* 55 */ BBZVM_INSTR_PUSHI8, (uint8_t)-100,
+        /* 57 */ BBZVM_INSTR_ADD,
+        /* 58 */ BBZVM_INSTR_RET1,
+    };
+    uint8_t bad[sizeof(bcode)];
+    uint8_t buf[sizeof(bcode)];
+    bbzverify_result_t res;
+    verified_bcode = bad;
+
+    // Short forms are verified like the long ones
+    memcpy(bad, bcode, sizeof(bcode));
+    ASSERT(bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(res.max_stack, 4);
+
+    // Short jump into the operand of an instruction
+    bad[47] = (uint8_t)(29 - 48);
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_PC);
+    ASSERT_EQUAL(res.pc, 46);
+
+    // Short jump before the start of the bytecode
+    bad[47] = (uint8_t)-128;
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_PC);
+    ASSERT_EQUAL(res.pc, 46);
+
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // Operands are signed for PUSHI8 and jumps, unsigned otherwise
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+    bbzvm_pushs(K + 1);
+    bbzvm_gload();
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 15 - 100);
+
+    bbzvm_destruct();
+}
+
+TEST(vm_register_instrs) {
+#ifdef BBZ_REGISTER_BCODE
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_PUSHS8, K,
+        /*  4 */ BBZVM_INSTR_PUSHL, ARG(28),
+        /*  7 */ BBZVM_INSTR_GSTORE,
+        /*  8 */ BBZVM_INSTR_NOP,
+        // r = f({x = 9000})
+        /*  9 */ BBZVM_INSTR_PUSHS8, K + 1,
+        /* 11 */ BBZVM_INSTR_PUSHNIL,
+        /* 12 */ BBZVM_INSTR_PUSHS8, K,
+        /* 14 */ BBZVM_INSTR_GLOAD,
+        /* 15 */ BBZVM_INSTR_PUSHT,
+        /* 16 */ BBZVM_INSTR_DUP,
+        /* 17 */ BBZVM_INSTR_PUSHS8, K + 2,
+        /* 19 */ BBZVM_INSTR_PUSHI, ARG(9000),
+        /* 22 */ BBZVM_INSTR_TPUT,
+        /* 23 */ BBZVM_INSTR_PUSHI8, 1,
+        /* 25 */ BBZVM_INSTR_CALLC,
+        /* 26 */ BBZVM_INSTR_GSTORE,
+        /* 27 */ BBZVM_INSTR_DONE,
+        // function f(t) { var a = -5; var b = t.x; a = a + b; a = a - 100;
+        //                 var c = a - b; c = c * c; var d = c; c = c + 1;
+        //                 b = 7; return d - c + b }
+        /* 28 */ BBZVM_INSTR_RSETI, 2, (uint8_t)-5,
+        /* 31 */ BBZVM_INSTR_RGETF, 3, 1, K + 2,
+        /* 35 */ BBZVM_INSTR_RADD, 2, 2, 3,
+        /* 39 */ BBZVM_INSTR_RADDI, 2, 2, (uint8_t)-100,
+        /* 43 */ BBZVM_INSTR_RSUB, 4, 2, 3,
+        /* 47 */ BBZVM_INSTR_RMUL, 4, 4, 4,
+        /* 51 */ BBZVM_INSTR_RMOV, 5, 4,
+        /* 54 */ BBZVM_INSTR_RADDI, 4, 4, 1,
+        /* 58 */ BBZVM_INSTR_RSETI, 3, 7,
+        /* 61 */ BBZVM_INSTR_LLOAD8, 5,
+        /* 63 */ BBZVM_INSTR_LLOAD8, 4,
+        /* 65 */ BBZVM_INSTR_SUB,
+        /* 66 */ BBZVM_INSTR_LLOAD8, 3,
+        /* 68 */ BBZVM_INSTR_ADD,
+        /* 69 */ BBZVM_INSTR_RET1,
+    };
+    uint8_t bad[sizeof(bcode)];
+    uint8_t buf[sizeof(bcode)];
+    bbzverify_result_t res;
+    verified_bcode = bad;
+
+    // Register instructions leave the stack as it is
+    memcpy(bad, bcode, sizeof(bcode));
+    ASSERT(bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(res.max_stack, 7);
+
+    // Jump onto a register operand
+    bad[61] = BBZVM_INSTR_JUMP8;
+    bad[62] = (uint8_t)(56 - 63);
+    ASSERT(!bbzverify_bcode(verifiedBcode, sizeof(bcode), buf, &res));
+    ASSERT_EQUAL(res.error, BBZVM_ERROR_PC);
+    ASSERT_EQUAL(res.pc, 61);
+
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // New local symbols are made as by LSTORE, integers which do not fit an
+    // immediate are allocated, and copies do not alias
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+    bbzvm_pushs(K + 1);
+    bbzvm_gload();
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, -1 + 7);
+
+    // Missing source register
+    memcpy(bad, bcode, sizeof(bcode));
+    bad[37] = 9;
+    bbzvm_set_error_receiver(&set_last_error_no_print);
+    bbzvm_set_bcode_ptr(bad, sizeof(bad));
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(get_last_error(), BBZVM_ERROR_LNUM);
+    ASSERT_EQUAL(vm->pc, 35);
+
+    bbzvm_destruct();
+#endif // BBZ_REGISTER_BCODE
+}
+
+TEST(vm_run_budget) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  5 */ BBZVM_INSTR_PUSHL, ARG(11),
+        /*  8 */ BBZVM_INSTR_GSTORE,
+        /*  9 */ BBZVM_INSTR_NOP,
+        /* 10 */ BBZVM_INSTR_DONE,
+        // function f(n) { var s = 0; while (n > 0) { s = s + n; n = n - 1 } return s }
+        /* 11 */ BBZVM_INSTR_PUSHI, ARG(0),
+        /* 14 */ BBZVM_INSTR_LSTORE, ARG(2),
+        /* 17 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 20 */ BBZVM_INSTR_PUSHI, ARG(0),
+        /* 23 */ BBZVM_INSTR_GT,
+        /* 24 */ BBZVM_INSTR_JUMPZ, ARG(50),
+        /* 27 */ BBZVM_INSTR_LLOAD, ARG(2),
+        /* 30 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 33 */ BBZVM_INSTR_ADD,
+        /* 34 */ BBZVM_INSTR_LSTORE, ARG(2),
+        /* 37 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 40 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 43 */ BBZVM_INSTR_SUB,
+        /* 44 */ BBZVM_INSTR_LSTORE, ARG(1),
+        /* 47 */ BBZVM_INSTR_JUMP, ARG(17),
+        /* 50 */ BBZVM_INSTR_LLOAD, ARG(2),
+        /* 53 */ BBZVM_INSTR_RET1,
+    };
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    bbzvm_function_register(K + 1, native_sum);
+
+    // Without a call, the main program is run
+    ASSERT_EQUAL(bbzvm_run_budget(0), BBZVM_STATE_DONE);
+    ASSERT_EQUAL(vm->pc, 10);
+
+    // f(10) runs in slices of 8 instructions
+    bbzvm_pushi(42);
+    bbzvm_pushnil();
+    bbzvm_pushi(10);
+    bbzvm_function_call_begin(K, 1);
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    uint16_t slices = 0;
+    while (bbzvm_run_budget(8) == BBZVM_STATE_YIELDED) {
+        ++slices;
+        int16_t stackptr = vm->stackptr;
+        bbzpc_t pc = vm->pc;
+        // Stepping does nothing while yielded
+        bbzvm_step();
+        ASSERT_EQUAL(vm->pc, pc);
+        // Other calls run to completion, and the VM stays yielded
+        bbzvm_pushnil();
+        bbzvm_pushi(slices);
+        bbzvm_pushi(1);
+        bbzvm_function_call(K + 1, 2);
+        REQUIRE(vm->state == BBZVM_STATE_YIELDED);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, slices + 1);
+        bbzvm_pop();
+        ASSERT_EQUAL(vm->stackptr, stackptr);
+    }
+    // 2 instructions before the loop, 10 iterations of 13, 4 to exit it
+    // and 2 to return
+    ASSERT_EQUAL(slices, (2 + 10 * 13 + 4 + 2 - 1) / 8);
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    REQUIRE(bbzvm_stack_size() == 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 55);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 42);
+    ASSERT_EQUAL(vm->blockptr, -1);
+
+    // Once the call returned, there is nothing left to run
+    ASSERT_EQUAL(bbzvm_run_budget(8), BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_stack_size(), 2);
+    bbzvm_pop();
+
+    // Unlimited budget
+    bbzvm_pushnil();
+    bbzvm_pushi(4);
+    bbzvm_function_call_begin(K, 1);
+    ASSERT_EQUAL(bbzvm_run_budget(0), BBZVM_STATE_READY);
+    REQUIRE(bbzvm_stack_size() == 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 10);
+
+    bbzvm_destruct();
+}
+
+/**
+ * @brief Boot image of the vm_boot_image test, and the bytecode it was
+ * made with.
+ */
+static uint8_t image[BBZHEAP_SIZE + 2 * BBZVM_GSYM_SLOTS + 64];
+static const uint8_t* image_bcode;
+
+static const uint8_t* image_fetch(bbzpc_t offset, uint8_t size) {
+    RM_UNUSED_WARN(size);
+    return image + offset;
+}
+
+static const uint8_t* image_bcode_fetch(bbzpc_t offset, uint8_t size) {
+    RM_UNUSED_WARN(size);
+    return image_bcode + offset;
+}
+
+TEST(vm_boot_image) {
+    vm = &vmObj;
+    testing_vm_construct(3);
+
+    const uint16_t K = _BBZSTRID_COUNT_;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  5 */ BBZVM_INSTR_PUSHL, ARG(16),
+        /*  8 */ BBZVM_INSTR_GSTORE,
+        /*  9 */ BBZVM_INSTR_PUSHS, ARG(K + 1),
+        /* 12 */ BBZVM_INSTR_PUSHT,
+        /* 13 */ BBZVM_INSTR_GSTORE,
+        /* 14 */ BBZVM_INSTR_NOP,
+        /* 15 */ BBZVM_INSTR_DONE,
+        // function f(n) { return n * 2 }
+        /* 16 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 19 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /* 22 */ BBZVM_INSTR_MUL,
+        /* 23 */ BBZVM_INSTR_RET1,
+    };
+    image_bcode = bcode;
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    // 1) Save
+    bbzvm_funp natives[16];
+    uint8_t nnatives = 0;
+#ifndef BBZ_DISABLE_NEIGHBORS
+    // The 'neighbors' table holds C closures
+    ASSERT_EQUAL(bbzvm_save_image(image, sizeof(image), natives, &nnatives), 0);
+#endif // !BBZ_DISABLE_NEIGHBORS
+    nnatives = 16;
+    uint16_t size = bbzvm_save_image(image, sizeof(image), natives, &nnatives);
+    REQUIRE(size > 0);
+    nnatives = 16;
+    ASSERT_EQUAL(bbzvm_save_image(image, size - 1, natives, &nnatives), 0);
+    nnatives = 16;
+    ASSERT_EQUAL(bbzvm_save_image(image, size, natives, &nnatives), size);
+    uintptr_t rtobj = (uintptr_t)(vm->heap.rtobj - vm->heap.data);
+    uintptr_t ltseg = (uintptr_t)(vm->heap.ltseg - vm->heap.data);
+    bbzvm_destruct();
+
+    // 2) Restore into a VM of another robot
+    memset(&vmObj, 0xA5, sizeof(vmObj));
+    REQUIRE(bbzvm_restore_image(5, image_fetch, natives, image_bcode_fetch));
+    bbzvm_set_error_receiver(&set_last_error);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(vm->pc, 15);
+    ASSERT_EQUAL(vm->bcode_size, sizeof(bcode));
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+    ASSERT_EQUAL((uintptr_t)(vm->heap.rtobj - vm->heap.data), rtobj);
+    ASSERT_EQUAL((uintptr_t)(vm->heap.ltseg - vm->heap.data), ltseg);
+    bbzvm_gloads(__BBZSTRID_id);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 5);
+    bbzvm_pop();
+    bbzvm_gloads(K + 1);
+    ASSERT(bbztype_istable(*bbzheap_obj_at(bbzvm_stack_at(0))));
+    bbzvm_pop();
+#ifndef BBZ_DISABLE_NEIGHBORS
+    bbzvm_gloads(__BBZSTRID_neighbors);
+    bbzvm_tgets(__BBZSTRID_count);
+    ASSERT(bbzheap_obj_at(bbzvm_stack_at(0))->c.value == bbzneighbors_count);
+    bbzvm_pop();
+#endif // !BBZ_DISABLE_NEIGHBORS
+
+    // 3) Run the restored VM
+    bbzvm_pushnil();
+    bbzvm_pushi(21);
+    bbzvm_function_call(K, 1);
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 42);
+    bbzvm_pop();
+    bbzvm_gc();
+    bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    bbzvm_destruct();
+
+    // 4) Images of another configuration are rejected
+    image[0] ^= 0xFF;
+    ASSERT(!bbzvm_restore_image(5, image_fetch, natives, image_bcode_fetch));
+}
+
+/**
+ * @brief Runs TGETS on the table at the top of the stack as if the
+ * instruction was at the given offset, and returns the value.
+ */
+static bbzheap_idx_t tgets_at(bbzpc_t pc, uint16_t strid) {
+    vm->pc = pc;
+    bbzvm_dup();
+    bbzvm_tgets(strid);
+    bbzheap_idx_t v = bbzvm_stack_at(0);
+    bbzvm_pop();
+    return v;
+}
+
+#ifdef BBZ_PROFILE
+/**
+ * @brief Fake clock of the vm_profile test, which advances by 10 each time
+ * it is read.
+ */
+static uint32_t profile_ticks;
+
+static uint32_t profile_clock() {
+    return profile_ticks += 10;
+}
+#endif // BBZ_PROFILE
+
+TEST(vm_profile) {
+#ifdef BBZ_PROFILE
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_NOP,
+        /*  3 */ BBZVM_INSTR_PUSHI, ARG(3),
+        /*  6 */ BBZVM_INSTR_PUSHI, ARG(4),
+        /*  9 */ BBZVM_INSTR_ADD,
+        /* 10 */ BBZVM_INSTR_POP,
+        /* 11 */ BBZVM_INSTR_DONE,
+    };
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    // Without a clock, executions are counted
+    ASSERT_EQUAL(vm->profile.count[BBZVM_INSTR_NOP], 1);
+    ASSERT_EQUAL(vm->profile.time[BBZVM_INSTR_NOP], 0);
+    bbzvm_profile_reset();
+    ASSERT_EQUAL(vm->profile.count[BBZVM_INSTR_NOP], 0);
+
+    // Each instruction reads the clock twice
+    bbzvm_set_clock(profile_clock);
+    ASSERT_EQUAL(bbzvm_run_budget(0), BBZVM_STATE_DONE);
+    ASSERT_EQUAL(vm->profile.count[BBZVM_INSTR_PUSHI], 2);
+    ASSERT_EQUAL(vm->profile.time[BBZVM_INSTR_PUSHI], 20);
+    ASSERT_EQUAL(vm->profile.count[BBZVM_INSTR_ADD], 1);
+    ASSERT_EQUAL(vm->profile.time[BBZVM_INSTR_ADD], 10);
+    ASSERT_EQUAL(vm->profile.count[BBZVM_INSTR_POP], 1);
+    ASSERT_EQUAL(vm->profile.count[BBZVM_INSTR_DONE], 1);
+    ASSERT_EQUAL(vm->profile.count[BBZVM_INSTR_NOP], 0);
+
+    // Garbage collection and message processing
+    uint32_t gcs = vm->profile.count[BBZVM_PROFILE_GC];
+    uint32_t gc_time = vm->profile.time[BBZVM_PROFILE_GC];
+    bbzvm_gc();
+    ASSERT_EQUAL(vm->profile.count[BBZVM_PROFILE_GC], gcs + 1);
+    ASSERT_EQUAL(vm->profile.time[BBZVM_PROFILE_GC], gc_time + 10);
+    vm->state = BBZVM_STATE_READY;
+    bbzvm_process_inmsgs();
+    bbzvm_process_outmsgs();
+    ASSERT_EQUAL(vm->profile.count[BBZVM_PROFILE_INMSGS], 1);
+    ASSERT_EQUAL(vm->profile.time[BBZVM_PROFILE_INMSGS], 10);
+    ASSERT_EQUAL(vm->profile.count[BBZVM_PROFILE_OUTMSGS], 1);
+    ASSERT_EQUAL(vm->profile.time[BBZVM_PROFILE_OUTMSGS], 10);
+
+    // Dump
+    uint8_t dump[3 + 8 * BBZVM_PROFILE_SIZE];
+    ASSERT_EQUAL(bbzvm_profile_dump(dump, sizeof(dump) - 1), 0);
+    REQUIRE(bbzvm_profile_dump(dump, sizeof(dump)) == sizeof(dump));
+    ASSERT_EQUAL(dump[0] | (dump[1] << 8), 0xB1F0);
+    ASSERT_EQUAL(dump[2], BBZVM_PROFILE_SIZE);
+    const uint8_t* pushi = dump + 3 + 8 * BBZVM_INSTR_PUSHI;
+    ASSERT_EQUAL(pushi[0] | (pushi[1] << 8) | (pushi[2] << 16) | (pushi[3] << 24), 2);
+    ASSERT_EQUAL(pushi[4] | (pushi[5] << 8) | (pushi[6] << 16) | (pushi[7] << 24), 20);
+
+    bbzvm_destruct();
+#endif // BBZ_PROFILE
+}
+
+TEST(vm_pc_sampling) {
+#ifdef BBZ_PC_SAMPLING
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_NOP,
+        /*  3 */ BBZVM_INSTR_PUSHI, ARG(3),
+        /*  6 */ BBZVM_INSTR_PUSHI, ARG(4),
+        /*  9 */ BBZVM_INSTR_ADD,
+        /* 10 */ BBZVM_INSTR_POP,
+        /* 11 */ BBZVM_INSTR_DONE,
+    };
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    // One bucket per byte, one sample per instruction
+    uint16_t samples[16];
+    bbzvm_set_sampling(samples, 16, 0, 1);
+    ASSERT_EQUAL(bbzvm_run_budget(0), BBZVM_STATE_DONE);
+    ASSERT_EQUAL(samples[2], 0);
+    ASSERT_EQUAL(samples[3], 1);
+    ASSERT_EQUAL(samples[4], 0);
+    ASSERT_EQUAL(samples[6], 1);
+    ASSERT_EQUAL(samples[9], 1);
+    ASSERT_EQUAL(samples[10], 1);
+    ASSERT_EQUAL(samples[11], 1);
+
+    // Manual samples, with 4 bytes per bucket
+    bbzvm_set_sampling(samples, 4, 2, 0);
+    ASSERT_EQUAL(samples[0], 0);
+    vm->pc = 9;
+    bbzvm_sample();
+    bbzvm_sample();
+    ASSERT_EQUAL(samples[2], 2);
+    vm->pc = 20;
+    bbzvm_sample(); // Out of the histogram
+    ASSERT_EQUAL(samples[0] + samples[1] + samples[2] + samples[3], 2);
+
+    // Dump
+    uint8_t dump[5 + 2 * 4];
+    ASSERT_EQUAL(bbzvm_samples_dump(dump, sizeof(dump) - 1), 0);
+    REQUIRE(bbzvm_samples_dump(dump, sizeof(dump)) == sizeof(dump));
+    ASSERT_EQUAL(dump[0] | (dump[1] << 8), 0xB15A);
+    ASSERT_EQUAL(dump[2], 2);
+    ASSERT_EQUAL(dump[3] | (dump[4] << 8), 4);
+    ASSERT_EQUAL(dump[9] | (dump[10] << 8), 2);
+
+    // Stop sampling
+    bbzvm_set_sampling(NULL, 0, 0, 0);
+    bbzvm_sample();
+
+    bbzvm_destruct();
+#endif // BBZ_PC_SAMPLING
+}
+
+TEST(vm_inline_cache) {
+    vm = &vmObj;
+    memset(&vmObj, 0, sizeof(vmObj));
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+#if BBZVM_ICACHE_SIZE > 0
+    // Caches start empty, even if the memory named a real segment
+    for (uint16_t i = 0; i < BBZVM_ICACHE_SIZE; ++i) {
+        ASSERT_EQUAL(vm->icache[i].tseg, BBZVM_ICACHE_EMPTY);
+    }
+#endif // BBZVM_ICACHE_SIZE > 0
+
+    // A table spanning two segments, with keys K+0 to K+7
+    const uint16_t K = _BBZSTRID_COUNT_;
+    bbzheap_idx_t t = bbztable_new();
+    bbzvm_push(t);
+    for (uint16_t i = 0; i < 8; ++i) {
+        REQUIRE(bbztable_set(t, bbzstring_get(K + i), bbzint_new(i)));
+    }
+
+    // Positions past the end of a segment are rejected
+    bbzheap_idx_t v;
+    ASSERT(!bbztable_get_at(t, K + 6, 1, BBZHEAP_ELEMS_PER_TSEG, &v));
+    ASSERT(!bbztable_get_at(t, K + 6, 1, 0xFF, &v));
+
+    // First lookup fills the cache, second one uses it
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 6))->i.value, 6);
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 6))->i.value, 6);
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+
+    // Same site, other key
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 1))->i.value, 1);
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 6))->i.value, 6);
+
+    // Value changes are seen
+    REQUIRE(bbztable_set(t, bbzstring_get(K + 6), bbzint_new(60)));
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 6))->i.value, 60);
+
+    // Emptying the first segment unlinks it from the table
+    for (uint16_t i = 0; i < 5; ++i) {
+        REQUIRE(bbztable_set(t, bbzstring_get(K + i), vm->nil));
+    }
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 6))->i.value, 60);
+    ASSERT(bbztype_isnil(*bbzheap_obj_at(tgets_at(22, K + 1))));
+
+    // Key erased, then re-added elsewhere
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 7))->i.value, 7);
+    REQUIRE(bbztable_set(t, bbzstring_get(K + 7), vm->nil));
+    ASSERT(bbztype_isnil(*bbzheap_obj_at(tgets_at(22, K + 7))));
+    REQUIRE(bbztable_set(t, bbzstring_get(K + 3), bbzint_new(3)));
+    REQUIRE(bbztable_set(t, bbzstring_get(K + 7), bbzint_new(70)));
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 7))->i.value, 70);
+
+    // Same site, other table
+    bbzheap_idx_t u = bbztable_new();
+    bbzvm_push(u);
+    REQUIRE(bbztable_set(u, bbzstring_get(K + 7), bbzint_new(-7)));
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 7))->i.value, -7);
+    bbzvm_pop();
+    ASSERT_EQUAL(bbzheap_obj_at(tgets_at(22, K + 7))->i.value, 70);
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+
+    bbzvm_destruct();
+}
+
+/**
+ * @brief Evaluates a lambda expression.
+ * @param[in] addr The bytecode address of the lambda.
+ * @return The position of the lambda in the function list.
+ */
+static uint8_t pushl_ref(uint16_t addr) {
+    bbzvm_pushl(addr);
+    uint8_t ref = bbzheap_obj_at(bbzvm_stack_at(0))->l.value.ref;
+    bbzvm_pop();
+    return ref;
+}
+
+TEST(vm_flist_index) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // More lambdas than the index holds, whose addresses collide in it
+    const uint8_t N = 40;
+    for (uint8_t i = 0; i < N; ++i) {
+        ASSERT_EQUAL(pushl_ref(5 + 256 * i), i);
+    }
+    for (uint8_t i = N; i > 0; --i) {
+        ASSERT_EQUAL(pushl_ref(5 + 256 * (i - 1)), i - 1);
+    }
+    ASSERT_EQUAL(bbzdarray_size(vm->flist), N);
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+
+    // Addresses which fit in an immediate are not allocated
+    bbzheap_idx_t f;
+    REQUIRE(bbzdarray_get(vm->flist, 0, &f));
+    ASSERT(bbzheap_idx_isimmint(f));
+    REQUIRE(bbzdarray_get(vm->flist, N - 1, &f));
+    ASSERT(!bbzheap_idx_isimm(f));
+    ASSERT_EQUAL(bbzheap_obj_at(f)->i.value, 5 + 256 * (N - 1));
+
+    bbzvm_destruct();
+}
+
+TEST(vm_global_symbols) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // One symbol which may have a slot, one which has none.
+    const uint16_t ids[] = { _BBZSTRID_COUNT_, BBZVM_GSYM_SLOTS + 3 };
+    for (uint8_t i = 0; i < 2; ++i) {
+        const uint16_t id = ids[i];
+
+        // GSTORE then GLOAD and GLOADS
+        bbzvm_pushs(id);
+        bbzvm_pushi(1000 + i);
+        bbzvm_gstore();
+        REQUIRE(bbzvm_stack_size() == 0);
+        bbzvm_pushs(id);
+        bbzvm_gload();
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 1000 + i);
+        bbzvm_pop();
+        bbzvm_gloads(id);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 1000 + i);
+        bbzvm_pop();
+
+        // Registered symbols survive garbage collection
+        bbzheap_idx_t t = bbztable_new();
+        REQUIRE(bbzvm_gsym_register(id, t));
+        bbzvm_gc();
+        bbzvm_gloads(id);
+        ASSERT_EQUAL(bbzvm_stack_at(0), t);
+        ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(bbzvm_stack_at(0))));
+        bbzvm_pop();
+
+        // Storing nil erases the symbol
+        bbzvm_pushs(id);
+        bbzvm_pushnil();
+        bbzvm_gstore();
+        bbzvm_gloads(id);
+        ASSERT(bbztype_isnil(*bbzheap_obj_at(bbzvm_stack_at(0))));
+        bbzvm_pop();
+    }
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+
+    bbzvm_destruct();
+}
+
+/**
+ * @brief Sets the globals read by the quickening test, and runs its
+ * bytecode until the end.
+ */
+static void quick_run(bbzheap_idx_t a, bbzheap_idx_t b) {
+    vm->stackptr = -1;
+    bbzvm_gsym_register(_BBZSTRID_COUNT_, a);
+    bbzvm_gsym_register(_BBZSTRID_COUNT_ + 1, b);
+    vm->state = BBZVM_STATE_READY;
+    vm->pc = 3;
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+}
+
+#define ASSERT_FLOAT(IDX, VAL) ASSERT(bbztype_isfloat(*bbzheap_obj_at(IDX)) && \
+                                      bbzfloat_tofloat(bbzheap_obj_at(IDX)->f.value) == (VAL))
+
+TEST(vm_quickening) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    const uint16_t A = _BBZSTRID_COUNT_, B = _BBZSTRID_COUNT_ + 1;
+    const uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_NOP,
+        /*  3 */ BBZVM_INSTR_GLOADS, ARG(A),
+        /*  6 */ BBZVM_INSTR_GLOADS, ARG(B),
+        /*  9 */ BBZVM_INSTR_ADD,
+        /* 10 */ BBZVM_INSTR_GLOADS, ARG(A),
+        /* 13 */ BBZVM_INSTR_GLOADS, ARG(B),
+        /* 16 */ BBZVM_INSTR_LT,
+        /* 17 */ BBZVM_INSTR_GLOADS, ARG(A),
+        /* 20 */ BBZVM_INSTR_GLOADS, ARG(B),
+        /* 23 */ BBZVM_INSTR_CMPJLT, ARG(29),
+        /* 26 */ BBZVM_INSTR_PUSHI, ARG(7),
+        /* 29 */ BBZVM_INSTR_DONE,
+    };
+    uint8_t rw[sizeof(bcode)];
+    memcpy(rw, bcode, sizeof(bcode));
+
+    // Read-only bytecode is never rewritten
+    bbzvm_set_bcode_ptr(bcode, sizeof(bcode));
+    quick_run(bbzint_new(2), bbzint_new(3));
+    REQUIRE(vm->state == BBZVM_STATE_DONE);
+    REQUIRE(bbzvm_stack_size() == 3);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(2))->i.value, 5);
+
+    // Integers
+    bbzvm_set_bcode_rw(rw, sizeof(rw));
+    for (uint8_t i = 0; i < 2; ++i) {
+        quick_run(bbzint_new(2), bbzint_new(3));
+        REQUIRE(vm->state == BBZVM_STATE_DONE);
+        REQUIRE(bbzvm_stack_size() == 3);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(2))->i.value, 5);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 1);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 7);
+    }
+#ifndef BBZ_DISABLE_QUICKENING
+    ASSERT_EQUAL(rw[9],  BBZVM_INSTR_ADDII);
+    ASSERT_EQUAL(rw[16], BBZVM_INSTR_LTII);
+    ASSERT_EQUAL(rw[23], BBZVM_INSTR_CMPJLTII);
+#endif
+
+#ifdef BBZ_ENABLE_FLOAT_OPERATIONS
+    // Floats: integer variants are rewritten back on the first run, and
+    // float variants are used from the second one
+    for (uint8_t i = 0; i < 2; ++i) {
+        quick_run(bbzfloat_new(bbzfloat_fromfloat(2.5f)), bbzfloat_new(bbzfloat_fromfloat(1.0f)));
+        REQUIRE(vm->state == BBZVM_STATE_DONE);
+        REQUIRE(bbzvm_stack_size() == 2);
+        ASSERT_FLOAT(bbzvm_stack_at(1), 3.5f);
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 0);
+#ifndef BBZ_DISABLE_QUICKENING
+        ASSERT_EQUAL(rw[9], (i ? BBZVM_INSTR_ADDFF : BBZVM_INSTR_ADD));
+#endif
+    }
+#ifndef BBZ_DISABLE_QUICKENING
+    ASSERT_EQUAL(rw[16], BBZVM_INSTR_LT);
+    ASSERT_EQUAL(rw[23], BBZVM_INSTR_CMPJLT);
+#endif
+
+    // Mixed types: everything is generic again
+    quick_run(bbzint_new(1), bbzfloat_new(bbzfloat_fromfloat(2.0f)));
+    REQUIRE(vm->state == BBZVM_STATE_DONE);
+    REQUIRE(bbzvm_stack_size() == 3);
+    ASSERT_FLOAT(bbzvm_stack_at(2), 3.0f);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 7);
+#ifndef BBZ_DISABLE_QUICKENING
+    ASSERT_EQUAL(rw[9], BBZVM_INSTR_ADD);
+#endif
+#endif // BBZ_ENABLE_FLOAT_OPERATIONS
+
+    // Quickened bytecode can be set again
+    bbzvm_set_bcode_rw(rw, sizeof(rw));
+    quick_run(bbzint_new(-4), bbzint_new(3));
+    REQUIRE(vm->state == BBZVM_STATE_DONE);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(2))->i.value, -1);
+#ifndef BBZ_DISABLE_QUICKENING
+    ASSERT_EQUAL(rw[9], BBZVM_INSTR_ADDII);
+#endif
+
+    bbzvm_destruct();
+}
+
 TEST(vm_arith_logic) {
     vm = &vmObj;
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_error_receiver(&set_last_error);
 
     fbcode = fopen(FILE_TEST1, "rb");
@@ -534,9 +1924,111 @@ TEST(vm_arith_logic) {
     fclose(fbcode);
 }
 
+TEST(vm_dup_aliasing) {
+    vm = &vmObj;
+    testing_vm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // Integers, floats and strings are shared, and operations on a copy
+    // leave the original alone
+    bbzvm_pushi(20000);
+    REQUIRE(!bbzheap_idx_isimm(bbzvm_stack_at(0)));
+    bbzvm_dup();
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(bbzvm_stack_at(0), bbzvm_stack_at(1));
+    bbzvm_pushi(1);
+    bbzvm_add();
+    ASSERT(bbzvm_stack_at(0) != bbzvm_stack_at(1));
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 20001);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 20000);
+    bbzvm_pop();
+    bbzvm_dup();
+    bbzvm_unm();
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, -20000);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 20000);
+    bbzvm_pop();
+    bbzvm_pop();
+
+    bbzvm_pushf(bbzfloat_fromint(3));
+    bbzvm_dup();
+    ASSERT_EQUAL(bbzvm_stack_at(0), bbzvm_stack_at(1));
+    bbzvm_unm();
+    ASSERT_EQUAL((int16_t)bbzfloat_tofloat(bbzheap_obj_at(bbzvm_stack_at(0))->f.value), -3);
+    ASSERT_EQUAL((int16_t)bbzfloat_tofloat(bbzheap_obj_at(bbzvm_stack_at(1))->f.value), 3);
+    bbzvm_pop();
+    bbzvm_pop();
+
+    bbzvm_pushs(__BBZSTRID_id);
+    bbzvm_dup();
+    ASSERT_EQUAL(bbzvm_stack_at(0), bbzvm_stack_at(1));
+    bbzvm_pop();
+    bbzvm_pop();
+
+    // A table's copy refers to the same contents
+    bbzvm_pusht();
+    bbzvm_dup();
+    ASSERT(bbztype_istable(*bbzheap_obj_at(bbzvm_stack_at(0))));
+    bbzvm_pushi(1);
+    bbzvm_pushi(20000);
+    bbzvm_tput();
+    bbzvm_pushi(1);
+    bbzvm_tget();
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 20000);
+    bbzvm_pop();
+    ASSERT_EQUAL(bbzvm_stack_size(), 0);
+
+    // Locals and stack elements share values, which the instructions
+    // never modify: after b = a; a = a + 1; c = a * 2, b is still 20000
+    const uint16_t K = _BBZSTRID_COUNT_;
+    uint8_t bcode[] = {
+        ARG(0),
+        /*  2 */ BBZVM_INSTR_NOP,
+        /*  3 */ BBZVM_INSTR_PUSHS, ARG(K),
+        /*  6 */ BBZVM_INSTR_PUSHNIL,
+        /*  7 */ BBZVM_INSTR_PUSHL, ARG(34),
+        /* 10 */ BBZVM_INSTR_PUSHI, ARG(20000),
+        /* 13 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 16 */ BBZVM_INSTR_CALLC,
+        /* 17 */ BBZVM_INSTR_GSTORE,
+        // Once more, with the instructions quickened
+        /* 18 */ BBZVM_INSTR_PUSHS, ARG(K + 1),
+        /* 21 */ BBZVM_INSTR_PUSHNIL,
+        /* 22 */ BBZVM_INSTR_PUSHL, ARG(34),
+        /* 25 */ BBZVM_INSTR_PUSHI, ARG(20000),
+        /* 28 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 31 */ BBZVM_INSTR_CALLC,
+        /* 32 */ BBZVM_INSTR_GSTORE,
+        /* 33 */ BBZVM_INSTR_DONE,
+        // function(a) { var b = a; a = a + 1; a = a + 1; var c = a * 2; return b }
+        /* 34 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 37 */ BBZVM_INSTR_LSTORE, ARG(2),
+        /* 40 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 43 */ BBZVM_INSTR_PUSHI, ARG(1),
+        /* 46 */ BBZVM_INSTR_ADD,
+        /* 47 */ BBZVM_INSTR_LSTORE, ARG(1),
+        /* 50 */ BBZVM_INSTR_INCL, ARG(1),
+        /* 53 */ BBZVM_INSTR_LLOAD, ARG(1),
+        /* 56 */ BBZVM_INSTR_PUSHI, ARG(2),
+        /* 59 */ BBZVM_INSTR_MUL,
+        /* 60 */ BBZVM_INSTR_LSTORE, ARG(3),
+        /* 63 */ BBZVM_INSTR_LLOAD, ARG(2),
+        /* 66 */ BBZVM_INSTR_RET1,
+    };
+    bbzvm_set_bcode_rw(bcode, sizeof(bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    while (vm->state == BBZVM_STATE_READY) bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    bbzvm_gloads(K);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 20000);
+    bbzvm_gloads(K + 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 20000);
+
+    bbzvm_destruct();
+}
+
 TEST(vm_stack_empty) {
     vm = &vmObj;
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_error_receiver(&set_last_error_no_print);
 
     fbcode = fopen(FILE_TEST1, "rb");
@@ -591,7 +2083,7 @@ TEST(vm_stack_empty) {
 
 TEST(vm_stack_full) {
     vm = &vmObj;
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_error_receiver(set_last_error_no_print);
 
     fbcode = fopen(FILE_TEST1, "rb");
@@ -612,13 +2104,13 @@ TEST(vm_stack_full) {
     // 3) Set the program counter
     vm->pc = 56;
 
-    // 4) Set local symbols
-    bbzdarray_new(&vm->lsyms);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->lsyms));
-    bbzdarray_push(vm->lsyms, vm->nil);
-
+    // 4) Set local symbols (self only)
     REQUIRE(bbzvm_stack_size() == 0);
-    for (uint16_t i = 0; i < BBZSTACK_SIZE; ++i) {
+    bbzvm_push(vm->nil);
+    vm->localptr = 0;
+    vm->blockptr = 0;
+
+    for (uint16_t i = 1; i < BBZSTACK_SIZE; ++i) {
         bbzvm_push(vm->nil);
     }
 
@@ -652,7 +2144,7 @@ TEST(vm_stack_full) {
 
 TEST(vm_closures) {
     vm = &vmObj;
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_error_receiver(&set_last_error);
 
     fbcode = fopen(FILE_TEST3, "rb");
@@ -712,7 +2204,7 @@ TEST(vm_closures) {
 TEST(vm_message_processing) {
     bbzvm_t vmObj;
     vm = &vmObj;
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_error_receiver(set_last_error);
 
     // Setup
@@ -751,7 +2243,7 @@ TEST(vm_script_execution) {
     vm = &vmObj;
 
     uint16_t robot = 0;
-    bbzvm_construct(robot);
+    testing_vm_construct(robot);
     bbzvm_set_error_receiver(&set_last_error);
     fbcode = fopen(FILE_TEST4, "rb");
     REQUIRE(fbcode != NULL);
@@ -788,6 +2280,7 @@ TEST(vm_script_execution) {
 TEST_LIST {
     ADD_TEST(vm_construct);
     ADD_TEST(vm_set_bytecode);
+    ADD_TEST(vm_set_bytecode_ptr);
     ADD_TEST(vm_step_nop);
     ADD_TEST(vm_step_done);
     ADD_TEST(vm_step_pushnil);
@@ -797,8 +2290,31 @@ TEST_LIST {
     ADD_TEST(vm_step_jump);
     ADD_TEST(vm_step_jumpz);
     ADD_TEST(vm_step_jumpnz);
+#ifndef BBZ_UNCHECKED
+    // Unchecked VMs only run verified bytecode, which this is not
+    ADD_TEST(vm_superinstructions);
+#endif // !BBZ_UNCHECKED
+    ADD_TEST(vm_call_frames);
+    ADD_TEST(vm_native_calls);
+    ADD_TEST(vm_tail_calls);
+    ADD_TEST(vm_function_handles);
+    ADD_TEST(vm_verifier);
+    ADD_TEST(vm_short_forms);
+    ADD_TEST(vm_register_instrs);
+    ADD_TEST(vm_run_budget);
+    ADD_TEST(vm_boot_image);
+    ADD_TEST(vm_profile);
+    ADD_TEST(vm_pc_sampling);
+    ADD_TEST(vm_inline_cache);
+    ADD_TEST(vm_flist_index);
+    ADD_TEST(vm_global_symbols);
+    ADD_TEST(vm_quickening);
     ADD_TEST(vm_arith_logic);
+    ADD_TEST(vm_dup_aliasing);
+#ifndef BBZ_UNCHECKED
+    // Unchecked VMs only run verified bytecode, which this is not
     ADD_TEST(vm_stack_empty);
+#endif // !BBZ_UNCHECKED
     ADD_TEST(vm_stack_full);
     ADD_TEST(vm_closures);
     ADD_TEST(vm_message_processing);
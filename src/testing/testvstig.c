@@ -3,10 +3,11 @@
 #define TEST_MODULE bbzvstig
 #define NUM_TEST_CASES 4
 #include "testingconfig.h"
+#include "testingvm.h"
 
 bbzvm_t vmObj;
 
-uint8_t buf[4] = {0,0,0,0};
+uint8_t buf[4] = {0,0,BBZVM_INSTR_NOP,BBZVM_INSTR_DONE};
 const uint8_t* bcodefetcher(bbzpc_t offset, uint8_t size) {
     RM_UNUSED_WARN(size);
     return buf + offset;
@@ -15,7 +16,7 @@ const uint8_t* bcodefetcher(bbzpc_t offset, uint8_t size) {
 uint8_t createWorks = 0;
 TEST(vstig_create) {
     vm = &vmObj;
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_bcode(bcodefetcher, 4);
 
     bbzvm_push(vm->vstig.hpos);
@@ -25,7 +26,7 @@ TEST(vstig_create) {
     bbzvm_pushi(0);
     bbzvm_closure_call(1);
     REQUIRE(vm->state != BBZVM_STATE_ERROR);
-    ASSERT(vm->vstig.hpos > vm->nil);
+    ASSERT(vm->vstig.hpos != vm->nil);
     bbzvm_pushs(__BBZSTRID_put);
     bbzheap_idx_t dummy = 0;
     REQUIRE(bbztable_get(bbzvm_stack_at(1),bbzvm_stack_at(0),&dummy));
@@ -38,7 +39,7 @@ TEST(vstig_create) {
 uint8_t putWorks = 0;
 TEST(vstig_put) {
     REQUIRE(createWorks);
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_bcode(bcodefetcher, 4);
 
     bbzvm_push(vm->vstig.hpos);
@@ -68,7 +69,7 @@ TEST(vstig_put) {
 TEST(vstig_get) {
     REQUIRE(createWorks);
     REQUIRE(putWorks);
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_bcode(bcodefetcher, 4);
 
     bbzvm_push(vm->vstig.hpos);
@@ -79,6 +80,7 @@ TEST(vstig_get) {
     bbzvm_closure_call(1);
     bbzheap_idx_t vs = bbzvm_stack_at(0);
 
+    bbzvm_dup(); // Keep the vstig on the stack, so that it is not collected
     bbzvm_dup(); // Push self table
     bbzvm_pushs(__BBZSTRID_put);
     bbzvm_tget();
@@ -86,8 +88,8 @@ TEST(vstig_get) {
     bbzvm_pushi(42);
     bbzvm_closure_call(2);
     bbzvm_pop();
-    
-    bbzvm_push(vs);
+    REQUIRE(bbzvm_stack_at(0) == vs);
+
     bbzvm_dup(); // Push self table
     bbzvm_pushs(__BBZSTRID_get);
     bbzvm_tget();
@@ -103,7 +105,7 @@ TEST(vstig_get) {
 TEST(vstig_size) {
     REQUIRE(createWorks);
     REQUIRE(putWorks);
-    bbzvm_construct(0);
+    testing_vm_construct(0);
     bbzvm_set_bcode(bcodefetcher, 4);
 
     bbzvm_push(vm->vstig.hpos);
@@ -7,9 +7,7 @@ bbzmsg_payload_t bbz_payload_buf;
 
 extern Position robotPosition;
 extern float robotOrientation;
-bbzheap_idx_t pos_x_idx;
-bbzheap_idx_t pos_y_idx;
-bbzheap_idx_t pos_orientation_idx;
+bbzheap_idx_t pos_idx;
 
 extern Motor motorValues;
 extern Target currentGoal;
@@ -28,22 +26,20 @@ const uint8_t *bbzzooids_bcodeFetcher(bbzpc_t offset, uint8_t size)
 void bbz_createPosObject();
 void bbz_updatePosObject();
 
-void bbz_func_call(uint16_t strid) {
-    bbzvm_pushs(strid);
-    bbzheap_idx_t l = bbzvm_stack_at(0);
-    bbzvm_pop();
-    if(bbztable_get(vmObj.gsyms, l, &l)) {
+static bbzvm_function_handle_t step_fun;
+
+void bbz_func_call(bbzvm_function_handle_t* h) {
+    bbzheap_idx_t l = bbzvm_function_lookup(h);
+    if (bbztype_isclosure(*bbzheap_obj_at(l))) {
         bbzvm_pushnil(); // Push self table
         bbzvm_push(l);
         bbzvm_closure_call(0);
     }
 }
 
-void bbzzooids_func_call(uint16_t strid) {
-    bbzvm_pushs(strid);
-    bbzheap_idx_t l = bbzvm_stack_at(0);
-    bbzvm_pop();
-    if(bbztable_get(vmObj.gsyms, l, &l)) {
+void bbzzooids_func_call(bbzvm_function_handle_t* h) {
+    bbzheap_idx_t l = bbzvm_function_lookup(h);
+    if (bbztype_isclosure(*bbzheap_obj_at(l))) {
         bbzvm_pushnil(); // Push self table
         bbzvm_push(l);
 
@@ -131,21 +127,23 @@ void bbz_init(void)
 
 void bbz_createPosObject() {
     bbzvm_pusht(); // "pos"
-    pos_x_idx = bbzint_new(0);
-    pos_y_idx = bbzint_new(0);
-    pos_orientation_idx = bbzfloat_new(bbzfloat_fromint(0));
-    bbztable_add_data(__BBZSTRID_x, pos_x_idx);
-    bbztable_add_data(__BBZSTRID_y, pos_y_idx);
-    bbztable_add_data(__BBZSTRID_orientation, pos_orientation_idx);
+    pos_idx = bbzvm_stack_at(0);
+    bbztable_add_data(__BBZSTRID_x, bbzint_new(0));
+    bbztable_add_data(__BBZSTRID_y, bbzint_new(0));
+    bbztable_add_data(__BBZSTRID_orientation, bbzfloat_new(bbzfloat_fromint(0)));
     bbzvm_gsym_register(__BBZSTRID_pos, bbzvm_stack_at(0));
     bbzheap_obj_make_permanent(*bbzheap_obj_at(bbzvm_stack_at(0)));
     bbzvm_pop();
 }
 
 void bbz_updatePosObject() {
-    bbzvm_assign(&bbzheap_obj_at(pos_x_idx)->i.value, &robotPosition.x);
-    bbzvm_assign(&bbzheap_obj_at(pos_y_idx)->i.value, &robotPosition.y);
-    bbzheap_obj_at(pos_orientation_idx)->f.value = bbzfloat_fromfloat(robotOrientation);
+    // Numbers may be shared by several variables: store new ones instead of
+    // modifying the current ones.
+    bbzvm_push(pos_idx);
+    bbztable_add_data(__BBZSTRID_x, bbzint_new((int16_t)robotPosition.x));
+    bbztable_add_data(__BBZSTRID_y, bbzint_new((int16_t)robotPosition.y));
+    bbztable_add_data(__BBZSTRID_orientation, bbzfloat_new(bbzfloat_fromfloat(robotOrientation)));
+    bbzvm_pop();
 }
 
 void bbz_start(void (*setup)(void))
@@ -168,7 +166,9 @@ void bbz_start(void (*setup)(void))
             else {
                 init_done = 1;
                 vm->state = BBZVM_STATE_READY;
-                bbz_func_call(__BBZSTRID_init);
+                bbzvm_function_handle_t init_fun = bbzvm_function_resolve(__BBZSTRID_init);
+                bbz_func_call(&init_fun);
+                step_fun = bbzvm_function_resolve(__BBZSTRID_step);
 #ifndef BBZ_DISABLE_MESSAGES
                 message_tx = bbzwhich_msg_tx;
                 message_tx_success = bbzoutmsg_queue_next;
@@ -179,7 +179,7 @@ void bbz_start(void (*setup)(void))
         else {
             if (vm->state != BBZVM_STATE_ERROR) {
                 bbzvm_process_inmsgs();
-                bbzzooids_func_call(__BBZSTRID_step);
+                bbzzooids_func_call(&step_fun);
                 bbzvm_process_outmsgs();
             }
             // checkRadio();